@@ -0,0 +1,627 @@
+#include <bmff.h>
+#include "../src/parse.h"
+#include "../src/context.h"
+#include "counters.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// rounds timed per case, the median round is reported.
+#define BENCH_ROUNDS        (9)
+// times every case is run, the fastest run is reported and the spread of the
+// runs is part of the noise.
+#define BENCH_RUNS          (3)
+// minimum duration of a round.
+#define BENCH_ROUND_NS      (2000000)
+// smallest slowdown reported as a regression.
+#define BENCH_THRESHOLD     (0.05)
+// times the cases slower than the baseline are run again before they are reported.
+#define BENCH_RECHECKS      (3)
+// maximum number of results in a baseline.
+#define BENCH_MAX_RESULTS   (1024)
+// minimum duration of the repeated parses of a file.
+#define BENCH_FILE_NS       (200000000)
+// maximum number of top level box types reported for a file.
+#define BENCH_MAX_TYPES     (64)
+#define BENCH_MB            (1024.0 * 1024.0)
+
+/**
+ * Box with a table whose entry count is scaled to the payload size.
+ */
+typedef struct TableCase {
+    const char  type[5];
+    uint8_t     version;
+    uint32_t    flags;
+    // offset of the entry count and of the first entry.
+    uint32_t    count_offset;
+    uint32_t    entries_offset;
+    uint32_t    entry_size;
+    // set when the entry count is the sample count of the context, as for sdtp.
+    uint32_t    sets_sample_count;
+} TableCase;
+
+static const TableCase table_cases[] = {
+    {"stts", 0, 0x000000, 12, 16, 8, 0},
+    {"ctts", 0, 0x000000, 12, 16, 8, 0},
+    {"stsc", 0, 0x000000, 12, 16, 12, 0},
+    {"stsz", 0, 0x000000, 16, 20, 4, 0},
+    {"stco", 0, 0x000000, 12, 16, 4, 0},
+    {"co64", 0, 0x000000, 12, 16, 8, 0},
+    {"stss", 0, 0x000000, 12, 16, 4, 0},
+    {"elst", 0, 0x000000, 12, 16, 12, 0},
+    {"sbgp", 0, 0x000000, 16, 20, 8, 0},
+    {"trun", 0, 0x000F00, 12, 16, 16, 0},
+    {"saiz", 0, 0x000000, 13, 17, 1, 0},
+    {"sdtp", 0, 0x000000, 0, 12, 1, 1},
+};
+
+// entry counts of the table cases.
+static const uint32_t table_entries[] = {16, 1024, 65536};
+// payload sizes of the boxes driven with a zeroed payload.
+static const uint32_t payload_sizes[] = {256, 2048, 16384};
+
+typedef struct BenchResult {
+    char    name[32];
+    double  ns_per_box;
+    double  bytes_per_ns;
+    // median absolute deviation of the rounds, or half the range of the runs
+    // when larger, relative to the median.
+    double  noise;
+    // median of the slowest run.
+    double  slowest;
+    // hardware counts per MB parsed, all 0 without counters.
+    double  per_mb[COUNTER_COUNT];
+    // set while the case is slower than the baseline.
+    int     slower;
+} BenchResult;
+
+typedef struct Bench {
+    BMFFContext context;
+    const char  *filter;
+    // opened with -c, counters->available is 0 otherwise.
+    Counters    counters;
+    BenchResult results[BENCH_MAX_RESULTS];
+    uint32_t    result_count;
+    // index of the run of the cases.
+    uint32_t    run;
+    // set while the slower cases are run again, the other cases are skipped.
+    int         recheck;
+} Bench;
+
+static void write_u32(uint8_t *dest, uint32_t value)
+{
+    dest[0] = value >> 24;
+    dest[1] = value >> 16;
+    dest[2] = value >> 8;
+    dest[3] = value;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *values, uint32_t count)
+{
+    qsort(values, count, sizeof(double), compare_double);
+    return values[count / 2];
+}
+
+// cycles per byte, instructions per cycle and misses per MB.
+static void print_counters(const double *per_mb)
+{
+    double cycles = per_mb[COUNTER_CYCLES];
+    printf("  %7.2f cycles/byte %5.2f ipc %9.1f l1d/MB %9.1f llc/MB %9.1f br-miss/MB",
+           cycles / BENCH_MB, cycles > 0 ? per_mb[COUNTER_INSTRUCTIONS] / cycles : 0,
+           per_mb[COUNTER_L1D_MISSES], per_mb[COUNTER_LLC_MISSES], per_mb[COUNTER_BRANCH_MISSES]);
+}
+
+static parse_func find_parser(const char *type)
+{
+    int i = 0;
+    for(; i < PARSE_MAP_LEN; ++i) {
+        if(memcmp(parse_map[i].box_type, type, 4) == 0) {
+            return parse_map[i].parse_func;
+        }
+    }
+    return NULL;
+}
+
+// parses the box iterations times, releasing the boxes as a top level parse would.
+static BMFFCode parse_box_n(Bench *bench, parse_func func, const uint8_t *data, size_t size, uint64_t iterations)
+{
+    BMFFContext *ctx = &bench->context;
+    BMFFCode res = BMFF_OK;
+    uint64_t i = 0;
+    for(; i < iterations && res == BMFF_OK; ++i) {
+        Box *box = NULL;
+        if(bmff_context_alloc_stack_push(ctx) != BMFF_OK) {
+            return BMFF_RESOURCE_LIMIT;
+        }
+        res = func(ctx, data, size, &box);
+        bmff_context_alloc_stack_pop(ctx);
+    }
+    return res;
+}
+
+static BenchResult * find_result(Bench *bench, const char *name)
+{
+    uint32_t i = 0;
+    for(; i < bench->result_count; ++i) {
+        if(strcmp(bench->results[i].name, name) == 0) {
+            return &bench->results[i];
+        }
+    }
+    return NULL;
+}
+
+static void run_case(Bench *bench, const char *name, parse_func func, const uint8_t *data, size_t size)
+{
+    if(bench->filter && !strstr(name, bench->filter)) {
+        return;
+    }
+    BenchResult *previous = find_result(bench, name);
+    if(bench->recheck && (!previous || !previous->slower)) {
+        return;
+    }
+    if(!previous && bench->result_count == BENCH_MAX_RESULTS) {
+        fprintf(stderr, "too many results, %s skipped\n", name);
+        return;
+    }
+
+    // only boxes the parser accepts are timed.
+    BMFFCode res = parse_box_n(bench, func, data, size, 1);
+    if(res != BMFF_OK) {
+        if(bench->run == 0) {
+            printf("%-24s skipped, parse error %d\n", name, res);
+        }
+        return;
+    }
+
+    // grow the iterations until a round takes long enough to time.
+    uint64_t iterations = 1;
+    for(;;) {
+        uint64_t start = now_ns();
+        parse_box_n(bench, func, data, size, iterations);
+        if(now_ns() - start >= BENCH_ROUND_NS) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    double rounds[BENCH_ROUNDS];
+    CounterValues counts_start;
+    CounterValues counts_end;
+    counters_read(&bench->counters, &counts_start);
+    uint32_t i = 0;
+    for(; i < BENCH_ROUNDS; ++i) {
+        uint64_t start = now_ns();
+        parse_box_n(bench, func, data, size, iterations);
+        rounds[i] = (double)(now_ns() - start) / iterations;
+    }
+    counters_read(&bench->counters, &counts_end);
+    double ns = median(rounds, BENCH_ROUNDS);
+    for(i = 0; i < BENCH_ROUNDS; ++i) {
+        rounds[i] = rounds[i] > ns ? rounds[i] - ns : ns - rounds[i];
+    }
+
+    BenchResult run;
+    BenchResult *result = &run;
+    memset(result, 0, sizeof(BenchResult));
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->ns_per_box = ns;
+    result->bytes_per_ns = size / ns;
+    result->noise = median(rounds, BENCH_ROUNDS) / ns;
+    double mb = (double)size * iterations * BENCH_ROUNDS / BENCH_MB;
+    for(i = 0; i < COUNTER_COUNT; ++i) {
+        result->per_mb[i] = (counts_end.values[i] - counts_start.values[i]) / mb;
+    }
+    result->slowest = ns;
+
+    if(!previous) {
+        bench->results[bench->result_count++] = run;
+        return;
+    }
+    // a case run again keeps its fastest run, the drift between runs is noise too.
+    double noise = previous->noise > run.noise ? previous->noise : run.noise;
+    if(run.ns_per_box < previous->ns_per_box) {
+        run.slower = previous->slower;
+        run.slowest = previous->slowest;
+        *previous = run;
+    }else if(run.ns_per_box > previous->slowest) {
+        previous->slowest = run.ns_per_box;
+    }
+    // half the range of the runs, comparable to the deviation of the rounds.
+    double spread = (previous->slowest / previous->ns_per_box - 1) / 2;
+    previous->noise = spread > noise ? spread : noise;
+}
+
+static void print_results(const Bench *bench)
+{
+    uint32_t i = 0;
+    for(; i < bench->result_count; ++i) {
+        const BenchResult *result = &bench->results[i];
+        printf("%-24s %12.1f ns/box %10.3f bytes/ns  noise %5.1f%%",
+               result->name, result->ns_per_box, result->bytes_per_ns, result->noise * 100);
+        if(bench->counters.available > 0) {
+            print_counters(result->per_mb);
+        }
+        printf("\n");
+    }
+}
+
+// boxes with tables of a growing number of entries.
+static void run_table_cases(Bench *bench)
+{
+    uint32_t i = 0;
+    for(; i < sizeof(table_cases) / sizeof(TableCase); ++i) {
+        const TableCase *tc = &table_cases[i];
+        parse_func func = find_parser(tc->type);
+        uint32_t j = 0;
+        for(; func && j < sizeof(table_entries) / sizeof(uint32_t); ++j) {
+            uint32_t entries = table_entries[j];
+            size_t size = tc->entries_offset + (size_t)entries * tc->entry_size;
+            uint8_t *data = calloc(1, size);
+            if(!data) {
+                continue;
+            }
+            write_u32(data, size);
+            memcpy(data + 4, tc->type, 4);
+            write_u32(data + 8, (uint32_t)tc->version << 24 | tc->flags);
+            if(tc->sets_sample_count) {
+                // the entry count comes from the sample size box.
+                bench->context.sample_count = entries;
+            }else{
+                write_u32(data + tc->count_offset, entries);
+            }
+            // entries of small non zero values, valid for every table.
+            uint8_t *entry = data + tc->entries_offset;
+            uint32_t k = 0;
+            for(; k < entries; ++k, entry += tc->entry_size) {
+                entry[tc->entry_size - 1] = 1 + k % 7;
+            }
+
+            char name[32];
+            snprintf(name, sizeof(name), "%.4s/%ue", tc->type, entries);
+            run_case(bench, name, func, data, size);
+            free(data);
+        }
+    }
+}
+
+// every parser of the parse map on a zeroed payload, the per box overhead.
+static void run_payload_cases(Bench *bench)
+{
+    int i = 0;
+    for(; i < PARSE_MAP_LEN; ++i) {
+        uint32_t j = 0;
+        for(; j < sizeof(payload_sizes) / sizeof(uint32_t); ++j) {
+            size_t size = payload_sizes[j];
+            uint8_t *data = calloc(1, size);
+            if(!data) {
+                continue;
+            }
+            write_u32(data, size);
+            memcpy(data + 4, parse_map[i].box_type, 4);
+            bench->context.sample_count = 0;
+
+            char name[32];
+            snprintf(name, sizeof(name), "%.4s/%zuB", parse_map[i].box_type, size);
+            run_case(bench, name, parse_map[i].parse_func, data, size);
+            free(data);
+        }
+    }
+}
+
+static int save_results(const Bench *bench, const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if(!file) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 1;
+    }
+    fprintf(file, "{\n  \"version\": \"%s\",\n  \"results\": [\n", bmff_get_version());
+    uint32_t i = 0;
+    for(; i < bench->result_count; ++i) {
+        const BenchResult *result = &bench->results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"ns_per_box\": %.3f, \"bytes_per_ns\": %.5f, \"noise\": %.5f",
+                result->name, result->ns_per_box, result->bytes_per_ns, result->noise);
+        // the counts follow the timings, so older baselines still compare.
+        uint32_t j = 0;
+        for(; bench->counters.available > 0 && j < COUNTER_COUNT; ++j) {
+            fprintf(file, ", \"%s_per_mb\": %.1f", counter_names[j], result->per_mb[j]);
+        }
+        fprintf(file, "}%s\n", i + 1 < bench->result_count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return 0;
+}
+
+// reads a baseline written by save_results, the counts are not needed.
+static int load_baseline(const char *path, BenchResult *base, uint32_t *base_count)
+{
+    FILE *file = fopen(path, "r");
+    if(!file) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    *base_count = 0;
+    char line[512];
+    while(*base_count < BENCH_MAX_RESULTS && fgets(line, sizeof(line), file)) {
+        BenchResult *result = &base[*base_count];
+        if(sscanf(line, " {\"name\": \"%31[^\"]\", \"ns_per_box\": %lf, \"bytes_per_ns\": %lf, \"noise\": %lf}",
+                  result->name, &result->ns_per_box, &result->bytes_per_ns, &result->noise) == 4) {
+            (*base_count)++;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+// marks the cases slower than the baseline, printing them when report is set.
+static uint32_t compare_results(Bench *bench, const BenchResult *base, uint32_t base_count,
+                                double threshold, int report, uint32_t *compared)
+{
+    uint32_t slower = 0;
+    *compared = 0;
+    uint32_t i = 0;
+    for(; i < base_count; ++i) {
+        BenchResult *result = find_result(bench, base[i].name);
+        if(!result) {
+            continue;
+        }
+        // noisy cases need a larger slowdown before they are reported.
+        double allowed = threshold;
+        if(3 * (base[i].noise + result->noise) > allowed) {
+            allowed = 3 * (base[i].noise + result->noise);
+        }
+        double change = result->ns_per_box / base[i].ns_per_box - 1;
+        result->slower = change > allowed;
+        if(result->slower) {
+            if(report) {
+                printf("REGRESSION %-24s %12.1f -> %12.1f ns/box (%+.1f%%, allowed %.1f%%)\n",
+                       result->name, base[i].ns_per_box, result->ns_per_box, change * 100, allowed * 100);
+            }
+            slower++;
+        }
+        (*compared)++;
+    }
+    return slower;
+}
+
+/**
+ * Compares the results to a baseline. The noise of a single run misses the
+ * drift between runs, such as a change of CPU frequency, so the cases slower
+ * than the baseline are run again and only reported when they stay slower.
+ */
+static int check_baseline(Bench *bench, const char *path, double threshold)
+{
+    static BenchResult base[BENCH_MAX_RESULTS];
+    uint32_t base_count = 0;
+    if(load_baseline(path, base, &base_count) != 0) {
+        return 1;
+    }
+
+    uint32_t compared = 0;
+    uint32_t slower = compare_results(bench, base, base_count, threshold, 0, &compared);
+    uint32_t i = 0;
+    for(; i < BENCH_RECHECKS && slower > 0; ++i) {
+        printf("running %u cases slower than %s again\n", slower, path);
+        bench->recheck = 1;
+        run_table_cases(bench);
+        run_payload_cases(bench);
+        bench->recheck = 0;
+        slower = compare_results(bench, base, base_count, threshold, 0, &compared);
+    }
+    slower = compare_results(bench, base, base_count, threshold, 1, &compared);
+
+    printf("%u of %u cases compared to %s, %u regressions\n", compared, bench->result_count, path, slower);
+    return slower > 0 ? 2 : 0;
+}
+
+/**
+ * Time and counts spent in the top level boxes of one type.
+ */
+typedef struct TypeStats {
+    uint8_t         type[4];
+    uint64_t        boxes;
+    uint64_t        bytes;
+    uint64_t        ns;
+    CounterValues   counts;
+} TypeStats;
+
+typedef struct FileBench {
+    const Counters  *counters;
+    // readings taken when the current top level box started.
+    uint64_t        start_ns;
+    CounterValues   start;
+    TypeStats       types[BENCH_MAX_TYPES];
+    uint32_t        type_count;
+} FileBench;
+
+static void file_callback_func(BMFFContext *ctx,
+    BMFFEventId event_id,
+    const uint8_t *fourCC,
+    void *data,
+    void *user_data)
+{
+    FileBench *file = (FileBench*)user_data;
+    if(ctx->breadcrumb_depth > 0) {
+        return;
+    }
+
+    if(event_id == BMFFEventParseStart) {
+        counters_read(file->counters, &file->start);
+        file->start_ns = now_ns();
+    }else if(event_id == BMFFEventParseComplete) {
+        uint64_t end_ns = now_ns();
+        CounterValues end;
+        counters_read(file->counters, &end);
+
+        uint32_t i = 0;
+        for(; i < file->type_count && memcmp(file->types[i].type, fourCC, 4) != 0; ++i);
+        if(i == BENCH_MAX_TYPES) {
+            return;
+        }
+        TypeStats *stats = &file->types[i];
+        if(i == file->type_count) {
+            memcpy(stats->type, fourCC, 4);
+            file->type_count++;
+        }
+        stats->boxes++;
+        stats->bytes += bmff_get_box_size((Box*)data);
+        stats->ns += end_ns - file->start_ns;
+        counters_add(&stats->counts, &file->start, &end);
+    }
+}
+
+// parses a file until enough time has passed, broken down by top level box type.
+static int run_file(Bench *bench, const char *path)
+{
+    FILE *input = fopen(path, "rb");
+    if(!input) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+    fseek(input, 0, SEEK_END);
+    long size = ftell(input);
+    fseek(input, 0, SEEK_SET);
+    uint8_t *data = size > 0 ? malloc(size) : NULL;
+    if(!data || fread(data, 1, size, input) != (size_t)size) {
+        fprintf(stderr, "cannot read %s\n", path);
+        fclose(input);
+        free(data);
+        return 1;
+    }
+    fclose(input);
+
+    static FileBench file;
+    memset(&file, 0, sizeof(FileBench));
+    file.counters = &bench->counters;
+
+    BMFFContext *ctx = &bench->context;
+    bmff_set_event_callback(ctx, file_callback_func, &file);
+    uint32_t runs = 0;
+    uint64_t start = now_ns();
+    do {
+        BMFFCode res;
+        bmff_context_reset(ctx);
+        bmff_set_end_of_stream(ctx, eBooleanTrue);
+        bmff_parse(ctx, data, size, &res);
+        runs++;
+    } while(now_ns() - start < BENCH_FILE_NS);
+    bmff_set_event_callback(ctx, NULL, NULL);
+    free(data);
+
+    printf("%s, %ld bytes parsed %u times\n", path, size, runs);
+    uint32_t i = 0;
+    for(; i < file.type_count; ++i) {
+        const TypeStats *stats = &file.types[i];
+        double mb = stats->bytes / BENCH_MB;
+        printf("%.4s %8lu boxes %10.1f ns/box %10.3f bytes/ns", (const char*)stats->type,
+               (unsigned long)(stats->boxes / runs), (double)stats->ns / stats->boxes,
+               stats->ns > 0 ? (double)stats->bytes / stats->ns : 0);
+        if(bench->counters.available > 0 && mb > 0) {
+            double per_mb[COUNTER_COUNT];
+            uint32_t j = 0;
+            for(; j < COUNTER_COUNT; ++j) {
+                per_mb[j] = stats->counts.values[j] / mb;
+            }
+            print_counters(per_mb);
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    printf("usage: %s [-c] [-o baseline.json] [-b baseline.json] [-t threshold] [-f filter] [-i file]\n", name);
+    printf("  -c  records hardware counters with perf_event_open\n");
+    printf("  -o  writes the results as a baseline\n");
+    printf("  -b  compares the results to a baseline, exits with 2 on a regression\n");
+    printf("  -t  smallest slowdown reported, %.2f by default\n", BENCH_THRESHOLD);
+    printf("  -f  only runs the cases whose name contains filter, e.g. stts, /16384B or /1024e\n");
+    printf("  -i  parses a file instead, reporting each top level box type, -o and -b do not apply\n");
+}
+
+int main(int argc, char** argv)
+{
+    static Bench bench;
+    const char *output = NULL;
+    const char *baseline = NULL;
+    const char *input = NULL;
+    double threshold = BENCH_THRESHOLD;
+    int use_counters = 0;
+
+    int i = 1;
+    for(; i < argc; ++i) {
+        if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        }else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        }else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        }else if(strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            bench.filter = argv[++i];
+        }else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            input = argv[++i];
+        }else if(strcmp(argv[i], "-c") == 0) {
+            use_counters = 1;
+        }else{
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    uint32_t j = 0;
+    for(; j < COUNTER_COUNT; ++j) {
+        bench.counters.fds[j] = -1;
+    }
+    if(use_counters) {
+        counters_open(&bench.counters);
+        for(j = 0; j < COUNTER_COUNT; ++j) {
+            if(bench.counters.fds[j] < 0) {
+                fprintf(stderr, "%s counter unavailable, reported as 0\n", counter_names[j]);
+            }
+        }
+    }
+
+    bmff_context_init(&bench.context);
+    if(input) {
+        int res = run_file(&bench, input);
+        bmff_context_destroy(&bench.context);
+        counters_close(&bench.counters);
+        return res;
+    }
+    for(j = 0; j < BENCH_RUNS; ++j) {
+        bench.run = j;
+        run_table_cases(&bench);
+        run_payload_cases(&bench);
+    }
+    print_results(&bench);
+
+    int res = 0;
+    if(output) {
+        res = save_results(&bench, output);
+    }
+    if(baseline && res == 0) {
+        res = check_baseline(&bench, baseline, threshold);
+    }
+    bmff_context_destroy(&bench.context);
+    counters_close(&bench.counters);
+    return res;
+}
@@ -0,0 +1,114 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Hardware counters of the calling thread, read with perf_event_open.
+ */
+typedef enum CounterId {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_COUNT,
+} CounterId;
+
+static const char * const counter_names[COUNTER_COUNT] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses",
+};
+
+typedef struct Counters {
+    // -1 for the counters the kernel or the CPU does not provide.
+    int         fds[COUNTER_COUNT];
+    uint32_t    available;
+} Counters;
+
+typedef struct CounterValues {
+    uint64_t    values[COUNTER_COUNT];
+} CounterValues;
+
+static int counter_open(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // the counters are multiplexed when there are more than the CPU has.
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * Opens the counters, returns the number available. Counters need
+ * /proc/sys/kernel/perf_event_paranoid at 2 or lower, and are often missing
+ * in virtual machines.
+ */
+static uint32_t counters_open(Counters *counters)
+{
+    counters->fds[COUNTER_CYCLES] = counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counters->fds[COUNTER_INSTRUCTIONS] = counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    counters->fds[COUNTER_L1D_MISSES] = counter_open(PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    counters->fds[COUNTER_LLC_MISSES] = counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    counters->fds[COUNTER_BRANCH_MISSES] = counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+    counters->available = 0;
+    uint32_t i = 0;
+    for(; i < COUNTER_COUNT; ++i) {
+        if(counters->fds[i] >= 0) {
+            counters->available++;
+        }
+    }
+    return counters->available;
+}
+
+static void counters_close(Counters *counters)
+{
+    uint32_t i = 0;
+    for(; i < COUNTER_COUNT; ++i) {
+        if(counters->fds[i] >= 0) {
+            close(counters->fds[i]);
+            counters->fds[i] = -1;
+        }
+    }
+    counters->available = 0;
+}
+
+/**
+ * Reads the running totals of the counters, scaled up for the time they were
+ * not scheduled. Missing counters read as 0.
+ */
+static void counters_read(const Counters *counters, CounterValues *values)
+{
+    uint32_t i = 0;
+    for(; i < COUNTER_COUNT; ++i) {
+        uint64_t data[3] = {0, 0, 0};
+        values->values[i] = 0;
+        if(counters->fds[i] < 0 || read(counters->fds[i], data, sizeof(data)) != sizeof(data)) {
+            continue;
+        }
+        // value, time enabled and time running.
+        values->values[i] = data[2] > 0 && data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+    }
+}
+
+// adds the counts between start and end to total.
+static void counters_add(CounterValues *total, const CounterValues *start, const CounterValues *end)
+{
+    uint32_t i = 0;
+    for(; i < COUNTER_COUNT; ++i) {
+        total->values[i] += end->values[i] - start->values[i];
+    }
+}
+
+#endif // COUNTERS_H
@@ -0,0 +1,299 @@
+#include <string.h>
+
+#include "aes.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define AES_HARDWARE 1
+#include <wmmintrin.h>
+#endif
+
+#define ROUND_KEY(k,r) ((k) + (r) * BMFF_AES_BLOCK_SIZE)
+
+static const uint8_t sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+static const uint8_t inv_sbox[256] = {
+    0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+    0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+    0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+    0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+    0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+    0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+    0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+    0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+    0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+    0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+    0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+    0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+    0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+    0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+    0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+    0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d,
+};
+
+static uint8_t _xtime(uint8_t a)
+{
+    return (uint8_t)((a << 1) ^ ((a & 0x80) ? 0x1b : 0x00));
+}
+
+static uint8_t _mul(uint8_t a, uint8_t b)
+{
+    uint8_t r = 0;
+    while(b) {
+        if(b & 1) {
+            r ^= a;
+        }
+        a = _xtime(a);
+        b >>= 1;
+    }
+    return r;
+}
+
+static void _add_round_key(uint8_t *state, const uint8_t *round_key)
+{
+    uint32_t i = 0;
+    for(; i < BMFF_AES_BLOCK_SIZE; ++i) {
+        state[i] ^= round_key[i];
+    }
+}
+
+// the state is column major, row r of column c is state[r + 4 * c].
+static void _sub_shift_rows(uint8_t *state, const uint8_t *box, int32_t direction)
+{
+    uint8_t tmp[BMFF_AES_BLOCK_SIZE];
+    uint32_t r = 0;
+    for(; r < 4; ++r) {
+        uint32_t c = 0;
+        for(; c < 4; ++c) {
+            tmp[r + 4 * c] = box[state[r + 4 * ((c + 4 + direction * (int32_t)r) % 4)]];
+        }
+    }
+    memcpy(state, tmp, BMFF_AES_BLOCK_SIZE);
+}
+
+static void _mix_columns(uint8_t *state)
+{
+    uint32_t c = 0;
+    for(; c < 4; ++c) {
+        uint8_t *col = state + 4 * c;
+        uint8_t a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+        uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+        col[0] ^= all ^ _xtime(a0 ^ a1);
+        col[1] ^= all ^ _xtime(a1 ^ a2);
+        col[2] ^= all ^ _xtime(a2 ^ a3);
+        col[3] ^= all ^ _xtime(a3 ^ a0);
+    }
+}
+
+static void _inv_mix_columns(uint8_t *state)
+{
+    uint32_t c = 0;
+    for(; c < 4; ++c) {
+        uint8_t *col = state + 4 * c;
+        uint8_t a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+        col[0] = _mul(a0, 14) ^ _mul(a1, 11) ^ _mul(a2, 13) ^ _mul(a3, 9);
+        col[1] = _mul(a0, 9) ^ _mul(a1, 14) ^ _mul(a2, 11) ^ _mul(a3, 13);
+        col[2] = _mul(a0, 13) ^ _mul(a1, 9) ^ _mul(a2, 14) ^ _mul(a3, 11);
+        col[3] = _mul(a0, 11) ^ _mul(a1, 13) ^ _mul(a2, 9) ^ _mul(a3, 14);
+    }
+}
+
+static void _encrypt_block(const BMFFAesKey *key, uint8_t *state)
+{
+    _add_round_key(state, ROUND_KEY(key->encrypt, 0));
+    uint32_t round = 1;
+    for(; round < BMFF_AES_ROUNDS; ++round) {
+        _sub_shift_rows(state, sbox, 1);
+        _mix_columns(state);
+        _add_round_key(state, ROUND_KEY(key->encrypt, round));
+    }
+    _sub_shift_rows(state, sbox, 1);
+    _add_round_key(state, ROUND_KEY(key->encrypt, BMFF_AES_ROUNDS));
+}
+
+// equivalent inverse cipher, the same round structure as the AES instructions.
+static void _decrypt_block(const BMFFAesKey *key, uint8_t *state)
+{
+    _add_round_key(state, ROUND_KEY(key->decrypt, 0));
+    uint32_t round = 1;
+    for(; round < BMFF_AES_ROUNDS; ++round) {
+        _sub_shift_rows(state, inv_sbox, -1);
+        _inv_mix_columns(state);
+        _add_round_key(state, ROUND_KEY(key->decrypt, round));
+    }
+    _sub_shift_rows(state, inv_sbox, -1);
+    _add_round_key(state, ROUND_KEY(key->decrypt, BMFF_AES_ROUNDS));
+}
+
+#ifdef AES_HARDWARE
+__attribute__((target("aes,sse2")))
+static void _encrypt_blocks_hw(const BMFFAesKey *key, const uint8_t *in, uint8_t *out, size_t blocks)
+{
+    __m128i k[BMFF_AES_ROUNDS + 1];
+    uint32_t r = 0;
+    for(; r <= BMFF_AES_ROUNDS; ++r) {
+        k[r] = _mm_loadu_si128((const __m128i*)ROUND_KEY(key->encrypt, r));
+    }
+
+    // four independent blocks keep the AES unit busy.
+    size_t i = 0;
+    for(; i + 4 <= blocks; i += 4) {
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + (i + 0) * 16)), k[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + (i + 1) * 16)), k[0]);
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + (i + 2) * 16)), k[0]);
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + (i + 3) * 16)), k[0]);
+        for(r = 1; r < BMFF_AES_ROUNDS; ++r) {
+            b0 = _mm_aesenc_si128(b0, k[r]);
+            b1 = _mm_aesenc_si128(b1, k[r]);
+            b2 = _mm_aesenc_si128(b2, k[r]);
+            b3 = _mm_aesenc_si128(b3, k[r]);
+        }
+        _mm_storeu_si128((__m128i*)(out + (i + 0) * 16), _mm_aesenclast_si128(b0, k[BMFF_AES_ROUNDS]));
+        _mm_storeu_si128((__m128i*)(out + (i + 1) * 16), _mm_aesenclast_si128(b1, k[BMFF_AES_ROUNDS]));
+        _mm_storeu_si128((__m128i*)(out + (i + 2) * 16), _mm_aesenclast_si128(b2, k[BMFF_AES_ROUNDS]));
+        _mm_storeu_si128((__m128i*)(out + (i + 3) * 16), _mm_aesenclast_si128(b3, k[BMFF_AES_ROUNDS]));
+    }
+    for(; i < blocks; ++i) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + i * 16)), k[0]);
+        for(r = 1; r < BMFF_AES_ROUNDS; ++r) {
+            b = _mm_aesenc_si128(b, k[r]);
+        }
+        _mm_storeu_si128((__m128i*)(out + i * 16), _mm_aesenclast_si128(b, k[BMFF_AES_ROUNDS]));
+    }
+}
+
+__attribute__((target("aes,sse2")))
+static void _cbc_decrypt_hw(const BMFFAesKey *key, uint8_t *iv, uint8_t *data, size_t blocks)
+{
+    __m128i k[BMFF_AES_ROUNDS + 1];
+    uint32_t r = 0;
+    for(; r <= BMFF_AES_ROUNDS; ++r) {
+        k[r] = _mm_loadu_si128((const __m128i*)ROUND_KEY(key->decrypt, r));
+    }
+
+    // unlike encryption, CBC decryption of consecutive blocks is independent.
+    __m128i prev = _mm_loadu_si128((const __m128i*)iv);
+    size_t i = 0;
+    for(; i + 4 <= blocks; i += 4) {
+        __m128i c0 = _mm_loadu_si128((const __m128i*)(data + (i + 0) * 16));
+        __m128i c1 = _mm_loadu_si128((const __m128i*)(data + (i + 1) * 16));
+        __m128i c2 = _mm_loadu_si128((const __m128i*)(data + (i + 2) * 16));
+        __m128i c3 = _mm_loadu_si128((const __m128i*)(data + (i + 3) * 16));
+        __m128i b0 = _mm_xor_si128(c0, k[0]);
+        __m128i b1 = _mm_xor_si128(c1, k[0]);
+        __m128i b2 = _mm_xor_si128(c2, k[0]);
+        __m128i b3 = _mm_xor_si128(c3, k[0]);
+        for(r = 1; r < BMFF_AES_ROUNDS; ++r) {
+            b0 = _mm_aesdec_si128(b0, k[r]);
+            b1 = _mm_aesdec_si128(b1, k[r]);
+            b2 = _mm_aesdec_si128(b2, k[r]);
+            b3 = _mm_aesdec_si128(b3, k[r]);
+        }
+        _mm_storeu_si128((__m128i*)(data + (i + 0) * 16), _mm_xor_si128(_mm_aesdeclast_si128(b0, k[BMFF_AES_ROUNDS]), prev));
+        _mm_storeu_si128((__m128i*)(data + (i + 1) * 16), _mm_xor_si128(_mm_aesdeclast_si128(b1, k[BMFF_AES_ROUNDS]), c0));
+        _mm_storeu_si128((__m128i*)(data + (i + 2) * 16), _mm_xor_si128(_mm_aesdeclast_si128(b2, k[BMFF_AES_ROUNDS]), c1));
+        _mm_storeu_si128((__m128i*)(data + (i + 3) * 16), _mm_xor_si128(_mm_aesdeclast_si128(b3, k[BMFF_AES_ROUNDS]), c2));
+        prev = c3;
+    }
+    for(; i < blocks; ++i) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(data + i * 16));
+        __m128i b = _mm_xor_si128(c, k[0]);
+        for(r = 1; r < BMFF_AES_ROUNDS; ++r) {
+            b = _mm_aesdec_si128(b, k[r]);
+        }
+        _mm_storeu_si128((__m128i*)(data + i * 16), _mm_xor_si128(_mm_aesdeclast_si128(b, k[BMFF_AES_ROUNDS]), prev));
+        prev = c;
+    }
+    _mm_storeu_si128((__m128i*)iv, prev);
+}
+#endif
+
+void _bmff_aes_init(BMFFAesKey *key, const uint8_t *bytes)
+{
+    static const uint8_t rcon[BMFF_AES_ROUNDS] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+
+    memcpy(key->encrypt, bytes, BMFF_KEY_SIZE);
+    uint32_t i = 4;
+    for(; i < 4 * (BMFF_AES_ROUNDS + 1); ++i) {
+        uint8_t *word = key->encrypt + 4 * i;
+        const uint8_t *prev = word - 4;
+        uint8_t t[4] = { prev[0], prev[1], prev[2], prev[3] };
+        if(i % 4 == 0) {
+            uint8_t first = t[0];
+            t[0] = sbox[t[1]] ^ rcon[i / 4 - 1];
+            t[1] = sbox[t[2]];
+            t[2] = sbox[t[3]];
+            t[3] = sbox[first];
+        }
+        uint32_t j = 0;
+        for(; j < 4; ++j) {
+            word[j] = key->encrypt[4 * (i - 4) + j] ^ t[j];
+        }
+    }
+
+    // decryption uses the round keys backwards, the inner ones passed through InvMixColumns.
+    memcpy(ROUND_KEY(key->decrypt, 0), ROUND_KEY(key->encrypt, BMFF_AES_ROUNDS), BMFF_AES_BLOCK_SIZE);
+    for(i = 1; i < BMFF_AES_ROUNDS; ++i) {
+        memcpy(ROUND_KEY(key->decrypt, i), ROUND_KEY(key->encrypt, BMFF_AES_ROUNDS - i), BMFF_AES_BLOCK_SIZE);
+        _inv_mix_columns(ROUND_KEY(key->decrypt, i));
+    }
+    memcpy(ROUND_KEY(key->decrypt, BMFF_AES_ROUNDS), ROUND_KEY(key->encrypt, 0), BMFF_AES_BLOCK_SIZE);
+
+#ifdef AES_HARDWARE
+    key->hardware = __builtin_cpu_supports("aes") ? eBooleanTrue : eBooleanFalse;
+#else
+    key->hardware = eBooleanFalse;
+#endif
+}
+
+void _bmff_aes_encrypt_blocks(const BMFFAesKey *key, const uint8_t *in, uint8_t *out, size_t blocks)
+{
+#ifdef AES_HARDWARE
+    if(key->hardware == eBooleanTrue) {
+        _encrypt_blocks_hw(key, in, out, blocks);
+        return;
+    }
+#endif
+    size_t i = 0;
+    for(; i < blocks; ++i) {
+        if(out != in) {
+            memcpy(out + i * BMFF_AES_BLOCK_SIZE, in + i * BMFF_AES_BLOCK_SIZE, BMFF_AES_BLOCK_SIZE);
+        }
+        _encrypt_block(key, out + i * BMFF_AES_BLOCK_SIZE);
+    }
+}
+
+void _bmff_aes_cbc_decrypt(const BMFFAesKey *key, uint8_t *iv, uint8_t *data, size_t blocks)
+{
+#ifdef AES_HARDWARE
+    if(key->hardware == eBooleanTrue) {
+        _cbc_decrypt_hw(key, iv, data, blocks);
+        return;
+    }
+#endif
+    uint8_t cipher[BMFF_AES_BLOCK_SIZE];
+    size_t i = 0;
+    for(; i < blocks; ++i) {
+        uint8_t *block = data + i * BMFF_AES_BLOCK_SIZE;
+        memcpy(cipher, block, BMFF_AES_BLOCK_SIZE);
+        _decrypt_block(key, block);
+        _add_round_key(block, iv);
+        memcpy(iv, cipher, BMFF_AES_BLOCK_SIZE);
+    }
+}
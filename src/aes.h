@@ -0,0 +1,49 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef AES_H
+#define AES_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "decrypt.h"
+
+/**
+ * Expands a 128 bit key and detects the AES instructions.
+ */
+void _bmff_aes_init(BMFFAesKey *key, const uint8_t *bytes);
+
+/**
+ * Encrypts whole blocks, in and out may be the same buffer.
+ */
+void _bmff_aes_encrypt_blocks(const BMFFAesKey *key, const uint8_t *in, uint8_t *out, size_t blocks);
+
+/**
+ * Decrypts whole blocks in CBC mode in place. iv is updated to the last
+ * ciphertext block so the chain can be continued.
+ */
+void _bmff_aes_cbc_decrypt(const BMFFAesKey *key, uint8_t *iv, uint8_t *data, size_t blocks);
+
+#endif // AES_H
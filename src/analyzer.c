@@ -0,0 +1,409 @@
+#include <string.h>
+
+#include "analyzer.h"
+#include "context.h"
+#include "snapshot.h"
+
+#define BOX_TYPE_IS(d,t) ((d)[0]==(t)[0] && (d)[1]==(t)[1] && (d)[2]==(t)[2] && (d)[3]==(t)[3])
+// sample_is_non_sync_sample bit of the sample flags.
+#define SAMPLE_FLAG_NON_SYNC (0x00010000)
+
+static const Box * _bmff_find_child(const Box *parent, const char *type)
+{
+    if(!parent) {
+        return NULL;
+    }
+    const ContainerBox *container = (const ContainerBox*)parent;
+    uint32_t i = 0;
+    for(; i < container->child_count; ++i) {
+        const Box *child = container->children[i];
+        if(child && BOX_TYPE_IS(child->type, type)) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+static BMFFTrackStats * _bmff_analyzer_track(BMFFAnalyzer *analyzer, uint32_t track_id)
+{
+    uint32_t i = 0;
+    for(; i < analyzer->track_count; ++i) {
+        if(analyzer->tracks[i].track_id == track_id) {
+            return &analyzer->tracks[i];
+        }
+    }
+    if(analyzer->track_count == BMFF_ANALYZER_MAX_TRACKS) {
+        return NULL;
+    }
+    BMFFTrackStats *track = &analyzer->tracks[analyzer->track_count++];
+    memset(track, 0, sizeof(BMFFTrackStats));
+    track->track_id = track_id;
+    track->in_gop = eBooleanFalse;
+    return track;
+}
+
+static void _bmff_analyzer_set_timescale(BMFFAnalyzer *analyzer, BMFFTrackStats *track, uint32_t timescale)
+{
+    track->timescale = timescale;
+    track->slot_duration = (uint64_t)timescale * analyzer->window / (1000 * BMFF_BITRATE_SLOTS);
+    if(track->slot_duration == 0) {
+        track->slot_duration = 1;
+    }
+}
+
+static void _bmff_size_add(BMFFSizeHistogram *histogram, uint32_t size)
+{
+    uint32_t bucket = size;
+    if(size >= BMFF_SIZE_SUB_BUCKETS) {
+        // position of the highest set bit, at least 3.
+        uint32_t exponent = 31;
+        while(!(size & ((uint32_t)1 << exponent))) {
+            exponent--;
+        }
+        uint32_t sub = (size >> (exponent - 3)) & (BMFF_SIZE_SUB_BUCKETS - 1);
+        bucket = (exponent - 2) * BMFF_SIZE_SUB_BUCKETS + sub;
+    }
+    if(histogram->count == 0 || size < histogram->min) {
+        histogram->min = size;
+    }
+    if(size > histogram->max) {
+        histogram->max = size;
+    }
+    histogram->buckets[bucket]++;
+    histogram->count++;
+}
+
+static void _bmff_gop_add(BMFFTrackStats *track, uint32_t length)
+{
+    if(track->gop_count == 0 || length < track->gop_min) {
+        track->gop_min = length;
+    }
+    if(length > track->gop_max) {
+        track->gop_max = length;
+    }
+    track->gop_buckets[length < BMFF_GOP_BUCKETS ? length : BMFF_GOP_BUCKETS - 1]++;
+    track->gop_count++;
+}
+
+static void _bmff_bitrate_add(BMFFTrackStats *track, uint64_t decode_time, uint32_t size)
+{
+    if(track->timescale == 0) {
+        return;
+    }
+
+    // slide the window forward, samples going back in time count in the current slot.
+    uint64_t slot = decode_time / track->slot_duration;
+    if(track->sample_count == 1) {
+        track->slot = slot;
+    }else if(slot > track->slot) {
+        if(slot - track->slot >= BMFF_BITRATE_SLOTS) {
+            memset(track->slot_bytes, 0, sizeof(track->slot_bytes));
+            track->window_bytes = 0;
+        }else{
+            uint64_t s = track->slot + 1;
+            for(; s <= slot; ++s) {
+                track->window_bytes -= track->slot_bytes[s % BMFF_BITRATE_SLOTS];
+                track->slot_bytes[s % BMFF_BITRATE_SLOTS] = 0;
+            }
+        }
+        track->slot = slot;
+    }
+    track->slot_bytes[track->slot % BMFF_BITRATE_SLOTS] += size;
+    track->window_bytes += size;
+
+    uint64_t bitrate = (uint64_t)((double)track->window_bytes * 8 * track->timescale /
+                                  (double)(track->slot_duration * BMFF_BITRATE_SLOTS));
+    if(bitrate > track->peak_bitrate) {
+        track->peak_bitrate = bitrate;
+    }
+}
+
+static void _bmff_analyzer_sample(BMFFTrackStats *track,
+                                  uint32_t size,
+                                  uint32_t duration,
+                                  eBoolean sync)
+{
+    uint64_t decode_time = track->decode_time;
+    track->decode_time += duration;
+    track->sample_count++;
+    track->total_size += size;
+    track->total_duration += duration;
+    if(track->timescale > 0 && track->total_duration > 0) {
+        track->average_bitrate = (uint64_t)((double)track->total_size * 8 * track->timescale /
+                                            (double)track->total_duration);
+    }
+
+    // running mean and variance of the durations.
+    if(track->sample_count == 1) {
+        track->duration_min = duration;
+        track->duration_max = duration;
+    }else{
+        if(duration < track->duration_min) track->duration_min = duration;
+        if(duration > track->duration_max) track->duration_max = duration;
+        if(duration != track->last_duration) track->duration_changes++;
+    }
+    track->last_duration = duration;
+    double delta = (double)duration - track->duration_mean;
+    track->duration_mean += delta / (double)track->sample_count;
+    track->duration_m2 += delta * ((double)duration - track->duration_mean);
+    track->duration_variance = track->duration_m2 / (double)track->sample_count;
+
+    _bmff_size_add(&track->sizes, size);
+    _bmff_bitrate_add(track, decode_time, size);
+
+    // samples before the first sync sample do not belong to a GOP.
+    if(sync == eBooleanTrue) {
+        if(track->in_gop == eBooleanTrue) {
+            _bmff_gop_add(track, track->gop_length);
+        }
+        track->sync_count++;
+        track->gop_length = 1;
+        track->in_gop = eBooleanTrue;
+    }else if(track->in_gop == eBooleanTrue) {
+        track->gop_length++;
+    }
+}
+
+static void _bmff_analyzer_track_box(BMFFAnalyzer *analyzer, const Box *trak)
+{
+    const TrackHeaderBox *tkhd = (const TrackHeaderBox*)_bmff_find_child(trak, "tkhd");
+    const Box *mdia = _bmff_find_child(trak, "mdia");
+    const MediaHeaderBox *mdhd = (const MediaHeaderBox*)_bmff_find_child(mdia, "mdhd");
+    const HandlerBox *hdlr = (const HandlerBox*)_bmff_find_child(mdia, "hdlr");
+    const Box *stbl = _bmff_find_child(_bmff_find_child(mdia, "minf"), "stbl");
+
+    const TimeToSampleBox *stts = (const TimeToSampleBox*)_bmff_find_child(stbl, "stts");
+    const SampleSizeBox *stsz = (const SampleSizeBox*)_bmff_find_child(stbl, "stsz");
+    const CompactSampleSizeBox *stz2 = (const CompactSampleSizeBox*)_bmff_find_child(stbl, "stz2");
+    const SyncSampleBox *stss = (const SyncSampleBox*)_bmff_find_child(stbl, "stss");
+
+    if(!tkhd) {
+        return;
+    }
+    BMFFTrackStats *track = _bmff_analyzer_track(analyzer, tkhd->track_id);
+    if(!track) {
+        return;
+    }
+    if(mdhd) {
+        _bmff_analyzer_set_timescale(analyzer, track, mdhd->timescale);
+    }
+    if(hdlr) {
+        memcpy(track->handler_type, hdlr->handler_type, 4);
+    }
+
+    // walk the tables side by side, every sample is a sync sample when there is no stss.
+    uint32_t n = stsz ? stsz->sample_count : (stz2 ? stz2->sample_count : 0);
+    uint32_t stts_entry = 0;
+    uint32_t stts_left = stts && stts->sample_count > 0 ? stts->samples[0].count : 0;
+    uint32_t stss_entry = 0;
+    uint32_t i = 0;
+    for(; i < n; ++i) {
+        uint32_t size = stsz ? (stsz->sample_size > 0 ? stsz->sample_size : stsz->entry_sizes[i]) :
+                        stz2->entry_sizes[i];
+
+        uint32_t duration = 0;
+        while(stts && stts_left == 0 && stts_entry + 1 < stts->sample_count) {
+            stts_left = stts->samples[++stts_entry].count;
+        }
+        if(stts_left > 0) {
+            duration = stts->samples[stts_entry].delta;
+            stts_left--;
+        }
+
+        eBoolean sync = eBooleanTrue;
+        if(stss) {
+            while(stss_entry < stss->entry_count && stss->sample_numbers[stss_entry] < i + 1) {
+                stss_entry++;
+            }
+            sync = stss_entry < stss->entry_count && stss->sample_numbers[stss_entry] == i + 1 ?
+                   eBooleanTrue : eBooleanFalse;
+        }
+
+        _bmff_analyzer_sample(track, size, duration, sync);
+    }
+}
+
+static void _bmff_analyzer_track_extends(BMFFAnalyzer *analyzer, const TrackExtendsBox *trex)
+{
+    BMFFTrackStats *track = _bmff_analyzer_track(analyzer, trex->track_id);
+    if(!track) {
+        return;
+    }
+    track->default_sample_duration = trex->default_sample_duration;
+    track->default_sample_size = trex->default_sample_size;
+    track->default_sample_flags = trex->default_sample_is_difference_sample == eBooleanTrue ?
+                                  SAMPLE_FLAG_NON_SYNC : 0;
+}
+
+static void _bmff_analyzer_fragment_header(BMFFAnalyzer *analyzer, const TrackFragmentHeaderBox *tfhd)
+{
+    uint32_t flags = tfhd->box.flags;
+    BMFFTrackStats *track = _bmff_analyzer_track(analyzer, tfhd->track_id);
+    analyzer->fragment_track = track;
+    analyzer->tfhd_flags = flags;
+    if(!track) {
+        return;
+    }
+
+    // the snapshot attached to the context stands in for the init segment.
+    const BMFFTrackState *state = analyzer->ctx->track_state;
+    uint32_t default_sample_duration = track->default_sample_duration;
+    uint32_t default_sample_size = track->default_sample_size;
+    uint32_t default_sample_flags = track->default_sample_flags;
+    if(state && state->track_id == tfhd->track_id) {
+        if(track->timescale == 0) {
+            memcpy(track->handler_type, state->handler_type, 4);
+            _bmff_analyzer_set_timescale(analyzer, track, state->timescale);
+        }
+        default_sample_duration = state->default_sample_duration;
+        default_sample_size = state->default_sample_size;
+        default_sample_flags = state->default_sample_is_difference_sample == eBooleanTrue ? SAMPLE_FLAG_NON_SYNC : 0;
+    }
+
+    // the track fragment defaults override the ones from the init segment.
+    analyzer->default_sample_duration = (flags & eTfhdDefaultSampleDurationPresent) == eTfhdDefaultSampleDurationPresent ?
+                                        tfhd->default_sample_duration : default_sample_duration;
+    analyzer->default_sample_size = (flags & eTfhdDefaultSampleSizePresent) == eTfhdDefaultSampleSizePresent ?
+                                    tfhd->default_sample_size : default_sample_size;
+    analyzer->default_sample_flags = (flags & eTfhdDefaultSampleFlagsPresent) == eTfhdDefaultSampleFlagsPresent ?
+                                     tfhd->default_sample_flags : default_sample_flags;
+}
+
+static void _bmff_analyzer_track_run(BMFFAnalyzer *analyzer, const TrackRunBox *trun)
+{
+    BMFFTrackStats *track = analyzer->fragment_track;
+    uint32_t flags = trun->box.flags;
+    uint32_t i = 0;
+    for(; i < trun->sample_count; ++i) {
+        const TrackRunSample *run_sample = &trun->samples[i];
+        uint32_t size = (flags & eTrunSampleSizePresent) == eTrunSampleSizePresent ?
+                        run_sample->size : analyzer->default_sample_size;
+        uint32_t duration = (flags & eTrunSampleDurationPresent) == eTrunSampleDurationPresent ?
+                            run_sample->duration : analyzer->default_sample_duration;
+        uint32_t sample_flags = analyzer->default_sample_flags;
+        if((flags & eTrunSampleFlagsPresent) == eTrunSampleFlagsPresent) {
+            sample_flags = run_sample->flags;
+        }else if(i == 0 && (flags & eTrunFirstSampleFlagsPresent) == eTrunFirstSampleFlagsPresent) {
+            sample_flags = trun->first_sample_flags;
+        }
+        _bmff_analyzer_sample(track, size, duration,
+                              (sample_flags & SAMPLE_FLAG_NON_SYNC) ? eBooleanFalse : eBooleanTrue);
+    }
+}
+
+static void _bmff_analyzer_on_event(BMFFContext *ctx,
+                                    BMFFEventId id,
+                                    const uint8_t *fourCC,
+                                    void *data,
+                                    void *user_data)
+{
+    BMFFAnalyzer *analyzer = (BMFFAnalyzer*)user_data;
+    if(analyzer->event_callback) {
+        analyzer->event_callback(ctx, id, fourCC, data, analyzer->event_user_data);
+    }
+
+    if(id != BMFFEventParseComplete) {
+        return;
+    }
+
+    if(BOX_TYPE_IS(fourCC, "trak")) {
+        _bmff_analyzer_track_box(analyzer, (const Box*)data);
+    }else if(BOX_TYPE_IS(fourCC, "trex")) {
+        _bmff_analyzer_track_extends(analyzer, (const TrackExtendsBox*)data);
+    }else if(BOX_TYPE_IS(fourCC, "tfhd")) {
+        _bmff_analyzer_fragment_header(analyzer, (const TrackFragmentHeaderBox*)data);
+    }else if(!analyzer->fragment_track) {
+        return;
+    }else if(BOX_TYPE_IS(fourCC, "tfdt")) {
+        analyzer->fragment_track->decode_time = ((const TrackFragmentDecodeTimeBox*)data)->base_media_decode_time;
+    }else if(BOX_TYPE_IS(fourCC, "trun")) {
+        _bmff_analyzer_track_run(analyzer, (const TrackRunBox*)data);
+    }else if(BOX_TYPE_IS(fourCC, "traf")) {
+        analyzer->fragment_track = NULL;
+    }
+}
+
+BMFFCode bmff_analyzer_init(BMFFAnalyzer *analyzer, BMFFContext *ctx, uint32_t window)
+{
+    if(!analyzer)   return BMFF_INVALID_PARAMETER;
+    if(!ctx)        return BMFF_INVALID_CONTEXT;
+    if(ctx->events) return BMFF_INVALID_PARAMETER;
+
+    memset(analyzer, 0, sizeof(BMFFAnalyzer));
+    analyzer->ctx = ctx;
+    analyzer->event_callback = ctx->callback;
+    analyzer->event_user_data = ctx->callback_user_data;
+    analyzer->window = window > 0 ? window : BMFF_BITRATE_WINDOW;
+
+    return bmff_set_event_callback(ctx, _bmff_analyzer_on_event, analyzer);
+}
+
+BMFFCode bmff_analyzer_destroy(BMFFAnalyzer *analyzer)
+{
+    if(!analyzer)       return BMFF_INVALID_PARAMETER;
+    if(!analyzer->ctx)  return BMFF_INVALID_CONTEXT;
+
+    bmff_set_event_callback(analyzer->ctx, analyzer->event_callback, analyzer->event_user_data);
+    memset(analyzer, 0, sizeof(BMFFAnalyzer));
+
+    return BMFF_OK;
+}
+
+BMFFCode bmff_analyzer_flush(BMFFAnalyzer *analyzer)
+{
+    if(!analyzer) return BMFF_INVALID_PARAMETER;
+
+    uint32_t i = 0;
+    for(; i < analyzer->track_count; ++i) {
+        BMFFTrackStats *track = &analyzer->tracks[i];
+        if(track->in_gop == eBooleanTrue) {
+            _bmff_gop_add(track, track->gop_length);
+            track->in_gop = eBooleanFalse;
+            track->gop_length = 0;
+        }
+    }
+    return BMFF_OK;
+}
+
+const BMFFTrackStats * bmff_analyzer_get_track(BMFFAnalyzer *analyzer, uint32_t track_id)
+{
+    if(!analyzer) return NULL;
+
+    uint32_t i = 0;
+    for(; i < analyzer->track_count; ++i) {
+        if(analyzer->tracks[i].track_id == track_id) {
+            return &analyzer->tracks[i];
+        }
+    }
+    return NULL;
+}
+
+uint32_t bmff_size_percentile(const BMFFSizeHistogram *histogram, uint32_t percentile)
+{
+    if(!histogram || histogram->count == 0) return 0;
+    if(percentile > 100) percentile = 100;
+
+    uint64_t target = (histogram->count * percentile + 99) / 100;
+    if(target == 0) target = 1;
+
+    uint64_t seen = 0;
+    uint32_t i = 0;
+    for(; i < BMFF_SIZE_BUCKETS - 1; ++i) {
+        seen += histogram->buckets[i];
+        if(seen >= target) {
+            break;
+        }
+    }
+
+    uint64_t upper = i;
+    if(i >= BMFF_SIZE_SUB_BUCKETS) {
+        uint32_t exponent = i / BMFF_SIZE_SUB_BUCKETS + 2;
+        uint32_t sub = i % BMFF_SIZE_SUB_BUCKETS;
+        upper = ((uint64_t)(BMFF_SIZE_SUB_BUCKETS + sub) << (exponent - 3)) +
+                ((uint64_t)1 << (exponent - 3)) - 1;
+    }
+    // the bucket bounds can not be tighter than the sizes seen.
+    if(upper > histogram->max) upper = histogram->max;
+    if(upper < histogram->min) upper = histogram->min;
+    return (uint32_t)upper;
+}
@@ -0,0 +1,159 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// number of tracks whose statistics are kept by the analyzer.
+#define BMFF_ANALYZER_MAX_TRACKS                (16)
+// number of slots the bitrate window is divided in.
+#define BMFF_BITRATE_SLOTS                      (16)
+// default length of the bitrate window in milliseconds.
+#define BMFF_BITRATE_WINDOW                     (1000)
+// number of buckets in the GOP length histogram.
+#define BMFF_GOP_BUCKETS                        (64)
+// number of linear sub buckets per power of two in the sample size histogram.
+#define BMFF_SIZE_SUB_BUCKETS                   (8)
+#define BMFF_SIZE_BUCKETS                       (30 * BMFF_SIZE_SUB_BUCKETS)
+
+/**
+ * Histogram of sample sizes.
+ * Sizes below BMFF_SIZE_SUB_BUCKETS have a bucket each, larger sizes are
+ * counted in BMFF_SIZE_SUB_BUCKETS linear buckets per power of two.
+ */
+typedef struct BMFFSizeHistogram {
+    uint64_t    buckets[BMFF_SIZE_BUCKETS];
+    uint64_t    count;
+    uint32_t    min;
+    uint32_t    max;
+} BMFFSizeHistogram;
+
+/**
+ * Statistics of a track, times are in the timescale of the track.
+ */
+typedef struct BMFFTrackStats {
+    uint32_t            track_id;
+    uint8_t             handler_type[4];
+    uint32_t            timescale;
+    uint64_t            sample_count;
+    uint64_t            total_size;
+    uint64_t            total_duration;
+    // bits per second over the whole track and the busiest bitrate window.
+    uint64_t            average_bitrate;
+    uint64_t            peak_bitrate;
+    // GOP lengths in samples, bucket i counts GOPs of i samples, the last bucket is open ended.
+    uint64_t            sync_count;
+    uint64_t            gop_count;
+    uint32_t            gop_min;
+    uint32_t            gop_max;
+    uint64_t            gop_buckets[BMFF_GOP_BUCKETS];
+    // sample durations, a regular frame rate has no duration changes and no variance.
+    uint32_t            duration_min;
+    uint32_t            duration_max;
+    double              duration_mean;
+    double              duration_variance;
+    uint64_t            duration_changes;
+    BMFFSizeHistogram   sizes;
+
+    // running state.
+    uint64_t            decode_time;
+    uint32_t            last_duration;
+    double              duration_m2;
+    uint32_t            gop_length;
+    eBoolean            in_gop;
+    uint64_t            slot;
+    uint64_t            slot_duration;
+    uint64_t            slot_bytes[BMFF_BITRATE_SLOTS];
+    uint64_t            window_bytes;
+    // trex defaults for fragmented tracks.
+    uint32_t            default_sample_duration;
+    uint32_t            default_sample_size;
+    uint32_t            default_sample_flags;
+} BMFFTrackStats;
+
+/**
+ * Analyzer state.
+ */
+typedef struct BMFFAnalyzer {
+    BMFFContext         *ctx;
+    // event callback of the context before the analyzer was attached.
+    bmff_on_event       event_callback;
+    void                *event_user_data;
+    uint32_t            window;
+    BMFFTrackStats      tracks[BMFF_ANALYZER_MAX_TRACKS];
+    uint32_t            track_count;
+    // state of the current track fragment.
+    BMFFTrackStats      *fragment_track;
+    uint32_t            tfhd_flags;
+    uint32_t            default_sample_duration;
+    uint32_t            default_sample_size;
+    uint32_t            default_sample_flags;
+} BMFFAnalyzer;
+
+/**
+ * Attaches an analyzer to an initialized context.
+ * The analyzer computes track statistics from the parse events in a single
+ * pass without keeping any boxes: sample tables are walked when their trak
+ * completes and track runs as they are parsed. Like the chunk ingest it takes
+ * over the event callback of the context and forwards every event.
+ * The bitrate window is given in milliseconds, 0 selects BMFF_BITRATE_WINDOW.
+ */
+BMFFCode bmff_analyzer_init(BMFFAnalyzer *analyzer, BMFFContext *ctx, uint32_t window);
+
+/**
+ * Detaches the analyzer from its context.
+ */
+BMFFCode bmff_analyzer_destroy(BMFFAnalyzer *analyzer);
+
+/**
+ * Counts the GOP still open at the end of each track.
+ * Call once all of the input has been parsed.
+ */
+BMFFCode bmff_analyzer_flush(BMFFAnalyzer *analyzer);
+
+/**
+ * Returns the statistics of a track, NULL if the track has not been seen.
+ */
+const BMFFTrackStats * bmff_analyzer_get_track(BMFFAnalyzer *analyzer, uint32_t track_id);
+
+/**
+ * Returns the upper bound of the bucket holding the given percentile of the
+ * sample sizes, in the range 0-100.
+ */
+uint32_t bmff_size_percentile(const BMFFSizeHistogram *histogram, uint32_t percentile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ANALYZER_H
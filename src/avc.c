@@ -0,0 +1,244 @@
+#include <string.h>
+
+#include "avc.h"
+
+#define NAL_TYPE(b) ((b) & 0x1F)
+
+static const uint8_t start_code[4] = { 0x00, 0x00, 0x00, 0x01 };
+
+static uint32_t _bmff_read_nal_length(const uint8_t *ptr, uint8_t nal_length_size)
+{
+    switch(nal_length_size) {
+    case 1:
+        return ptr[0];
+    case 2:
+        return ((uint32_t)ptr[0] << 8) | ptr[1];
+    default:
+        return ((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | ptr[3];
+    }
+}
+
+// reads count parameter sets of 16 bit length, returns the bytes read or 0 when they do not fit.
+static size_t _bmff_read_parameter_sets(const uint8_t *data, size_t size, uint32_t count, BMFFAvcParameterSet *sets)
+{
+    const uint8_t *ptr = data;
+    const uint8_t *end = data + size;
+    uint32_t i = 0;
+    for(; i < count; ++i) {
+        if(end - ptr < 2) {
+            return 0;
+        }
+        uint16_t length = ((uint16_t)ptr[0] << 8) | ptr[1];
+        ptr += 2;
+        if((size_t)(end - ptr) < length) {
+            return 0;
+        }
+        sets[i].data = ptr;
+        sets[i].size = length;
+        ptr += length;
+    }
+    return ptr - data;
+}
+
+BMFFCode bmff_avc_config_decode(const AVCDecoderConfigBox *avcc, BMFFAvcConfig *config)
+{
+    if(!avcc || !config)        return BMFF_INVALID_PARAMETER;
+    if(!avcc->config_record)    return BMFF_INVALID_DATA;
+    if(avcc->config_record_size < 7) return BMFF_INVALID_SIZE;
+
+    const uint8_t *ptr = avcc->config_record;
+    const uint8_t *end = ptr + avcc->config_record_size;
+
+    memset(config, 0, sizeof(BMFFAvcConfig));
+    config->configuration_version = ptr[0];
+    config->profile_indication = ptr[1];
+    config->profile_compatibility = ptr[2];
+    config->level_indication = ptr[3];
+    config->nal_length_size = (ptr[4] & 0x03) + 1;
+    if(config->nal_length_size == 3) {
+        return BMFF_INVALID_DATA;
+    }
+
+    config->sps_count = ptr[5] & 0x1F;
+    ptr += 6;
+    size_t read = _bmff_read_parameter_sets(ptr, end - ptr, config->sps_count, config->sps);
+    if(read == 0 && config->sps_count > 0) {
+        return BMFF_INVALID_SIZE;
+    }
+    ptr += read;
+
+    if(ptr == end) {
+        return BMFF_INVALID_SIZE;
+    }
+    config->pps_count = *ptr++;
+    read = _bmff_read_parameter_sets(ptr, end - ptr, config->pps_count, config->pps);
+    if(read == 0 && config->pps_count > 0) {
+        return BMFF_INVALID_SIZE;
+    }
+    ptr += read;
+
+    // the high profiles append the chroma format and bit depths, older files leave them out.
+    if((config->profile_indication == 100 || config->profile_indication == 110 ||
+            config->profile_indication == 122 || config->profile_indication == 144) && end - ptr >= 4) {
+        config->has_format_extension = eBooleanTrue;
+        config->chroma_format = ptr[0] & 0x03;
+        config->bit_depth_luma_minus8 = ptr[1] & 0x07;
+        config->bit_depth_chroma_minus8 = ptr[2] & 0x07;
+    }
+
+    return BMFF_OK;
+}
+
+BMFFCode bmff_avc_index_nal_units(const uint8_t *data,
+                                  size_t size,
+                                  uint8_t nal_length_size,
+                                  BMFFNalUnit *units,
+                                  uint32_t capacity,
+                                  uint32_t *count)
+{
+    if(!data || !count)                                 return BMFF_INVALID_PARAMETER;
+    if(!units && capacity > 0)                          return BMFF_INVALID_PARAMETER;
+    if(nal_length_size != 1 && nal_length_size != 2 &&
+            nal_length_size != 4)                       return BMFF_INVALID_PARAMETER;
+
+    // the lengths chain the NAL units, so the walk costs one step per NAL unit, not per byte.
+    const uint8_t *ptr = data;
+    const uint8_t *end = data + size;
+    uint32_t n = 0;
+    while((size_t)(end - ptr) >= nal_length_size) {
+        uint32_t length = _bmff_read_nal_length(ptr, nal_length_size);
+        ptr += nal_length_size;
+        if((size_t)(end - ptr) < length) {
+            *count = n;
+            return BMFF_INVALID_DATA;
+        }
+        if(n < capacity) {
+            units[n].offset = (uint32_t)(ptr - data);
+            units[n].size = length;
+            units[n].type = length > 0 ? NAL_TYPE(ptr[0]) : 0;
+        }
+        n++;
+        ptr += length;
+    }
+
+    *count = n;
+    if(ptr != end) {
+        return BMFF_INVALID_DATA;
+    }
+    return n > capacity ? BMFF_RESOURCE_LIMIT : BMFF_OK;
+}
+
+static uint8_t * _bmff_write_nal_unit(uint8_t *out, const uint8_t *nal, size_t size)
+{
+    memcpy(out, start_code, sizeof(start_code));
+    memcpy(out + sizeof(start_code), nal, size);
+    return out + sizeof(start_code) + size;
+}
+
+BMFFCode bmff_avc_to_annexb(const BMFFAvcConfig *config,
+                            const uint8_t *data,
+                            size_t size,
+                            eBoolean sync,
+                            uint8_t *out,
+                            size_t out_size,
+                            size_t *written)
+{
+    if(!config || !data || !written)    return BMFF_INVALID_PARAMETER;
+
+    uint8_t nal_length_size = config->nal_length_size;
+    if(nal_length_size != 1 && nal_length_size != 2 && nal_length_size != 4) {
+        return BMFF_INVALID_PARAMETER;
+    }
+
+    // size the output and look for in band parameter sets.
+    const uint8_t *ptr = data;
+    const uint8_t *end = data + size;
+    size_t needed = 0;
+    eBoolean has_sps = eBooleanFalse;
+    eBoolean leading_aud = eBooleanFalse;
+    while((size_t)(end - ptr) >= nal_length_size) {
+        uint32_t length = _bmff_read_nal_length(ptr, nal_length_size);
+        ptr += nal_length_size;
+        if((size_t)(end - ptr) < length) {
+            return BMFF_INVALID_DATA;
+        }
+        if(length > 0 && NAL_TYPE(ptr[0]) == BMFF_AVC_NAL_SPS) {
+            has_sps = eBooleanTrue;
+        }
+        if(length > 0 && ptr == data + nal_length_size && NAL_TYPE(ptr[0]) == BMFF_AVC_NAL_AUD) {
+            leading_aud = eBooleanTrue;
+        }
+        needed += sizeof(start_code) + length;
+        ptr += length;
+    }
+    if(ptr != end) {
+        return BMFF_INVALID_DATA;
+    }
+
+    eBoolean insert = sync == eBooleanTrue && has_sps == eBooleanFalse ? eBooleanTrue : eBooleanFalse;
+    uint32_t i = 0;
+    if(insert == eBooleanTrue) {
+        for(i = 0; i < config->sps_count; ++i) {
+            needed += sizeof(start_code) + config->sps[i].size;
+        }
+        for(i = 0; i < config->pps_count; ++i) {
+            needed += sizeof(start_code) + config->pps[i].size;
+        }
+    }
+
+    *written = needed;
+    if(!out || out_size < needed) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+
+    uint8_t *dst = out;
+    ptr = data;
+    if(leading_aud == eBooleanTrue) {
+        uint32_t length = _bmff_read_nal_length(ptr, nal_length_size);
+        dst = _bmff_write_nal_unit(dst, ptr + nal_length_size, length);
+        ptr += nal_length_size + length;
+    }
+    if(insert == eBooleanTrue) {
+        for(i = 0; i < config->sps_count; ++i) {
+            dst = _bmff_write_nal_unit(dst, config->sps[i].data, config->sps[i].size);
+        }
+        for(i = 0; i < config->pps_count; ++i) {
+            dst = _bmff_write_nal_unit(dst, config->pps[i].data, config->pps[i].size);
+        }
+    }
+    while(ptr < end) {
+        uint32_t length = _bmff_read_nal_length(ptr, nal_length_size);
+        dst = _bmff_write_nal_unit(dst, ptr + nal_length_size, length);
+        ptr += nal_length_size + length;
+    }
+
+    return BMFF_OK;
+}
+
+BMFFCode bmff_avc_to_annexb_in_place(uint8_t nal_length_size, uint8_t *data, size_t size)
+{
+    if(!data)                   return BMFF_INVALID_PARAMETER;
+    if(nal_length_size != 4)    return BMFF_INVALID_PARAMETER;
+
+    // check the whole sample first so a bad one is left untouched.
+    uint8_t *ptr = data;
+    uint8_t *end = data + size;
+    while((size_t)(end - ptr) >= 4) {
+        uint32_t length = _bmff_read_nal_length(ptr, 4);
+        if((size_t)(end - ptr) - 4 < length) {
+            return BMFF_INVALID_DATA;
+        }
+        ptr += 4 + length;
+    }
+    if(ptr != end) {
+        return BMFF_INVALID_DATA;
+    }
+
+    ptr = data;
+    while(ptr < end) {
+        uint32_t length = _bmff_read_nal_length(ptr, 4);
+        memcpy(ptr, start_code, sizeof(start_code));
+        ptr += 4 + length;
+    }
+    return BMFF_OK;
+}
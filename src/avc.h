@@ -0,0 +1,136 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef AVC_H
+#define AVC_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// limits of the parameter set counts of an AVCDecoderConfigurationRecord.
+#define BMFF_AVC_MAX_SPS                        (31)
+#define BMFF_AVC_MAX_PPS                        (255)
+
+// NAL unit types that matter for the conversion.
+#define BMFF_AVC_NAL_IDR                        (5)
+#define BMFF_AVC_NAL_SPS                        (7)
+#define BMFF_AVC_NAL_PPS                        (8)
+#define BMFF_AVC_NAL_AUD                        (9)
+
+/**
+ * Parameter set of a decoder configuration, pointing into the avcC box.
+ */
+typedef struct BMFFAvcParameterSet {
+    const uint8_t   *data;
+    uint16_t        size;
+} BMFFAvcParameterSet;
+
+/**
+ * AVCDecoderConfigurationRecord from ISO/IEC 14496-15.
+ */
+typedef struct BMFFAvcConfig {
+    uint8_t             configuration_version;
+    uint8_t             profile_indication;
+    uint8_t             profile_compatibility;
+    uint8_t             level_indication;
+    // size in bytes of the NAL unit length fields of the samples, 1, 2 or 4.
+    uint8_t             nal_length_size;
+    uint8_t             sps_count;
+    BMFFAvcParameterSet sps[BMFF_AVC_MAX_SPS];
+    uint8_t             pps_count;
+    BMFFAvcParameterSet pps[BMFF_AVC_MAX_PPS];
+    // only present for the high profiles.
+    eBoolean            has_format_extension;
+    uint8_t             chroma_format;
+    uint8_t             bit_depth_luma_minus8;
+    uint8_t             bit_depth_chroma_minus8;
+} BMFFAvcConfig;
+
+/**
+ * NAL unit of a sample, the offset is that of the NAL unit header in the sample.
+ */
+typedef struct BMFFNalUnit {
+    uint32_t    offset;
+    uint32_t    size;
+    uint8_t     type;
+} BMFFNalUnit;
+
+/**
+ * Decodes the configuration record of an avcC box.
+ * The parameter sets point into the record.
+ */
+BMFFCode bmff_avc_config_decode(const AVCDecoderConfigBox *avcc, BMFFAvcConfig *config);
+
+/**
+ * Lists the NAL units of a length prefixed sample.
+ * All NAL units are counted, but only the first capacity ones are stored.
+ *
+ * @param count receives the number of NAL units in the sample.
+ * @return BMFF_RESOURCE_LIMIT when there are more than capacity NAL units,
+ * BMFF_INVALID_DATA when a length runs past the end of the sample.
+ */
+BMFFCode bmff_avc_index_nal_units(const uint8_t *data,
+                                  size_t size,
+                                  uint8_t nal_length_size,
+                                  BMFFNalUnit *units,
+                                  uint32_t capacity,
+                                  uint32_t *count);
+
+/**
+ * Converts a length prefixed sample to Annex B by gathering its NAL units
+ * behind 4 byte start codes. Sync samples that carry no SPS of their own get
+ * the parameter sets of the configuration, after the access unit delimiter if
+ * the sample starts with one.
+ *
+ * @param out output buffer, may be NULL to query the size.
+ * @param written receives the size of the Annex B sample.
+ * @return BMFF_RESOURCE_LIMIT when out is smaller than the Annex B sample.
+ */
+BMFFCode bmff_avc_to_annexb(const BMFFAvcConfig *config,
+                            const uint8_t *data,
+                            size_t size,
+                            eBoolean sync,
+                            uint8_t *out,
+                            size_t out_size,
+                            size_t *written);
+
+/**
+ * Rewrites the 4 byte NAL unit lengths of a sample to start codes in place.
+ * Parameter sets are not inserted.
+ *
+ * @return BMFF_INVALID_PARAMETER when the NAL unit lengths are not 4 bytes.
+ */
+BMFFCode bmff_avc_to_annexb_in_place(uint8_t nal_length_size, uint8_t *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AVC_H
@@ -1,13 +1,12 @@
 #include <memory.h>
-#include <stdio.h>
 
 #include "bmff.h"
 #include "parse.h"
 #include "parse_common.h"
 #include "context.h"
+#include "memo.h"
 
 #define BOX_TYPE_IS(d,t) ((d)[0]==(t)[0] && (d)[1]==(t)[1] && (d)[2]==(t)[2] && (d)[3]==(t)[3])
-#define CALLBACK(c, e, f, d)  if((c)->callback) { (c)->callback((c), (e), (f), (void*)(d), (c)->callback_user_data); }
 
 const char *bmff_get_version(void)
 {
@@ -23,6 +22,7 @@ BMFFCode bmff_context_init(BMFFContext *ctx)
     ctx->calloc = calloc;
     ctx->realloc = realloc;
     ctx->free = free;
+    ctx->event_mask = BMFF_EVENT_MASK_ALL;
 
     return BMFF_OK;
 }
@@ -30,10 +30,111 @@ BMFFCode bmff_context_init(BMFFContext *ctx)
 BMFFCode bmff_context_destroy(BMFFContext *ctx)
 {
     if(!ctx) return BMFF_INVALID_CONTEXT;
+    _bmff_context_release_memory(ctx);
+    if(ctx->allocator.reset) {
+        ctx->allocator.reset(ctx->allocator.state);
+    }
     memset(ctx, 0, sizeof(BMFFContext));
     return BMFF_OK;
 }
 
+BMFFCode bmff_context_reset(BMFFContext *ctx)
+{
+    if(!ctx) return BMFF_INVALID_CONTEXT;
+
+    // release the boxes of an unfinished parse, the layers stay warm.
+    while(ctx->allocs_stack) {
+        bmff_context_alloc_stack_pop(ctx);
+    }
+
+    ctx->sample_count = 0;
+    memset(ctx->handler_type, 0, 4);
+    ctx->channel_count = 0;
+    ctx->sample_description_version = 0;
+    ctx->default_iv_size = 0;
+    ctx->is_constant_iv = eBooleanUnknown;
+    ctx->events_count = 0;
+    ctx->parse_data = NULL;
+    ctx->parse_offset = 0;
+    ctx->breadcrumb_depth = 0;
+    ctx->frame_count = 0;
+    ctx->end_of_stream = eBooleanUnknown;
+    ctx->diagnostics_count = 0;
+    ctx->track_state = NULL;
+
+    // drop every library allocation at once, nothing is kept warm and the
+    // memo cache starts over empty.
+    if(ctx->allocator.reset) {
+        MemoSettings memo;
+        _bmff_memo_save_settings(ctx, &memo);
+        _bmff_context_release_memory(ctx);
+        ctx->allocator.reset(ctx->allocator.state);
+        _bmff_memo_restore_settings(ctx, &memo);
+    }
+
+    return BMFF_OK;
+}
+
+BMFFCode bmff_context_pool_init(BMFFContextPool *pool, uint32_t size)
+{
+    if(!pool)       return BMFF_INVALID_PARAMETER;
+    if(size == 0)   return BMFF_INVALID_SIZE;
+
+    memset(pool, 0, sizeof(BMFFContextPool));
+    pool->contexts = malloc(sizeof(BMFFContext) * size);
+    pool->available = malloc(sizeof(BMFFContext*) * size);
+    if(!pool->contexts || !pool->available) {
+        free(pool->contexts);
+        free(pool->available);
+        memset(pool, 0, sizeof(BMFFContextPool));
+        return BMFF_RESOURCE_LIMIT;
+    }
+
+    uint32_t i = 0;
+    for(; i < size; ++i) {
+        bmff_context_init(&pool->contexts[i]);
+        pool->available[i] = &pool->contexts[size - 1 - i];
+    }
+    pool->size = size;
+    pool->available_count = size;
+
+    return BMFF_OK;
+}
+
+BMFFCode bmff_context_pool_destroy(BMFFContextPool *pool)
+{
+    if(!pool) return BMFF_INVALID_PARAMETER;
+
+    uint32_t i = 0;
+    for(; i < pool->size; ++i) {
+        bmff_context_destroy(&pool->contexts[i]);
+    }
+    free(pool->contexts);
+    free(pool->available);
+    memset(pool, 0, sizeof(BMFFContextPool));
+
+    return BMFF_OK;
+}
+
+BMFFContext * bmff_context_pool_acquire(BMFFContextPool *pool)
+{
+    if(!pool || pool->available_count == 0) return NULL;
+    return pool->available[--pool->available_count];
+}
+
+BMFFCode bmff_context_pool_release(BMFFContextPool *pool, BMFFContext *ctx)
+{
+    if(!pool)   return BMFF_INVALID_PARAMETER;
+    if(!ctx)    return BMFF_INVALID_CONTEXT;
+    if(ctx < pool->contexts || ctx >= pool->contexts + pool->size) return BMFF_INVALID_CONTEXT;
+    if(pool->available_count == pool->size) return BMFF_INVALID_PARAMETER;
+
+    bmff_context_reset(ctx);
+    pool->available[pool->available_count++] = ctx;
+
+    return BMFF_OK;
+}
+
 BMFFCode bmff_set_event_callback(BMFFContext *ctx, bmff_on_event callback, void *user_data)
 {
     if(!ctx) return BMFF_INVALID_CONTEXT;
@@ -42,22 +143,117 @@ BMFFCode bmff_set_event_callback(BMFFContext *ctx, bmff_on_event callback, void
     return BMFF_OK;
 }
 
+BMFFCode bmff_set_event_mask(BMFFContext *ctx, uint32_t mask)
+{
+    if(!ctx) return BMFF_INVALID_CONTEXT;
+    ctx->event_mask = mask;
+    return BMFF_OK;
+}
+
+BMFFCode bmff_set_event_batch(BMFFContext *ctx, BMFFEvent *buffer, uint32_t capacity, bmff_on_events callback, void *user_data)
+{
+    if(!ctx) return BMFF_INVALID_CONTEXT;
+    if(buffer && capacity == 0) return BMFF_INVALID_PARAMETER;
+
+    // deliver anything queued in the previous buffer first.
+    _bmff_flush_events(ctx);
+
+    ctx->events = buffer;
+    ctx->events_capacity = buffer ? capacity : 0;
+    ctx->events_count = 0;
+    ctx->batch_callback = callback;
+    ctx->batch_user_data = user_data;
+    return BMFF_OK;
+}
+
+BMFFCode bmff_set_end_of_stream(BMFFContext *ctx, eBoolean end_of_stream)
+{
+    if(!ctx) return BMFF_INVALID_CONTEXT;
+    ctx->end_of_stream = end_of_stream;
+    return BMFF_OK;
+}
+
+BMFFCode bmff_set_allocator(BMFFContext *ctx, const BMFFAllocator *allocator)
+{
+    if(!ctx)                                return BMFF_INVALID_CONTEXT;
+    if(allocator && !allocator->alloc)      return BMFF_INVALID_PARAMETER;
+
+    // the blocks held so far go back to the allocator they came from.
+    MemoSettings memo;
+    _bmff_memo_save_settings(ctx, &memo);
+    _bmff_context_release_memory(ctx);
+    if(ctx->allocator.reset) {
+        ctx->allocator.reset(ctx->allocator.state);
+    }
+    if(allocator) {
+        ctx->allocator = *allocator;
+    }else{
+        memset(&ctx->allocator, 0, sizeof(BMFFAllocator));
+    }
+    return _bmff_memo_restore_settings(ctx, &memo);
+}
+
+BMFFCode bmff_set_max_depth(BMFFContext *ctx, uint32_t depth)
+{
+    if(!ctx) return BMFF_INVALID_CONTEXT;
+    if(depth != ctx->max_depth) {
+        // the frames are allocated again at the new depth by the next parse.
+        _bmff_free(ctx, ctx->frames);
+        ctx->frames = NULL;
+    }
+    ctx->max_depth = depth;
+    return BMFF_OK;
+}
+
+BMFFCode bmff_set_memory_limit(BMFFContext *ctx, size_t limit)
+{
+    if(!ctx) return BMFF_INVALID_CONTEXT;
+    ctx->memory_limit = limit;
+    return BMFF_OK;
+}
+
 size_t bmff_parse(BMFFContext *ctx, const uint8_t *data, size_t size, BMFFCode *code)
 {
-    if(!ctx)        return BMFF_INVALID_CONTEXT;
-    if(!data)       return BMFF_INVALID_DATA;
-    if(size < 20)   return BMFF_INVALID_SIZE;
-    if(!code)       return BMFF_INVALID_PARAMETER;
+    // no bytes are consumed on error, the reason is reported through code.
+    if(!code)       return 0;
+    if(!ctx)        { *code = BMFF_INVALID_CONTEXT; return 0; }
+    if(!data)       { *code = BMFF_INVALID_DATA; return 0; }
+    if(size < 8)    { *code = BMFF_INVALID_SIZE; return 0; }
 
     // parse top level boxes
     const uint8_t *ptr = data;
     const uint8_t *end = data + size;
+    ctx->parse_data = data;
+    *code = BMFF_OK;
+    if(ctx->memo) {
+        _bmff_memo_begin(ctx);
+    }
 
-    while(ptr + 8 < end) {
+    while(ptr + 8 <= end) {
+
+        uint64_t box_size;
+        uint32_t raw_size = parse_u32(ptr);
+        if(raw_size == 0) {
+            // the box runs to the end of the stream, which is only known at the end.
+            if(ctx->end_of_stream != eBooleanTrue) {
+                break;
+            }
+            box_size = end - ptr;
+        }else if(raw_size == 1 && ptr + 16 > end) {
+            // wait for the rest of the largesize header.
+            break;
+        }else{
+            box_size = parse_box_size(ptr, end - ptr);
+            if(box_size == 0) {
+                // the size is corrupt so there is no way to find the next box.
+                _bmff_record_diagnostic(ctx, BMFF_INVALID_SIZE, ptr+4);
+                *code = BMFF_INVALID_SIZE;
+                break;
+            }
+        }
 
-        uint32_t box_size = parse_u32(ptr);
         // make sure we have enough data to parse this box, otherwise exit parsing
-        if(ptr + box_size > end) {
+        if(box_size > (uint64_t)(end - ptr)) {
             break;
         }
 
@@ -70,30 +266,38 @@ size_t bmff_parse(BMFFContext *ctx, const uint8_t *data, size_t size, BMFFCode *
         int i=0;
         for(; i < PARSE_MAP_LEN; ++i) {
             uint32_t parser_box_type = parse_map[i].box_type_value;
-            uint8_t parser_is_container_type = parse_map[i].is_container_type;
             if(parser_box_type == box_type) {
-                if(parser_is_container_type == 1) {
-                    bmff_context_alloc_stack_push(ctx);
+                // every top level box gets a layer so leaf boxes are released too.
+                if(bmff_context_alloc_stack_push(ctx) != BMFF_OK) {
+                    _bmff_record_diagnostic(ctx, BMFF_RESOURCE_LIMIT, ptr+4);
+                    CALLBACK(ctx, BMFFEventParseError, ptr+4, (void*)ptr);
+                    break;
                 }
 
                 Box *box;
                 CALLBACK(ctx, BMFFEventParseStart, ptr+4, NULL);
                 _bmff_breadcrumb_push(ctx, ptr+4);
 
-                BMFFCode res = parse_map[i].parse_func(ctx, ptr, end-ptr, &box);
+                BMFFCode res = ctx->memo ? _bmff_memo_parse(ctx, parse_map[i].parse_func, ptr, end-ptr, &box)
+                                         : parse_map[i].parse_func(ctx, ptr, end-ptr, &box);
                 
                 if(res == BMFF_OK) {
                     _bmff_breadcrumb_pop(ctx);
+                    // bmff_detach_box may take the box while its events are delivered.
+                    ctx->detach_box = box;
+                    ctx->detach_data = ptr;
+                    ctx->detach_size = (size_t)box_size;
                     CALLBACK(ctx, BMFFEventParseComplete, ptr+4, (void*)box);
                 } else {
-                    fprintf(stderr, "Error paring box: %d\n", res);
                     _bmff_breadcrumb_pop(ctx);
+                    _bmff_record_diagnostic(ctx, res, ptr+4);
                     CALLBACK(ctx, BMFFEventParseError, ptr+4, (void*)ptr);
                 }
                 
-                if(parser_is_container_type) {
-                    bmff_context_alloc_stack_pop(ctx);
-                }
+                // queued events reference boxes that are about to be released.
+                _bmff_flush_events(ctx);
+                bmff_context_alloc_stack_pop(ctx);
+                ctx->detach_box = NULL;
                 break;
             }
         }
@@ -105,10 +309,241 @@ size_t bmff_parse(BMFFContext *ctx, const uint8_t *data, size_t size, BMFFCode *
         ptr += box_size;
     }
 
+    _bmff_flush_events(ctx);
+    ctx->parse_offset += ptr - data;
+    ctx->parse_data = NULL;
+
     return ptr - data;
 }
 
+uint64_t bmff_get_box_size(const Box *box)
+{
+    if(!box) return 0;
+    if(box->size == 1 || box->size == 0) {
+        return box->large_size;
+    }
+    return box->size;
+}
+
+// copies up to size bytes starting at offset of segment seg, returns the number copied.
+static size_t _bmff_iov_gather(const struct iovec *iov, int iov_count, int seg, size_t offset, uint8_t *dest, size_t size)
+{
+    size_t copied = 0;
+    for(; seg < iov_count && copied < size; ++seg, offset = 0) {
+        size_t avail = iov[seg].iov_len - offset;
+        size_t n = avail < size - copied ? avail : size - copied;
+        memcpy(dest + copied, (const uint8_t*)iov[seg].iov_base + offset, n);
+        copied += n;
+    }
+    return copied;
+}
+
+// parses a mdat that straddles segments from its header alone, its payload is
+// handed over as the ranges of the segments it covers rather than copied.
+static void _bmff_iov_media_data(BMFFContext *ctx,
+                                 const struct iovec *iov,
+                                 int iov_count,
+                                 int seg,
+                                 size_t offset,
+                                 const uint8_t *header,
+                                 uint64_t box_size)
+{
+    if(bmff_context_alloc_stack_push(ctx) != BMFF_OK) {
+        _bmff_record_diagnostic(ctx, BMFF_RESOURCE_LIMIT, header+4);
+        CALLBACK(ctx, BMFFEventParseError, header+4, (void*)header);
+        return;
+    }
+
+    // events report the stream offset of the box from its header.
+    ctx->parse_data = header;
+    CALLBACK(ctx, BMFFEventParseStart, header+4, NULL);
+    _bmff_breadcrumb_push(ctx, header+4);
+
+    size_t header_size = parse_u32(header) == 1 ? 16 : 8;
+    MediaDataBox *box = NULL;
+    BMFFCode res = _bmff_parse_box_media_data(ctx, header, header_size, (Box**)&box);
+    if(res == BMFF_OK) {
+        if(box->box.size == 0) {
+            // the box runs to the end of the stream rather than of its header.
+            box->box.large_size = box_size;
+        }
+        box->data_len = (size_t)(box_size - header_size);
+
+        // find where the payload starts and count the segments it covers.
+        offset += header_size;
+        while(seg < iov_count && offset >= iov[seg].iov_len) {
+            offset -= iov[seg].iov_len;
+            seg++;
+        }
+        int count = 0;
+        size_t left = box->data_len;
+        int i = seg;
+        size_t start = offset;
+        for(; i < iov_count && left > 0; ++i, start = 0) {
+            size_t len = iov[i].iov_len - start;
+            if(len > 0) {
+                left -= len < left ? len : left;
+                count++;
+            }
+        }
+
+        struct iovec *ranges = count > 0 ? bmff_context_alloc_on_stack(ctx, sizeof(struct iovec) * count) : NULL;
+        if(count > 0 && !ranges) {
+            res = BMFF_RESOURCE_LIMIT;
+        }else{
+            left = box->data_len;
+            count = 0;
+            for(i = seg, start = offset; i < iov_count && left > 0; ++i, start = 0) {
+                size_t len = iov[i].iov_len - start;
+                if(len > left) {
+                    len = left;
+                }
+                if(len > 0) {
+                    ranges[count].iov_base = (uint8_t*)iov[i].iov_base + start;
+                    ranges[count].iov_len = len;
+                    left -= len;
+                    count++;
+                }
+            }
+            box->data = count == 1 ? (const uint8_t*)ranges[0].iov_base : NULL;
+            box->data_iov = count > 1 ? ranges : NULL;
+            box->data_iov_count = count > 1 ? count : 0;
+        }
+    }
+
+    _bmff_breadcrumb_pop(ctx);
+    if(res == BMFF_OK) {
+        // only the header is contiguous, the payload is never copied anyway.
+        ctx->detach_box = (Box*)box;
+        ctx->detach_data = header;
+        ctx->detach_size = header_size;
+        CALLBACK(ctx, BMFFEventParseComplete, header+4, (void*)box);
+    }else{
+        _bmff_record_diagnostic(ctx, res, header+4);
+        CALLBACK(ctx, BMFFEventParseError, header+4, (void*)header);
+    }
+
+    _bmff_flush_events(ctx);
+    bmff_context_alloc_stack_pop(ctx);
+    ctx->detach_box = NULL;
+    ctx->parse_offset += box_size;
+    ctx->parse_data = NULL;
+}
+
+size_t bmff_parse_iov(BMFFContext *ctx, const struct iovec *iov, int iov_count, BMFFCode *code)
+{
+    if(!code)                       return 0;
+    if(!ctx)                        { *code = BMFF_INVALID_CONTEXT; return 0; }
+    if(!iov || iov_count < 0)       { *code = BMFF_INVALID_DATA; return 0; }
+
+    size_t remaining = 0;
+    int seg = 0;
+    for(; seg < iov_count; ++seg) {
+        remaining += iov[seg].iov_len;
+    }
+
+    size_t consumed = 0;
+    size_t offset = 0;
+    *code = BMFF_OK;
+    seg = 0;
+    while(seg < iov_count && *code == BMFF_OK) {
+        const uint8_t *base = (const uint8_t*)iov[seg].iov_base + offset;
+        size_t avail = iov[seg].iov_len - offset;
+
+        // the boxes that lie entirely inside the segment.
+        size_t parsed = 0;
+        if(avail >= 8) {
+            // a box of size 0 runs past the segment when more data follows.
+            eBoolean end_of_stream = ctx->end_of_stream;
+            if(avail < remaining) {
+                ctx->end_of_stream = eBooleanFalse;
+            }
+            parsed = bmff_parse(ctx, base, avail, code);
+            ctx->end_of_stream = end_of_stream;
+            if(*code != BMFF_OK) {
+                consumed += parsed;
+                break;
+            }
+        }
+        consumed += parsed;
+        remaining -= parsed;
+        offset += parsed;
+        if(offset == iov[seg].iov_len) {
+            seg++;
+            offset = 0;
+            continue;
+        }
+
+        // the next box straddles the end of the segment.
+        uint8_t header[16];
+        size_t header_size = _bmff_iov_gather(iov, iov_count, seg, offset, header, 16);
+        if(header_size < 8) {
+            break;
+        }
+        uint64_t box_size = parse_u32(header);
+        if(box_size == 1) {
+            if(header_size < 16) {
+                break;
+            }
+            box_size = parse_box_size(header, header_size);
+        }else if(box_size == 0) {
+            if(ctx->end_of_stream != eBooleanTrue) {
+                break;
+            }
+            box_size = remaining;
+        }
+        if(box_size < 8 || box_size > remaining) {
+            if(box_size < 8) {
+                // bmff_parse reports the corrupt size.
+                bmff_parse(ctx, header, header_size, code);
+            }
+            break;
+        }
+
+        if(BOX_TYPE_IS(header+4, "mdat")) {
+            _bmff_iov_media_data(ctx, iov, iov_count, seg, offset, header, box_size);
+            consumed += (size_t)box_size;
+            remaining -= (size_t)box_size;
+        }else{
+            // other boxes are parsed from a copy, charged to the memory budget.
+            if(ctx->bounce_size < box_size) {
+                if(box_size - ctx->bounce_size > _bmff_memory_available(ctx)) {
+                    _bmff_record_diagnostic(ctx, BMFF_RESOURCE_LIMIT, header+4);
+                    *code = BMFF_RESOURCE_LIMIT;
+                    break;
+                }
+                uint8_t *bounce = _bmff_realloc(ctx, ctx->bounce, ctx->bounce_size, (size_t)box_size);
+                if(!bounce) {
+                    *code = BMFF_RESOURCE_LIMIT;
+                    break;
+                }
+                ctx->memory_used += (size_t)box_size - ctx->bounce_size;
+                ctx->bounce = bounce;
+                ctx->bounce_size = (size_t)box_size;
+            }
+            _bmff_iov_gather(iov, iov_count, seg, offset, ctx->bounce, (size_t)box_size);
+            parsed = bmff_parse(ctx, ctx->bounce, (size_t)box_size, code);
+            consumed += parsed;
+            remaining -= parsed;
+            if(parsed < box_size) {
+                break;
+            }
+        }
+
+        // step over the segments the box covered.
+        offset += (size_t)box_size;
+        while(seg < iov_count && offset >= iov[seg].iov_len) {
+            offset -= iov[seg].iov_len;
+            seg++;
+        }
+    }
+
+    return consumed;
+}
+
 BMFFCode bmff_parse_end(BMFFContext *ctx)
 {
+    if(!ctx) return BMFF_INVALID_CONTEXT;
+    _bmff_flush_events(ctx);
     return BMFF_OK;
 }
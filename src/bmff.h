@@ -27,11 +27,21 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 #include "boxes.h"
 
 // Software version, format MAJOR.MINOR.PATCH
 #define BMFF_VERSION                            "0.1.1"
-#define BMFF_BREADCRUMB_SIZE                    (50)
+// maximum number of box types tracked in the breadcrumb.
+#define BMFF_BREADCRUMB_DEPTH                   (16)
+// size of the formatted breadcrumb string, "type." per level.
+#define BMFF_BREADCRUMB_SIZE                    (BMFF_BREADCRUMB_DEPTH * 5)
+// number of parse errors retained by the context.
+#define BMFF_DIAGNOSTICS_SIZE                   (16)
+// alignment of the memory blocks the context allocates, enough for any box structure.
+#define BMFF_ALLOC_ALIGNMENT                    (16)
+// default maximum nesting depth of boxes.
+#define BMFF_DEFAULT_MAX_DEPTH                  (32)
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,8 +57,31 @@ typedef enum BMFFEventId {
     BMFFEventParserNotFound,
 } BMFFEventId;
 
+// bit of an event id in the event mask.
+#define BMFF_EVENT_MASK(id)                     (1u << (id))
+#define BMFF_EVENT_MASK_ALL                     (0xFFFFFFFFu)
+
+/**
+ * Event record used by batched event delivery.
+ */
+typedef struct BMFFEvent {
+    BMFFEventId id;
+    // box type.
+    uint8_t type[4];
+    // number of parent boxes.
+    uint32_t depth;
+    // offset of the box in the stream, counted across bmff_parse calls.
+    uint64_t offset;
+    // same as the data argument of the event callback.
+    void *data;
+} BMFFEvent;
+
 // forward declaration
 typedef struct BMFFContext BMFFContext;
+typedef struct BMFFInitSnapshot BMFFInitSnapshot;
+typedef struct BMFFTrackState BMFFTrackState;
+typedef struct BMFFMemo BMFFMemo;
+typedef struct BMFFParseFrame BMFFParseFrame;
 
 /**
  * Memory Allocator.
@@ -76,6 +109,26 @@ typedef void * (*bmff_realloc) (void *ptr, size_t size);
  */
 typedef void (*bmff_free) (void *mem);
 
+/**
+ * Memory Allocator with a state pointer.
+ * Every call receives the state, so a per thread pool, a slab allocator or a
+ * per request arena can be plugged in without globals. Only alloc is required.
+ */
+typedef struct BMFFAllocator {
+    // opaque state of the allocator, passed to every call.
+    void *state;
+    // allocates size bytes aligned to alignment, a power of 2.
+    void * (*alloc) (void *state, size_t size, size_t alignment);
+    // resizes a block of old_size bytes, keeping its contents. When NULL the
+    // block is allocated again and copied.
+    void * (*realloc) (void *state, void *ptr, size_t old_size, size_t size, size_t alignment);
+    // releases a block. When NULL blocks are only released by reset.
+    void (*free) (void *state, void *ptr);
+    // releases every block at once. Called by bmff_context_reset and
+    // bmff_context_destroy once the context holds no block anymore.
+    void (*reset) (void *state);
+} BMFFAllocator;
+
 /**
  * Parse Callback.
  */
@@ -85,6 +138,16 @@ typedef void (*bmff_on_event) (BMFFContext *ctx,
                                 void *data,
                                 void *user_data);
 
+/**
+ * Batched Events Callback.
+ * Receives the events queued since the last call. Box pointers in the events
+ * are valid for the duration of the call only.
+ */
+typedef void (*bmff_on_events) (BMFFContext *ctx,
+                                 const BMFFEvent *events,
+                                 uint32_t count,
+                                 void *user_data);
+
 /**
  * Return codes.
  */
@@ -94,8 +157,24 @@ typedef enum BMFFCode {
     BMFF_INVALID_DATA                       = 0x0002,
     BMFF_INVALID_SIZE                       = 0x0003,
     BMFF_INVALID_PARAMETER                  = 0x0004,
+    BMFF_RESOURCE_LIMIT                     = 0x0005,
+    BMFF_IO_ERROR                           = 0x0006,
+    BMFF_END_OF_DATA                        = 0x0007,
 } BMFFCode;
 
+/**
+ * Record of a box that failed to parse.
+ */
+typedef struct BMFFDiagnostic {
+    BMFFCode code;
+    // box type.
+    uint8_t type[4];
+    // number of parent boxes.
+    uint32_t depth;
+    // offset of the box in the stream, counted across bmff_parse calls.
+    uint64_t offset;
+} BMFFDiagnostic;
+
 /**
  * LinkList of pointers.
  */
@@ -103,6 +182,14 @@ typedef struct MemList {
     size_t *addresses;
     uint32_t count;
     uint32_t used;
+    // number of bytes allocated on this layer of the stack.
+    size_t bytes;
+    // scratch memory the allocations are carved from before falling back to malloc.
+    uint8_t *arena;
+    size_t arena_size;
+    size_t arena_used;
+    // bytes that did not fit in the arena, the arena grows by this when the layer is popped.
+    size_t overflow;
     struct MemList *next;
 } MemList;
 
@@ -129,14 +216,65 @@ typedef struct BMFFContext {
     uint32_t sample_description_version;
     // memory allocations stack (linked list)
     MemList *allocs_stack;
+    // popped layers kept with their arenas for reuse.
+    MemList *spare_stack;
     // default IV size set by the Track Encryption Box parser. Used by the Sample Encrpytion Box Parser.
     uint8_t default_iv_size;
     // indicates whether the default_iv_size is taken from the default_constant_iv_size from the Track Encryption Box parse.
     eBoolean is_constant_iv;
     // user data supplied in the callback
     void *callback_user_data;
-    // breadcrumb
+    // events that are delivered, one bit per BMFFEventId.
+    uint32_t event_mask;
+    // user specified callback that receives queued events in batches.
+    bmff_on_events batch_callback;
+    // user data supplied in the batch callback
+    void *batch_user_data;
+    // user supplied queue for batched events.
+    BMFFEvent *events;
+    uint32_t events_capacity;
+    uint32_t events_count;
+    // data passed to the active bmff_parse call.
+    const uint8_t *parse_data;
+    // number of bytes consumed by previous bmff_parse calls.
+    uint64_t parse_offset;
+    // maximum number of bytes the parsers may hold at any time, 0 for no limit.
+    size_t memory_limit;
+    // number of bytes currently allocated by the parsers.
+    size_t memory_used;
+    // breadcrumb of the parent box types, stored as their 4 raw type bytes.
+    uint32_t breadcrumb_path[BMFF_BREADCRUMB_DEPTH];
+    // number of boxes in the breadcrumb, may exceed BMFF_BREADCRUMB_DEPTH.
+    uint32_t breadcrumb_depth;
+    // set when the data passed to bmff_parse runs to the end of the stream.
+    eBoolean end_of_stream;
+    // formatted breadcrumb, only written by bmff_get_breadcrumb.
     char breadcrumb[BMFF_BREADCRUMB_SIZE];
+    // ring of the most recent parse errors.
+    BMFFDiagnostic diagnostics[BMFF_DIAGNOSTICS_SIZE];
+    // number of parse errors recorded since the last clear, may exceed BMFF_DIAGNOSTICS_SIZE.
+    uint32_t diagnostics_count;
+    // per track state of the init segment, shared read only between contexts.
+    const BMFFInitSnapshot *snapshot;
+    // state of the track of the last track fragment header, NULL without a snapshot.
+    const BMFFTrackState *track_state;
+    // cache of parsed boxes keyed by their bytes, NULL when not enabled.
+    BMFFMemo *memo;
+    // top level box whose events are delivered and the bytes it was parsed
+    // from, NULL once it is detached or released.
+    Box *detach_box;
+    const uint8_t *detach_data;
+    size_t detach_size;
+    // buffer bmff_parse_iov copies boxes that straddle two segments into.
+    uint8_t *bounce;
+    size_t bounce_size;
+    // maximum nesting depth of boxes, 0 for BMFF_DEFAULT_MAX_DEPTH.
+    uint32_t max_depth;
+    // stack of the generic containers being parsed, max_depth frames long.
+    BMFFParseFrame *frames;
+    uint32_t frame_count;
+    // allocator set by bmff_set_allocator, the functions above are used while its alloc is NULL.
+    BMFFAllocator allocator;
 } BMFFContext;
 
 const char *bmff_get_version(void);
@@ -151,32 +289,192 @@ BMFFCode bmff_context_init(BMFFContext *ctx);
  */
 BMFFCode bmff_context_destroy(BMFFContext *ctx);
 
+/**
+ * Prepares a context for parsing a new stream.
+ * The parse state is cleared while the callbacks, allocators, memory limit,
+ * attached init snapshot, memo cache and the warmed memory arenas are kept.
+ * With an allocator that has a reset function every allocation is dropped
+ * instead, the memo cache is emptied but stays enabled with the same types
+ * and budget.
+ * The boxes of a parse are released with their top level box, so once its
+ * arenas have grown to the largest top level box a reused context parses
+ * without calling malloc.
+ */
+BMFFCode bmff_context_reset(BMFFContext *ctx);
+
+/**
+ * Fixed size pool of reusable contexts.
+ * A pool is not thread-safe, use one pool per thread.
+ */
+typedef struct BMFFContextPool {
+    BMFFContext *contexts;
+    BMFFContext **available;
+    uint32_t size;
+    uint32_t available_count;
+} BMFFContextPool;
+
+/**
+ * Initializes a pool of size contexts.
+ */
+BMFFCode bmff_context_pool_init(BMFFContextPool *pool, uint32_t size);
+
+/**
+ * Destroys the pool and all of its contexts.
+ */
+BMFFCode bmff_context_pool_destroy(BMFFContextPool *pool);
+
+/**
+ * Takes a context from the pool.
+ *
+ * @return NULL when every context is in use.
+ */
+BMFFContext * bmff_context_pool_acquire(BMFFContextPool *pool);
+
+/**
+ * Resets a context and returns it to the pool.
+ */
+BMFFCode bmff_context_pool_release(BMFFContextPool *pool, BMFFContext *ctx);
+
 /**
  * Returns the breadcrumb of the parent box tpyes at any time during the parsing context.
  * 
  * @example
  * During parsing a "vmhd" box, the breadcrumb might be:
  *     "moov.trak.mdia.minf"
+ *
+ * The string is formatted from the box type path when this function is called.
  */
 const char * bmff_get_breadcrumb(BMFFContext *ctx);
 
+/**
+ * Returns the box types of the breadcrumb without formatting them as a string.
+ * Each entry holds the 4 type bytes of a parent box as they appear in the file,
+ * so it can be compared directly to a type loaded from memory, for example
+ * `memcmp(&path[0], "moov", 4) == 0`.
+ * The number of entries is written to depth; at most BMFF_BREADCRUMB_DEPTH
+ * entries are available.
+ */
+const uint32_t * bmff_get_breadcrumb_path(BMFFContext *ctx, uint32_t *depth);
+
+/**
+ * Copies the retained parse errors into the supplied array, oldest first.
+ * Only the last BMFF_DIAGNOSTICS_SIZE errors are retained; ctx->diagnostics_count
+ * holds the total number recorded.
+ *
+ * @return number of diagnostics copied.
+ */
+uint32_t bmff_get_diagnostics(BMFFContext *ctx, BMFFDiagnostic *diagnostics, uint32_t max);
+
+/**
+ * Discards all recorded parse errors.
+ */
+BMFFCode bmff_clear_diagnostics(BMFFContext *ctx);
+
 /**
  * Sets the parsing callback.
  * The user must set the callback to retreive Box information.
  */
 BMFFCode bmff_set_event_callback(BMFFContext *ctx, bmff_on_event callback, void *user_data);
 
+/**
+ * Sets the events that are delivered to the callbacks.
+ * The mask is a combination of BMFF_EVENT_MASK(id) values; events that are
+ * not in the mask are dropped before any callback is made.
+ * The default mask is BMFF_EVENT_MASK_ALL.
+ */
+BMFFCode bmff_set_event_mask(BMFFContext *ctx, uint32_t mask);
+
+/**
+ * Enables batched event delivery.
+ * Events are appended to the user supplied buffer and handed to the callback
+ * in bulk when the buffer is full, before the memory of a top level box is
+ * released, and at the end of bmff_parse. While batching is enabled the
+ * per event callback is not called.
+ * Passing a NULL buffer disables batching.
+ */
+BMFFCode bmff_set_event_batch(BMFFContext *ctx,
+                              BMFFEvent *buffer,
+                              uint32_t capacity,
+                              bmff_on_events callback,
+                              void *user_data);
+
+/**
+ * Marks whether the data passed to the following bmff_parse calls runs to the
+ * end of the stream. A top level box with a size of 0 extends to the end of the
+ * stream, so it is only parsed once this is set to eBooleanTrue.
+ */
+BMFFCode bmff_set_end_of_stream(BMFFContext *ctx, eBoolean end_of_stream);
+
+/**
+ * Sets the allocator of the context in place of its malloc, realloc and free
+ * functions. The memory the context holds is released first, the entries of
+ * the memo cache included, while the memo cache stays enabled with the same
+ * types and budget. Passing NULL goes back to the functions of the context.
+ *
+ * With a reset function the allocator can be a per request arena: every
+ * library allocation is dropped with one reset when bmff_context_reset is
+ * called at the end of the request. The context then keeps neither warm
+ * arenas nor memoized boxes across resets, its memo cache starts over empty
+ * with the same types and budget. Objects built from the context,
+ * such as sample indexes, frozen trees and sample iterators, use the same
+ * allocator and do not outlive a reset.
+ */
+BMFFCode bmff_set_allocator(BMFFContext *ctx, const BMFFAllocator *allocator);
+
+/**
+ * Sets the maximum nesting depth of boxes, top level boxes are at depth 1.
+ * A box nested deeper fails to parse with BMFF_RESOURCE_LIMIT. Generic
+ * containers are walked with a stack of the context rather than by recursion,
+ * so the call stack used by a parse stays small whatever the limit is.
+ * A depth of 0 restores BMFF_DEFAULT_MAX_DEPTH. Must not be called during a parse.
+ */
+BMFFCode bmff_set_max_depth(BMFFContext *ctx, uint32_t depth);
+
+/**
+ * Sets the memory budget of the context.
+ * Box allocations that would take the context over the limit fail, and the
+ * parser reports BMFF_RESOURCE_LIMIT for the box. The memory of a top level
+ * box, and of the boxes inside it, is released once its events are delivered,
+ * so the budget bounds the largest top level box rather than the whole stream.
+ * A limit of 0 disables the budget.
+ */
+BMFFCode bmff_set_memory_limit(BMFFContext *ctx, size_t limit);
+
 /**
  * Parses ISO BMFF boxes.
  * The data must contain complete boxes, but does not need to contain a full file.
+ * The boxes handed to the callbacks are released once the events of their top
+ * level box are delivered.
+ *
+ * @return number of bytes consumed, 0 when the arguments are invalid.
  */
 size_t bmff_parse(BMFFContext *ctx, const uint8_t *data, size_t size, BMFFCode *code);
 
+/**
+ * Parses ISO BMFF boxes from a chain of buffers, as if they were one.
+ * Boxes inside a single buffer are parsed in place. A mdat that straddles two
+ * or more buffers is not copied, its payload is listed by the data_iov ranges
+ * of the MediaDataBox. Any other box that straddles buffers is copied into a
+ * bounce buffer of the context, which is charged to the memory limit and
+ * reused by the next straddling box; code is set to BMFF_RESOURCE_LIMIT when
+ * the box does not fit. As with bmff_parse the parsed boxes are only valid for
+ * the duration of their events.
+ *
+ * @return number of bytes consumed across all buffers.
+ */
+size_t bmff_parse_iov(BMFFContext *ctx, const struct iovec *iov, int iov_count, BMFFCode *code);
+
 /**
  * This needs to be called to end a parsing session.
  */
 BMFFCode bmff_parse_end(BMFFContext *ctx);
 
+/**
+ * Returns the size of a parsed box in bytes, resolving the 64 bit largesize
+ * and the size 0 (to the end of the enclosing data) forms.
+ */
+uint64_t bmff_get_box_size(const Box *box);
+
 #ifdef __cplusplus
 }
 #endif
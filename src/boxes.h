@@ -26,6 +26,7 @@
 #define BOXES_H
 
 #include <stdint.h>
+#include <sys/uio.h>
 #include "descriptors.h"
 
 #ifdef __cplusplus
@@ -64,7 +65,8 @@ typedef enum {
 typedef struct Box {
     uint32_t        size;
     uint8_t         type[4];
-    size_t          large_size;
+    // 64 bit size when size is 1, or the bytes to the end of the enclosing data when size is 0.
+    uint64_t        large_size;
     const uint8_t   *user_type;
 } Box;
 
@@ -72,7 +74,8 @@ typedef struct FullBox {
     // Box
     uint32_t        size;
     uint8_t         type[4];
-    size_t          large_size;
+    // 64 bit size when size is 1, or the bytes to the end of the enclosing data when size is 0.
+    uint64_t        large_size;
     const uint8_t   *user_type;
     // FullBox items
     uint8_t     version;
@@ -151,9 +154,13 @@ typedef struct ProgressiveDownloadBox { // pdin
 } ProgressiveDownloadBox;
 
 typedef struct MediaDataBox { // mdat
-    Box             box;
-    const uint8_t   *data;
-    size_t          data_len;
+    Box                 box;
+    // NULL when bmff_parse_iov finds the payload split across its buffers,
+    // which data_iov then lists in order.
+    const uint8_t       *data;
+    size_t              data_len;
+    const struct iovec  *data_iov;
+    int                 data_iov_count;
 } MediaDataBox;
 
 typedef struct HandlerBox { // hdlr
@@ -1101,7 +1108,8 @@ typedef struct EventMessageBox { // emsg
     const char              *scheme_id_uri;
     const char              *value;
     uint32_t                timescale;
-    uint32_t                presentation_time_delta;
+    uint32_t                presentation_time_delta; // version 0
+    uint64_t                presentation_time; // version 1
     uint32_t                event_duration;
     uint32_t                id;
     const uint8_t           *message_data;
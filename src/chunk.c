@@ -0,0 +1,378 @@
+#include <string.h>
+#include <time.h>
+
+#include "chunk.h"
+#include "context.h"
+#include "snapshot.h"
+
+#define BOX_TYPE_IS(d,t) ((d)[0]==(t)[0] && (d)[1]==(t)[1] && (d)[2]==(t)[2] && (d)[3]==(t)[3])
+
+static uint64_t _bmff_monotonic_clock(void *user_data)
+{
+    (void)user_data;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// stream offset of a pointer into the data of the active bmff_parse call.
+static uint64_t _bmff_stream_offset(BMFFContext *ctx, const uint8_t *ptr)
+{
+    return ctx->parse_offset + (ptr - ctx->parse_data);
+}
+
+static void _bmff_latency_add(BMFFLatencyHistogram *histogram, uint64_t latency)
+{
+    uint32_t bucket = 0;
+    uint64_t value = latency;
+    while(value > 0 && bucket < BMFF_LATENCY_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->total += latency;
+    if(latency > histogram->max) {
+        histogram->max = latency;
+    }
+}
+
+static void _bmff_chunk_track_extends(BMFFChunkIngest *ingest, const TrackExtendsBox *trex)
+{
+    uint32_t i = 0;
+    for(; i < ingest->track_count; ++i) {
+        if(ingest->tracks[i].track_id == trex->track_id) {
+            break;
+        }
+    }
+    if(i == BMFF_CHUNK_MAX_TRACKS) {
+        return;
+    }
+    if(i == ingest->track_count) {
+        ingest->track_count++;
+    }
+    ingest->tracks[i].track_id = trex->track_id;
+    ingest->tracks[i].default_sample_duration = trex->default_sample_duration;
+    ingest->tracks[i].default_sample_size = trex->default_sample_size;
+}
+
+static void _bmff_chunk_fragment_header(BMFFChunkIngest *ingest, const TrackFragmentHeaderBox *tfhd)
+{
+    uint32_t flags = tfhd->box.flags;
+    ingest->track_id = tfhd->track_id;
+    ingest->tfhd_flags = flags;
+    ingest->decode_time = 0;
+
+    // CMAF fragments use the moof as the base unless an explicit offset is given.
+    if((flags & eTfhdBaseDataOffsetPresent) == eTfhdBaseDataOffsetPresent) {
+        ingest->base_offset = tfhd->base_data_offset;
+    }else{
+        ingest->base_offset = ingest->chunk.offset;
+    }
+    ingest->next_offset = ingest->base_offset;
+
+    // the track fragment defaults override the ones from the init segment, which
+    // are taken from the snapshot attached to the context when there is one.
+    const BMFFTrackState *track = ingest->ctx->track_state;
+    if(track && track->track_id == tfhd->track_id) {
+        ingest->default_sample_duration = track->default_sample_duration;
+        ingest->default_sample_size = track->default_sample_size;
+    }else{
+        ingest->default_sample_duration = 0;
+        ingest->default_sample_size = 0;
+        uint32_t i = 0;
+        for(; i < ingest->track_count; ++i) {
+            if(ingest->tracks[i].track_id == tfhd->track_id) {
+                ingest->default_sample_duration = ingest->tracks[i].default_sample_duration;
+                ingest->default_sample_size = ingest->tracks[i].default_sample_size;
+                break;
+            }
+        }
+    }
+    if((flags & eTfhdDefaultSampleDurationPresent) == eTfhdDefaultSampleDurationPresent) {
+        ingest->default_sample_duration = tfhd->default_sample_duration;
+    }
+    if((flags & eTfhdDefaultSampleSizePresent) == eTfhdDefaultSampleSizePresent) {
+        ingest->default_sample_size = tfhd->default_sample_size;
+    }
+    ingest->default_sample_flags = (flags & eTfhdDefaultSampleFlagsPresent) == eTfhdDefaultSampleFlagsPresent ?
+                                   tfhd->default_sample_flags : 0;
+}
+
+static BMFFCode _bmff_chunk_track_run(BMFFChunkIngest *ingest, const TrackRunBox *trun)
+{
+    BMFFContext *ctx = ingest->ctx;
+    uint32_t flags = trun->box.flags;
+
+    uint32_t needed = ingest->chunk.sample_count + trun->sample_count;
+    if(needed < ingest->chunk.sample_count) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    if(needed > ingest->samples_capacity) {
+        uint32_t capacity = ingest->samples_capacity > 0 ? ingest->samples_capacity : 64;
+        while(capacity < needed) {
+            capacity *= 2;
+        }
+        BMFFChunkSample *samples = _bmff_realloc(ctx, ingest->samples, sizeof(BMFFChunkSample) * ingest->samples_capacity,
+                                                  sizeof(BMFFChunkSample) * capacity);
+        if(!samples) {
+            return BMFF_RESOURCE_LIMIT;
+        }
+        ingest->samples = samples;
+        ingest->samples_capacity = capacity;
+    }
+
+    uint64_t offset = ingest->next_offset;
+    if((flags & eTrunDataOffsetPresent) == eTrunDataOffsetPresent) {
+        offset = ingest->base_offset + (int64_t)trun->data_offset;
+    }
+
+    uint32_t i = 0;
+    for(; i < trun->sample_count; ++i) {
+        const TrackRunSample *run_sample = &trun->samples[i];
+        BMFFChunkSample *sample = &ingest->samples[ingest->chunk.sample_count++];
+
+        sample->track_id = ingest->track_id;
+        sample->data = NULL;
+        sample->offset = offset;
+        sample->size = (flags & eTrunSampleSizePresent) == eTrunSampleSizePresent ?
+                       run_sample->size : ingest->default_sample_size;
+        sample->duration = (flags & eTrunSampleDurationPresent) == eTrunSampleDurationPresent ?
+                           run_sample->duration : ingest->default_sample_duration;
+        if((flags & eTrunSampleFlagsPresent) == eTrunSampleFlagsPresent) {
+            sample->flags = run_sample->flags;
+        }else if(i == 0 && (flags & eTrunFirstSampleFlagsPresent) == eTrunFirstSampleFlagsPresent) {
+            sample->flags = trun->first_sample_flags;
+        }else{
+            sample->flags = ingest->default_sample_flags;
+        }
+        sample->composition_time_offset = (flags & eTrunSampleCompTimeOffsetsPresent) == eTrunSampleCompTimeOffsetsPresent ?
+                                          run_sample->composition_time_offset : 0;
+        sample->decode_time = ingest->decode_time;
+
+        offset += sample->size;
+        ingest->decode_time += sample->duration;
+    }
+    ingest->next_offset = offset;
+
+    return BMFF_OK;
+}
+
+static void _bmff_chunk_ready(BMFFChunkIngest *ingest, const MediaDataBox *mdat)
+{
+    BMFFContext *ctx = ingest->ctx;
+
+    // resolve the sample offsets against the payload of the mdat.
+    uint64_t data_offset = _bmff_stream_offset(ctx, mdat->data);
+    uint64_t data_end = data_offset + mdat->data_len;
+    uint32_t i = 0;
+    for(; i < ingest->chunk.sample_count; ++i) {
+        BMFFChunkSample *sample = &ingest->samples[i];
+        if(sample->offset >= data_offset && sample->offset + sample->size <= data_end) {
+            sample->data = mdat->data + (sample->offset - data_offset);
+        }
+    }
+
+    ingest->chunk.mdat = mdat;
+    ingest->chunk.samples = ingest->samples;
+    ingest->chunk.latency = ingest->clock(ingest->clock_user_data) - ingest->start_time;
+    _bmff_latency_add(&ingest->latency, ingest->chunk.latency);
+
+    if(ingest->callback) {
+        ingest->callback(ingest, &ingest->chunk, ingest->callback_user_data);
+    }
+    ingest->in_chunk = eBooleanFalse;
+}
+
+static void _bmff_chunk_on_event(BMFFContext *ctx,
+                                 BMFFEventId id,
+                                 const uint8_t *fourCC,
+                                 void *data,
+                                 void *user_data)
+{
+    BMFFChunkIngest *ingest = (BMFFChunkIngest*)user_data;
+    if(ingest->event_callback) {
+        ingest->event_callback(ctx, id, fourCC, data, ingest->event_user_data);
+    }
+
+    if(id == BMFFEventParseStart) {
+        if(ctx->breadcrumb_depth == 0 && BOX_TYPE_IS(fourCC, "moof")) {
+            const uint8_t *moof = fourCC - 4;
+            memset(&ingest->chunk, 0, sizeof(BMFFChunk));
+            ingest->chunk.offset = _bmff_stream_offset(ctx, moof);
+            // a moof at the start of the buffer may have started arriving in an earlier push.
+            ingest->start_time = moof == ctx->parse_data ? ingest->head_time : ingest->push_time;
+            ingest->in_chunk = eBooleanTrue;
+        }
+        return;
+    }
+
+    if(id != BMFFEventParseComplete) {
+        return;
+    }
+
+    if(BOX_TYPE_IS(fourCC, "trex")) {
+        _bmff_chunk_track_extends(ingest, (const TrackExtendsBox*)data);
+    }else if(ingest->in_chunk != eBooleanTrue) {
+        return;
+    }else if(BOX_TYPE_IS(fourCC, "mfhd")) {
+        ingest->chunk.sequence_number = ((const MovieFragmentHeaderBox*)data)->sequence_number;
+    }else if(BOX_TYPE_IS(fourCC, "tfhd")) {
+        _bmff_chunk_fragment_header(ingest, (const TrackFragmentHeaderBox*)data);
+    }else if(BOX_TYPE_IS(fourCC, "tfdt")) {
+        ingest->decode_time = ((const TrackFragmentDecodeTimeBox*)data)->base_media_decode_time;
+    }else if(BOX_TYPE_IS(fourCC, "trun")) {
+        BMFFCode res = _bmff_chunk_track_run(ingest, (const TrackRunBox*)data);
+        if(res != BMFF_OK) {
+            // the chunk can not be delivered without all of its samples.
+            _bmff_record_diagnostic(ctx, res, fourCC);
+            ingest->in_chunk = eBooleanFalse;
+        }
+    }else if(BOX_TYPE_IS(fourCC, "mdat") && ctx->breadcrumb_depth == 0) {
+        _bmff_chunk_ready(ingest, (const MediaDataBox*)data);
+    }
+}
+
+// grows the buffer to hold needed bytes, charged to the memory budget of the
+// context as the size announced by a corrupt box can not be trusted.
+static BMFFCode _bmff_chunk_grow(BMFFChunkIngest *ingest, size_t needed)
+{
+    BMFFContext *ctx = ingest->ctx;
+    size_t buffer_size = ingest->buffer_size > 0 ? ingest->buffer_size : 4096;
+    while(buffer_size < needed && buffer_size * 2 > buffer_size) {
+        buffer_size *= 2;
+    }
+    if(buffer_size < needed) {
+        buffer_size = needed;
+    }
+
+    size_t available = _bmff_memory_available(ctx);
+    if(buffer_size - ingest->buffer_size > available) {
+        // a smaller buffer may still fit.
+        buffer_size = needed;
+        if(buffer_size - ingest->buffer_size > available) {
+            return BMFF_RESOURCE_LIMIT;
+        }
+    }
+
+    uint8_t *buffer = _bmff_realloc(ctx, ingest->buffer, ingest->buffer_size, buffer_size);
+    if(!buffer) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    ctx->memory_used += buffer_size - ingest->buffer_size;
+    ingest->buffer = buffer;
+    ingest->buffer_size = buffer_size;
+    return BMFF_OK;
+}
+
+BMFFCode bmff_chunk_ingest_init(BMFFChunkIngest *ingest,
+                                BMFFContext *ctx,
+                                bmff_on_chunk callback,
+                                void *user_data)
+{
+    if(!ingest)     return BMFF_INVALID_PARAMETER;
+    if(!ctx)        return BMFF_INVALID_CONTEXT;
+    if(ctx->events) return BMFF_INVALID_PARAMETER;
+
+    memset(ingest, 0, sizeof(BMFFChunkIngest));
+    ingest->ctx = ctx;
+    ingest->callback = callback;
+    ingest->callback_user_data = user_data;
+    ingest->event_callback = ctx->callback;
+    ingest->event_user_data = ctx->callback_user_data;
+    ingest->clock = _bmff_monotonic_clock;
+    ingest->in_chunk = eBooleanFalse;
+
+    return bmff_set_event_callback(ctx, _bmff_chunk_on_event, ingest);
+}
+
+BMFFCode bmff_chunk_ingest_destroy(BMFFChunkIngest *ingest)
+{
+    if(!ingest)         return BMFF_INVALID_PARAMETER;
+    if(!ingest->ctx)    return BMFF_INVALID_CONTEXT;
+
+    BMFFContext *ctx = ingest->ctx;
+    bmff_set_event_callback(ctx, ingest->event_callback, ingest->event_user_data);
+    _bmff_free(ctx, ingest->buffer);
+    ctx->memory_used -= ingest->buffer_size;
+    _bmff_free(ctx, ingest->samples);
+    memset(ingest, 0, sizeof(BMFFChunkIngest));
+
+    return BMFF_OK;
+}
+
+BMFFCode bmff_chunk_ingest_set_clock(BMFFChunkIngest *ingest, bmff_clock clock, void *user_data)
+{
+    if(!ingest) return BMFF_INVALID_PARAMETER;
+    ingest->clock = clock ? clock : _bmff_monotonic_clock;
+    ingest->clock_user_data = user_data;
+    return BMFF_OK;
+}
+
+BMFFCode bmff_chunk_ingest_push(BMFFChunkIngest *ingest, const uint8_t *data, size_t size)
+{
+    if(!ingest)         return BMFF_INVALID_PARAMETER;
+    if(!ingest->ctx)    return BMFF_INVALID_CONTEXT;
+    if(!data)           return BMFF_INVALID_DATA;
+
+    BMFFContext *ctx = ingest->ctx;
+    ingest->push_time = ingest->clock(ingest->clock_user_data);
+    if(ingest->buffer_used == 0) {
+        ingest->head_time = ingest->push_time;
+    }
+
+    // append the data to the unparsed bytes.
+    if(ingest->buffer_used + size < size) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    if(ingest->buffer_used + size > ingest->buffer_size) {
+        BMFFCode res = _bmff_chunk_grow(ingest, ingest->buffer_used + size);
+        if(res != BMFF_OK) {
+            return res;
+        }
+    }
+    memcpy(ingest->buffer + ingest->buffer_used, data, size);
+    ingest->buffer_used += size;
+
+    BMFFCode res = BMFF_OK;
+    size_t parsed = bmff_parse(ctx, ingest->buffer, ingest->buffer_used, &res);
+    if(parsed > 0) {
+        // the first incomplete box always starts in the bytes of this push.
+        ingest->buffer_used -= parsed;
+        memmove(ingest->buffer, ingest->buffer + parsed, ingest->buffer_used);
+        ingest->head_time = ingest->push_time;
+    }
+
+    // not enough data to parse anything yet.
+    if(res == BMFF_INVALID_SIZE && parsed == 0 && ingest->buffer_used < 8) {
+        res = BMFF_OK;
+    }
+    return res;
+}
+
+const BMFFLatencyHistogram * bmff_chunk_ingest_get_latency(BMFFChunkIngest *ingest)
+{
+    return ingest ? &ingest->latency : NULL;
+}
+
+uint64_t bmff_latency_percentile(const BMFFLatencyHistogram *histogram, uint32_t percentile)
+{
+    if(!histogram || histogram->count == 0) return 0;
+    if(percentile > 100) percentile = 100;
+
+    uint64_t target = (histogram->count * percentile + 99) / 100;
+    if(target == 0) target = 1;
+
+    uint64_t seen = 0;
+    uint32_t i = 0;
+    for(; i < BMFF_LATENCY_BUCKETS; ++i) {
+        seen += histogram->buckets[i];
+        if(seen >= target) {
+            break;
+        }
+    }
+    if(i == 0) return 0;
+    // the last bucket is open ended.
+    if(i >= BMFF_LATENCY_BUCKETS - 1) return histogram->max;
+    return (uint64_t)1 << i;
+}
@@ -0,0 +1,192 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// number of tracks whose trex defaults are kept by the chunk ingest.
+#define BMFF_CHUNK_MAX_TRACKS                   (16)
+// number of log2 buckets in the latency histogram.
+#define BMFF_LATENCY_BUCKETS                    (32)
+
+/**
+ * Sample of a CMAF chunk.
+ */
+typedef struct BMFFChunkSample {
+    uint32_t        track_id;
+    // payload of the sample inside the mdat, NULL if it lies outside the mdat.
+    const uint8_t   *data;
+    // offset of the payload in the stream.
+    uint64_t        offset;
+    uint32_t        size;
+    uint32_t        duration;
+    uint32_t        flags;
+    int64_t         composition_time_offset;
+    uint64_t        decode_time;
+} BMFFChunkSample;
+
+/**
+ * A moof and the mdat that follows it.
+ */
+typedef struct BMFFChunk {
+    uint32_t                sequence_number;
+    // offset of the moof in the stream.
+    uint64_t                offset;
+    const MediaDataBox      *mdat;
+    uint32_t                sample_count;
+    const BMFFChunkSample   *samples;
+    // microseconds from the first byte of the chunk to the chunk being ready.
+    uint64_t                latency;
+} BMFFChunk;
+
+/**
+ * Histogram of chunk latencies.
+ * Bucket 0 counts latencies of 0us, bucket i counts latencies in [2^(i-1), 2^i)us.
+ */
+typedef struct BMFFLatencyHistogram {
+    uint64_t    buckets[BMFF_LATENCY_BUCKETS];
+    uint64_t    count;
+    uint64_t    total;
+    uint64_t    max;
+} BMFFLatencyHistogram;
+
+// forward declaration
+typedef struct BMFFChunkIngest BMFFChunkIngest;
+
+/**
+ * Chunk Ready Callback.
+ * The chunk and the sample payloads are valid for the duration of the call only.
+ */
+typedef void (*bmff_on_chunk) (BMFFChunkIngest *ingest,
+                               const BMFFChunk *chunk,
+                               void *user_data);
+
+/**
+ * Clock used to time chunks, in microseconds.
+ */
+typedef uint64_t (*bmff_clock) (void *user_data);
+
+typedef struct BMFFChunkTrack {
+    uint32_t    track_id;
+    uint32_t    default_sample_duration;
+    uint32_t    default_sample_size;
+} BMFFChunkTrack;
+
+/**
+ * Chunk ingest state.
+ */
+typedef struct BMFFChunkIngest {
+    BMFFContext         *ctx;
+    // user specified callback for ready chunks.
+    bmff_on_chunk       callback;
+    void                *callback_user_data;
+    // event callback of the context before the ingest was attached.
+    bmff_on_event       event_callback;
+    void                *event_user_data;
+    // clock used to time the chunks.
+    bmff_clock          clock;
+    void                *clock_user_data;
+    // bytes received but not yet parsed.
+    uint8_t             *buffer;
+    size_t              buffer_size;
+    size_t              buffer_used;
+    // trex defaults from the init segment.
+    BMFFChunkTrack      tracks[BMFF_CHUNK_MAX_TRACKS];
+    uint32_t            track_count;
+    // arrival time of the first unparsed byte, and of the bytes of the current push.
+    uint64_t            head_time;
+    uint64_t            push_time;
+    // chunk being assembled.
+    eBoolean            in_chunk;
+    uint64_t            start_time;
+    BMFFChunk           chunk;
+    BMFFChunkSample     *samples;
+    uint32_t            samples_capacity;
+    // state of the current track fragment.
+    uint32_t            track_id;
+    uint32_t            tfhd_flags;
+    uint64_t            base_offset;
+    uint64_t            next_offset;
+    uint64_t            decode_time;
+    uint32_t            default_sample_duration;
+    uint32_t            default_sample_size;
+    uint32_t            default_sample_flags;
+    // latencies of all chunks delivered so far.
+    BMFFLatencyHistogram latency;
+} BMFFChunkIngest;
+
+/**
+ * Attaches a chunk ingest to an initialized context.
+ * The ingest takes over the event callback of the context and forwards every
+ * event to the callback that was set before. Batched event delivery must not
+ * be enabled on the context.
+ */
+BMFFCode bmff_chunk_ingest_init(BMFFChunkIngest *ingest,
+                                BMFFContext *ctx,
+                                bmff_on_chunk callback,
+                                void *user_data);
+
+/**
+ * Detaches the ingest from its context and frees its buffers.
+ */
+BMFFCode bmff_chunk_ingest_destroy(BMFFChunkIngest *ingest);
+
+/**
+ * Sets the clock used for the chunk latencies. The default is the monotonic clock.
+ */
+BMFFCode bmff_chunk_ingest_set_clock(BMFFChunkIngest *ingest, bmff_clock clock, void *user_data);
+
+/**
+ * Appends received bytes and parses every box that is complete.
+ * The chunk callback is called as soon as the mdat following a moof is complete.
+ * The buffer of the unparsed bytes is charged to the memory limit of the context.
+ *
+ * @return BMFF_RESOURCE_LIMIT when the bytes do not fit the memory limit, in which case they are dropped.
+ */
+BMFFCode bmff_chunk_ingest_push(BMFFChunkIngest *ingest, const uint8_t *data, size_t size);
+
+/**
+ * Returns the histogram of the chunk latencies.
+ */
+const BMFFLatencyHistogram * bmff_chunk_ingest_get_latency(BMFFChunkIngest *ingest);
+
+/**
+ * Returns the upper bound in microseconds of the bucket holding the given
+ * percentile, in the range 0-100.
+ */
+uint64_t bmff_latency_percentile(const BMFFLatencyHistogram *histogram, uint32_t percentile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CHUNK_H
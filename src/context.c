@@ -1,44 +1,205 @@
 #include "context.h"
 #include <string.h>
-#include <stdio.h>
+#include "snapshot.h"
+#include "parse_common.h"
+#include "memo.h"
 
-void bmff_context_alloc_stack_push(BMFFContext *ctx)
+// arenas grow in whole pages.
+#define ARENA_ROUND(n) (((n) + 4095) & ~((size_t)4095))
+// allocations from an arena are aligned for any box structure.
+#define ARENA_ALIGN(n) (((n) + 15) & ~((size_t)15))
+// arenas start on a cache line when the allocator supports alignment.
+#define ARENA_ALIGNMENT (64)
+
+void * _bmff_malloc_aligned(BMFFContext *ctx, size_t size, size_t alignment)
 {
-    if(ctx) {
-        MemList *new_list = (MemList*) ctx->malloc(sizeof(MemList));
+    if(ctx->allocator.alloc) {
+        return ctx->allocator.alloc(ctx->allocator.state, size, alignment);
+    }
+    return ctx->malloc(size);
+}
+
+void * _bmff_malloc(BMFFContext *ctx, size_t size)
+{
+    return _bmff_malloc_aligned(ctx, size, BMFF_ALLOC_ALIGNMENT);
+}
+
+void * _bmff_allocator_realloc(const BMFFAllocator *allocator, bmff_realloc realloc_func,
+                               void *ptr, size_t old_size, size_t size)
+{
+    if(!allocator->alloc) {
+        return realloc_func(ptr, size);
+    }
+    if(allocator->realloc) {
+        return allocator->realloc(allocator->state, ptr, old_size, size, BMFF_ALLOC_ALIGNMENT);
+    }
+    void *mem = allocator->alloc(allocator->state, size, BMFF_ALLOC_ALIGNMENT);
+    if(mem && ptr) {
+        memcpy(mem, ptr, old_size < size ? old_size : size);
+        if(allocator->free) {
+            allocator->free(allocator->state, ptr);
+        }
+    }
+    return mem;
+}
+
+void * _bmff_realloc(BMFFContext *ctx, void *ptr, size_t old_size, size_t size)
+{
+    return _bmff_allocator_realloc(&ctx->allocator, ctx->realloc, ptr, old_size, size);
+}
+
+void _bmff_allocator_free(const BMFFAllocator *allocator, bmff_free free_func, void *ptr)
+{
+    if(!ptr) {
+        return;
+    }
+    if(!allocator->alloc) {
+        free_func(ptr);
+    }else if(allocator->free) {
+        allocator->free(allocator->state, ptr);
+    }
+}
+
+void _bmff_free(BMFFContext *ctx, void *ptr)
+{
+    _bmff_allocator_free(&ctx->allocator, ctx->free, ptr);
+}
+
+void _bmff_context_release_memory(BMFFContext *ctx)
+{
+    bmff_memo_disable(ctx);
+    bmff_context_release_stack(ctx);
+    _bmff_free(ctx, ctx->frames);
+    ctx->frames = NULL;
+    ctx->frame_count = 0;
+    _bmff_free(ctx, ctx->bounce);
+    ctx->memory_used -= ctx->bounce_size;
+    ctx->bounce = NULL;
+    ctx->bounce_size = 0;
+}
+
+size_t _bmff_memory_available(const BMFFContext *ctx)
+{
+    if(ctx->memory_limit == 0) {
+        return SIZE_MAX;
+    }
+    return ctx->memory_used < ctx->memory_limit ? ctx->memory_limit - ctx->memory_used : 0;
+}
+
+BMFFCode bmff_context_alloc_stack_push(BMFFContext *ctx)
+{
+    if(!ctx) return BMFF_INVALID_CONTEXT;
+
+    // reuse a popped layer with its arena when there is one.
+    MemList *new_list = ctx->spare_stack;
+    if(new_list) {
+        ctx->spare_stack = new_list->next;
+    }else{
+        new_list = (MemList*) _bmff_malloc(ctx, sizeof(MemList));
+        if(!new_list) {
+            return BMFF_RESOURCE_LIMIT;
+        }
+        memset(new_list, 0, sizeof(MemList));
         new_list->count = 8;
-        new_list->addresses = (size_t*) ctx->malloc(sizeof(size_t) * new_list->count);
-        new_list->used = 0;
-        new_list->next = ctx->allocs_stack;
-        ctx->allocs_stack = new_list;
+        new_list->addresses = (size_t*) _bmff_malloc(ctx, sizeof(size_t) * new_list->count);
+        if(!new_list->addresses) {
+            _bmff_free(ctx, new_list);
+            return BMFF_RESOURCE_LIMIT;
+        }
     }
+    new_list->next = ctx->allocs_stack;
+    ctx->allocs_stack = new_list;
+    return BMFF_OK;
 }
 
 void bmff_context_alloc_stack_pop(BMFFContext *ctx) {
     if(ctx && ctx->allocs_stack) {
         MemList *old_list = ctx->allocs_stack;
         ctx->allocs_stack = ctx->allocs_stack->next;
+        ctx->memory_used -= old_list->bytes;
 
         uint32_t i=old_list->used;
         for(; i > 0; --i) {
-            ctx->free((void*)old_list->addresses[i-1]);
+            _bmff_free(ctx, (void*)old_list->addresses[i-1]);
+        }
+        old_list->used = 0;
+        old_list->bytes = 0;
+
+        // grow the arena so the same amount of allocations fit in it next time.
+        size_t wanted = old_list->arena_used + old_list->overflow;
+        if(wanted > old_list->arena_size) {
+            BMFF_TRACE_ARENA_GROW(old_list->arena_size, ARENA_ROUND(wanted));
+            _bmff_free(ctx, old_list->arena);
+            old_list->arena_size = ARENA_ROUND(wanted);
+            old_list->arena = _bmff_malloc_aligned(ctx, old_list->arena_size, ARENA_ALIGNMENT);
+            if(!old_list->arena) {
+                old_list->arena_size = 0;
+            }
+        }
+        old_list->arena_used = 0;
+        old_list->overflow = 0;
+
+        old_list->next = ctx->spare_stack;
+        ctx->spare_stack = old_list;
+    }
+}
+
+void bmff_context_release_stack(BMFFContext *ctx)
+{
+    if(ctx) {
+        while(ctx->allocs_stack) {
+            bmff_context_alloc_stack_pop(ctx);
+        }
+        while(ctx->spare_stack) {
+            MemList *list = ctx->spare_stack;
+            ctx->spare_stack = list->next;
+            _bmff_free(ctx, list->arena);
+            _bmff_free(ctx, list->addresses);
+            _bmff_free(ctx, list);
         }
-        ctx->free(old_list->addresses);
-        ctx->free(old_list);
     }
 }
 
 void * bmff_context_alloc_on_stack(BMFFContext *ctx, size_t size)
 {
     if(ctx) {
-        void *mem = ctx->malloc(size);
+        // enforce the memory budget before touching the allocator.
+        if(ctx->memory_limit > 0 &&
+           (ctx->memory_used > ctx->memory_limit || size > ctx->memory_limit - ctx->memory_used)) {
+            return NULL;
+        }
+
+        MemList *layer = ctx->allocs_stack;
+        if(layer) {
+            size_t aligned = ARENA_ALIGN(size);
+            if(aligned >= size && layer->arena_size - layer->arena_used >= aligned) {
+                void *mem = layer->arena + layer->arena_used;
+                layer->arena_used += aligned;
+                layer->bytes += size;
+                ctx->memory_used += size;
+                return mem;
+            }
+            layer->overflow += aligned;
+        }
+
+        void *mem = _bmff_malloc(ctx, size);
+        if(!mem) {
+            return NULL;
+        }
+        ctx->memory_used += size;
 
         if(ctx->allocs_stack) {
             // extend address space so we can add it to the stack.
             if(ctx->allocs_stack->used == ctx->allocs_stack->count) {
                 // extend address space so we can add it to the stack.
                 uint32_t new_count = ctx->allocs_stack->count + 8;
-                size_t *new_addresses = ctx->malloc(sizeof(size_t) * new_count);
+                size_t *new_addresses = _bmff_malloc(ctx, sizeof(size_t) * new_count);
+                if(!new_addresses) {
+                    // the block could not be released with the layer.
+                    ctx->memory_used -= size;
+                    _bmff_free(ctx, mem);
+                    return NULL;
+                }
                 // copy old addresses into new list
                 uint32_t i=0;
                 for(; i < ctx->allocs_stack->used; ++i) {
@@ -46,42 +207,175 @@ void * bmff_context_alloc_on_stack(BMFFContext *ctx, size_t size)
                 }
                 // adjust count and free old address space
                 ctx->allocs_stack->count = new_count;
-                ctx->free(ctx->allocs_stack->addresses);
+                _bmff_free(ctx, ctx->allocs_stack->addresses);
                 ctx->allocs_stack->addresses = new_addresses;
             }
             // add allocation to the stack.
             ctx->allocs_stack->addresses[ctx->allocs_stack->used] = (size_t)mem;
             ctx->allocs_stack->used++;
+            ctx->allocs_stack->bytes += size;
         }
         return mem;
     }
     return NULL;
 }
 
+// stream offset of the box whose type is at fourCC.
+static uint64_t _bmff_box_offset(BMFFContext *ctx, const uint8_t *fourCC)
+{
+    // the type follows the 4 byte size at the start of the box.
+    return ctx->parse_data ? ctx->parse_offset + ((fourCC - 4) - ctx->parse_data) : 0;
+}
+
+void _bmff_queue_event(BMFFContext *ctx, BMFFEventId id, const uint8_t *fourCC, void *data)
+{
+    if(ctx->events_count == ctx->events_capacity) {
+        _bmff_flush_events(ctx);
+    }
+
+    BMFFEvent *event = &ctx->events[ctx->events_count++];
+    event->id = id;
+    memcpy(event->type, fourCC, 4);
+    event->depth = ctx->breadcrumb_depth;
+    event->offset = _bmff_box_offset(ctx, fourCC);
+    event->data = data;
+}
+
+void _bmff_flush_events(BMFFContext *ctx)
+{
+    if(ctx->events_count > 0) {
+        if(ctx->batch_callback) {
+            ctx->batch_callback(ctx, ctx->events, ctx->events_count, ctx->batch_user_data);
+        }
+        ctx->events_count = 0;
+    }
+}
+
+void _bmff_record_diagnostic(BMFFContext *ctx, BMFFCode code, const uint8_t *fourCC)
+{
+    BMFFDiagnostic *diagnostic = &ctx->diagnostics[ctx->diagnostics_count % BMFF_DIAGNOSTICS_SIZE];
+    diagnostic->code = code;
+    memcpy(diagnostic->type, fourCC, 4);
+    diagnostic->depth = ctx->breadcrumb_depth;
+    diagnostic->offset = _bmff_box_offset(ctx, fourCC);
+    ctx->diagnostics_count++;
+    BMFF_TRACE_ERROR(fourCC, diagnostic->depth, diagnostic->offset, code);
+}
+
+#ifdef BMFF_USDT
+// semaphores of the probes, in the section the tracers look them up in.
+unsigned short BMFF_PROBE_SEMAPHORE(box__start) __attribute__((section(".probes")));
+unsigned short BMFF_PROBE_SEMAPHORE(box__end) __attribute__((section(".probes")));
+unsigned short BMFF_PROBE_SEMAPHORE(box__error) __attribute__((section(".probes")));
+unsigned short BMFF_PROBE_SEMAPHORE(arena__grow) __attribute__((section(".probes")));
+
+void _bmff_trace_box(BMFFContext *ctx, BMFFEventId id, const uint8_t *fourCC, void *data)
+{
+    if(id == BMFFEventParseStart && BMFF_PROBE_ENABLED(box__start)) {
+        // the box is not parsed yet, its size comes from the header.
+        uint64_t size = parse_u32(fourCC - 4);
+        if(size == 1) {
+            size = parse_u64(fourCC + 4);
+        }
+        DTRACE_PROBE4(libbmff, box__start, fourCC, ctx->breadcrumb_depth, _bmff_box_offset(ctx, fourCC), size);
+    }else if(id == BMFFEventParseComplete && BMFF_PROBE_ENABLED(box__end)) {
+        DTRACE_PROBE4(libbmff, box__end, fourCC, ctx->breadcrumb_depth, _bmff_box_offset(ctx, fourCC), bmff_get_box_size((Box*)data));
+    }
+}
+#endif
+
+uint32_t bmff_get_diagnostics(BMFFContext *ctx, BMFFDiagnostic *diagnostics, uint32_t max)
+{
+    if(!ctx || !diagnostics) return 0;
+
+    uint32_t retained = ctx->diagnostics_count < BMFF_DIAGNOSTICS_SIZE ? ctx->diagnostics_count : BMFF_DIAGNOSTICS_SIZE;
+    uint32_t count = retained < max ? retained : max;
+    // skip the oldest entries that do not fit.
+    uint32_t first = ctx->diagnostics_count - retained + (retained - count);
+
+    uint32_t i = 0;
+    for(; i < count; ++i) {
+        diagnostics[i] = ctx->diagnostics[(first + i) % BMFF_DIAGNOSTICS_SIZE];
+    }
+    return count;
+}
+
+BMFFCode bmff_clear_diagnostics(BMFFContext *ctx)
+{
+    if(!ctx) return BMFF_INVALID_CONTEXT;
+    ctx->diagnostics_count = 0;
+    return BMFF_OK;
+}
+
 void _bmff_breadcrumb_push(BMFFContext *ctx, const uint8_t *crumb)
 {
-    size_t len = strlen(ctx->breadcrumb);
-    if(len < BMFF_BREADCRUMB_SIZE - 5)
-    {
-        const char *format = len == 0 ? "%c%c%c%c" : ".%c%c%c%c";
-        sprintf(&ctx->breadcrumb[len], format, crumb[0], crumb[1], crumb[2], crumb[3]);
+    if(ctx->breadcrumb_depth < BMFF_BREADCRUMB_DEPTH) {
+        memcpy(&ctx->breadcrumb_path[ctx->breadcrumb_depth], crumb, 4);
     }
+    // keep counting past the maximum depth so pushes and pops stay balanced.
+    ctx->breadcrumb_depth++;
 }
 
 void _bmff_breadcrumb_pop(BMFFContext *ctx)
 {
-    size_t len = strlen(ctx->breadcrumb);
-    if(len > 4) {
-        ctx->breadcrumb[len-5] = '\00';        
-    }else{
-        ctx->breadcrumb[0] = '\00';
+    if(ctx->breadcrumb_depth > 0) {
+        ctx->breadcrumb_depth--;
     }
 }
 
 const char * bmff_get_breadcrumb(BMFFContext *ctx)
 {
     if(ctx) {
+        uint32_t depth = ctx->breadcrumb_depth;
+        if(depth > BMFF_BREADCRUMB_DEPTH) {
+            depth = BMFF_BREADCRUMB_DEPTH;
+        }
+
+        char *str = ctx->breadcrumb;
+        uint32_t i = 0;
+        for(; i < depth; ++i) {
+            if(i > 0) {
+                *str++ = '.';
+            }
+            memcpy(str, &ctx->breadcrumb_path[i], 4);
+            str += 4;
+        }
+        *str = '\0';
+
         return ctx->breadcrumb;
     }
     return NULL;
-}
\ No newline at end of file
+}
+
+const uint32_t * bmff_get_breadcrumb_path(BMFFContext *ctx, uint32_t *depth)
+{
+    if(ctx) {
+        if(depth) {
+            *depth = ctx->breadcrumb_depth < BMFF_BREADCRUMB_DEPTH ? ctx->breadcrumb_depth : BMFF_BREADCRUMB_DEPTH;
+        }
+        return ctx->breadcrumb_path;
+    }
+    return NULL;
+}
+
+void _bmff_context_select_track(BMFFContext *ctx, uint32_t track_id)
+{
+    if(!ctx->snapshot) return;
+
+    const BMFFTrackState *track = bmff_init_snapshot_get_track(ctx->snapshot, track_id);
+    ctx->track_state = track;
+    if(!track) {
+        // the state of the previous track does not apply to a track the snapshot does not have.
+        memset(ctx->handler_type, 0, 4);
+        ctx->default_iv_size = 0;
+        ctx->is_constant_iv = eBooleanUnknown;
+        return;
+    }
+
+    // restore the state the init segment parse would have left in the context.
+    memcpy(ctx->handler_type, track->handler_type, 4);
+    ctx->channel_count = track->channel_count;
+    ctx->sample_description_version = track->sample_description_version;
+    ctx->default_iv_size = track->default_iv_size;
+    ctx->is_constant_iv = track->is_constant_iv;
+}
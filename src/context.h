@@ -29,11 +29,90 @@
 #include <stdlib.h>
 
 #include "bmff.h"
+#include "memo.h"
+
+#ifdef BMFF_USDT
+// every probe has a semaphore, which a tracer increments while it is attached.
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define BMFF_PROBE_SEMAPHORE(name)                  libbmff_##name##_semaphore
+#define BMFF_PROBE_ENABLED(name)                    __builtin_expect(BMFF_PROBE_SEMAPHORE(name), 0)
+
+extern unsigned short BMFF_PROBE_SEMAPHORE(box__start);
+extern unsigned short BMFF_PROBE_SEMAPHORE(box__end);
+extern unsigned short BMFF_PROBE_SEMAPHORE(box__error);
+extern unsigned short BMFF_PROBE_SEMAPHORE(arena__grow);
+
+// static probes of the libbmff provider, compiled in with USDT=1. Their
+// arguments are only computed while a tracer is attached.
+#define BMFF_TRACE_BOX(c, e, f, d)                  ((BMFF_PROBE_ENABLED(box__start) || BMFF_PROBE_ENABLED(box__end)) ? \
+                                                     _bmff_trace_box((c), (e), (f), (void*)(d)) : (void)0)
+#define BMFF_TRACE_ERROR(f, depth, offset, code)    do { if(BMFF_PROBE_ENABLED(box__error)) { \
+                                                         DTRACE_PROBE4(libbmff, box__error, (f), (depth), (offset), (code)); } } while(0)
+#define BMFF_TRACE_ARENA_GROW(old_size, new_size)   do { if(BMFF_PROBE_ENABLED(arena__grow)) { \
+                                                         DTRACE_PROBE2(libbmff, arena__grow, (old_size), (new_size)); } } while(0)
+
+/**
+ * Fires the box__start and box__end probes of a parse event.
+ */
+void _bmff_trace_box(BMFFContext *ctx, BMFFEventId id, const uint8_t *fourCC, void *data);
+#else
+#define BMFF_TRACE_BOX(c, e, f, d)                  ((void)0)
+#define BMFF_TRACE_ERROR(f, depth, offset, code)    ((void)0)
+#define BMFF_TRACE_ARENA_GROW(old_size, new_size)   ((void)0)
+#endif
+
+// delivers an event to the batch queue or the user callback.
+#define CALLBACK(c, e, f, d)  if((BMFF_TRACE_BOX((c), (e), (f), (d)), (c)->event_mask & BMFF_EVENT_MASK(e))) { \
+                                  if((c)->events) { _bmff_queue_event((c), (e), (f), (void*)(d)); } \
+                                  else if((c)->callback) { (c)->callback((c), (e), (f), (void*)(d), (c)->callback_user_data); } \
+                              }
 
 /**
- * Adds a new to the stack of memory allocations.
+ * Allocates memory with the allocator of the context, or its malloc function
+ * when no allocator is set.
  */
-void bmff_context_alloc_stack_push(BMFFContext *ctx);
+void * _bmff_malloc(BMFFContext *ctx, size_t size);
+
+/**
+ * Allocates memory aligned to alignment. The malloc function of the context
+ * only provides the alignment of malloc.
+ */
+void * _bmff_malloc_aligned(BMFFContext *ctx, size_t size, size_t alignment);
+
+/**
+ * Resizes a block of old_size bytes allocated by the context.
+ */
+void * _bmff_realloc(BMFFContext *ctx, void *ptr, size_t old_size, size_t size);
+
+/**
+ * Releases a block allocated by the context, NULL is ignored.
+ */
+void _bmff_free(BMFFContext *ctx, void *ptr);
+
+/**
+ * Allocator functions for objects that keep the allocator of the context they
+ * were built with. The legacy function is used when the allocator has no alloc.
+ */
+void * _bmff_allocator_realloc(const BMFFAllocator *allocator, bmff_realloc realloc_func,
+                               void *ptr, size_t old_size, size_t size);
+void _bmff_allocator_free(const BMFFAllocator *allocator, bmff_free free_func, void *ptr);
+
+/**
+ * Releases the memory the context holds between parses: the layers of the
+ * memory allocations stack with their arenas, the frames, the bounce buffer
+ * and the memo cache.
+ */
+void _bmff_context_release_memory(BMFFContext *ctx);
+
+/**
+ * Adds a new layer to the stack of memory allocations.
+ *
+ * @return BMFF_RESOURCE_LIMIT when the layer can not be allocated, in which
+ * case nothing must be popped.
+ */
+BMFFCode bmff_context_alloc_stack_push(BMFFContext *ctx);
 
 /**
  * Removes the last layer of the memory allocations stack freeing all
@@ -41,11 +120,24 @@ void bmff_context_alloc_stack_push(BMFFContext *ctx);
  */
 void bmff_context_alloc_stack_pop(BMFFContext *ctx);
 
+/**
+ * Pops every layer of the memory allocations stack and frees the layers
+ * and arenas kept for reuse.
+ */
+void bmff_context_release_stack(BMFFContext *ctx);
+
 /**
  * Allocates memory on the active stack.
  */
 void * bmff_context_alloc_on_stack(BMFFContext *ctx, size_t size);
 
+/**
+ * Returns the number of bytes left in the memory budget of the context,
+ * SIZE_MAX when it has no memory limit. Buffers held outside the allocation
+ * stack charge their growth to memory_used once it fits.
+ */
+size_t _bmff_memory_available(const BMFFContext *ctx);
+
 /**
  * Adds an item onto the breadcrumb
  */
@@ -56,4 +148,49 @@ void _bmff_breadcrumb_push(BMFFContext *ctx, const uint8_t *crumb);
  */
 void _bmff_breadcrumb_pop(BMFFContext *ctx);
 
+/**
+ * Starts a new generation of the memo cache, called by every bmff_parse.
+ */
+void _bmff_memo_begin(BMFFContext *ctx);
+
+/**
+ * Types and budget of the memo cache, kept while its memory is released.
+ */
+typedef struct MemoSettings {
+    eBoolean    enabled;
+    uint32_t    types[BMFF_MEMO_MAX_TYPES];
+    uint32_t    type_count;
+    size_t      budget;
+} MemoSettings;
+
+/**
+ * Saves the settings of the memo cache of the context.
+ */
+void _bmff_memo_save_settings(const BMFFContext *ctx, MemoSettings *settings);
+
+/**
+ * Enables an empty memo cache with the saved settings, if it was enabled.
+ */
+BMFFCode _bmff_memo_restore_settings(BMFFContext *ctx, const MemoSettings *settings);
+
+/**
+ * Loads the state of a track from the attached init snapshot into the context.
+ */
+void _bmff_context_select_track(BMFFContext *ctx, uint32_t track_id);
+
+/**
+ * Appends an event to the batch queue, flushing the queue when it is full.
+ */
+void _bmff_queue_event(BMFFContext *ctx, BMFFEventId id, const uint8_t *fourCC, void *data);
+
+/**
+ * Hands all queued events to the batch callback.
+ */
+void _bmff_flush_events(BMFFContext *ctx);
+
+/**
+ * Records a parse error in the diagnostics ring.
+ */
+void _bmff_record_diagnostic(BMFFContext *ctx, BMFFCode code, const uint8_t *fourCC);
+
 #endif // CONTEXT_H
@@ -0,0 +1,178 @@
+#include <string.h>
+
+#include "aes.h"
+#include "decrypt.h"
+
+#define BOX_TYPE_IS(d,t) ((d)[0]==(t)[0] && (d)[1]==(t)[1] && (d)[2]==(t)[2] && (d)[3]==(t)[3])
+// counter blocks encrypted per call in CTR mode.
+#define CTR_BATCH (8)
+
+/**
+ * AES-CTR position, the keystream runs on across the encrypted ranges of a sample.
+ */
+typedef struct CtrState {
+    uint8_t     counter[BMFF_AES_BLOCK_SIZE];
+    uint8_t     keystream[CTR_BATCH * BMFF_AES_BLOCK_SIZE];
+    size_t      keystream_size;
+    size_t      keystream_used;
+} CtrState;
+
+BMFFCode bmff_decryptor_init(BMFFDecryptor *decryptor,
+                             const uint8_t *scheme,
+                             const uint8_t *key,
+                             const TrackEncryptionBox *tenc)
+{
+    if(!decryptor || !scheme || !key) return BMFF_INVALID_PARAMETER;
+
+    memset(decryptor, 0, sizeof(BMFFDecryptor));
+    if(BOX_TYPE_IS(scheme, "cenc")) {
+        decryptor->scheme = BMFFSchemeCenc;
+    }else if(BOX_TYPE_IS(scheme, "cbcs")) {
+        decryptor->scheme = BMFFSchemeCbcs;
+    }else{
+        return BMFF_INVALID_PARAMETER;
+    }
+    _bmff_aes_init(&decryptor->key, key);
+
+    if(tenc) {
+        if(decryptor->scheme == BMFFSchemeCbcs) {
+            decryptor->crypt_byte_block = tenc->default_crypt_byte_block;
+            decryptor->skip_byte_block = tenc->default_skip_byte_block;
+        }
+        if(tenc->default_per_sample_iv_size == 0 && tenc->default_constant_iv) {
+            if(tenc->default_constant_iv_size > BMFF_AES_BLOCK_SIZE) {
+                return BMFF_INVALID_SIZE;
+            }
+            decryptor->constant_iv_size = tenc->default_constant_iv_size;
+            memcpy(decryptor->constant_iv, tenc->default_constant_iv, tenc->default_constant_iv_size);
+        }
+    }
+    return BMFF_OK;
+}
+
+// the block counter is the low 64 bits of the counter block.
+static void _bmff_ctr_refill(const BMFFDecryptor *decryptor, CtrState *ctr, size_t blocks)
+{
+    size_t i = 0;
+    for(; i < blocks; ++i) {
+        memcpy(ctr->keystream + i * BMFF_AES_BLOCK_SIZE, ctr->counter, BMFF_AES_BLOCK_SIZE);
+        uint32_t j = BMFF_AES_BLOCK_SIZE;
+        while(j > 8 && ++ctr->counter[--j] == 0);
+    }
+    _bmff_aes_encrypt_blocks(&decryptor->key, ctr->keystream, ctr->keystream, blocks);
+    ctr->keystream_size = blocks * BMFF_AES_BLOCK_SIZE;
+    ctr->keystream_used = 0;
+}
+
+static void _bmff_ctr_decrypt(const BMFFDecryptor *decryptor, CtrState *ctr, uint8_t *data, size_t size)
+{
+    while(size > 0) {
+        if(ctr->keystream_used == ctr->keystream_size) {
+            size_t blocks = (size + BMFF_AES_BLOCK_SIZE - 1) / BMFF_AES_BLOCK_SIZE;
+            _bmff_ctr_refill(decryptor, ctr, blocks < CTR_BATCH ? blocks : CTR_BATCH);
+        }
+        size_t n = ctr->keystream_size - ctr->keystream_used;
+        if(n > size) {
+            n = size;
+        }
+        const uint8_t *keystream = ctr->keystream + ctr->keystream_used;
+        size_t i = 0;
+        for(; i < n; ++i) {
+            data[i] ^= keystream[i];
+        }
+        ctr->keystream_used += n;
+        data += n;
+        size -= n;
+    }
+}
+
+// decrypts one encrypted range, the CBC chain restarts at the IV for every range.
+static void _bmff_cbcs_decrypt(const BMFFDecryptor *decryptor, const uint8_t *iv, uint8_t *data, size_t size)
+{
+    uint8_t chain[BMFF_AES_BLOCK_SIZE];
+    memcpy(chain, iv, BMFF_AES_BLOCK_SIZE);
+
+    size_t blocks = size / BMFF_AES_BLOCK_SIZE;
+    size_t crypt = decryptor->crypt_byte_block;
+    size_t skip = decryptor->skip_byte_block;
+    if(crypt == 0 && skip == 0) {
+        crypt = blocks;
+    }
+
+    // the partial block at the end is left in the clear.
+    while(blocks > 0) {
+        size_t n = crypt < blocks ? crypt : blocks;
+        _bmff_aes_cbc_decrypt(&decryptor->key, chain, data, n);
+        data += n * BMFF_AES_BLOCK_SIZE;
+        blocks -= n;
+        n = skip < blocks ? skip : blocks;
+        data += n * BMFF_AES_BLOCK_SIZE;
+        blocks -= n;
+        if(crypt == 0) {
+            break;
+        }
+    }
+}
+
+BMFFCode bmff_decrypt_sample(const BMFFDecryptor *decryptor,
+                             const EncryptionSample *sample,
+                             uint8_t *data,
+                             size_t size)
+{
+    if(!decryptor || !sample)   return BMFF_INVALID_PARAMETER;
+    if(!data && size > 0)       return BMFF_INVALID_DATA;
+
+    // 8 byte IVs are padded with zeros.
+    uint8_t iv[BMFF_AES_BLOCK_SIZE];
+    memset(iv, 0, BMFF_AES_BLOCK_SIZE);
+    if(sample->iv_size > 0 && sample->iv) {
+        if(sample->iv_size > BMFF_AES_BLOCK_SIZE) {
+            return BMFF_INVALID_SIZE;
+        }
+        memcpy(iv, sample->iv, sample->iv_size);
+    }else if(decryptor->constant_iv_size > 0) {
+        memcpy(iv, decryptor->constant_iv, decryptor->constant_iv_size);
+    }else{
+        return BMFF_INVALID_DATA;
+    }
+
+    // check the subsamples fit before anything is modified.
+    uint64_t total = 0;
+    uint32_t i = 0;
+    for(; i < sample->subsample_count; ++i) {
+        total += sample->subsamples[i].bytes_of_clear_data;
+        total += sample->subsamples[i].bytes_of_encrypted_data;
+    }
+    if(total > size) {
+        return BMFF_INVALID_SIZE;
+    }
+
+    CtrState ctr;
+    if(decryptor->scheme == BMFFSchemeCenc) {
+        memcpy(ctr.counter, iv, BMFF_AES_BLOCK_SIZE);
+        ctr.keystream_size = 0;
+        ctr.keystream_used = 0;
+    }
+
+    if(sample->subsample_count == 0) {
+        if(decryptor->scheme == BMFFSchemeCenc) {
+            _bmff_ctr_decrypt(decryptor, &ctr, data, size);
+        }else{
+            _bmff_cbcs_decrypt(decryptor, iv, data, size);
+        }
+        return BMFF_OK;
+    }
+
+    uint8_t *ptr = data;
+    for(i = 0; i < sample->subsample_count; ++i) {
+        const EncryptionSubsample *subsample = &sample->subsamples[i];
+        ptr += subsample->bytes_of_clear_data;
+        if(decryptor->scheme == BMFFSchemeCenc) {
+            _bmff_ctr_decrypt(decryptor, &ctr, ptr, subsample->bytes_of_encrypted_data);
+        }else{
+            _bmff_cbcs_decrypt(decryptor, iv, ptr, subsample->bytes_of_encrypted_data);
+        }
+        ptr += subsample->bytes_of_encrypted_data;
+    }
+    return BMFF_OK;
+}
@@ -0,0 +1,109 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef DECRYPT_H
+#define DECRYPT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// size of a content key and of an AES block.
+#define BMFF_KEY_SIZE                           (16)
+#define BMFF_AES_BLOCK_SIZE                     (16)
+#define BMFF_AES_ROUNDS                         (10)
+
+/**
+ * Common encryption schemes that can be decrypted.
+ */
+typedef enum BMFFEncryptionScheme {
+    // AES-CTR over the full encrypted ranges.
+    BMFFSchemeCenc                          = 0x0000,
+    // AES-CBC with a crypt/skip block pattern and constant or per sample IVs.
+    BMFFSchemeCbcs                          = 0x0001,
+} BMFFEncryptionScheme;
+
+/**
+ * Expanded AES-128 key.
+ */
+typedef struct BMFFAesKey {
+    uint8_t     encrypt[(BMFF_AES_ROUNDS + 1) * BMFF_AES_BLOCK_SIZE];
+    // decryption round keys in the order used by the AES instructions.
+    uint8_t     decrypt[(BMFF_AES_ROUNDS + 1) * BMFF_AES_BLOCK_SIZE];
+    // set when the CPU has AES instructions, clear it to force the portable code.
+    eBoolean    hardware;
+} BMFFAesKey;
+
+/**
+ * Decryption state of a protected track.
+ * The state is not modified by bmff_decrypt_sample, so one decryptor can be
+ * shared by threads decrypting different samples.
+ */
+typedef struct BMFFDecryptor {
+    BMFFEncryptionScheme    scheme;
+    BMFFAesKey              key;
+    // cbcs pattern, 0:0 encrypts every block.
+    uint8_t                 crypt_byte_block;
+    uint8_t                 skip_byte_block;
+    // IV used by samples without a per sample IV.
+    uint8_t                 constant_iv[BMFF_AES_BLOCK_SIZE];
+    uint8_t                 constant_iv_size;
+} BMFFDecryptor;
+
+/**
+ * Sets up a decryptor for a track.
+ *
+ * @param scheme scheme_type of the schm box, "cenc" or "cbcs".
+ * @param key content key of the default_kid of the tenc box.
+ * @param tenc track encryption box giving the pattern and constant IV.
+ * @return BMFF_INVALID_PARAMETER for other schemes.
+ */
+BMFFCode bmff_decryptor_init(BMFFDecryptor *decryptor,
+                             const uint8_t *scheme,
+                             const uint8_t *key,
+                             const TrackEncryptionBox *tenc);
+
+/**
+ * Decrypts a sample in place.
+ * The ranges of the subsamples of the senc entry are decrypted, a sample
+ * without subsamples is encrypted as a whole.
+ *
+ * @param sample senc entry of the sample.
+ * @return BMFF_INVALID_SIZE when the subsamples do not fit in the sample.
+ */
+BMFFCode bmff_decrypt_sample(const BMFFDecryptor *decryptor,
+                             const EncryptionSample *sample,
+                             uint8_t *data,
+                             size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DECRYPT_H
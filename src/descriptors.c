@@ -16,7 +16,9 @@ size_t _bmff_parse_object_descriptor(BMFFContext *ctx, const uint8_t *data, size
     if(desc->url_flag == 1) {
         ADV_PARSE_U8(desc->url_length, ptr);
         if(desc->url_length > 0) {
-            BOX_MALLOCN(desc->url, uint8_t, desc->url_length+1);
+            desc->url = bmff_context_alloc_on_stack(ctx, desc->url_length+1);
+            if(!desc->url) return 0;
+            memset(desc->url, 0, desc->url_length+1);
             memcpy(desc->url, ptr, desc->url_length);
         }
     }else{
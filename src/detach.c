@@ -0,0 +1,692 @@
+#include <string.h>
+
+#include "detach.h"
+#include "context.h"
+#include "parse_common.h"
+
+#define BOX_TYPE_IS(d,t) ((d)[0]==(t)[0] && (d)[1]==(t)[1] && (d)[2]==(t)[2] && (d)[3]==(t)[3])
+
+/**
+ * Allocations of a detached box, taken off the stack of the context, followed
+ * by the addresses and the copies of the bytes the boxes refer to.
+ */
+struct BMFFDetachedBox {
+    size_t      *addresses;
+    uint32_t    address_count;
+    uint8_t     *arena;
+    // bytes charged to the memory limit until the box is released.
+    size_t      bytes;
+};
+
+/**
+ * Walk over the boxes of a detached box. It runs twice, first to measure the
+ * copies and then, once copy is set, to make them.
+ */
+typedef struct DetachWalk {
+    // bytes of the top level box, only pointers into them are rewritten.
+    const uint8_t   *begin;
+    const uint8_t   *end;
+    uint8_t         *copy;
+    size_t          used;
+    // handler of the track being walked, the sample entries are parsed by it.
+    uint8_t         handler_type[4];
+} DetachWalk;
+
+typedef void (*detach_func)(DetachWalk *walk, Box *box);
+
+static void _bmff_detach_box(DetachWalk *walk, Box *box);
+
+static const uint8_t * _bmff_detach_bytes(DetachWalk *walk, const void *ptr, size_t size)
+{
+    const uint8_t *src = ptr;
+    if(!src || src < walk->begin || src >= walk->end) {
+        return src;
+    }
+    if(size > (size_t)(walk->end - src)) {
+        size = walk->end - src;
+    }
+    const uint8_t *dst = src;
+    if(walk->copy) {
+        memcpy(walk->copy + walk->used, src, size);
+        dst = walk->copy + walk->used;
+    }
+    walk->used += size;
+    return dst;
+}
+
+// copies a string up to its terminator, which is added when the box lacks it.
+static const char * _bmff_detach_string(DetachWalk *walk, const char *str)
+{
+    const uint8_t *src = (const uint8_t*)str;
+    if(!src || src < walk->begin || src >= walk->end) {
+        return str;
+    }
+    size_t len = strnlen(str, walk->end - src);
+    char *dst = (char*)str;
+    if(walk->copy) {
+        dst = (char*)walk->copy + walk->used;
+        memcpy(dst, str, len);
+        dst[len] = '\0';
+    }
+    walk->used += len + 1;
+    return dst;
+}
+
+// copies a length prefixed IPMP string, the 32 bit length precedes it.
+static const uint8_t * _bmff_detach_ipmp_string(DetachWalk *walk, const uint8_t *ptr)
+{
+    if(!ptr || ptr < walk->begin + 4 || ptr >= walk->end) {
+        return ptr;
+    }
+    return _bmff_detach_bytes(walk, ptr, (size_t)parse_u32(ptr - 4) + 1);
+}
+
+// size of count descriptors, each with a tag and an expandable size.
+static size_t _bmff_detach_descriptors_size(const DetachWalk *walk, const uint8_t *ptr, size_t count)
+{
+    if(!ptr || ptr < walk->begin || ptr >= walk->end) {
+        return 0;
+    }
+    const uint8_t *p = ptr;
+    for(; count > 0 && p < walk->end; --count) {
+        p++; // tag
+        size_t size = 0;
+        int i = 0;
+        for(; i < 4 && p < walk->end; ++i) {
+            uint8_t b = *p++;
+            size = (size << 7) | (b & 0x7F);
+            if((b & 0x80) == 0) break;
+        }
+        p += size < (size_t)(walk->end - p) ? size : (size_t)(walk->end - p);
+    }
+    return p - ptr;
+}
+
+static void _bmff_detach_children(DetachWalk *walk, Box **children, uint32_t count)
+{
+    uint32_t i = 0;
+    for(; children && i < count; ++i) {
+        _bmff_detach_box(walk, children[i]);
+    }
+}
+
+static void _bmff_detach_header(DetachWalk *walk, Box *box)
+{
+    box->user_type = _bmff_detach_bytes(walk, box->user_type, 16);
+}
+
+static void _bmff_detach_container(DetachWalk *walk, Box *box)
+{
+    ContainerBox *container = (ContainerBox*)box;
+    _bmff_detach_children(walk, container->children, container->child_count);
+}
+
+static void _bmff_detach_file_type(DetachWalk *walk, Box *box)
+{
+    FileTypeBox *ftyp = (FileTypeBox*)box;
+    ftyp->compatible_brands = _bmff_detach_bytes(walk, ftyp->compatible_brands, ftyp->nb_compatible_brands * 4);
+}
+
+static void _bmff_detach_handler(DetachWalk *walk, Box *box)
+{
+    HandlerBox *hdlr = (HandlerBox*)box;
+    hdlr->name = _bmff_detach_string(walk, hdlr->name);
+    memcpy(walk->handler_type, hdlr->handler_type, 4);
+}
+
+static void _bmff_detach_item_info_entry(DetachWalk *walk, Box *box)
+{
+    ItemInfoEntry *infe = (ItemInfoEntry*)box;
+    infe->item_name = _bmff_detach_string(walk, infe->item_name);
+    infe->content_type = _bmff_detach_string(walk, infe->content_type);
+    infe->content_encoding = _bmff_detach_string(walk, infe->content_encoding);
+    infe->item_uri_type = _bmff_detach_string(walk, infe->item_uri_type);
+    if(infe->extension) {
+        infe->extension->content_location = _bmff_detach_string(walk, infe->extension->content_location);
+        infe->extension->content_md5 = _bmff_detach_string(walk, infe->extension->content_md5);
+    }else{
+        infe->extension_bytes = _bmff_detach_bytes(walk, infe->extension_bytes, infe->extension_size);
+    }
+}
+
+static void _bmff_detach_item_info(DetachWalk *walk, Box *box)
+{
+    ItemInfoBox *iinf = (ItemInfoBox*)box;
+    uint32_t i = 0;
+    for(; iinf->entries && i < iinf->entry_count; ++i) {
+        if(iinf->entries[i]) {
+            _bmff_detach_header(walk, (Box*)iinf->entries[i]);
+            _bmff_detach_item_info_entry(walk, (Box*)iinf->entries[i]);
+        }
+    }
+}
+
+static void _bmff_detach_ipmp_control(DetachWalk *walk, Box *box)
+{
+    IPMPControlBox *ipmc = (IPMPControlBox*)box;
+    int i = 0;
+    for(; ipmc->tool_list.ipmp_tools && i < ipmc->tool_list.num_tools; ++i) {
+        IPMPTool *tool = &ipmc->tool_list.ipmp_tools[i];
+        tool->tool_param_desc = _bmff_detach_ipmp_string(walk, tool->tool_param_desc);
+        int j = 0;
+        for(; tool->tool_urls && j < tool->num_urls; ++j) {
+            tool->tool_urls[j] = (uint8_t*)_bmff_detach_ipmp_string(walk, tool->tool_urls[j]);
+        }
+    }
+    size_t size = _bmff_detach_descriptors_size(walk, ipmc->ipmp_descriptors, ipmc->ipmp_descriptors_len);
+    ipmc->ipmp_descriptors = _bmff_detach_bytes(walk, ipmc->ipmp_descriptors, size);
+}
+
+static void _bmff_detach_ipmp_info(DetachWalk *walk, Box *box)
+{
+    IPMPInfoBox *imif = (IPMPInfoBox*)box;
+    // the descriptors are not parsed, they run from the header to the end of the box.
+    size_t header = 12 + (imif->box.size == 1 ? 8 : 0) + (imif->box.user_type ? 16 : 0);
+    uint64_t size = bmff_get_box_size(box);
+    imif->ipmp_desc = _bmff_detach_bytes(walk, imif->ipmp_desc, size > header ? (size_t)(size - header) : 0);
+}
+
+static void _bmff_detach_scheme_type(DetachWalk *walk, Box *box)
+{
+    SchemeTypeBox *schm = (SchemeTypeBox*)box;
+    schm->scheme_uri = _bmff_detach_string(walk, schm->scheme_uri);
+}
+
+static void _bmff_detach_protection_scheme_info(DetachWalk *walk, Box *box)
+{
+    ProtectionSchemeInfoBox *sinf = (ProtectionSchemeInfoBox*)box;
+    _bmff_detach_header(walk, &sinf->original_format.box);
+    if(sinf->scheme_type) {
+        _bmff_detach_header(walk, (Box*)sinf->scheme_type);
+        _bmff_detach_scheme_type(walk, (Box*)sinf->scheme_type);
+    }
+    if(sinf->scheme_info) {
+        _bmff_detach_header(walk, (Box*)sinf->scheme_info);
+        _bmff_detach_container(walk, (Box*)sinf->scheme_info);
+    }
+}
+
+static void _bmff_detach_item_protection(DetachWalk *walk, Box *box)
+{
+    ItemProtectionBox *ipro = (ItemProtectionBox*)box;
+    int i = 0;
+    for(; ipro->protection_info && i < ipro->protection_count; ++i) {
+        if(ipro->protection_info[i]) {
+            _bmff_detach_header(walk, (Box*)ipro->protection_info[i]);
+            _bmff_detach_protection_scheme_info(walk, (Box*)ipro->protection_info[i]);
+        }
+    }
+}
+
+static void _bmff_detach_meta(DetachWalk *walk, Box *box)
+{
+    MetaBox *meta = (MetaBox*)box;
+    // the handler is parsed whatever its type, the optional boxes only by theirs.
+    if(meta->handler) {
+        _bmff_detach_header(walk, (Box*)meta->handler);
+        _bmff_detach_handler(walk, (Box*)meta->handler);
+    }
+    _bmff_detach_box(walk, (Box*)meta->primary_resource);
+    _bmff_detach_box(walk, (Box*)meta->file_locations);
+    _bmff_detach_box(walk, (Box*)meta->item_locations);
+    _bmff_detach_box(walk, (Box*)meta->protections);
+    _bmff_detach_box(walk, (Box*)meta->item_infos);
+    _bmff_detach_box(walk, (Box*)meta->ipmp_control);
+    _bmff_detach_box(walk, (Box*)meta->item_refs);
+    _bmff_detach_box(walk, (Box*)meta->item_data);
+    _bmff_detach_children(walk, meta->other_boxes, meta->other_boxes_len);
+}
+
+static void _bmff_detach_xml(DetachWalk *walk, Box *box)
+{
+    XMLBox *xml = (XMLBox*)box;
+    xml->data = _bmff_detach_bytes(walk, xml->data, xml->data_len);
+}
+
+static void _bmff_detach_copyright(DetachWalk *walk, Box *box)
+{
+    CopyrightBox *cprt = (CopyrightBox*)box;
+    cprt->notice = _bmff_detach_string(walk, cprt->notice);
+}
+
+static void _bmff_detach_data_entry(DetachWalk *walk, Box *box)
+{
+    DataEntryBox *entry = (DataEntryBox*)box;
+    entry->name = _bmff_detach_string(walk, entry->name);
+    entry->location = _bmff_detach_string(walk, entry->location);
+}
+
+static void _bmff_detach_data_reference(DetachWalk *walk, Box *box)
+{
+    DataReferenceBox *dref = (DataReferenceBox*)box;
+    _bmff_detach_children(walk, (Box**)dref->data_entries, dref->entry_count);
+}
+
+static void _bmff_detach_visual_sample_entry(DetachWalk *walk, Box *box)
+{
+    VisualSampleEntry *entry = (VisualSampleEntry*)box;
+    _bmff_detach_box(walk, (Box*)entry->clap);
+    _bmff_detach_box(walk, (Box*)entry->pasp);
+    _bmff_detach_children(walk, entry->children, entry->child_count);
+}
+
+static void _bmff_detach_audio_sample_entry(DetachWalk *walk, Box *box)
+{
+    AudioSampleEntry *entry = (AudioSampleEntry*)box;
+    _bmff_detach_box(walk, (Box*)entry->sampling_rate);
+    _bmff_detach_box(walk, (Box*)entry->channel_layout);
+    _bmff_detach_children(walk, entry->children, entry->child_count);
+}
+
+static void _bmff_detach_hint_sample_entry(DetachWalk *walk, Box *box)
+{
+    HintSampleEntry *entry = (HintSampleEntry*)box;
+    entry->data = _bmff_detach_bytes(walk, entry->data, entry->data_size);
+}
+
+static void _bmff_detach_sample_description(DetachWalk *walk, Box *box)
+{
+    SampleDescriptionBox *stsd = (SampleDescriptionBox*)box;
+
+    // the same handler types as _bmff_parse_box_sample_description.
+    detach_func func = NULL;
+    const uint8_t *handler = walk->handler_type;
+    if(BOX_TYPE_IS(handler, "vide") || BOX_TYPE_IS(handler, "encv") || BOX_TYPE_IS(handler, "icpv")) {
+        func = _bmff_detach_visual_sample_entry;
+    }else if(BOX_TYPE_IS(handler, "soun") || BOX_TYPE_IS(handler, "enca") || BOX_TYPE_IS(handler, "icpa")) {
+        func = _bmff_detach_audio_sample_entry;
+    }else if(BOX_TYPE_IS(handler, "hint") || BOX_TYPE_IS(handler, "icph")) {
+        func = _bmff_detach_hint_sample_entry;
+    }
+
+    uint32_t i = 0;
+    for(; stsd->entries && i < stsd->entry_count; ++i) {
+        if(stsd->entries[i]) {
+            _bmff_detach_header(walk, (Box*)stsd->entries[i]);
+            if(func) {
+                func(walk, (Box*)stsd->entries[i]);
+            }
+        }
+    }
+}
+
+static void _bmff_detach_sample_group_description(DetachWalk *walk, Box *box)
+{
+    SampleGroupDescriptionBox *sgpd = (SampleGroupDescriptionBox*)box;
+    sgpd->sample_group_entries = _bmff_detach_bytes(walk, sgpd->sample_group_entries, sgpd->sample_group_entries_size);
+}
+
+static void _bmff_detach_extended_language_tag(DetachWalk *walk, Box *box)
+{
+    ExtendedLanguageTagBox *elng = (ExtendedLanguageTagBox*)box;
+    elng->extended_language = _bmff_detach_string(walk, elng->extended_language);
+}
+
+static void _bmff_detach_track_extension_properties(DetachWalk *walk, Box *box)
+{
+    TrackExtensionPropertiesBox *trep = (TrackExtensionPropertiesBox*)box;
+    _bmff_detach_children(walk, trep->children, trep->child_count);
+}
+
+static void _bmff_detach_kind(DetachWalk *walk, Box *box)
+{
+    KindBox *kind = (KindBox*)box;
+    kind->scheme_uri = _bmff_detach_string(walk, kind->scheme_uri);
+    kind->value = _bmff_detach_string(walk, kind->value);
+}
+
+static void _bmff_detach_item_data(DetachWalk *walk, Box *box)
+{
+    ItemDataBox *idat = (ItemDataBox*)box;
+    idat->data = _bmff_detach_bytes(walk, idat->data, idat->data_size);
+}
+
+static void _bmff_detach_file_partition(DetachWalk *walk, Box *box)
+{
+    FilePartitionBox *fpar = (FilePartitionBox*)box;
+    fpar->scheme_specific_info = _bmff_detach_string(walk, fpar->scheme_specific_info);
+}
+
+static void _bmff_detach_partition_entry(DetachWalk *walk, Box *box)
+{
+    PartitionEntryBox *paen = (PartitionEntryBox*)box;
+    if(paen->blocks_and_symbols) {
+        _bmff_detach_header(walk, (Box*)paen->blocks_and_symbols);
+        _bmff_detach_file_partition(walk, (Box*)paen->blocks_and_symbols);
+    }
+    if(paen->fec_symbol_locations) {
+        _bmff_detach_header(walk, (Box*)paen->fec_symbol_locations);
+    }
+    if(paen->file_symbol_locations) {
+        _bmff_detach_header(walk, (Box*)paen->file_symbol_locations);
+    }
+}
+
+static void _bmff_detach_group_id_to_name(DetachWalk *walk, Box *box)
+{
+    GroupIdToNameBox *gitn = (GroupIdToNameBox*)box;
+    uint32_t i = 0;
+    for(; gitn->group_names && i < gitn->entry_count; ++i) {
+        gitn->group_names[i] = _bmff_detach_string(walk, gitn->group_names[i]);
+    }
+}
+
+static void _bmff_detach_fd_item_information(DetachWalk *walk, Box *box)
+{
+    FDItemInformationBox *fiin = (FDItemInformationBox*)box;
+    uint32_t i = 0;
+    for(; fiin->entries && i < fiin->entry_count; ++i) {
+        if(fiin->entries[i]) {
+            _bmff_detach_header(walk, (Box*)fiin->entries[i]);
+            _bmff_detach_partition_entry(walk, (Box*)fiin->entries[i]);
+        }
+    }
+    if(fiin->session_info) {
+        _bmff_detach_header(walk, (Box*)fiin->session_info);
+    }
+    if(fiin->group_id_to_name) {
+        _bmff_detach_header(walk, (Box*)fiin->group_id_to_name);
+        _bmff_detach_group_id_to_name(walk, (Box*)fiin->group_id_to_name);
+    }
+}
+
+static void _bmff_detach_sub_track_information(DetachWalk *walk, Box *box)
+{
+    SubTrackInformationBox *stri = (SubTrackInformationBox*)box;
+    uint32_t i = 0;
+    for(; stri->attribute_list && i < stri->attribute_list_count; ++i) {
+        stri->attribute_list[i] = _bmff_detach_bytes(walk, stri->attribute_list[i], 4);
+    }
+}
+
+static void _bmff_detach_stereo_video(DetachWalk *walk, Box *box)
+{
+    StereoVideoBox *stvi = (StereoVideoBox*)box;
+    _bmff_detach_children(walk, stvi->children, stvi->child_count);
+}
+
+static void _bmff_detach_complete_track_info(DetachWalk *walk, Box *box)
+{
+    CompleteTrackInfoBox *cinf = (CompleteTrackInfoBox*)box;
+    _bmff_detach_header(walk, &cinf->original_format.box);
+    _bmff_detach_children(walk, cinf->children, cinf->child_count);
+}
+
+static void _bmff_detach_rtp_hint_sample_entry(DetachWalk *walk, Box *box)
+{
+    RtpHintSampleEntry *entry = (RtpHintSampleEntry*)box;
+    _bmff_detach_children(walk, entry->additional_data, entry->additional_data_count);
+}
+
+static void _bmff_detach_fd_hint_sample_entry(DetachWalk *walk, Box *box)
+{
+    FDHintSampleEntry *entry = (FDHintSampleEntry*)box;
+    _bmff_detach_children(walk, entry->additional_data, entry->additional_data_count);
+}
+
+static void _bmff_detach_xml_meta_data_sample_entry(DetachWalk *walk, Box *box)
+{
+    XMLMetaDataSampleEntry *metx = (XMLMetaDataSampleEntry*)box;
+    _bmff_detach_children(walk, metx->other_boxes, metx->other_boxes_count);
+    metx->content_encoding = _bmff_detach_string(walk, metx->content_encoding);
+    metx->nmspace = _bmff_detach_string(walk, metx->nmspace);
+    metx->schema_location = _bmff_detach_string(walk, metx->schema_location);
+    if(metx->bitrate) {
+        _bmff_detach_header(walk, (Box*)metx->bitrate);
+    }
+}
+
+static void _bmff_detach_full_string(DetachWalk *walk, Box *box)
+{
+    StringFullBox *string = (StringFullBox*)box;
+    string->value = _bmff_detach_string(walk, string->value);
+}
+
+static void _bmff_detach_full_data(DetachWalk *walk, Box *box)
+{
+    DataFullBox *data = (DataFullBox*)box;
+    data->data = _bmff_detach_bytes(walk, data->data, data->data_len);
+}
+
+static void _bmff_detach_text_meta_data_sample_entry(DetachWalk *walk, Box *box)
+{
+    TextMetaDataSampleEntry *mett = (TextMetaDataSampleEntry*)box;
+    _bmff_detach_children(walk, mett->other_boxes, mett->other_boxes_count);
+    mett->content_encoding = _bmff_detach_string(walk, mett->content_encoding);
+    mett->mime_format = _bmff_detach_string(walk, mett->mime_format);
+    if(mett->bitrate) {
+        _bmff_detach_header(walk, (Box*)mett->bitrate);
+    }
+    if(mett->text_config) {
+        _bmff_detach_header(walk, (Box*)mett->text_config);
+        _bmff_detach_full_string(walk, (Box*)mett->text_config);
+    }
+}
+
+static void _bmff_detach_uri_meta_sample_entry(DetachWalk *walk, Box *box)
+{
+    // the label, init and bitrate boxes are not counted in the other boxes.
+    UriMetaSampleEntryBox *urim = (UriMetaSampleEntryBox*)box;
+    _bmff_detach_children(walk, urim->other_boxes, urim->other_boxes_count);
+    _bmff_detach_box(walk, (Box*)urim->the_label);
+    _bmff_detach_box(walk, (Box*)urim->init);
+    _bmff_detach_box(walk, (Box*)urim->bitrate);
+}
+
+static void _bmff_detach_object_descriptor(DetachWalk *walk, Box *box)
+{
+    ObjectDescriptorBox *iods = (ObjectDescriptorBox*)box;
+    iods->od.descriptors = _bmff_detach_bytes(walk, iods->od.descriptors, iods->od.descriptors_size);
+}
+
+static void _bmff_detach_es_descriptor(DetachWalk *walk, Box *box)
+{
+    ESDescriptorBox *esds = (ESDescriptorBox*)box;
+    esds->descriptor = _bmff_detach_bytes(walk, esds->descriptor, esds->descriptor_size);
+}
+
+static void _bmff_detach_avc_decoder_config(DetachWalk *walk, Box *box)
+{
+    AVCDecoderConfigBox *avcc = (AVCDecoderConfigBox*)box;
+    avcc->config_record = _bmff_detach_bytes(walk, avcc->config_record, avcc->config_record_size);
+}
+
+static void _bmff_detach_sample_encryption(DetachWalk *walk, Box *box)
+{
+    SampleEncryptionBox *senc = (SampleEncryptionBox*)box;
+    uint32_t i = 0;
+    for(; senc->samples && i < senc->sample_count; ++i) {
+        EncryptionSample *sample = &senc->samples[i];
+        sample->iv = _bmff_detach_bytes(walk, sample->iv, sample->iv_size);
+    }
+}
+
+static void _bmff_detach_track_encryption(DetachWalk *walk, Box *box)
+{
+    TrackEncryptionBox *tenc = (TrackEncryptionBox*)box;
+    tenc->default_constant_iv = _bmff_detach_bytes(walk, tenc->default_constant_iv, tenc->default_constant_iv_size);
+}
+
+static void _bmff_detach_protection_system_specific_header(DetachWalk *walk, Box *box)
+{
+    ProtectionSystemSpecificHeaderBox *pssh = (ProtectionSystemSpecificHeaderBox*)box;
+    pssh->kids = _bmff_detach_bytes(walk, pssh->kids, (size_t)pssh->kid_count * 16);
+    pssh->data = _bmff_detach_bytes(walk, pssh->data, pssh->data_size);
+}
+
+static void _bmff_detach_id3v2_metadata(DetachWalk *walk, Box *box)
+{
+    ID3v2MetadataBox *id32 = (ID3v2MetadataBox*)box;
+    id32->data = _bmff_detach_bytes(walk, id32->data, id32->data_size);
+}
+
+static void _bmff_detach_event_message(DetachWalk *walk, Box *box)
+{
+    EventMessageBox *emsg = (EventMessageBox*)box;
+    emsg->scheme_id_uri = _bmff_detach_string(walk, emsg->scheme_id_uri);
+    emsg->value = _bmff_detach_string(walk, emsg->value);
+    emsg->message_data = _bmff_detach_bytes(walk, emsg->message_data, emsg->message_data_size);
+}
+
+typedef struct DetachMapItem {
+    char        type[4];
+    detach_func func;
+} DetachMapItem;
+
+// boxes of parse_map that refer to their bytes or hold other boxes, every
+// other box only refers to its user type.
+static const DetachMapItem detach_map[] = {
+    {"ftyp", _bmff_detach_file_type},
+    {"styp", _bmff_detach_file_type},
+    {"moov", _bmff_detach_container},
+    {"trak", _bmff_detach_container},
+    {"edts", _bmff_detach_container},
+    {"mdia", _bmff_detach_container},
+    {"minf", _bmff_detach_container},
+    {"dinf", _bmff_detach_container},
+    {"stbl", _bmff_detach_container},
+    {"mvex", _bmff_detach_container},
+    {"moof", _bmff_detach_container},
+    {"traf", _bmff_detach_container},
+    {"mfra", _bmff_detach_container},
+    {"udta", _bmff_detach_container},
+    {"tref", _bmff_detach_container},
+    {"meco", _bmff_detach_container},
+    {"strk", _bmff_detach_container},
+    {"strd", _bmff_detach_container},
+    {"schi", _bmff_detach_container},
+    {"hdlr", _bmff_detach_handler},
+    {"infe", _bmff_detach_item_info_entry},
+    {"iinf", _bmff_detach_item_info},
+    {"ipmc", _bmff_detach_ipmp_control},
+    {"imif", _bmff_detach_ipmp_info},
+    {"schm", _bmff_detach_scheme_type},
+    {"sinf", _bmff_detach_protection_scheme_info},
+    {"rinf", _bmff_detach_protection_scheme_info},
+    {"ipro", _bmff_detach_item_protection},
+    {"meta", _bmff_detach_meta},
+    {"xml ", _bmff_detach_xml},
+    {"bxml", _bmff_detach_xml},
+    {"cprt", _bmff_detach_copyright},
+    {"url ", _bmff_detach_data_entry},
+    {"urn ", _bmff_detach_data_entry},
+    {"dref", _bmff_detach_data_reference},
+    {"stsd", _bmff_detach_sample_description},
+    {"sgpd", _bmff_detach_sample_group_description},
+    {"elng", _bmff_detach_extended_language_tag},
+    {"trep", _bmff_detach_track_extension_properties},
+    {"kind", _bmff_detach_kind},
+    {"idat", _bmff_detach_item_data},
+    {"fpar", _bmff_detach_file_partition},
+    {"paen", _bmff_detach_partition_entry},
+    {"gitn", _bmff_detach_group_id_to_name},
+    {"fiin", _bmff_detach_fd_item_information},
+    {"stri", _bmff_detach_sub_track_information},
+    {"stvi", _bmff_detach_stereo_video},
+    {"cinf", _bmff_detach_complete_track_info},
+    {"rtp ", _bmff_detach_rtp_hint_sample_entry},
+    {"srtp", _bmff_detach_rtp_hint_sample_entry},
+    {"rrtp", _bmff_detach_rtp_hint_sample_entry},
+    {"rsrp", _bmff_detach_rtp_hint_sample_entry},
+    {"fdp ", _bmff_detach_fd_hint_sample_entry},
+    {"metx", _bmff_detach_xml_meta_data_sample_entry},
+    {"txtC", _bmff_detach_full_string},
+    {"mett", _bmff_detach_text_meta_data_sample_entry},
+    {"uri ", _bmff_detach_full_string},
+    {"uriI", _bmff_detach_full_data},
+    {"urim", _bmff_detach_uri_meta_sample_entry},
+    {"iods", _bmff_detach_object_descriptor},
+    {"esds", _bmff_detach_es_descriptor},
+    {"avcC", _bmff_detach_avc_decoder_config},
+    {"senc", _bmff_detach_sample_encryption},
+    {"tenc", _bmff_detach_track_encryption},
+    {"pssh", _bmff_detach_protection_system_specific_header},
+    {"ID32", _bmff_detach_id3v2_metadata},
+    {"emsg", _bmff_detach_event_message},
+};
+
+#define DETACH_MAP_LEN (sizeof(detach_map) / sizeof(DetachMapItem))
+
+// walks a box found by its type, the way parse_map finds its parser.
+static void _bmff_detach_box(DetachWalk *walk, Box *box)
+{
+    if(!box) {
+        return;
+    }
+    _bmff_detach_header(walk, box);
+
+    size_t i = 0;
+    for(; i < DETACH_MAP_LEN; ++i) {
+        if(BOX_TYPE_IS(box->type, detach_map[i].type)) {
+            detach_map[i].func(walk, box);
+            break;
+        }
+    }
+}
+
+BMFFCode bmff_detach_box(BMFFContext *ctx, const Box *box, BMFFDetachedBox **detached)
+{
+    if(!ctx)                    return BMFF_INVALID_CONTEXT;
+    if(!box || !detached)       return BMFF_INVALID_PARAMETER;
+    // memoized boxes belong to the cache, and a box is only detached once.
+    if(ctx->memo || !ctx->allocs_stack || box != ctx->detach_box) {
+        return BMFF_INVALID_PARAMETER;
+    }
+
+    DetachWalk walk;
+    memset(&walk, 0, sizeof(DetachWalk));
+    walk.begin = ctx->detach_data;
+    walk.end = ctx->detach_data + ctx->detach_size;
+    _bmff_detach_box(&walk, (Box*)box);
+
+    MemList *layer = ctx->allocs_stack;
+    size_t size = sizeof(BMFFDetachedBox) + sizeof(size_t) * layer->used + walk.used;
+    if(size > _bmff_memory_available(ctx)) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    BMFFDetachedBox *result = _bmff_malloc(ctx, size);
+    if(!result) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    ctx->memory_used += size;
+
+    // second pass, now that there is room for the copies.
+    uint8_t *copy = (uint8_t*)(result + 1) + sizeof(size_t) * layer->used;
+    memset(&walk.handler_type, 0, sizeof(walk.handler_type));
+    walk.copy = copy;
+    walk.used = 0;
+    _bmff_detach_box(&walk, (Box*)box);
+
+    // take the allocations of the layer, the arena it had is allocated again
+    // when the layer is popped.
+    result->addresses = (size_t*)(result + 1);
+    memcpy(result->addresses, layer->addresses, sizeof(size_t) * layer->used);
+    result->address_count = layer->used;
+    result->arena = layer->arena;
+    result->bytes = layer->bytes + size;
+    layer->used = 0;
+    layer->bytes = 0;
+    layer->overflow += layer->arena_used;
+    layer->arena = NULL;
+    layer->arena_size = 0;
+    layer->arena_used = 0;
+
+    ctx->detach_box = NULL;
+    *detached = result;
+    return BMFF_OK;
+}
+
+BMFFCode bmff_detached_box_release(BMFFContext *ctx, BMFFDetachedBox *detached)
+{
+    if(!ctx)        return BMFF_INVALID_CONTEXT;
+    if(!detached)   return BMFF_INVALID_PARAMETER;
+
+    uint32_t i = detached->address_count;
+    for(; i > 0; --i) {
+        _bmff_free(ctx, (void*)detached->addresses[i-1]);
+    }
+    _bmff_free(ctx, detached->arena);
+    ctx->memory_used -= detached->bytes;
+    _bmff_free(ctx, detached);
+    return BMFF_OK;
+}
@@ -0,0 +1,71 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef DETACH_H
+#define DETACH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Top level box taken over by the caller, see bmff_detach_box.
+ */
+typedef struct BMFFDetachedBox BMFFDetachedBox;
+
+/**
+ * Detaches a top level box from the context and from the data it was parsed
+ * from, so the box outlives bmff_parse and the caller may recycle its buffer.
+ * Only valid for the box of a BMFFEventParseComplete event at the top level,
+ * while the events of that box are delivered, and not while the memo cache is
+ * enabled.
+ *
+ * The byte ranges the box and the boxes inside it refer to, such as brands,
+ * strings, IVs, sgpd entries or message_data, are copied in one pass and their
+ * pointers rewritten. The payload of an mdat box is not copied. The box keeps
+ * its address and stays charged to the memory limit until it is released with
+ * bmff_detached_box_release, which must happen before the context is destroyed
+ * or its allocator changed.
+ *
+ * @return BMFF_RESOURCE_LIMIT when the copies do not fit the memory limit, in
+ *         which case the box is released with the others.
+ */
+BMFFCode bmff_detach_box(BMFFContext *ctx, const Box *box, BMFFDetachedBox **detached);
+
+/**
+ * Frees a detached box, the boxes inside it and the copies of their bytes.
+ */
+BMFFCode bmff_detached_box_release(BMFFContext *ctx, BMFFDetachedBox *detached);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DETACH_H
@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "frozen_tree.h"
+#include "sample_index.h"
+#include "parse_common.h"
+
+#define FROZEN_ALIGN(n) (((n) + 7) & ~((uint64_t)7))
+#define FROZEN_BYTE_ORDER (0x01020304)
+
+/**
+ * Blob header, written in host byte order. The node table follows the header
+ * and the source bytes follow the node table.
+ */
+typedef struct FrozenHeader {
+    uint8_t     magic[4];
+    uint32_t    version;
+    uint32_t    byte_order;
+    uint32_t    node_count;
+    uint64_t    source_hash;
+    uint64_t    data_offset;
+    uint64_t    data_size;
+    uint64_t    total_size;
+} FrozenHeader;
+
+/**
+ * Build state, the nodes are collected from the parse events.
+ */
+typedef struct FrozenBuild {
+    BMFFContext     *ctx;
+    const uint8_t   *data;
+    size_t          size;
+    BMFFFrozenNode  *nodes;
+    // last child of each node, used to link the next sibling.
+    uint32_t        *last_child;
+    uint32_t        count;
+    uint32_t        capacity;
+    // node whose box is being parsed.
+    uint32_t        current;
+    // last top level node.
+    uint32_t        last_root;
+    BMFFCode        result;
+} FrozenBuild;
+
+static void _bmff_frozen_add_node(FrozenBuild *build, const uint8_t *fourCC, uint32_t flags)
+{
+    if(build->count == build->capacity) {
+        uint32_t capacity = build->capacity ? build->capacity * 2 : 64;
+        BMFFFrozenNode *nodes = _bmff_realloc(build->ctx, build->nodes, sizeof(BMFFFrozenNode) * build->capacity,
+                                               sizeof(BMFFFrozenNode) * capacity);
+        if(!nodes) {
+            build->result = BMFF_RESOURCE_LIMIT;
+            return;
+        }
+        build->nodes = nodes;
+        uint32_t *last_child = _bmff_realloc(build->ctx, build->last_child, sizeof(uint32_t) * build->capacity,
+                                             sizeof(uint32_t) * capacity);
+        if(!last_child) {
+            build->result = BMFF_RESOURCE_LIMIT;
+            return;
+        }
+        build->last_child = last_child;
+        build->capacity = capacity;
+    }
+
+    uint32_t index = build->count++;
+    BMFFFrozenNode *node = &build->nodes[index];
+    const uint8_t *start = fourCC - 4;
+    size_t remaining = build->size - (size_t)(start - build->data);
+    memcpy(node->type, fourCC, 4);
+    node->parent = build->current;
+    node->first_child = BMFF_FROZEN_NONE;
+    node->next_sibling = BMFF_FROZEN_NONE;
+    node->flags = flags;
+    // the offset is relative to the source until the blob is laid out.
+    node->offset = (uint64_t)(start - build->data);
+    node->size = parse_u32(start) == 0 ? remaining : parse_box_size(start, remaining);
+    build->last_child[index] = BMFF_FROZEN_NONE;
+
+    if(build->current == BMFF_FROZEN_NONE) {
+        node->depth = 0;
+        if(build->last_root != BMFF_FROZEN_NONE) {
+            build->nodes[build->last_root].next_sibling = index;
+        }
+        build->last_root = index;
+    }else{
+        BMFFFrozenNode *parent = &build->nodes[build->current];
+        node->depth = parent->depth + 1;
+        if(build->last_child[build->current] == BMFF_FROZEN_NONE) {
+            parent->first_child = index;
+        }else{
+            build->nodes[build->last_child[build->current]].next_sibling = index;
+        }
+        build->last_child[build->current] = index;
+    }
+}
+
+static void _bmff_frozen_on_event(BMFFContext *ctx,
+                                  BMFFEventId id,
+                                  const uint8_t *fourCC,
+                                  void *data,
+                                  void *user_data)
+{
+    (void)ctx;
+    (void)data;
+    FrozenBuild *build = (FrozenBuild*)user_data;
+    if(build->result != BMFF_OK) {
+        return;
+    }
+
+    switch(id) {
+        case BMFFEventParseStart:
+            _bmff_frozen_add_node(build, fourCC, 0);
+            if(build->result == BMFF_OK) {
+                build->current = build->count - 1;
+            }
+            break;
+        case BMFFEventParseError:
+            build->nodes[build->current].flags |= BMFF_FROZEN_NODE_UNPARSED;
+            // fall through
+        case BMFFEventParseComplete:
+            build->current = build->nodes[build->current].parent;
+            break;
+        case BMFFEventParserNotFound:
+            // only reported for top level boxes, which are kept as leaves.
+            _bmff_frozen_add_node(build, fourCC, BMFF_FROZEN_NODE_UNPARSED);
+            break;
+        default:
+            break;
+    }
+}
+
+BMFFCode bmff_frozen_tree_build(BMFFContext *ctx, const uint8_t *data, size_t size, BMFFFrozenTree *tree)
+{
+    if(!ctx)            return BMFF_INVALID_CONTEXT;
+    if(!data)           return BMFF_INVALID_DATA;
+    if(!tree)           return BMFF_INVALID_PARAMETER;
+    if(ctx->events)     return BMFF_INVALID_PARAMETER;
+    memset(tree, 0, sizeof(BMFFFrozenTree));
+
+    FrozenBuild build;
+    memset(&build, 0, sizeof(FrozenBuild));
+    build.ctx = ctx;
+    build.data = data;
+    build.size = size;
+    build.current = BMFF_FROZEN_NONE;
+    build.last_root = BMFF_FROZEN_NONE;
+    build.result = BMFF_OK;
+
+    bmff_on_event callback = ctx->callback;
+    void *callback_user_data = ctx->callback_user_data;
+    uint32_t event_mask = ctx->event_mask;
+    // the boxes of a memoized box point into the copy kept by the cache.
+    BMFFMemo *memo = ctx->memo;
+    ctx->memo = NULL;
+    ctx->callback = _bmff_frozen_on_event;
+    ctx->callback_user_data = &build;
+    ctx->event_mask = BMFF_EVENT_MASK(BMFFEventParseStart) |
+                      BMFF_EVENT_MASK(BMFFEventParseComplete) |
+                      BMFF_EVENT_MASK(BMFFEventParseError) |
+                      BMFF_EVENT_MASK(BMFFEventParserNotFound);
+
+    BMFFCode res = BMFF_OK;
+    size_t parsed = bmff_parse(ctx, data, size, &res);
+
+    ctx->callback = callback;
+    ctx->callback_user_data = callback_user_data;
+    ctx->event_mask = event_mask;
+    ctx->memo = memo;
+
+    if(res == BMFF_OK) {
+        res = build.result;
+    }
+
+    uint8_t *blob = NULL;
+    if(res == BMFF_OK) {
+        uint64_t data_offset = FROZEN_ALIGN(sizeof(FrozenHeader) + sizeof(BMFFFrozenNode) * (uint64_t)build.count);
+        uint64_t total_size = data_offset + FROZEN_ALIGN(parsed);
+        blob = _bmff_malloc(ctx, (size_t)total_size);
+        if(!blob) {
+            res = BMFF_RESOURCE_LIMIT;
+        }else{
+            memset(blob, 0, (size_t)total_size);
+            FrozenHeader *header = (FrozenHeader*)blob;
+            memcpy(header->magic, "BMFT", 4);
+            header->version = BMFF_FROZEN_TREE_VERSION;
+            header->byte_order = FROZEN_BYTE_ORDER;
+            header->node_count = build.count;
+            header->source_hash = bmff_hash(data, parsed);
+            header->data_offset = data_offset;
+            header->data_size = parsed;
+            header->total_size = total_size;
+
+            BMFFFrozenNode *nodes = (BMFFFrozenNode*)(blob + sizeof(FrozenHeader));
+            uint32_t i = 0;
+            for(; i < build.count; ++i) {
+                nodes[i] = build.nodes[i];
+                nodes[i].offset += data_offset;
+            }
+            memcpy(blob + data_offset, data, parsed);
+        }
+    }
+
+    _bmff_free(ctx, build.nodes);
+    _bmff_free(ctx, build.last_child);
+
+    if(res != BMFF_OK) {
+        return res;
+    }
+    res = bmff_frozen_tree_load(blob, ((FrozenHeader*)blob)->total_size, tree);
+    tree->free = ctx->free;
+    tree->allocator = ctx->allocator;
+    return res;
+}
+
+BMFFCode bmff_frozen_tree_load(const uint8_t *blob, size_t size, BMFFFrozenTree *tree)
+{
+    if(!blob || !tree) return BMFF_INVALID_PARAMETER;
+    memset(tree, 0, sizeof(BMFFFrozenTree));
+
+    if(size < sizeof(FrozenHeader) || ((uintptr_t)blob & 7) != 0) {
+        return BMFF_INVALID_DATA;
+    }
+    const FrozenHeader *header = (const FrozenHeader*)blob;
+    int valid = memcmp(header->magic, "BMFT", 4) == 0 &&
+                header->version == BMFF_FROZEN_TREE_VERSION &&
+                header->byte_order == FROZEN_BYTE_ORDER &&
+                header->total_size == size &&
+                header->data_offset >= sizeof(FrozenHeader) + sizeof(BMFFFrozenNode) * (uint64_t)header->node_count &&
+                header->data_offset <= size &&
+                header->data_size <= size - header->data_offset;
+    if(!valid) {
+        return BMFF_INVALID_DATA;
+    }
+
+    // links only point forward, so walking the tree always ends.
+    const BMFFFrozenNode *nodes = (const BMFFFrozenNode*)(blob + sizeof(FrozenHeader));
+    uint64_t data_end = header->data_offset + header->data_size;
+    uint32_t i = 0;
+    for(; i < header->node_count; ++i) {
+        const BMFFFrozenNode *node = &nodes[i];
+        if(node->offset < header->data_offset || node->offset > data_end || node->size > data_end - node->offset ||
+           (node->parent != BMFF_FROZEN_NONE && node->parent >= i) ||
+           (node->first_child != BMFF_FROZEN_NONE && (node->first_child <= i || node->first_child >= header->node_count)) ||
+           (node->next_sibling != BMFF_FROZEN_NONE && (node->next_sibling <= i || node->next_sibling >= header->node_count)))
+        {
+            return BMFF_INVALID_DATA;
+        }
+    }
+
+    tree->blob = blob;
+    tree->blob_size = size;
+    tree->node_count = header->node_count;
+    tree->nodes = nodes;
+    tree->source_hash = header->source_hash;
+    return BMFF_OK;
+}
+
+BMFFCode bmff_frozen_tree_save(const BMFFFrozenTree *tree, const char *path)
+{
+    if(!tree || !tree->blob || !path) return BMFF_INVALID_PARAMETER;
+
+    size_t path_len = strlen(path);
+    char *tmp_path = malloc(path_len + 5);
+    if(!tmp_path) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", 5);
+
+    int ok = 0;
+    FILE *file = fopen(tmp_path, "wb");
+    if(file) {
+        ok = fwrite(tree->blob, tree->blob_size, 1, file) == 1;
+        ok = (fclose(file) == 0) && ok;
+    }
+    if(ok) {
+        ok = rename(tmp_path, path) == 0;
+    }
+    if(!ok) {
+        remove(tmp_path);
+    }
+
+    free(tmp_path);
+    return ok ? BMFF_OK : BMFF_IO_ERROR;
+}
+
+BMFFCode bmff_frozen_tree_open(const char *path, uint64_t source_hash, BMFFFrozenTree *tree)
+{
+    if(!path || !tree) return BMFF_INVALID_PARAMETER;
+    memset(tree, 0, sizeof(BMFFFrozenTree));
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return BMFF_INVALID_DATA;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(FrozenHeader)) {
+        close(fd);
+        return BMFF_INVALID_DATA;
+    }
+    size_t size = (size_t)st.st_size;
+    uint8_t *mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) {
+        return BMFF_INVALID_DATA;
+    }
+
+    BMFFCode res = bmff_frozen_tree_load(mapping, size, tree);
+    if(res == BMFF_OK && source_hash != 0 && source_hash != tree->source_hash) {
+        res = BMFF_INVALID_DATA;
+    }
+    if(res != BMFF_OK) {
+        memset(tree, 0, sizeof(BMFFFrozenTree));
+        munmap(mapping, size);
+        return res;
+    }
+
+    tree->mapping = mapping;
+    tree->mapping_size = size;
+    return BMFF_OK;
+}
+
+static const BMFFFrozenNode * _bmff_frozen_find(const BMFFFrozenTree *tree, uint32_t index, const char *path)
+{
+    for(; index != BMFF_FROZEN_NONE; index = tree->nodes[index].next_sibling) {
+        const BMFFFrozenNode *node = &tree->nodes[index];
+        if(memcmp(node->type, path, 4) != 0) {
+            continue;
+        }
+        if(path[4] == '\0') {
+            return node;
+        }
+        // keep looking in the next sibling of the same type when this one has no match.
+        const BMFFFrozenNode *found = _bmff_frozen_find(tree, node->first_child, path + 5);
+        if(found) {
+            return found;
+        }
+    }
+    return NULL;
+}
+
+const BMFFFrozenNode * bmff_frozen_tree_find(const BMFFFrozenTree *tree,
+                                             const BMFFFrozenNode *from,
+                                             const char *path)
+{
+    if(!tree || !path || tree->node_count == 0) return NULL;
+    if(strlen(path) % 5 != 4) return NULL;
+
+    return _bmff_frozen_find(tree, from ? from->first_child : 0, path);
+}
+
+const uint8_t * bmff_frozen_node_data(const BMFFFrozenTree *tree, const BMFFFrozenNode *node)
+{
+    if(!tree || !node) return NULL;
+    return tree->blob + node->offset;
+}
+
+BMFFCode bmff_frozen_tree_destroy(BMFFFrozenTree *tree)
+{
+    if(!tree) return BMFF_INVALID_PARAMETER;
+
+    if(tree->mapping) {
+        munmap(tree->mapping, tree->mapping_size);
+    }else if(tree->free) {
+        _bmff_allocator_free(&tree->allocator, tree->free, (void*)tree->blob);
+    }
+    memset(tree, 0, sizeof(BMFFFrozenTree));
+
+    return BMFF_OK;
+}
@@ -0,0 +1,137 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef FROZEN_TREE_H
+#define FROZEN_TREE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// version of the frozen tree blob format.
+#define BMFF_FROZEN_TREE_VERSION                (1)
+// node index used when there is no parent, child or sibling.
+#define BMFF_FROZEN_NONE                        (0xFFFFFFFF)
+// set on a node whose box failed to parse or has no parser.
+#define BMFF_FROZEN_NODE_UNPARSED               (0x01)
+
+/**
+ * Box of a frozen tree. Nodes are stored in document order and refer to each
+ * other by index, the box bytes by offset from the start of the blob.
+ */
+typedef struct BMFFFrozenNode {
+    uint8_t     type[4];
+    uint32_t    parent;
+    uint32_t    first_child;
+    uint32_t    next_sibling;
+    uint32_t    depth;
+    uint32_t    flags;
+    // offset and size of the whole box, header included.
+    uint64_t    offset;
+    uint64_t    size;
+} BMFFFrozenNode;
+
+/**
+ * Box tree frozen into one contiguous, position independent blob holding the
+ * node table and a copy of the source bytes the nodes refer to. The blob has no
+ * pointers, so it can be written to a file or shared memory once and mapped
+ * read only by any number of processes.
+ */
+typedef struct BMFFFrozenTree {
+    const uint8_t           *blob;
+    size_t                  blob_size;
+    uint32_t                node_count;
+    const BMFFFrozenNode    *nodes;
+    // bmff_hash of the source bytes.
+    uint64_t                source_hash;
+    // allocator that owns a built blob.
+    void (*free)(void*);
+    BMFFAllocator           allocator;
+    // file the blob is mapped from, when the tree was opened from one.
+    void                    *mapping;
+    size_t                  mapping_size;
+} BMFFFrozenTree;
+
+/**
+ * Parses data, typically a whole moov box, and freezes the tree of its boxes.
+ * The event callback of the context is replaced for the duration of the call,
+ * batched event delivery must not be enabled. The memo cache of the context is
+ * not used while the tree is built. The blob is allocated with the allocator of
+ * the context.
+ */
+BMFFCode bmff_frozen_tree_build(BMFFContext *ctx, const uint8_t *data, size_t size, BMFFFrozenTree *tree);
+
+/**
+ * Uses a blob in memory, such as shared memory, without copying it. The blob
+ * is validated and must outlive the tree.
+ *
+ * @return BMFF_INVALID_DATA when the blob is not a valid frozen tree.
+ */
+BMFFCode bmff_frozen_tree_load(const uint8_t *blob, size_t size, BMFFFrozenTree *tree);
+
+/**
+ * Writes the blob to a file. The file is written next to path and renamed
+ * into place.
+ *
+ * @return BMFF_IO_ERROR when the file can not be written.
+ */
+BMFFCode bmff_frozen_tree_save(const BMFFFrozenTree *tree, const char *path);
+
+/**
+ * Maps a file read only and loads it. A source_hash other than 0 must match
+ * the hash of the source the tree was built from.
+ *
+ * @return BMFF_INVALID_DATA when the file is missing, stale or not a frozen tree.
+ */
+BMFFCode bmff_frozen_tree_open(const char *path, uint64_t source_hash, BMFFFrozenTree *tree);
+
+/**
+ * Finds the first node matching a dot separated path of box types, such as
+ * "trak.mdia.hdlr", below a node, or from the top level boxes when from is NULL.
+ */
+const BMFFFrozenNode * bmff_frozen_tree_find(const BMFFFrozenTree *tree,
+                                             const BMFFFrozenNode *from,
+                                             const char *path);
+
+/**
+ * Returns the bytes of the box of a node. They can be handed to bmff_parse to
+ * parse a single box on demand.
+ */
+const uint8_t * bmff_frozen_node_data(const BMFFFrozenTree *tree, const BMFFFrozenNode *node);
+
+/**
+ * Frees a built blob or unmaps an opened one. A loaded blob is left alone.
+ */
+BMFFCode bmff_frozen_tree_destroy(BMFFFrozenTree *tree);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FROZEN_TREE_H
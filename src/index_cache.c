@@ -0,0 +1,312 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "index_cache.h"
+
+#define INDEX_CACHE_BUCKETS (64)
+
+#define ATOMIC_ADD(p, v) __atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+#define ATOMIC_SUB(p, v) __atomic_sub_fetch((p), (v), __ATOMIC_RELAXED)
+#define ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+
+/**
+ * Cached index, the index comes first so a handed out index leads back to
+ * its entry.
+ */
+typedef struct CacheEntry {
+    BMFFSampleIndex     index;
+    char                *path;
+    uint64_t            path_hash;
+    size_t              bytes;
+    // value of the use clock of the cache at the last use.
+    uint64_t            last_used;
+    // handed out references, the entry is freed once evicted and unreferenced.
+    uint32_t            refs;
+    eBoolean            evicted;
+    BMFFIndexCacheShard *shard;
+    struct CacheEntry   *hash_next;
+    // least recently used list, most recent first.
+    struct CacheEntry   *prev;
+    struct CacheEntry   *next;
+} CacheEntry;
+
+struct BMFFIndexCacheShard {
+    pthread_mutex_t     lock;
+    CacheEntry          *buckets[INDEX_CACHE_BUCKETS];
+    CacheEntry          *head;
+    CacheEntry          *tail;
+};
+
+static size_t _bmff_index_bytes(const BMFFSampleIndex *index)
+{
+    if(index->mapping) {
+        return index->mapping_size;
+    }
+    size_t bytes = sizeof(BMFFTrackIndex) * index->track_count;
+    uint32_t i = 0;
+    for(; i < index->track_count; ++i) {
+        size_t n = index->tracks[i].sample_count;
+        bytes += n * (8 + 8 + 4 + 4) + (n + 7) / 8;
+    }
+    return bytes;
+}
+
+static void _bmff_cache_free_entry(CacheEntry *entry)
+{
+    bmff_sample_index_destroy(&entry->index);
+    free(entry->path);
+    free(entry);
+}
+
+// removes an entry from its shard, the shard must be locked.
+static void _bmff_cache_unlink(BMFFIndexCache *cache, CacheEntry *entry)
+{
+    BMFFIndexCacheShard *shard = entry->shard;
+    CacheEntry **link = &shard->buckets[entry->path_hash % INDEX_CACHE_BUCKETS];
+    while(*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+
+    if(entry->prev) entry->prev->next = entry->next;
+    else            shard->head = entry->next;
+    if(entry->next) entry->next->prev = entry->prev;
+    else            shard->tail = entry->prev;
+
+    entry->evicted = eBooleanTrue;
+    ATOMIC_SUB(&cache->stats.entries, 1);
+    ATOMIC_SUB(&cache->stats.bytes, entry->bytes);
+    ATOMIC_ADD(&cache->stats.evictions, 1);
+}
+
+static void _bmff_cache_touch(BMFFIndexCache *cache, BMFFIndexCacheShard *shard, CacheEntry *entry)
+{
+    entry->last_used = ATOMIC_ADD(&cache->clock, 1);
+    if(shard->head == entry) {
+        return;
+    }
+    if(entry->prev) entry->prev->next = entry->next;
+    if(entry->next) entry->next->prev = entry->prev;
+    else            shard->tail = entry->prev;
+    entry->prev = NULL;
+    entry->next = shard->head;
+    if(shard->head) shard->head->prev = entry;
+    else            shard->tail = entry;
+    shard->head = entry;
+}
+
+static uint64_t _bmff_cache_hash(const char *path)
+{
+    return bmff_hash((const uint8_t*)path, strlen(path));
+}
+
+static BMFFIndexCacheShard * _bmff_cache_shard(BMFFIndexCache *cache, uint64_t path_hash)
+{
+    // the low bits pick the bucket, the high bits the shard.
+    return &cache->shards[(path_hash >> 32) % BMFF_INDEX_CACHE_SHARDS];
+}
+
+// evicts the least recently used entries, one shard locked at a time. The
+// shard whose tail was used the longest ago is picked each time.
+static void _bmff_cache_trim(BMFFIndexCache *cache)
+{
+    while(ATOMIC_LOAD(&cache->stats.bytes) > cache->budget) {
+        BMFFIndexCacheShard *oldest = NULL;
+        uint64_t oldest_use = 0;
+        uint32_t i = 0;
+        for(; i < BMFF_INDEX_CACHE_SHARDS; ++i) {
+            BMFFIndexCacheShard *shard = &cache->shards[i];
+            pthread_mutex_lock(&shard->lock);
+            if(shard->tail && (!oldest || shard->tail->last_used < oldest_use)) {
+                oldest = shard;
+                oldest_use = shard->tail->last_used;
+            }
+            pthread_mutex_unlock(&shard->lock);
+        }
+        if(!oldest) {
+            break;
+        }
+
+        // another thread may have changed the shard meanwhile, its tail is still a good pick.
+        pthread_mutex_lock(&oldest->lock);
+        CacheEntry *entry = oldest->tail;
+        if(entry && ATOMIC_LOAD(&cache->stats.bytes) > cache->budget) {
+            _bmff_cache_unlink(cache, entry);
+            if(entry->refs == 0) {
+                _bmff_cache_free_entry(entry);
+            }
+        }
+        pthread_mutex_unlock(&oldest->lock);
+    }
+}
+
+BMFFCode bmff_index_cache_init(BMFFIndexCache *cache, size_t budget)
+{
+    if(!cache) return BMFF_INVALID_PARAMETER;
+    memset(cache, 0, sizeof(BMFFIndexCache));
+
+    cache->shards = calloc(BMFF_INDEX_CACHE_SHARDS, sizeof(BMFFIndexCacheShard));
+    if(!cache->shards) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    uint32_t i = 0;
+    for(; i < BMFF_INDEX_CACHE_SHARDS; ++i) {
+        pthread_mutex_init(&cache->shards[i].lock, NULL);
+    }
+    cache->budget = budget;
+
+    return BMFF_OK;
+}
+
+BMFFCode bmff_index_cache_destroy(BMFFIndexCache *cache)
+{
+    if(!cache || !cache->shards) return BMFF_INVALID_PARAMETER;
+
+    uint32_t i = 0;
+    for(; i < BMFF_INDEX_CACHE_SHARDS; ++i) {
+        BMFFIndexCacheShard *shard = &cache->shards[i];
+        CacheEntry *entry = shard->head;
+        while(entry) {
+            CacheEntry *next = entry->next;
+            _bmff_cache_free_entry(entry);
+            entry = next;
+        }
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free(cache->shards);
+    memset(cache, 0, sizeof(BMFFIndexCache));
+
+    return BMFF_OK;
+}
+
+const BMFFSampleIndex * bmff_index_cache_get(BMFFIndexCache *cache,
+                                             const char *path,
+                                             uint64_t file_size,
+                                             uint64_t mtime)
+{
+    if(!cache || !cache->shards || !path) return NULL;
+
+    uint64_t path_hash = _bmff_cache_hash(path);
+    BMFFIndexCacheShard *shard = _bmff_cache_shard(cache, path_hash);
+
+    pthread_mutex_lock(&shard->lock);
+    CacheEntry *entry = shard->buckets[path_hash % INDEX_CACHE_BUCKETS];
+    for(; entry; entry = entry->hash_next) {
+        if(entry->path_hash == path_hash &&
+           entry->index.key.file_size == file_size &&
+           entry->index.key.mtime == mtime &&
+           strcmp(entry->path, path) == 0) {
+            entry->refs++;
+            _bmff_cache_touch(cache, shard, entry);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if(entry) {
+        ATOMIC_ADD(&cache->stats.hits, 1);
+        return &entry->index;
+    }
+    ATOMIC_ADD(&cache->stats.misses, 1);
+    return NULL;
+}
+
+const BMFFSampleIndex * bmff_index_cache_put(BMFFIndexCache *cache, const char *path, BMFFSampleIndex *index)
+{
+    if(!cache || !cache->shards || !path || !index) return NULL;
+
+    CacheEntry *entry = calloc(1, sizeof(CacheEntry));
+    size_t path_len = strlen(path);
+    char *path_copy = malloc(path_len + 1);
+    if(!entry || !path_copy) {
+        free(entry);
+        free(path_copy);
+        return NULL;
+    }
+    memcpy(path_copy, path, path_len + 1);
+
+    entry->index = *index;
+    memset(index, 0, sizeof(BMFFSampleIndex));
+    entry->path = path_copy;
+    entry->path_hash = _bmff_cache_hash(path);
+    entry->bytes = _bmff_index_bytes(&entry->index);
+    entry->refs = 1;
+    entry->evicted = eBooleanFalse;
+    entry->shard = _bmff_cache_shard(cache, entry->path_hash);
+
+    BMFFIndexCacheShard *shard = entry->shard;
+    CacheEntry *found = NULL;
+    pthread_mutex_lock(&shard->lock);
+    CacheEntry *other = shard->buckets[entry->path_hash % INDEX_CACHE_BUCKETS];
+    while(other) {
+        CacheEntry *next = other->hash_next;
+        if(other->path_hash == entry->path_hash && strcmp(other->path, path) == 0) {
+            if(other->index.key.file_size == entry->index.key.file_size &&
+               other->index.key.mtime == entry->index.key.mtime) {
+                found = other;
+            }else{
+                // an index of an older version of the file.
+                _bmff_cache_unlink(cache, other);
+                if(other->refs == 0) {
+                    _bmff_cache_free_entry(other);
+                }
+            }
+        }
+        other = next;
+    }
+
+    if(found) {
+        found->refs++;
+        _bmff_cache_touch(cache, shard, found);
+    }else{
+        CacheEntry **bucket = &shard->buckets[entry->path_hash % INDEX_CACHE_BUCKETS];
+        entry->hash_next = *bucket;
+        *bucket = entry;
+        entry->next = shard->head;
+        if(shard->head) shard->head->prev = entry;
+        else            shard->tail = entry;
+        shard->head = entry;
+        entry->last_used = ATOMIC_ADD(&cache->clock, 1);
+        ATOMIC_ADD(&cache->stats.entries, 1);
+        ATOMIC_ADD(&cache->stats.bytes, entry->bytes);
+        ATOMIC_ADD(&cache->stats.insertions, 1);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if(found) {
+        _bmff_cache_free_entry(entry);
+        return &found->index;
+    }
+    _bmff_cache_trim(cache);
+    return &entry->index;
+}
+
+void bmff_index_cache_release(BMFFIndexCache *cache, const BMFFSampleIndex *index)
+{
+    if(!cache || !index) return;
+
+    CacheEntry *entry = (CacheEntry*)index;
+    BMFFIndexCacheShard *shard = entry->shard;
+
+    pthread_mutex_lock(&shard->lock);
+    eBoolean release = (--entry->refs == 0 && entry->evicted == eBooleanTrue) ? eBooleanTrue : eBooleanFalse;
+    pthread_mutex_unlock(&shard->lock);
+
+    if(release == eBooleanTrue) {
+        _bmff_cache_free_entry(entry);
+    }
+}
+
+BMFFCode bmff_index_cache_get_stats(BMFFIndexCache *cache, BMFFIndexCacheStats *stats)
+{
+    if(!cache || !stats) return BMFF_INVALID_PARAMETER;
+
+    stats->hits = ATOMIC_LOAD(&cache->stats.hits);
+    stats->misses = ATOMIC_LOAD(&cache->stats.misses);
+    stats->insertions = ATOMIC_LOAD(&cache->stats.insertions);
+    stats->evictions = ATOMIC_LOAD(&cache->stats.evictions);
+    stats->entries = ATOMIC_LOAD(&cache->stats.entries);
+    stats->bytes = ATOMIC_LOAD(&cache->stats.bytes);
+
+    return BMFF_OK;
+}
@@ -0,0 +1,119 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef INDEX_CACHE_H
+#define INDEX_CACHE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+#include "sample_index.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// number of independently locked shards of an index cache.
+#define BMFF_INDEX_CACHE_SHARDS                 (16)
+
+typedef struct BMFFIndexCacheShard BMFFIndexCacheShard;
+
+/**
+ * Counters of an index cache, read while other threads use the cache.
+ */
+typedef struct BMFFIndexCacheStats {
+    uint64_t    hits;
+    uint64_t    misses;
+    uint64_t    insertions;
+    uint64_t    evictions;
+    uint32_t    entries;
+    // bytes of the tables held by the cache, handed out indexes included.
+    size_t      bytes;
+} BMFFIndexCacheStats;
+
+/**
+ * Thread-safe cache of sample indexes shared by the whole process, keyed by
+ * the path, size and modification time of the file they were built from.
+ * Keys are spread over BMFF_INDEX_CACHE_SHARDS shards, each with a lock and a
+ * least recently used list of its own. All shards share one byte budget, the
+ * entry evicted to stay within it is the oldest of the shard tails.
+ */
+typedef struct BMFFIndexCache {
+    BMFFIndexCacheShard *shards;
+    size_t              budget;
+    // incremented atomically on every use, orders entries across shards.
+    uint64_t            clock;
+    // updated atomically.
+    BMFFIndexCacheStats stats;
+} BMFFIndexCache;
+
+/**
+ * Initializes a cache that holds at most budget bytes of sample tables.
+ */
+BMFFCode bmff_index_cache_init(BMFFIndexCache *cache, size_t budget);
+
+/**
+ * Destroys the cache and every index in it. No index may still be handed out.
+ */
+BMFFCode bmff_index_cache_destroy(BMFFIndexCache *cache);
+
+/**
+ * Looks up the index of a file. A returned index stays valid, even once it is
+ * evicted, until it is handed back with bmff_index_cache_release.
+ *
+ * @return NULL when the cache has no index for this version of the file.
+ */
+const BMFFSampleIndex * bmff_index_cache_get(BMFFIndexCache *cache,
+                                             const char *path,
+                                             uint64_t file_size,
+                                             uint64_t mtime);
+
+/**
+ * Adds the index of a file, keyed by path and the file_size and mtime of the
+ * key of the index. The cache takes the index over and clears it. Indexes of
+ * older versions of the file are dropped. When another thread added the same
+ * file first, the new index is destroyed and the cached one is returned.
+ * Least recently used indexes are evicted to stay within the budget.
+ *
+ * @return the cached index, to hand back with bmff_index_cache_release, or
+ * NULL when it could not be added.
+ */
+const BMFFSampleIndex * bmff_index_cache_put(BMFFIndexCache *cache, const char *path, BMFFSampleIndex *index);
+
+/**
+ * Hands back an index returned by bmff_index_cache_get or bmff_index_cache_put.
+ */
+void bmff_index_cache_release(BMFFIndexCache *cache, const BMFFSampleIndex *index);
+
+/**
+ * Returns a snapshot of the counters of the cache.
+ */
+BMFFCode bmff_index_cache_get_stats(BMFFIndexCache *cache, BMFFIndexCacheStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INDEX_CACHE_H
@@ -0,0 +1,448 @@
+#include <string.h>
+
+#include "memo.h"
+#include "context.h"
+#include "parse.h"
+#include "parse_common.h"
+#include "sample_index.h"
+
+#define MEMO_BUCKETS (256)
+
+/**
+ * Event of a box inside a memoized box, replayed when the box is returned
+ * again. The type and data point into the source copy and layer of the entry.
+ */
+typedef struct MemoEvent {
+    BMFFEventId         id;
+    const uint8_t       *fourCC;
+    void                *data;
+} MemoEvent;
+
+/**
+ * Parsed box kept with the bytes it was parsed from and the allocations of
+ * its parse.
+ */
+typedef struct MemoEntry {
+    uint64_t            hash;
+    uint32_t            type;
+    size_t              size;
+    uint8_t             *source;
+    Box                 *box;
+    MemList             *layer;
+    MemoEvent           *events;
+    uint32_t            event_count;
+    uint32_t            event_capacity;
+    size_t              bytes;
+    // parse generation of the last use, pinned while it is the current one.
+    uint64_t            generation;
+    // context state left by the parse.
+    uint8_t             handler_type[4];
+    uint32_t            channel_count;
+    uint32_t            sample_description_version;
+    uint8_t             default_iv_size;
+    eBoolean            is_constant_iv;
+    struct MemoEntry    *hash_next;
+    // least recently used list, most recent first.
+    struct MemoEntry    *prev;
+    struct MemoEntry    *next;
+} MemoEntry;
+
+struct BMFFMemo {
+    uint32_t        types[BMFF_MEMO_MAX_TYPES];
+    uint32_t        type_count;
+    size_t          budget;
+    uint64_t        generation;
+    // set while a box is parsed into an entry, boxes inside it are not memoized.
+    eBoolean        filling;
+    MemoEntry       *buckets[MEMO_BUCKETS];
+    MemoEntry       *head;
+    MemoEntry       *tail;
+    BMFFMemoStats   stats;
+};
+
+static void _bmff_memo_unlink(BMFFMemo *memo, MemoEntry *entry)
+{
+    if(entry->prev) entry->prev->next = entry->next;
+    else            memo->head = entry->next;
+    if(entry->next) entry->next->prev = entry->prev;
+    else            memo->tail = entry->prev;
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void _bmff_memo_link_head(BMFFMemo *memo, MemoEntry *entry)
+{
+    entry->prev = NULL;
+    entry->next = memo->head;
+    if(memo->head)  memo->head->prev = entry;
+    else            memo->tail = entry;
+    memo->head = entry;
+}
+
+static void _bmff_memo_free_layer(BMFFContext *ctx, MemList *layer)
+{
+    uint32_t i = layer->used;
+    for(; i > 0; --i) {
+        _bmff_free(ctx, (void*)layer->addresses[i-1]);
+    }
+    _bmff_free(ctx, layer->arena);
+    _bmff_free(ctx, layer->addresses);
+    _bmff_free(ctx, layer);
+}
+
+static void _bmff_memo_free_entry(BMFFContext *ctx, MemoEntry *entry)
+{
+    if(entry->layer) {
+        _bmff_memo_free_layer(ctx, entry->layer);
+    }
+    _bmff_free(ctx, entry->events);
+    _bmff_free(ctx, entry->source);
+    _bmff_free(ctx, entry);
+}
+
+static void _bmff_memo_evict(BMFFContext *ctx, MemoEntry *entry)
+{
+    BMFFMemo *memo = ctx->memo;
+    MemoEntry **link = &memo->buckets[entry->hash % MEMO_BUCKETS];
+    while(*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    _bmff_memo_unlink(memo, entry);
+
+    memo->stats.entries--;
+    memo->stats.bytes -= entry->bytes;
+    memo->stats.evictions++;
+    _bmff_memo_free_entry(ctx, entry);
+}
+
+static void _bmff_memo_trim(BMFFContext *ctx)
+{
+    BMFFMemo *memo = ctx->memo;
+    MemoEntry *entry = memo->tail;
+    while(entry && memo->stats.bytes > memo->budget) {
+        MemoEntry *prev = entry->prev;
+        // boxes returned by the current parse may still be referenced by their parents.
+        if(entry->generation != memo->generation) {
+            _bmff_memo_evict(ctx, entry);
+        }
+        entry = prev;
+    }
+}
+
+static eBoolean _bmff_memo_type(const BMFFMemo *memo, uint32_t type)
+{
+    uint32_t i = 0;
+    for(; i < memo->type_count; ++i) {
+        if(memo->types[i] == type) {
+            return eBooleanTrue;
+        }
+    }
+    return eBooleanFalse;
+}
+
+static void _bmff_memo_restore(BMFFContext *ctx, const MemoEntry *entry)
+{
+    memcpy(ctx->handler_type, entry->handler_type, 4);
+    ctx->channel_count = entry->channel_count;
+    ctx->sample_description_version = entry->sample_description_version;
+    ctx->default_iv_size = entry->default_iv_size;
+    ctx->is_constant_iv = entry->is_constant_iv;
+}
+
+/**
+ * Event consumers of the context while a box is parsed into an entry.
+ */
+typedef struct MemoRecorder {
+    MemoEntry       *entry;
+    BMFFCode        result;
+    bmff_on_event   callback;
+    void            *callback_user_data;
+    uint32_t        event_mask;
+    BMFFEvent       *events;
+} MemoRecorder;
+
+// records every event of the boxes inside the entry and passes it on to the consumers.
+static void _bmff_memo_record(BMFFContext *ctx,
+                              BMFFEventId id,
+                              const uint8_t *fourCC,
+                              void *data,
+                              void *user_data)
+{
+    MemoRecorder *recorder = (MemoRecorder*)user_data;
+    MemoEntry *entry = recorder->entry;
+    if(entry->event_count == entry->event_capacity && recorder->result == BMFF_OK) {
+        uint32_t capacity = entry->event_capacity > 0 ? entry->event_capacity * 2 : 16;
+        MemoEvent *events = _bmff_realloc(ctx, entry->events, sizeof(MemoEvent) * entry->event_capacity,
+                                          sizeof(MemoEvent) * capacity);
+        if(events) {
+            entry->events = events;
+            entry->event_capacity = capacity;
+        }else{
+            recorder->result = BMFF_RESOURCE_LIMIT;
+        }
+    }
+    if(recorder->result == BMFF_OK) {
+        MemoEvent *event = &entry->events[entry->event_count++];
+        event->id = id;
+        event->fourCC = fourCC;
+        event->data = data;
+    }
+
+    if(recorder->event_mask & BMFF_EVENT_MASK(id)) {
+        if(recorder->events) {
+            ctx->events = recorder->events;
+            _bmff_queue_event(ctx, id, fourCC, data);
+            ctx->events = NULL;
+        }else if(recorder->callback) {
+            recorder->callback(ctx, id, fourCC, data, recorder->callback_user_data);
+        }
+    }
+}
+
+// delivers the recorded events as if the boxes inside the entry were parsed again.
+static void _bmff_memo_replay(BMFFContext *ctx, const MemoEntry *entry, const uint8_t *data)
+{
+    if(!ctx->events && !ctx->callback) {
+        return;
+    }
+
+    const uint8_t *parse_data = ctx->parse_data;
+    uint64_t parse_offset = ctx->parse_offset;
+    if(parse_data) {
+        ctx->parse_offset += data - parse_data;
+        ctx->parse_data = entry->source;
+    }
+    uint32_t depth = ctx->breadcrumb_depth;
+
+    // a box is on the breadcrumbs from its start event until its complete or error event.
+    uint32_t i = 0;
+    for(; i < entry->event_count; ++i) {
+        const MemoEvent *event = &entry->events[i];
+        if(event->id == BMFFEventParseComplete || event->id == BMFFEventParseError) {
+            _bmff_breadcrumb_pop(ctx);
+        }
+        CALLBACK(ctx, event->id, event->fourCC, event->data);
+        if(event->id == BMFFEventParseStart) {
+            _bmff_breadcrumb_push(ctx, event->fourCC);
+        }
+    }
+
+    ctx->breadcrumb_depth = depth;
+    ctx->parse_data = parse_data;
+    ctx->parse_offset = parse_offset;
+}
+
+// parses a copy of the box into a layer of its own so it outlives the parse.
+static BMFFCode _bmff_memo_fill(BMFFContext *ctx, parse_func func, MemoEntry *entry, const uint8_t *data)
+{
+    entry->layer = _bmff_malloc(ctx, sizeof(MemList));
+    if(!entry->layer) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    // the entry is freed on failure, so the layer must be valid before the next allocation.
+    memset(entry->layer, 0, sizeof(MemList));
+    entry->source = _bmff_malloc(ctx, entry->size);
+    if(!entry->source) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    entry->layer->count = 8;
+    entry->layer->addresses = _bmff_malloc(ctx, sizeof(size_t) * entry->layer->count);
+    if(!entry->layer->addresses) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    memcpy(entry->source, data, entry->size);
+
+    // events of the boxes inside report offsets as if the copy was the source.
+    MemList *allocs_stack = ctx->allocs_stack;
+    const uint8_t *parse_data = ctx->parse_data;
+    uint64_t parse_offset = ctx->parse_offset;
+    if(parse_data) {
+        ctx->parse_offset += data - parse_data;
+        ctx->parse_data = entry->source;
+    }
+    ctx->allocs_stack = entry->layer;
+    ctx->memo->filling = eBooleanTrue;
+
+    // the events of the boxes inside are recorded whatever the consumers, which
+    // may change before the entry is returned again.
+    MemoRecorder recorder;
+    recorder.entry = entry;
+    recorder.result = BMFF_OK;
+    recorder.callback = ctx->callback;
+    recorder.callback_user_data = ctx->callback_user_data;
+    recorder.event_mask = ctx->event_mask;
+    recorder.events = ctx->events;
+    ctx->callback = _bmff_memo_record;
+    ctx->callback_user_data = &recorder;
+    ctx->event_mask = BMFF_EVENT_MASK_ALL;
+    ctx->events = NULL;
+
+    BMFFCode res = func(ctx, entry->source, entry->size, &entry->box);
+
+    ctx->callback = recorder.callback;
+    ctx->callback_user_data = recorder.callback_user_data;
+    ctx->event_mask = recorder.event_mask;
+    ctx->events = recorder.events;
+    ctx->memo->filling = eBooleanFalse;
+    ctx->allocs_stack = allocs_stack;
+    ctx->parse_data = parse_data;
+    ctx->parse_offset = parse_offset;
+    // the memo has a budget of its own.
+    ctx->memory_used -= entry->layer->bytes;
+    entry->bytes = sizeof(MemoEntry) + entry->size + entry->layer->bytes + sizeof(MemoEvent) * entry->event_capacity;
+
+    memcpy(entry->handler_type, ctx->handler_type, 4);
+    entry->channel_count = ctx->channel_count;
+    entry->sample_description_version = ctx->sample_description_version;
+    entry->default_iv_size = ctx->default_iv_size;
+    entry->is_constant_iv = ctx->is_constant_iv;
+
+    // an entry that can not replay all its events is not kept.
+    return res != BMFF_OK ? res : recorder.result;
+}
+
+BMFFCode _bmff_memo_parse(BMFFContext *ctx, parse_func func, const uint8_t *data, size_t size, Box **box_ptr)
+{
+    BMFFMemo *memo = ctx->memo;
+    uint32_t type = *((uint32_t*)(data+4));
+    uint64_t box_size = parse_box_size(data, size);
+    if(memo->filling == eBooleanTrue || _bmff_memo_type(memo, type) == eBooleanFalse || box_size == 0 || box_size > size || box_size > memo->budget) {
+        return func(ctx, data, size, box_ptr);
+    }
+
+    uint64_t hash = bmff_hash(data, (size_t)box_size);
+    MemoEntry *entry = memo->buckets[hash % MEMO_BUCKETS];
+    for(; entry; entry = entry->hash_next) {
+        if(entry->hash == hash && entry->type == type && entry->size == box_size &&
+           memcmp(entry->source, data, entry->size) == 0) {
+            break;
+        }
+    }
+
+    if(entry) {
+        memo->stats.hits++;
+        entry->generation = memo->generation;
+        _bmff_memo_unlink(memo, entry);
+        _bmff_memo_link_head(memo, entry);
+        _bmff_memo_replay(ctx, entry, data);
+        _bmff_memo_restore(ctx, entry);
+        *box_ptr = entry->box;
+        return BMFF_OK;
+    }
+
+    memo->stats.misses++;
+    entry = _bmff_malloc(ctx, sizeof(MemoEntry));
+    if(!entry) {
+        return func(ctx, data, size, box_ptr);
+    }
+    memset(entry, 0, sizeof(MemoEntry));
+    entry->hash = hash;
+    entry->type = type;
+    entry->size = (size_t)box_size;
+    entry->generation = memo->generation;
+
+    BMFFCode res = _bmff_memo_fill(ctx, func, entry, data);
+    if(res != BMFF_OK) {
+        // boxes that fail to parse are not kept, the error is reported as usual.
+        _bmff_memo_free_entry(ctx, entry);
+        return res;
+    }
+
+    MemoEntry **bucket = &memo->buckets[hash % MEMO_BUCKETS];
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    _bmff_memo_link_head(memo, entry);
+    memo->stats.entries++;
+    memo->stats.bytes += entry->bytes;
+    _bmff_memo_trim(ctx);
+
+    *box_ptr = entry->box;
+    return BMFF_OK;
+}
+
+void _bmff_memo_begin(BMFFContext *ctx)
+{
+    ctx->memo->generation++;
+}
+
+static BMFFCode _bmff_memo_create(BMFFContext *ctx, const uint32_t *types, uint32_t type_count, size_t memory_budget)
+{
+    BMFFMemo *memo = _bmff_malloc(ctx, sizeof(BMFFMemo));
+    if(!memo) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    memset(memo, 0, sizeof(BMFFMemo));
+    memcpy(memo->types, types, sizeof(uint32_t) * type_count);
+    memo->type_count = type_count;
+    memo->budget = memory_budget;
+    ctx->memo = memo;
+    return BMFF_OK;
+}
+
+BMFFCode bmff_memo_enable(BMFFContext *ctx, const char * const *types, uint32_t type_count, size_t memory_budget)
+{
+    if(!ctx)                                return BMFF_INVALID_CONTEXT;
+    if(!types && type_count > 0)            return BMFF_INVALID_PARAMETER;
+    if(type_count > BMFF_MEMO_MAX_TYPES)    return BMFF_INVALID_PARAMETER;
+
+    uint32_t values[BMFF_MEMO_MAX_TYPES];
+    uint32_t i = 0;
+    for(; i < type_count; ++i) {
+        if(!types[i] || strlen(types[i]) != 4) {
+            return BMFF_INVALID_PARAMETER;
+        }
+        memcpy(&values[i], types[i], 4);
+    }
+
+    bmff_memo_disable(ctx);
+    return _bmff_memo_create(ctx, values, type_count, memory_budget);
+}
+
+void _bmff_memo_save_settings(const BMFFContext *ctx, MemoSettings *settings)
+{
+    memset(settings, 0, sizeof(MemoSettings));
+    if(ctx->memo) {
+        settings->enabled = eBooleanTrue;
+        memcpy(settings->types, ctx->memo->types, sizeof(settings->types));
+        settings->type_count = ctx->memo->type_count;
+        settings->budget = ctx->memo->budget;
+    }
+}
+
+BMFFCode _bmff_memo_restore_settings(BMFFContext *ctx, const MemoSettings *settings)
+{
+    bmff_memo_disable(ctx);
+    if(settings->enabled != eBooleanTrue) {
+        return BMFF_OK;
+    }
+    return _bmff_memo_create(ctx, settings->types, settings->type_count, settings->budget);
+}
+
+BMFFCode bmff_memo_disable(BMFFContext *ctx)
+{
+    if(!ctx) return BMFF_INVALID_CONTEXT;
+
+    BMFFMemo *memo = ctx->memo;
+    if(memo) {
+        MemoEntry *entry = memo->head;
+        while(entry) {
+            MemoEntry *next = entry->next;
+            _bmff_memo_free_entry(ctx, entry);
+            entry = next;
+        }
+        _bmff_free(ctx, memo);
+        ctx->memo = NULL;
+    }
+    return BMFF_OK;
+}
+
+BMFFCode bmff_memo_get_stats(const BMFFContext *ctx, BMFFMemoStats *stats)
+{
+    if(!ctx)        return BMFF_INVALID_CONTEXT;
+    if(!stats)      return BMFF_INVALID_PARAMETER;
+    if(!ctx->memo)  return BMFF_INVALID_PARAMETER;
+
+    *stats = ctx->memo->stats;
+    return BMFF_OK;
+}
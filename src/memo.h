@@ -0,0 +1,85 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// number of box types that can be memoized.
+#define BMFF_MEMO_MAX_TYPES                     (16)
+
+/**
+ * Counters of the memo cache of a context.
+ */
+typedef struct BMFFMemoStats {
+    uint64_t    hits;
+    uint64_t    misses;
+    uint64_t    evictions;
+    uint32_t    entries;
+    // bytes held by the entries, source copies included.
+    size_t      bytes;
+} BMFFMemoStats;
+
+/**
+ * Enables the memo cache of a context for the given box types, such as
+ * "moov", "pssh", "sgpd" and "tenc". A box of one of these types whose bytes
+ * were parsed before is not parsed again, its ParseComplete event hands back
+ * the box parsed the first time, and the context state the parse left behind
+ * (handler type, channel count, sample description version and IV defaults)
+ * is restored.
+ *
+ * Memoized boxes are immutable and point into a copy of their source bytes
+ * kept by the cache. The events of the boxes inside a memoized box are
+ * recorded when it is parsed for the first time and replayed, with their
+ * breadcrumbs and offsets, every time it is returned. Only the context state
+ * the whole box left behind is restored, not the state at each of these
+ * events. Entries are evicted least recently used first once the cache holds
+ * more than memory_budget bytes, but never during the bmff_parse call that
+ * returned them.
+ */
+BMFFCode bmff_memo_enable(BMFFContext *ctx, const char * const *types, uint32_t type_count, size_t memory_budget);
+
+/**
+ * Frees every entry and disables the memo cache. Called by bmff_context_destroy.
+ */
+BMFFCode bmff_memo_disable(BMFFContext *ctx);
+
+/**
+ * Returns the counters of the memo cache.
+ */
+BMFFCode bmff_memo_get_stats(const BMFFContext *ctx, BMFFMemoStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEMO_H
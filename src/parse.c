@@ -3,8 +3,6 @@
 #include "parse_common.h"
 #include "parse.h"
 
-#define CALLBACK(c, e, f, d)  if((c)->callback) { (c)->callback((c), (e), (f), (void*)(d), (c)->callback_user_data); }
-
 const MapItem parse_map[] = {
     {"ftyp", 1, _bmff_parse_box_file_type},
     {"styp", 1, _bmff_parse_box_file_type},
@@ -152,6 +150,9 @@ int parse_box(const uint8_t *data, size_t size, Box *box)
 
     if(box->size == 1) {
         ADV_PARSE_U64(box->large_size, ptr);
+    }else if(box->size == 0) {
+        // the box extends to the end of the enclosing data.
+        box->large_size = size;
     }else{
         box->large_size = 0;
     }
@@ -171,10 +172,6 @@ int parse_full_box(const uint8_t *data, size_t size, FullBox *box)
     const uint8_t *ptr = data;
     ptr += parse_box(data, size, (Box*)box);
 
-    if(box->size == 1) {
-        ADV_PARSE_U64(box->large_size, ptr);
-    }
-
     box->version = *ptr;
     ptr++;
     box->flags = (parse_u32(ptr) >> 8) & 0x00FFFFFF;
@@ -183,6 +180,16 @@ int parse_full_box(const uint8_t *data, size_t size, FullBox *box)
     return ptr - data;
 }
 
+const uint8_t *box_end(const uint8_t *data, size_t size, const Box *box)
+{
+    // the end of the box, limited to the bytes that are actually available.
+    uint64_t box_size = bmff_get_box_size(box);
+    if(box_size >= 8 && box_size <= size) {
+        return data + box_size;
+    }
+    return data + size;
+}
+
 void parse_iso639_2_lang(uint16_t value, uint8_t *output)
 {
     output[0] = (uint8_t)(0x0060 + ((value >> 10) & 0x001F));
@@ -232,7 +239,7 @@ BMFFCode _bmff_parse_box_file_type(BMFFContext *ctx, const uint8_t *data, size_t
     memcpy(&box->major_brand, ptr, 4);
     ptr += 4;
     ADV_PARSE_U32(box->minor_version, ptr);
-    box->nb_compatible_brands = (box->box.size-16) / 4;
+    box->nb_compatible_brands = (box_end(data, size, (Box*)box) - ptr) / 4;
     box->compatible_brands = ptr;
 
     *box_ptr = (Box*)box;
@@ -250,6 +257,25 @@ uint32_t _is_valid_cc4(const uint8_t *cc4) {
     return 0;
 }
 
+static uint32_t _bmff_max_depth(const BMFFContext *ctx)
+{
+    return ctx->max_depth ? ctx->max_depth : BMFF_DEFAULT_MAX_DEPTH;
+}
+
+static parse_func _bmff_find_parser(const uint8_t *data)
+{
+    // get the numerical value of the type, making sure to keep the bytes in
+    // the correct order.
+    uint32_t box_type = *((uint32_t*)(data+4));
+    int i=0;
+    for(; i < PARSE_MAP_LEN; ++i) {
+        if(parse_map[i].box_type_value == box_type) {
+            return parse_map[i].parse_func;
+        }
+    }
+    return NULL;
+}
+
 BMFFCode _bmff_parse_child(BMFFContext *ctx, parse_func func, const uint8_t *data, size_t size, Box **box_ptr)
 {
     const uint8_t *fourCC = data+4;
@@ -257,9 +283,16 @@ BMFFCode _bmff_parse_child(BMFFContext *ctx, parse_func func, const uint8_t *dat
     CALLBACK(ctx, BMFFEventParseStart, fourCC, NULL);
     _bmff_breadcrumb_push(ctx, fourCC);
 
-    BMFFCode res = func(ctx, data, size, box_ptr);
+    BMFFCode res;
+    if(ctx->breadcrumb_depth > _bmff_max_depth(ctx)) {
+        // bounds the recursion through the specialized parsers.
+        res = BMFF_RESOURCE_LIMIT;
+    }else{
+        res = ctx->memo ? _bmff_memo_parse(ctx, func, data, size, box_ptr) : func(ctx, data, size, box_ptr);
+    }
     if(res != BMFF_OK) {
         _bmff_breadcrumb_pop(ctx);
+        _bmff_record_diagnostic(ctx, res, fourCC);
         CALLBACK(ctx, BMFFEventParseError, fourCC, (void*)data);
     }else{
         _bmff_breadcrumb_pop(ctx);
@@ -268,15 +301,16 @@ BMFFCode _bmff_parse_child(BMFFContext *ctx, parse_func func, const uint8_t *dat
     return res;
 }
 
-uint32_t _bmff_parse_children(BMFFContext *ctx, const uint8_t *data, size_t size, uint32_t *child_count, Box ***children)
+// counts the valid boxes in data and allocates room for them.
+static uint32_t _bmff_alloc_children(BMFFContext *ctx, const uint8_t *data, size_t size, uint32_t *child_count, Box ***children)
 {
     const uint8_t *tmp = data;
     const uint8_t *end = &data[size];
 
     uint32_t count = 0;
-    while(tmp + 8 < end && _is_valid_cc4(tmp + 4) == 1) {
-        uint32_t box_size = parse_u32(tmp);
-        if(box_size == 0 || tmp + box_size > end) {
+    while(tmp + 8 <= end && _is_valid_cc4(tmp + 4) == 1) {
+        uint64_t box_size = parse_box_size(tmp, end - tmp);
+        if(box_size == 0 || box_size > (uint64_t)(end - tmp)) {
             break; // something went wrong
         }
         tmp += box_size;
@@ -286,41 +320,40 @@ uint32_t _bmff_parse_children(BMFFContext *ctx, const uint8_t *data, size_t size
 
     // allocate room for the children
     if(count > 0) {
-        BOX_MALLOCN(*children, Box*, count);
-    }else{
-        return 0;
+        *children = bmff_context_alloc_on_stack(ctx, sizeof(Box*) * count);
+        if(!(*children)) {
+            *child_count = 0;
+            return 0;
+        }
+        memset(*children, 0, sizeof(Box*) * count);
     }
+    return *child_count;
+}
+
+uint32_t _bmff_parse_children(BMFFContext *ctx, const uint8_t *data, size_t size, uint32_t *child_count, Box ***children)
+{
+    const uint8_t *end = &data[size];
+    uint32_t count = _bmff_alloc_children(ctx, data, size, child_count, children);
 
     // parse all the Boxes.
-    int child_idx = 0;
+    uint32_t child_idx = 0;
 
     const uint8_t *ptr = data;
-    while(ptr + 8 < end && child_idx < count)
+    while(ptr + 8 <= end && child_idx < count)
     {
-        uint32_t box_size = parse_u32(ptr);
-        // get the numerical value of the type, making sure to keep the bytes in
-        // the correct order.
-        uint32_t box_type = *((uint32_t*)(ptr+4));
+        uint64_t box_size = parse_box_size(ptr, end - ptr);
 
         // find the parser for the next Child.
-        int i=0;
-        for(; i < PARSE_MAP_LEN; ++i)
-        {
-            uint32_t parser_box_type = parse_map[i].box_type_value;
-            if(parser_box_type == box_type) {
-                // parse the Box.
-                Box *child_box;
-                BMFFCode res = _bmff_parse_child(ctx, parse_map[i].parse_func, ptr, end-ptr, &child_box);
-                if(res == BMFF_OK) {
-                    // add the parsed Box to the list of children.
-                    (*children)[child_idx] = child_box;
-                }
-                // break out once we have found a parser.
-                break;
+        parse_func func = _bmff_find_parser(ptr);
+        if(func) {
+            // parse the Box.
+            Box *child_box;
+            BMFFCode res = _bmff_parse_child(ctx, func, ptr, end-ptr, &child_box);
+            if(res == BMFF_OK) {
+                // add the parsed Box to the list of children.
+                (*children)[child_idx] = child_box;
             }
-        }
-
-        if(i == PARSE_MAP_LEN) {
+        }else{
             CALLBACK(ctx, BMFFEventParserNotFound, ptr+4, (void*)ptr);
         }
 
@@ -332,6 +365,27 @@ uint32_t _bmff_parse_children(BMFFContext *ctx, const uint8_t *data, size_t size
     return ptr - data;
 }
 
+// parses the header of a generic container into a new frame.
+static BMFFCode _bmff_open_container(BMFFContext *ctx, const uint8_t *data, size_t size, BMFFParseFrame *frame)
+{
+    if(size <= 8)   return BMFF_INVALID_SIZE;
+
+    BOX_MALLOC(box, ContainerBox);
+
+    const uint8_t *ptr = data;
+    ptr += parse_box(data, size, &box->box);
+
+    frame->box = box;
+    frame->data = data;
+    frame->ptr = ptr;
+    frame->end = box_end(data, size, (Box*)box);
+    frame->child_idx = 0;
+    frame->slot = NULL;
+    _bmff_alloc_children(ctx, ptr, frame->end - ptr, &box->child_count, &box->children);
+
+    return BMFF_OK;
+}
+
 BMFFCode _bmff_parse_box_generic_container(BMFFContext *ctx, const uint8_t *data, size_t size, Box **box_ptr)
 {
     if(!ctx)        return BMFF_INVALID_CONTEXT;
@@ -339,15 +393,76 @@ BMFFCode _bmff_parse_box_generic_container(BMFFContext *ctx, const uint8_t *data
     if(size <= 8)   return BMFF_INVALID_SIZE;
     if(!box_ptr)    return BMFF_INVALID_PARAMETER;
 
-    BOX_MALLOC(box, ContainerBox);
+    uint32_t max_depth = _bmff_max_depth(ctx);
+    if(!ctx->frames) {
+        ctx->frames = _bmff_malloc(ctx, sizeof(BMFFParseFrame) * max_depth);
+        if(!ctx->frames) {
+            return BMFF_RESOURCE_LIMIT;
+        }
+    }
+    if(ctx->frame_count >= max_depth) {
+        return BMFF_RESOURCE_LIMIT;
+    }
 
-    const uint8_t *ptr = data;
-    ptr += parse_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    // a specialized parser may run a generic container inside another one,
+    // the frames below base belong to the outer traversal.
+    uint32_t base = ctx->frame_count;
+    BMFFCode res = _bmff_open_container(ctx, data, size, &ctx->frames[base]);
+    if(res != BMFF_OK) {
+        return res;
+    }
+    ctx->frame_count++;
 
-    _bmff_parse_children(ctx, ptr, end-ptr, &box->child_count, &box->children);
+    while(ctx->frame_count > base) {
+        BMFFParseFrame *frame = &ctx->frames[ctx->frame_count - 1];
 
-    *box_ptr = (Box*)box;
+        if(frame->ptr + 8 > frame->end || frame->child_idx >= frame->box->child_count) {
+            // all the children of the container are parsed.
+            ctx->frame_count--;
+            if(ctx->frame_count > base) {
+                _bmff_breadcrumb_pop(ctx);
+                CALLBACK(ctx, BMFFEventParseComplete, frame->data+4, (void*)frame->box);
+                *frame->slot = (Box*)frame->box;
+            }
+            continue;
+        }
+
+        const uint8_t *ptr = frame->ptr;
+        size_t remaining = frame->end - ptr;
+        Box **slot = &frame->box->children[frame->child_idx++];
+        frame->ptr += parse_box_size(ptr, remaining);
+
+        // find the parser for the next Child.
+        parse_func func = _bmff_find_parser(ptr);
+        if(!func) {
+            CALLBACK(ctx, BMFFEventParserNotFound, ptr+4, (void*)ptr);
+        }else if(func == _bmff_parse_box_generic_container && !ctx->memo) {
+            // nested generic containers get a frame rather than a recursive call,
+            // reporting the same events as _bmff_parse_child.
+            CALLBACK(ctx, BMFFEventParseStart, ptr+4, NULL);
+            _bmff_breadcrumb_push(ctx, ptr+4);
+
+            if(ctx->breadcrumb_depth > max_depth || ctx->frame_count >= max_depth) {
+                res = BMFF_RESOURCE_LIMIT;
+            }else{
+                res = _bmff_open_container(ctx, ptr, remaining, &ctx->frames[ctx->frame_count]);
+            }
+            if(res == BMFF_OK) {
+                ctx->frames[ctx->frame_count++].slot = slot;
+            }else{
+                _bmff_breadcrumb_pop(ctx);
+                _bmff_record_diagnostic(ctx, res, ptr+4);
+                CALLBACK(ctx, BMFFEventParseError, ptr+4, (void*)ptr);
+            }
+        }else{
+            Box *child_box;
+            if(_bmff_parse_child(ctx, func, ptr, remaining, &child_box) == BMFF_OK) {
+                *slot = child_box;
+            }
+        }
+    }
+
+    *box_ptr = (Box*)ctx->frames[base].box;
     return BMFF_OK;
 }
 
@@ -380,7 +495,7 @@ BMFFCode _bmff_parse_box_full_data(BMFFContext *ctx, const uint8_t *data, size_t
 
     const uint8_t *ptr = data;
     ptr += parse_full_box(ptr, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     box->data_len = end-ptr;
     if(box->data_len > 0) {
@@ -403,7 +518,7 @@ BMFFCode _bmff_parse_box_track_reference_type(BMFFContext *ctx, const uint8_t *d
     const uint8_t *ptr = data;
     ptr += parse_box(ptr, size, &box->box); // hint or cdsc
 
-    box->nb_track_ids = (box->box.size - 8) / 4;
+    box->nb_track_ids = (box_end(data, size, (Box*)box) - ptr) / 4;
     BOX_MALLOCN(box->track_ids, uint32_t, box->nb_track_ids);
 
     int i = 0;
@@ -469,7 +584,7 @@ BMFFCode _bmff_parse_box_media_data(BMFFContext *ctx, const uint8_t *data, size_
     ptr += parse_box(data, size, &box->box);
 
     box->data = ptr;
-    box->data_len = size - (ptr - data);
+    box->data_len = box_end(data, size, (Box*)box) - ptr;
 
     *box_ptr = (Box*)box;
     return BMFF_OK;
@@ -552,6 +667,7 @@ BMFFCode _bmff_parse_box_item_location(BMFFContext *ctx, const uint8_t *data, si
     }
 
     if(box->item_count > 0) {
+        BOX_CHECK_TABLE(box->item_count, (ver < 2 ? 6 : 8), ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->items, ItemLocation, box->item_count);
 
         int offset_shift = 64 - (((int)box->offset_size) * 8);
@@ -629,7 +745,9 @@ size_t _bmff_parse_fd_item_info_extension(BMFFContext *ctx, const uint8_t *data,
     if(size < 27)   return 0;
     if(!box_ptr)    return 0;
 
-    BOX_MALLOC(box, FDItemInfoExtension);
+    FDItemInfoExtension *box = bmff_context_alloc_on_stack(ctx, sizeof(FDItemInfoExtension));
+    if(!box)        return 0;
+    memset(box, 0, sizeof(FDItemInfoExtension));
 
     const uint8_t *ptr = data;
 
@@ -640,7 +758,8 @@ size_t _bmff_parse_fd_item_info_extension(BMFFContext *ctx, const uint8_t *data,
     ADV_PARSE_U8(box->entry_count, ptr);
 
     if(box->entry_count > 0) {
-        BOX_MALLOCN(box->group_ids, uint32_t, box->entry_count);
+        box->group_ids = bmff_context_alloc_on_stack(ctx, sizeof(uint32_t) * box->entry_count);
+        if(!box->group_ids) return 0;
     }
 
     uint8_t i = 0;
@@ -687,7 +806,7 @@ BMFFCode _bmff_parse_box_item_info_entry(BMFFContext *ctx, const uint8_t *data,
     if(ver == 1) {
         memcpy(box->extension_type, ptr, 4);
         ptr += 4;
-        const uint8_t *end = data + box->box.size;
+        const uint8_t *end = box_end(data, size, (Box*)box);
         if(strcmp(box->extension_type, "fdel") == 0) {
             BOX_MALLOC(ext, FDItemInfoExtension); 
             box->extension_size = _bmff_parse_fd_item_info_extension(ctx, ptr, end - ptr, &ext);
@@ -726,6 +845,7 @@ BMFFCode _bmff_parse_box_item_info(BMFFContext *ctx, const uint8_t *data, size_t
         ADV_PARSE_U32(box->entry_count, ptr);
     }
 
+    BOX_CHECK_TABLE(box->entry_count, 12, ptr, box_end(data, size, (Box*)box));
     BOX_MALLOCN(box->entries, ItemInfoEntry*, box->entry_count);
     uint32_t i=0;
     for(; i < box->entry_count; ++i) {
@@ -734,7 +854,7 @@ BMFFCode _bmff_parse_box_item_info(BMFFContext *ctx, const uint8_t *data, size_t
         if(res != BMFF_OK) {
             return res;
         }
-        ptr += box->entries[i]->box.size;
+        ptr += bmff_get_box_size((Box*)box->entries[i]);
     }
 
     *box_ptr = (Box*)box;
@@ -887,7 +1007,7 @@ BMFFCode _bmff_parse_box_protection_scheme_info(BMFFContext *ctx, const uint8_t
     ptr += parse_box(ptr, size, &box->box);
     ptr += parse_original_format_box(ptr, size, &box->original_format);
 
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     // parse the optional boxes
     if(ptr < end && strncmp(ptr+4, "schm", 4) == 0) {
@@ -895,8 +1015,7 @@ BMFFCode _bmff_parse_box_protection_scheme_info(BMFFContext *ctx, const uint8_t
         if(res != BMFF_OK) {
             return res;
         }
-        uint32_t box_size = parse_u32(ptr);
-        ptr += box_size;
+        ptr += parse_box_size(ptr, end - ptr);
     }
 
     if(ptr < end && strncmp(ptr+4, "schi", 4) == 0) {
@@ -904,8 +1023,7 @@ BMFFCode _bmff_parse_box_protection_scheme_info(BMFFContext *ctx, const uint8_t
         if(res != BMFF_OK) {
             return res;
         }
-        uint32_t box_size = parse_u32(ptr);
-        ptr += box_size;
+        ptr += parse_box_size(ptr, end - ptr);
     }
 
     *box_ptr = (Box*)box;
@@ -924,7 +1042,7 @@ BMFFCode _bmff_parse_box_item_protection(BMFFContext *ctx, const uint8_t *data,
     const uint8_t *ptr = data;
     ptr += parse_full_box(data, size, &box->box);
 
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     ADV_PARSE_U16(box->protection_count, ptr);
 
@@ -937,8 +1055,7 @@ BMFFCode _bmff_parse_box_item_protection(BMFFContext *ctx, const uint8_t *data,
             if(res != BMFF_OK) {
                 return res;
             }
-            uint32_t box_size = parse_u32(ptr);
-            ptr += box_size;
+            ptr += parse_box_size(ptr, end - ptr);
         }
     }
 
@@ -958,14 +1075,14 @@ BMFFCode _bmff_parse_box_meta(BMFFContext *ctx, const uint8_t *data, size_t size
     const uint8_t *ptr = data;
     ptr += parse_full_box(data, size, &box->box);
 
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     BMFFCode res = _bmff_parse_child(ctx, _bmff_parse_box_handler, ptr, end-ptr, (Box**)&box->handler);
     if(res != BMFF_OK) {
         return res;
     }
 
-    ptr += box->handler->box.size;
+    ptr += bmff_get_box_size((Box*)box->handler);
 
     // parse all the optional and "other" boxes
     // define a structure we can use to make a box type to a parsing function
@@ -1001,7 +1118,7 @@ BMFFCode _bmff_parse_box_meta(BMFFContext *ctx, const uint8_t *data, size_t size
                 if(res != BMFF_OK) {
                     return res;
                 }
-                ptr += (*(map[i].box_ptr))->box.size;
+                ptr += bmff_get_box_size((Box*)(*(map[i].box_ptr)));
                 break;
             }
         }
@@ -1035,7 +1152,7 @@ BMFFCode _bmff_parse_box_movie_header(BMFFContext *ctx, const uint8_t *data, siz
     if(box->box.version == 1) {
       ADV_PARSE_U64(box->creation_time, ptr);
       ADV_PARSE_U64(box->modification_time, ptr);
-      ADV_PARSE_U64(box->timescale, ptr);
+      ADV_PARSE_U32(box->timescale, ptr);
       ADV_PARSE_U64(box->duration, ptr);
     }else{
       ADV_PARSE_U32(box->creation_time, ptr);
@@ -1097,6 +1214,7 @@ BMFFCode _bmff_parse_box_track_fragment_random_access(BMFFContext *ctx, const ui
     ptr++;
     ADV_PARSE_U32(box->number_of_entry, ptr);
 
+    BOX_CHECK_TABLE(box->number_of_entry, (box->box.version == 1 ? 16 : 8) + 3, ptr, box_end(data, size, (Box*)box));
     BOX_MALLOCN(box->entries, Entry, box->number_of_entry);
 
     uint32_t i=0;
@@ -1269,24 +1387,26 @@ BMFFCode _bmff_parse_box_track_fragment_header(BMFFContext *ctx, const uint8_t *
     ptr += parse_full_box(data, size, &box->box);
 
     ADV_PARSE_U32(box->track_id, ptr);
+    // the boxes of the track fragment are parsed with the state of its track.
+    _bmff_context_select_track(ctx, box->track_id);
 
-    if(box->box.flags & eTfhdBaseDataOffsetPresent == eTfhdBaseDataOffsetPresent) {
+    if((box->box.flags & eTfhdBaseDataOffsetPresent) == eTfhdBaseDataOffsetPresent) {
         ADV_PARSE_U64(box->base_data_offset, ptr);
     }
 
-    if(box->box.flags & eTfhdSampleDescIdxPresent == eTfhdSampleDescIdxPresent) {
+    if((box->box.flags & eTfhdSampleDescIdxPresent) == eTfhdSampleDescIdxPresent) {
         ADV_PARSE_U32(box->sample_description_index, ptr);
     }
 
-    if(box->box.flags & eTfhdDefaultSampleDurationPresent == eTfhdDefaultSampleDurationPresent) {
+    if((box->box.flags & eTfhdDefaultSampleDurationPresent) == eTfhdDefaultSampleDurationPresent) {
         ADV_PARSE_U32(box->default_sample_duration, ptr);
     }
 
-    if(box->box.flags & eTfhdDefaultSampleSizePresent == eTfhdDefaultSampleSizePresent) {
+    if((box->box.flags & eTfhdDefaultSampleSizePresent) == eTfhdDefaultSampleSizePresent) {
         ADV_PARSE_U32(box->default_sample_size, ptr);
     }
 
-    if(box->box.flags & eTfhdDefaultSampleFlagsPresent == eTfhdDefaultSampleFlagsPresent) {
+    if((box->box.flags & eTfhdDefaultSampleFlagsPresent) == eTfhdDefaultSampleFlagsPresent) {
         ADV_PARSE_U32(box->default_sample_flags, ptr);
     }
 
@@ -1309,16 +1429,20 @@ BMFFCode _bmff_parse_box_track_run(BMFFContext *ctx, const uint8_t *data, size_t
     ADV_PARSE_U32(box->sample_count, ptr);
 
     if(box->sample_count > 0) {
+        // each optional per sample field present is 4 bytes.
+        uint32_t sample_bytes = 4 * (((box->box.flags >> 8) & 0x01) + ((box->box.flags >> 9) & 0x01) +
+                                     ((box->box.flags >> 10) & 0x01) + ((box->box.flags >> 11) & 0x01));
+        BOX_CHECK_TABLE(box->sample_count, sample_bytes, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->samples, TrackRunSample, box->sample_count);
     }
 
     eTrackRunFlags flags = box->box.flags;
 
-    if(flags & eTrunDataOffsetPresent == eTrunDataOffsetPresent) {
+    if((flags & eTrunDataOffsetPresent) == eTrunDataOffsetPresent) {
         ADV_PARSE_U32(box->data_offset, ptr);
     }
 
-    if(flags & eTrunFirstSampleFlagsPresent == eTrunFirstSampleFlagsPresent) {
+    if((flags & eTrunFirstSampleFlagsPresent) == eTrunFirstSampleFlagsPresent) {
         ADV_PARSE_U32(box->first_sample_flags, ptr);
     }
 
@@ -1326,16 +1450,16 @@ BMFFCode _bmff_parse_box_track_run(BMFFContext *ctx, const uint8_t *data, size_t
     for(;i < box->sample_count; ++i) {
         TrackRunSample *sample = &box->samples[i];
 
-        if(flags & eTrunSampleDurationPresent == eTrunSampleDurationPresent) {
+        if((flags & eTrunSampleDurationPresent) == eTrunSampleDurationPresent) {
             ADV_PARSE_U32(sample->duration, ptr);
         }
-        if(flags & eTrunSampleSizePresent == eTrunSampleSizePresent) {
+        if((flags & eTrunSampleSizePresent) == eTrunSampleSizePresent) {
             ADV_PARSE_U32(sample->size, ptr);
         }
-        if(flags & eTrunSampleFlagsPresent == eTrunSampleFlagsPresent) {
+        if((flags & eTrunSampleFlagsPresent) == eTrunSampleFlagsPresent) {
             ADV_PARSE_U32(sample->flags, ptr);
         }
-        if(flags & eTrunSampleCompTimeOffsetsPresent == eTrunSampleCompTimeOffsetsPresent) {
+        if((flags & eTrunSampleCompTimeOffsetsPresent) == eTrunSampleCompTimeOffsetsPresent) {
             if(box->box.version == 0) {
                 ADV_PARSE_U32(sample->composition_time_offset, ptr);
             }else{
@@ -1361,6 +1485,7 @@ BMFFCode _bmff_parse_box_sample_dependency_type(BMFFContext *ctx, const uint8_t
     ptr += parse_full_box(data, size, &box->box);
 
     if(ctx->sample_count > 0) {
+        BOX_CHECK_TABLE(ctx->sample_count, 1, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->samples, SampleDependencyType, ctx->sample_count);
     }
 
@@ -1399,6 +1524,7 @@ BMFFCode _bmff_parse_box_sample_to_group(BMFFContext *ctx, const uint8_t *data,
     ADV_PARSE_U32(box->entry_count, ptr);
 
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, 8, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->entries, SampleToGroupEntry, box->entry_count);
     }
 
@@ -1428,6 +1554,7 @@ BMFFCode _bmff_parse_box_sub_sample_information(BMFFContext *ctx, const uint8_t
     ADV_PARSE_U32(box->entry_count, ptr);
 
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, 6, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->entries, SubSampleInformationEntry, box->entry_count);
     }
 
@@ -1438,6 +1565,7 @@ BMFFCode _bmff_parse_box_sub_sample_information(BMFFContext *ctx, const uint8_t
         ADV_PARSE_U16(entry->subsample_count, ptr);
 
         if(entry->subsample_count > 0) {
+            BOX_CHECK_TABLE(entry->subsample_count, (box->box.version == 1 ? 4 : 2) + 6, ptr, box_end(data, size, (Box*)box));
             BOX_MALLOCN(entry->subsamples, SubSampleInformation, entry->subsample_count);
 
             uint32_t j=0;
@@ -1538,6 +1666,7 @@ BMFFCode _bmff_parse_box_data_reference(BMFFContext *ctx, const uint8_t *data, s
     ADV_PARSE_U32(box->entry_count, ptr);
 
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, 12, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->data_entries, DataEntryBox*, box->entry_count);
 
         uint32_t i=0;
@@ -1558,8 +1687,7 @@ BMFFCode _bmff_parse_box_data_reference(BMFFContext *ctx, const uint8_t *data, s
                 (*dataEntry)->box.flags = box->box.flags;
             }
             // move ptr to the start of the next Data Entry box.
-            uint32_t box_size = parse_u32(ptr);
-            ptr += box_size;
+            ptr += parse_box_size(ptr, end - ptr);
         }
     }
 
@@ -1582,6 +1710,7 @@ BMFFCode _bmff_parse_box_edit_list(BMFFContext *ctx, const uint8_t *data, size_t
     ADV_PARSE_U32(box->entry_count, ptr);
 
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, (box->box.version == 1 ? 20 : 12), ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->entries, EditEntry, box->entry_count);
 
         uint32_t i=0;
@@ -1727,7 +1856,7 @@ BMFFCode _bmff_parse_incomplete_sample_entry(BMFFContext *ctx, const uint8_t *da
     if(res != BMFF_OK) {
         return res;
     }
-    ptr += box->complete_track_info->box.size;
+    ptr += bmff_get_box_size((Box*)box->complete_track_info);
 
     // parse any other boxes
     if(end > ptr) {
@@ -1750,7 +1879,7 @@ BMFFCode _bmff_parse_box_visual_sample_entry(BMFFContext *ctx, const uint8_t *da
 
     const uint8_t *ptr = data;
     ptr += parse_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     // Sample Entry parsing
     ptr += 6; // reserverd (8)[6]
@@ -1782,7 +1911,7 @@ BMFFCode _bmff_parse_box_visual_sample_entry(BMFFContext *ctx, const uint8_t *da
         if(res != BMFF_OK) {
             return res;
         }
-        ptr += box->clap->box.size;
+        ptr += bmff_get_box_size((Box*)box->clap);
     }
 
     // PixelAspectRatioBox
@@ -1791,7 +1920,7 @@ BMFFCode _bmff_parse_box_visual_sample_entry(BMFFContext *ctx, const uint8_t *da
         if(res != BMFF_OK) {
             return res;
         }
-        ptr += box->pasp->box.size;
+        ptr += bmff_get_box_size((Box*)box->pasp);
     }
 
     // parse incomplete data if the sample has an incomplete tag
@@ -1819,7 +1948,7 @@ BMFFCode _bmff_parse_box_audio_sample_entry(BMFFContext *ctx, const uint8_t *dat
 
     const uint8_t *ptr = data;
     ptr += parse_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     // Sample Entry parsing
     ptr += 6; // reserverd (8)[6]
@@ -1842,7 +1971,7 @@ BMFFCode _bmff_parse_box_audio_sample_entry(BMFFContext *ctx, const uint8_t *dat
         if(res != BMFF_OK) {
             return res;
         }
-        ptr += box->sampling_rate->box.size;
+        ptr += bmff_get_box_size((Box*)box->sampling_rate);
     }
 
     // Channel Layout
@@ -1851,7 +1980,7 @@ BMFFCode _bmff_parse_box_audio_sample_entry(BMFFContext *ctx, const uint8_t *dat
         if(res != BMFF_OK) {
             return res;
         }
-        ptr += box->channel_layout->box.size;
+        ptr += bmff_get_box_size((Box*)box->channel_layout);
     }
 
     if(strncmp(box->box.type, "icpa", 4) == 0) {
@@ -1883,7 +2012,7 @@ BMFFCode _bmff_parse_box_hint_sample_entry(BMFFContext *ctx, const uint8_t *data
     ADV_PARSE_U16(box->data_reference_index, ptr);
 
     box->data = ptr;
-    box->data_size = (data + box->box.size) -  ptr;
+    box->data_size = (box_end(data, size, (Box*)box)) -  ptr;
 
     ptr += box->data_size;
 
@@ -1911,13 +2040,14 @@ BMFFCode _bmff_parse_box_sample_description(BMFFContext *ctx, const uint8_t *dat
 
     const uint8_t *ptr = data;
     ptr += parse_full_box(data, size, &box->box);
-    const uint8_t *end = ptr + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     ADV_PARSE_U32(box->entry_count, ptr);
     if(box->entry_count > 0) {
 
         parse_func parser;
 
+        BOX_CHECK_TABLE(box->entry_count, 8, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->entries, SampleEntry*, box->entry_count);
 
         if( strncmp(ctx->handler_type, "vide", 4) == 0 ||
@@ -1948,7 +2078,7 @@ BMFFCode _bmff_parse_box_sample_description(BMFFContext *ctx, const uint8_t *dat
             if(res != BMFF_OK) {
                 return res;
             }
-            ptr += box->entries[i]->box.size;
+            ptr += bmff_get_box_size((Box*)box->entries[i]);
         }
     }
 
@@ -1970,6 +2100,7 @@ BMFFCode _bmff_parse_box_time_to_sample(BMFFContext *ctx, const uint8_t *data, s
 
     ADV_PARSE_U32(box->sample_count, ptr);
     if(box->sample_count > 0) {
+        BOX_CHECK_TABLE(box->sample_count, 8, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->samples, TimeToSample, box->sample_count);
 
         uint32_t i = 0;
@@ -1998,6 +2129,7 @@ BMFFCode _bmff_parse_box_composition_offset(BMFFContext *ctx, const uint8_t *dat
 
     ADV_PARSE_U32(box->entry_count, ptr);
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, 8, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->entries, CompositionOffset, box->entry_count);
 
         uint32_t i = 0;
@@ -2034,6 +2166,7 @@ BMFFCode _bmff_parse_box_sample_to_chunk(BMFFContext *ctx, const uint8_t *data,
 
     ADV_PARSE_U32(box->entry_count, ptr);
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, 12, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->entries, SampleToChunk, box->entry_count);
 
         uint32_t i = 0;
@@ -2065,6 +2198,7 @@ BMFFCode _bmff_parse_box_sample_size(BMFFContext *ctx, const uint8_t *data, size
     ADV_PARSE_U32(box->sample_count, ptr);
 
     if(box->sample_size == 0 && box->sample_count > 0) {
+        BOX_CHECK_TABLE(box->sample_count, 4, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->entry_sizes, uint32_t, box->sample_count);
         uint32_t i = 0;
         for(; i < box->sample_count; ++i) {
@@ -2093,6 +2227,7 @@ BMFFCode _bmff_parse_box_compact_sample_size(BMFFContext *ctx, const uint8_t *da
     ADV_PARSE_U32(box->sample_count, ptr);
 
     if(box->sample_count > 0) {
+        BOX_CHECK_TABLE(((uint64_t)box->sample_count * box->field_size + 7) / 8, 1, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->entry_sizes, uint16_t, box->sample_count);
         uint32_t i = 0;
         for(; i < box->sample_count; ++i) {
@@ -2132,6 +2267,7 @@ BMFFCode _bmff_parse_box_chunk_offset(BMFFContext *ctx, const uint8_t *data, siz
 
     ADV_PARSE_U32(box->entry_count, ptr);
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, 4, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->chunk_offsets, uint32_t, box->entry_count);
     }
 
@@ -2158,7 +2294,8 @@ BMFFCode _bmff_parse_box_chunk_large_offset(BMFFContext *ctx, const uint8_t *dat
 
     ADV_PARSE_U32(box->entry_count, ptr);
     if(box->entry_count > 0) {
-        BOX_MALLOCN(box->chunk_offsets, uint32_t, box->entry_count);
+        BOX_CHECK_TABLE(box->entry_count, 8, ptr, box_end(data, size, (Box*)box));
+        BOX_MALLOCN(box->chunk_offsets, uint64_t, box->entry_count);
     }
 
     uint32_t i = 0;
@@ -2185,6 +2322,7 @@ BMFFCode _bmff_parse_box_sync_sample(BMFFContext *ctx, const uint8_t *data, size
     ADV_PARSE_U32(box->entry_count, ptr);
 
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, 4, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->sample_numbers, uint32_t, box->entry_count);
     }
 
@@ -2212,6 +2350,7 @@ BMFFCode _bmff_parse_box_shadow_sync_sample(BMFFContext *ctx, const uint8_t *dat
     ADV_PARSE_U32(box->entry_count, ptr);
 
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, 8, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->entries, ShadowSyncSample, box->entry_count);
     }
 
@@ -2241,6 +2380,7 @@ BMFFCode _bmff_parse_box_padding_bits(BMFFContext *ctx, const uint8_t *data, siz
 
     ADV_PARSE_U32(box->sample_count, ptr);
     if(box->sample_count > 0) {
+        BOX_CHECK_TABLE(((uint64_t)box->sample_count + 1) / 2, 1, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->samples, PaddingBits, box->sample_count);
     }
 
@@ -2270,6 +2410,7 @@ BMFFCode _bmff_parse_box_degradation_priority(BMFFContext *ctx, const uint8_t *d
     ptr += parse_full_box(data, size, &box->box);
 
     if(ctx->sample_count > 0) {
+        BOX_CHECK_TABLE(ctx->sample_count, 2, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->priorities, uint16_t, ctx->sample_count);
     }
     box->priority_count = ctx->sample_count;
@@ -2304,9 +2445,10 @@ BMFFCode _bmff_parse_box_sample_group_description(BMFFContext *ctx, const uint8_
     ADV_PARSE_U32(box->entry_count, ptr);
 
     box->sample_group_entries = ptr;
-    box->sample_group_entries_size = (data + size) - ptr;
+    box->sample_group_entries_size = box_end(data, size, (Box*)box) - ptr;
 
     if(box->box.version == 1 && box->default_length == 0 && box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, 4, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->description_lengths, uint32_t, box->entry_count);
 
         uint32_t i = 0;
@@ -2426,6 +2568,7 @@ BMFFCode _bmff_parse_box_sample_aux_info_sizes(BMFFContext *ctx, const uint8_t *
     ADV_PARSE_U32(box->sample_count, ptr);
 
     if(box->default_sample_info_size == 0 && box->sample_count > 0) {
+        BOX_CHECK_TABLE(box->sample_count, 1, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->sample_info_sizes, uint8_t, box->sample_count);
         uint32_t i = 0;
         for(; i < box->sample_count; ++i) {
@@ -2456,6 +2599,7 @@ BMFFCode _bmff_parse_box_sample_aux_info_offsets(BMFFContext *ctx, const uint8_t
     ADV_PARSE_U32(box->entry_count, ptr);
 
     if(box->entry_count  > 0) {
+        BOX_CHECK_TABLE(box->entry_count, (box->box.version == 0 ? 4 : 8), ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->offsets, uint64_t, box->entry_count);
         uint32_t i = 0;
         for(; i < box->entry_count; ++i) {
@@ -2549,7 +2693,7 @@ BMFFCode _bmff_parse_box_track_extension_properties(BMFFContext *ctx, const uint
 
     ADV_PARSE_U32(box->track_id, ptr);
 
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
     _bmff_parse_children(ctx, ptr, end-ptr, &box->child_count, &box->children);
 
     *box_ptr = (Box*)box;
@@ -2573,6 +2717,7 @@ BMFFCode _bmff_parse_box_alt_startup_seq_properties(BMFFContext *ctx, const uint
     }else if(box->box.version == 1) {
         ADV_PARSE_U32(box->entry_count, ptr);
         if(box->entry_count > 0) {
+            BOX_CHECK_TABLE(box->entry_count, 8, ptr, box_end(data, size, (Box*)box));
             BOX_MALLOCN(box->entries, AltStartSeqPropertiesEntry, box->entry_count);
         }
 
@@ -2655,12 +2800,16 @@ BMFFCode _bmff_parse_box_item_reference(BMFFContext *ctx, const uint8_t *data, s
     ptr += parse_full_box(data, size, &box->box);
 
     // count the number of reference boxes coming up
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
     const uint8_t *tmp = ptr;
     uint32_t count = 0;
     while(tmp < end) {
-        tmp += parse_u32(ptr);
-        ++count;        
+        uint64_t ref_size = parse_box_size(tmp, end - tmp);
+        if(ref_size == 0 || ref_size > (uint64_t)(end - tmp)) {
+            break;
+        }
+        tmp += ref_size;
+        ++count;
     }
 
     box->references_count = count;
@@ -2719,7 +2868,7 @@ BMFFCode _bmff_parse_box_item_data(BMFFContext *ctx, const uint8_t *data, size_t
     ptr += parse_box(data, size, &box->box);
 
     box->data = ptr;
-    box->data_size = (data + box->box.size) - ptr;
+    box->data_size = (box_end(data, size, (Box*)box)) - ptr;
 
     *box_ptr = (Box*)box;
     return BMFF_OK;
@@ -2781,6 +2930,7 @@ BMFFCode _bmff_parse_box_file_partition(BMFFContext *ctx, const uint8_t *data, s
     }
 
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, 6, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->block_counts, uint16_t, box->entry_count);
         BOX_MALLOCN(box->block_sizes, uint32_t, box->entry_count);
 
@@ -2814,6 +2964,7 @@ BMFFCode _bmff_parse_box_reservoir(BMFFContext *ctx, const uint8_t *data, size_t
     }
 
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, (box->box.version == 0 ? 6 : 8), ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->item_ids, uint32_t, box->entry_count);        
         BOX_MALLOCN(box->symbol_counts, uint32_t, box->entry_count);    
 
@@ -2844,20 +2995,20 @@ BMFFCode _bmff_parse_box_partition_entry(BMFFContext *ctx, const uint8_t *data,
 
     const uint8_t *ptr = data;
     ptr += parse_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     BMFFCode res = _bmff_parse_child(ctx, _bmff_parse_box_file_partition, ptr, end - ptr, (Box**)&box->blocks_and_symbols);
     if(res != BMFF_OK) {
         return res;
     }
-    ptr += box->blocks_and_symbols->box.size;
+    ptr += bmff_get_box_size((Box*)box->blocks_and_symbols);
 
     if(ptr + 8 < end) {
         res = _bmff_parse_child(ctx, _bmff_parse_box_reservoir, ptr, end - ptr, (Box**)&box->fec_symbol_locations);
         if(res != BMFF_OK) {
             return res;
         }
-        ptr += box->fec_symbol_locations->box.size;
+        ptr += bmff_get_box_size((Box*)box->fec_symbol_locations);
     }
 
     if(ptr + 8 < end) {
@@ -2865,7 +3016,7 @@ BMFFCode _bmff_parse_box_partition_entry(BMFFContext *ctx, const uint8_t *data,
         if(res != BMFF_OK) {
             return res;
         }
-        ptr += box->file_symbol_locations->box.size;
+        ptr += bmff_get_box_size((Box*)box->file_symbol_locations);
     }
 
     *box_ptr = (Box*)box;
@@ -2887,6 +3038,7 @@ BMFFCode _bmff_parse_box_fd_session_group(BMFFContext *ctx, const uint8_t *data,
     ADV_PARSE_U16(box->num_session_groups, ptr);
 
     if(box->num_session_groups > 0) {
+        BOX_CHECK_TABLE(box->num_session_groups, 3, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->session_groups, FDSessionGroupEntry, box->num_session_groups);
 
         uint32_t i = 0;
@@ -2895,6 +3047,7 @@ BMFFCode _bmff_parse_box_fd_session_group(BMFFContext *ctx, const uint8_t *data,
             ADV_PARSE_U8(entry->entry_count, ptr);
 
             if(entry->entry_count > 0) {
+                BOX_CHECK_TABLE(entry->entry_count, 4, ptr, box_end(data, size, (Box*)box));
                 BOX_MALLOCN(entry->group_ids, uint32_t, entry->entry_count);
                 uint8_t j = 0;
                 for(; j < entry->entry_count; ++j) {
@@ -2904,6 +3057,7 @@ BMFFCode _bmff_parse_box_fd_session_group(BMFFContext *ctx, const uint8_t *data,
 
             ADV_PARSE_U16(entry->num_channels_in_session_group, ptr);
             if(entry->num_channels_in_session_group) {
+                BOX_CHECK_TABLE(entry->num_channels_in_session_group, 4, ptr, box_end(data, size, (Box*)box));
                 BOX_MALLOCN(entry->hint_track_ids, uint32_t, entry->num_channels_in_session_group);
                 uint16_t k = 0;
                 for(; k < entry->num_channels_in_session_group; ++k) {
@@ -2932,6 +3086,7 @@ BMFFCode _bmff_parse_box_group_id_to_name(BMFFContext *ctx, const uint8_t *data,
     ADV_PARSE_U16(box->entry_count, ptr);
 
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, 5, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->group_ids, uint32_t, box->entry_count);
         BOX_MALLOCN(box->group_names, char*, box->entry_count);
 
@@ -2958,11 +3113,12 @@ BMFFCode _bmff_parse_box_fd_item_information(BMFFContext *ctx, const uint8_t *da
     const uint8_t *ptr = data;
     ptr += parse_full_box(data, size, &box->box);
 
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     ADV_PARSE_U16(box->entry_count, ptr);
 
     if(box->entry_count > 0) {
+        BOX_CHECK_TABLE(box->entry_count, 8, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->entries, PartitionEntryBox*, box->entry_count);
         uint16_t i = 0;
         for(; i < box->entry_count; ++i) {
@@ -2970,7 +3126,7 @@ BMFFCode _bmff_parse_box_fd_item_information(BMFFContext *ctx, const uint8_t *da
             if(res != BMFF_OK) {
                 return res;
             }
-            ptr += box->entries[i]->box.size;
+            ptr += bmff_get_box_size((Box*)box->entries[i]);
         }
     }
 
@@ -2979,7 +3135,7 @@ BMFFCode _bmff_parse_box_fd_item_information(BMFFContext *ctx, const uint8_t *da
         if(res != BMFF_OK) {
             return res;
         }
-        ptr += box->session_info->box.size;
+        ptr += bmff_get_box_size((Box*)box->session_info);
     }
 
     if(ptr + 8 < end) {
@@ -2987,7 +3143,7 @@ BMFFCode _bmff_parse_box_fd_item_information(BMFFContext *ctx, const uint8_t *da
         if(res != BMFF_OK) {
             return res;
         }
-        ptr += box->group_id_to_name->box.size;
+        ptr += bmff_get_box_size((Box*)box->group_id_to_name);
     }
 
     *box_ptr = (Box*)box;
@@ -3010,7 +3166,7 @@ BMFFCode _bmff_parse_box_sub_track_information(BMFFContext *ctx, const uint8_t *
     ADV_PARSE_U16(box->alternate_group, ptr);
     ADV_PARSE_U32(box->sub_track_id, ptr);
 
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
     box->attribute_list_count = (end - ptr) / 4;
 
     if(box->attribute_list_count > 0) {
@@ -3043,6 +3199,7 @@ BMFFCode _bmff_parse_box_sub_track_sample_group(BMFFContext *ctx, const uint8_t
     ADV_PARSE_U16(box->item_count, ptr);
 
     if(box->item_count > 0) {
+        BOX_CHECK_TABLE(box->item_count, 4, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->group_description_indicies, uint32_t, box->item_count);
         
         uint16_t i = 0;
@@ -3080,7 +3237,7 @@ BMFFCode _bmff_parse_box_stereo_video(BMFFContext *ctx, const uint8_t *data, siz
         case 8: ADV_PARSE_U64(box->stereo_indication_type, ptr); break;
     }
 
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
     if(ptr < end) {
         _bmff_parse_children(ctx, ptr, end-ptr, &box->child_count, &box->children);
     }
@@ -3116,6 +3273,7 @@ BMFFCode _bmff_parse_box_segment_index(BMFFContext *ctx, const uint8_t *data, si
     ADV_PARSE_U16(box->reference_count, ptr);
 
     if(box->reference_count > 0) {
+        BOX_CHECK_TABLE(box->reference_count, 12, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->references, SegmentIndexRefEntry, box->reference_count);
 
         uint16_t i = 0;
@@ -3173,7 +3331,7 @@ BMFFCode _bmff_parse_box_complete_track_info(BMFFContext *ctx, const uint8_t *da
     const uint8_t *ptr = data;
     ptr += parse_box(data, size, &box->box);
 
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
     ptr += parse_original_format_box(ptr, end-ptr, &box->original_format);
 
     _bmff_parse_children(ctx, ptr, end-ptr, &box->child_count, &box->children);
@@ -3246,6 +3404,7 @@ BMFFCode _bmff_parse_box_channel_layout(BMFFContext *ctx, const uint8_t *data, s
 
         if(box->channel.defined_layout == 0) {
             if(ctx->channel_count > 0) {
+                BOX_CHECK_TABLE(ctx->channel_count, 1, ptr, box_end(data, size, (Box*)box));
                 BOX_MALLOCN(box->channel.speaker_positions, uint8_t, ctx->channel_count);
                 BOX_MALLOCN(box->channel.azimuths, uint16_t, ctx->channel_count);
                 BOX_MALLOCN(box->channel.elevations, uint8_t, ctx->channel_count);
@@ -3304,6 +3463,7 @@ BMFFCode _bmff_parse_box_subsegment_index(BMFFContext *ctx, const uint8_t *data,
     ADV_PARSE_U32(box->subsegment_count, ptr);
 
     if(box->subsegment_count > 0) {
+        BOX_CHECK_TABLE(box->subsegment_count, 4, ptr, box_end(data, size, (Box*)box));
         BOX_MALLOCN(box->subsegments, SubsegmentIndexEntry, box->subsegment_count);
     }
 
@@ -3313,6 +3473,7 @@ BMFFCode _bmff_parse_box_subsegment_index(BMFFContext *ctx, const uint8_t *data,
 
         ADV_PARSE_U32(entry->range_count, ptr);
         if(entry->range_count > 0) {
+            BOX_CHECK_TABLE(entry->range_count, 4, ptr, box_end(data, size, (Box*)box));
             BOX_MALLOCN(entry->levels, uint8_t, entry->range_count);
             BOX_MALLOCN(entry->range_sizes, uint32_t, entry->range_count);
         }
@@ -3340,7 +3501,7 @@ BMFFCode _bmff_parse_box_rtp_hint_sample_entry(BMFFContext *ctx, const uint8_t *
 
     const uint8_t *ptr = data;
     ptr += parse_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     ptr += 6; // reserved
     ADV_PARSE_U16(box->data_reference_index, ptr);
@@ -3367,7 +3528,7 @@ BMFFCode _bmff_parse_box_fd_hint_sample_entry(BMFFContext *ctx, const uint8_t *d
 
     const uint8_t *ptr = data;
     ptr += parse_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     ptr += 6; // reserved
     ADV_PARSE_U16(box->data_reference_index, ptr);
@@ -3395,7 +3556,7 @@ BMFFCode _bmff_parse_box_xml_meta_data_sample_entry(BMFFContext *ctx, const uint
 
     const uint8_t *ptr = data;
     ptr += parse_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     ptr += 6; // reserved
     ADV_PARSE_U16(box->data_reference_index, ptr);
@@ -3426,7 +3587,7 @@ BMFFCode _bmff_parse_box_text_meta_data_sample_entry(BMFFContext *ctx, const uin
 
     const uint8_t *ptr = data;
     ptr += parse_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     ptr += 6; // reserved
     ADV_PARSE_U16(box->data_reference_index, ptr);
@@ -3439,12 +3600,12 @@ BMFFCode _bmff_parse_box_text_meta_data_sample_entry(BMFFContext *ctx, const uin
 
     if(ptr < end && strncmp(&ptr[4], "btrt", 4) == 0) {
         if(BMFF_OK == _bmff_parse_child(ctx, _bmff_parse_box_bit_rate, ptr, end-ptr, (Box**)&box->bitrate)) {
-            ptr += box->bitrate->box.size;
+            ptr += bmff_get_box_size((Box*)box->bitrate);
         }
     }
     if(ptr < end && strncmp(&ptr[4], "txtC", 4) == 0) {
         if(BMFF_OK == _bmff_parse_child(ctx, _bmff_parse_box_full_string, ptr, end-ptr, (Box**)&box->text_config)) {
-            ptr += box->text_config->box.size;
+            ptr += bmff_get_box_size((Box*)box->text_config);
         }
     }
 
@@ -3463,7 +3624,7 @@ BMFFCode _bmff_parse_box_uri_meta_sample_entry(BMFFContext *ctx, const uint8_t *
 
     const uint8_t *ptr = data;
     ptr += parse_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     ptr += 6; // reserved
     ADV_PARSE_U16(box->data_reference_index, ptr);
@@ -3476,21 +3637,25 @@ BMFFCode _bmff_parse_box_uri_meta_sample_entry(BMFFContext *ctx, const uint8_t *
 
     uint32_t i = box->other_boxes_count;
     for(; i > 0; --i) {
-        if(strncmp("uri ", box->other_boxes[i-1]->type, 4) == 0) {
-            --i;
+        if(box->other_boxes[i-1] && strncmp("uri ", box->other_boxes[i-1]->type, 4) == 0) {
             break;
         }
     }
+    // the uri box is mandatory.
+    if(i == 0) return BMFF_INVALID_DATA;
+    --i;
 
     box->the_label = (UriBox*) box->other_boxes[i];
 
     // optional boxes
     uint32_t count = 1;
-    if(i + count < box->other_boxes_count && strncmp("uriI", box->other_boxes[i + count]->type, 4) == 0) {
+    if(i + count < box->other_boxes_count && box->other_boxes[i + count] &&
+       strncmp("uriI", box->other_boxes[i + count]->type, 4) == 0) {
         box->init = (UriInitBox*) box->other_boxes[i + count];
         count++;
     }         
-    if(i + count < box->other_boxes_count && strncmp("btrt", box->other_boxes[i + count]->type, 4) == 0) {
+    if(i + count < box->other_boxes_count && box->other_boxes[i + count] &&
+       strncmp("btrt", box->other_boxes[i + count]->type, 4) == 0) {
         box->bitrate = (BitRateBox*) box->other_boxes[i + count];
         count++;
     }
@@ -3514,7 +3679,7 @@ BMFFCode _bmff_parse_box_object_descriptor(BMFFContext *ctx, const uint8_t *data
     const uint8_t *ptr = data;
     ptr += parse_full_box(data, size, &box->box);
 
-    ptr += _bmff_parse_object_descriptor(ctx, ptr, box->box.size, &box->od);
+    ptr += _bmff_parse_object_descriptor(ctx, ptr, box_end(data, size, (Box*)box) - ptr, &box->od);
 
     *box_ptr = (Box*)box;
     return BMFF_OK;
@@ -3531,7 +3696,7 @@ BMFFCode _bmff_parse_box_es_descriptor(BMFFContext *ctx, const uint8_t *data, si
 
     const uint8_t *ptr = data;
     ptr += parse_full_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     box->descriptor = ptr;
     box->descriptor_size = end - ptr;
@@ -3551,7 +3716,7 @@ BMFFCode _bmff_parse_box_avc_decoder_config(BMFFContext *ctx, const uint8_t *dat
 
     const uint8_t *ptr = data;
     ptr += parse_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     box->config_record = ptr;
     box->config_record_size = end - ptr;
@@ -3573,6 +3738,7 @@ BMFFCode _bmff_parse_box_sample_encryption(BMFFContext *ctx, const uint8_t *data
     ptr += parse_full_box(data, size, &box->box);
 
     ADV_PARSE_U32(box->sample_count, ptr);
+    BOX_CHECK_TABLE(box->sample_count, (ctx->is_constant_iv == eBooleanFalse ? ctx->default_iv_size : 0) + ((box->box.flags & 0x02) ? 2 : 0), ptr, box_end(data, size, (Box*)box));
     BOX_MALLOCN(box->samples, EncryptionSample, box->sample_count);
 
     uint32_t i=0;
@@ -3586,6 +3752,7 @@ BMFFCode _bmff_parse_box_sample_encryption(BMFFContext *ctx, const uint8_t *data
 
         if((box->box.flags & 0x02) == 0x02) {
             ADV_PARSE_U16(sample->subsample_count, ptr);
+            BOX_CHECK_TABLE(sample->subsample_count, 6, ptr, box_end(data, size, (Box*)box));
             BOX_MALLOCN(sample->subsamples, EncryptionSubsample, sample->subsample_count);
 
             uint32_t j=0;
@@ -3630,6 +3797,7 @@ BMFFCode _bmff_parse_box_track_encryption(BMFFContext *ctx, const uint8_t *data,
     // this is used by the Sample Encryption Box parser.
     // note: this may get overwritten by the constant iv size.
     ctx->default_iv_size = box->default_per_sample_iv_size;
+    ctx->is_constant_iv = eBooleanFalse;
 
     memcpy(box->default_kid, ptr, 16);
     ptr += 16;
@@ -3691,7 +3859,7 @@ BMFFCode _bmff_parse_box_id3v2_metadata(BMFFContext *ctx, const uint8_t *data, s
 
     const uint8_t *ptr = data;
     ptr += parse_full_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
     uint16_t val = parse_u16(ptr);
     parse_iso639_2_lang(val, box->language);
@@ -3715,14 +3883,25 @@ BMFFCode _bmff_parse_box_event_message(BMFFContext *ctx, const uint8_t *data, si
 
     const uint8_t *ptr = data;
     ptr += parse_full_box(data, size, &box->box);
-    const uint8_t *end = data + box->box.size;
+    const uint8_t *end = box_end(data, size, (Box*)box);
 
-    ADV_PARSE_STR(box->scheme_id_uri, ptr);
-    ADV_PARSE_STR(box->value, ptr);
-    ADV_PARSE_U32(box->timescale, ptr);
-    ADV_PARSE_U32(box->presentation_time_delta, ptr);
-    ADV_PARSE_U32(box->event_duration, ptr);
-    ADV_PARSE_U32(box->id, ptr);
+    // version 1 moves the strings behind an absolute presentation time.
+    if(box->box.version == 1) {
+        if(end - ptr < 22) return BMFF_INVALID_SIZE;
+        ADV_PARSE_U32(box->timescale, ptr);
+        ADV_PARSE_U64(box->presentation_time, ptr);
+        ADV_PARSE_U32(box->event_duration, ptr);
+        ADV_PARSE_U32(box->id, ptr);
+        ADV_PARSE_STR(box->scheme_id_uri, ptr);
+        ADV_PARSE_STR(box->value, ptr);
+    }else{
+        ADV_PARSE_STR(box->scheme_id_uri, ptr);
+        ADV_PARSE_STR(box->value, ptr);
+        ADV_PARSE_U32(box->timescale, ptr);
+        ADV_PARSE_U32(box->presentation_time_delta, ptr);
+        ADV_PARSE_U32(box->event_duration, ptr);
+        ADV_PARSE_U32(box->id, ptr);
+    }
 
     if(ptr < end) {
         box->message_data = ptr;
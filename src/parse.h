@@ -36,6 +36,28 @@
  */
 typedef BMFFCode (*parse_func) (BMFFContext *ctx, const uint8_t *data, size_t size, Box **box_ptr);
 
+/*
+ * Parses a box with func, or hands back the memoized box when the memo cache
+ * of the context holds one parsed from the same bytes.
+ */
+BMFFCode _bmff_memo_parse(BMFFContext *ctx, parse_func func, const uint8_t *data, size_t size, Box **box_ptr);
+
+/*
+ * Generic container in the middle of being parsed. The frames of nested
+ * generic containers are kept on the stack of the context instead of the call stack.
+ */
+struct BMFFParseFrame {
+    ContainerBox    *box;
+    // start of the container, its type follows the size.
+    const uint8_t   *data;
+    // next child and end of the container.
+    const uint8_t   *ptr;
+    const uint8_t   *end;
+    uint32_t        child_idx;
+    // entry of the parent's children the container is stored in once parsed.
+    Box             **slot;
+};
+
 // list of box/atom parsing functions.
 PARSER_FUNC(_bmff_parse_box);
 PARSER_FUNC(_bmff_parse_box_file_type);
@@ -156,7 +178,7 @@ typedef struct MapItem {
 /**
  * List of functions used to parse the different ISO BMFF Boxes.
  */
-const MapItem parse_map[PARSE_MAP_LEN];
+extern const MapItem parse_map[PARSE_MAP_LEN];
 
 // TODO: Parsers for the child descriptors
 /*
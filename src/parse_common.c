@@ -65,3 +65,21 @@ uint32_t parse_var_length(const uint8_t *bytes, uint8_t length)
 
     return val;
 }
+
+uint64_t parse_box_size(const uint8_t *data, size_t size)
+{
+    if(size < 8) return 0;
+
+    uint64_t box_size = parse_u32(data);
+    if(box_size == 1) {
+        if(size < 16) return 0;
+        box_size = parse_u64(data + 8);
+        if(box_size < 16) return 0;
+    }else if(box_size == 0) {
+        // the box extends to the end of the enclosing data.
+        box_size = size;
+    }else if(box_size < 8) {
+        return 0;
+    }
+    return box_size;
+}
@@ -43,8 +43,14 @@
 #define ADV_PARSE_STR(A,P)      ((A) = (P)); while(*(P) != '\0'){(P)++;}; (P)++;
 #define ADV_PARSE_MATRIX(A,P)   int i=0; for(;i<9;++i){(A)[i] = (int32_t)parse_u32(P);(P)+=4;}; 
 
-#define BOX_MALLOC(M, T)        T *M = bmff_context_alloc_on_stack(ctx, sizeof(T)); memset(M, 0, sizeof(T));
-#define BOX_MALLOCN(M, T, N)    M = bmff_context_alloc_on_stack(ctx, sizeof(T)*(N)); memset(M, 0, sizeof(T)*(N));      
+// allocation macros return BMFF_RESOURCE_LIMIT from the calling parser when the
+// context memory budget is exhausted.
+#define BOX_MALLOC(M, T)        T *M = bmff_context_alloc_on_stack(ctx, sizeof(T)); if(!(M)) return BMFF_RESOURCE_LIMIT; memset(M, 0, sizeof(T));
+#define BOX_MALLOCN(M, T, N)    M = bmff_context_alloc_on_stack(ctx, sizeof(T)*(N)); if(!(M)) return BMFF_RESOURCE_LIMIT; memset(M, 0, sizeof(T)*(N));
+// makes sure a table of N entries of S bytes each fits in the bytes remaining
+// between P and E before any memory is allocated for it. Entries without any
+// bytes count as one so an empty table can not claim billions of entries.
+#define BOX_CHECK_TABLE(N, S, P, E) if((uint64_t)(N) * (uint64_t)((S) > 0 ? (S) : 1) > (uint64_t)((E) > (P) ? (E) - (P) : 0)) return BMFF_RESOURCE_LIMIT;
 
 // conversion functions
 uint16_t parse_u16(const uint8_t *data);
@@ -53,5 +59,8 @@ uint64_t parse_u64(const uint8_t *data);
 fxpt16_t parse_fp16(const uint8_t *data);
 fxpt8_t parse_fp8(const uint8_t *bytes);
 uint32_t parse_var_length(const uint8_t *bytes, uint8_t length);
+// size of the box at data, resolving largesize and size 0 against the size
+// bytes available. 0 when the size is invalid or its header is incomplete.
+uint64_t parse_box_size(const uint8_t *data, size_t size);
 
 #endif // PARSE_COMMON_H
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include <string.h>
+
+#include "planner.h"
+#include "parse_common.h"
+#include "context.h"
+
+#define BOX_TYPE_IS(d,t) ((d)[0]==(t)[0] && (d)[1]==(t)[1] && (d)[2]==(t)[2] && (d)[3]==(t)[3])
+
+typedef struct ReadBuffer {
+    uint8_t     *data;
+    size_t      capacity;
+    // file range held by the buffer.
+    uint64_t    offset;
+    size_t      length;
+} ReadBuffer;
+
+// makes the buffer hold at least [offset, offset + needed) and up to
+// [offset, offset + wanted). The bytes already held from offset onwards are
+// kept, so only [buf->offset + buf->length, offset + wanted) is read. The
+// buffer is charged to the memory budget, which bounds how far past needed
+// it reads.
+static BMFFCode _bmff_plan_read(BMFFContext *ctx,
+                                ReadBuffer *buf,
+                                uint64_t offset,
+                                size_t needed,
+                                size_t wanted,
+                                bmff_read_at read_at,
+                                void *user_data,
+                                BMFFReadStats *stats)
+{
+    size_t kept = 0;
+    if(offset >= buf->offset && offset < buf->offset + buf->length) {
+        kept = (size_t)(buf->offset + buf->length - offset);
+        if(kept >= needed) {
+            return BMFF_OK;
+        }
+        memmove(buf->data, buf->data + (offset - buf->offset), kept);
+    }
+
+    if(wanted > buf->capacity) {
+        size_t capacity = wanted;
+        size_t available = _bmff_memory_available(ctx);
+        if(capacity - buf->capacity > available) {
+            capacity = buf->capacity + available;
+        }
+        if(capacity < needed) {
+            return BMFF_RESOURCE_LIMIT;
+        }
+        if(capacity > buf->capacity) {
+            uint8_t *data = _bmff_realloc(ctx, buf->data, buf->capacity, capacity);
+            if(!data) {
+                return BMFF_RESOURCE_LIMIT;
+            }
+            ctx->memory_used += capacity - buf->capacity;
+            buf->data = data;
+            buf->capacity = capacity;
+        }
+    }
+    if(wanted > buf->capacity) {
+        wanted = buf->capacity;
+    }
+
+    size_t missing = wanted - kept;
+    size_t read = read_at(user_data, offset + kept, buf->data + kept, missing);
+    stats->requests++;
+    stats->bytes += read;
+
+    buf->offset = offset;
+    buf->length = kept + read;
+    return read == missing ? BMFF_OK : BMFF_INVALID_DATA;
+}
+
+static size_t _bmff_plan_span(uint64_t offset, uint64_t size, uint64_t file_size)
+{
+    uint64_t end = offset + size;
+    if(end < offset || end > file_size) {
+        end = file_size;
+    }
+    return (size_t)(end - offset);
+}
+
+BMFFCode bmff_load_header_boxes(BMFFContext *ctx,
+                                uint64_t file_size,
+                                bmff_read_at read_at,
+                                void *user_data,
+                                size_t probe_size,
+                                BMFFReadStats *stats)
+{
+    if(!ctx)        return BMFF_INVALID_CONTEXT;
+    if(!read_at)    return BMFF_INVALID_PARAMETER;
+
+    BMFFReadStats local_stats;
+    if(!stats) {
+        stats = &local_stats;
+    }
+    memset(stats, 0, sizeof(BMFFReadStats));
+    if(probe_size < 16) {
+        probe_size = BMFF_PLANNER_PROBE_SIZE;
+    }
+
+    ReadBuffer buf;
+    memset(&buf, 0, sizeof(ReadBuffer));
+
+    BMFFCode res = BMFF_OK;
+    eBoolean moov_loaded = eBooleanFalse;
+    uint64_t pos = 0;
+
+    while(pos + 8 <= file_size) {
+        // make sure the largest possible box header is held.
+        size_t header_size = _bmff_plan_span(pos, 16, file_size);
+        if(pos < buf.offset || pos + header_size > buf.offset + buf.length) {
+            res = _bmff_plan_read(ctx, &buf, pos, header_size, _bmff_plan_span(pos, probe_size, file_size),
+                                  read_at, user_data, stats);
+            if(res != BMFF_OK) {
+                break;
+            }
+        }
+
+        const uint8_t *ptr = buf.data + (pos - buf.offset);
+        uint64_t box_size = parse_u32(ptr) == 0 ? file_size - pos : parse_box_size(ptr, header_size);
+        if(box_size == 0) {
+            _bmff_record_diagnostic(ctx, BMFF_INVALID_SIZE, ptr + 4);
+            res = BMFF_INVALID_SIZE;
+            break;
+        }
+
+        // the init segment ends with the moov and the sidx boxes following it.
+        if(moov_loaded == eBooleanTrue && !BOX_TYPE_IS(ptr + 4, "sidx")) {
+            break;
+        }
+
+        if(BOX_TYPE_IS(ptr + 4, "ftyp") || BOX_TYPE_IS(ptr + 4, "moov") || BOX_TYPE_IS(ptr + 4, "sidx")) {
+            if(pos + box_size > file_size || box_size > (size_t)-1 - probe_size) {
+                res = BMFF_INVALID_SIZE;
+                break;
+            }
+            // read the rest of the box together with the headers that follow it.
+            if(pos + box_size > buf.offset + buf.length) {
+                res = _bmff_plan_read(ctx, &buf, pos, (size_t)box_size, _bmff_plan_span(pos, box_size + probe_size, file_size),
+                                      read_at, user_data, stats);
+                if(res != BMFF_OK) {
+                    break;
+                }
+                ptr = buf.data + (pos - buf.offset);
+            }
+
+            if(BOX_TYPE_IS(ptr + 4, "moov")) {
+                moov_loaded = eBooleanTrue;
+            }
+
+            // report file offsets in the events and diagnostics.
+            ctx->parse_offset = pos;
+            eBoolean end_of_stream = ctx->end_of_stream;
+            ctx->end_of_stream = eBooleanTrue;
+            bmff_parse(ctx, ptr, (size_t)box_size, &res);
+            ctx->end_of_stream = end_of_stream;
+            if(res != BMFF_OK) {
+                break;
+            }
+        }
+
+        pos += box_size;
+    }
+
+    _bmff_free(ctx, buf.data);
+    ctx->memory_used -= buf.capacity;
+    return res;
+}
@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// default number of bytes read to look for the next box headers.
+#define BMFF_PLANNER_PROBE_SIZE                 (16 * 1024)
+
+/**
+ * Reads size bytes at offset into buffer.
+ *
+ * @return number of bytes read.
+ */
+typedef size_t (*bmff_read_at) (void *user_data,
+                                uint64_t offset,
+                                uint8_t *buffer,
+                                size_t size);
+
+/**
+ * Reads issued by the planner.
+ */
+typedef struct BMFFReadStats {
+    uint32_t    requests;
+    uint64_t    bytes;
+} BMFFReadStats;
+
+/**
+ * Loads the header boxes of a file through positioned reads and parses them
+ * with the context, as if the boxes had been passed to bmff_parse.
+ *
+ * Top level box headers are read in probes of probe_size bytes. The ftyp, moov
+ * and sidx boxes are loaded and parsed, every other box is hopped over by its
+ * size. Boxes that fit within a probe are taken from it. For a larger box only
+ * the bytes past those already read are requested, together with the probe that
+ * follows it, so no byte is read twice. Reading stops once the moov and any sidx
+ * boxes directly after it are loaded, so a moov at the end of the file costs one
+ * read past the mdat.
+ *
+ * The read buffer is charged to the memory limit of the context. The probe after
+ * a box is shortened to fit the limit.
+ *
+ * @param probe_size bytes per probe, BMFF_PLANNER_PROBE_SIZE when 0.
+ * @param stats optional, receives the number of reads and bytes read.
+ * @return BMFF_RESOURCE_LIMIT when a box does not fit the memory limit.
+ */
+BMFFCode bmff_load_header_boxes(BMFFContext *ctx,
+                                uint64_t file_size,
+                                bmff_read_at read_at,
+                                void *user_data,
+                                size_t probe_size,
+                                BMFFReadStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PLANNER_H
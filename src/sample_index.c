@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sample_index.h"
+#include "context.h"
+
+#define BOX_TYPE_IS(d,t) ((d)[0]==(t)[0] && (d)[1]==(t)[1] && (d)[2]==(t)[2] && (d)[3]==(t)[3])
+// tables in the cache file start on 8 byte boundaries.
+#define CACHE_ALIGN(n) (((n) + 7) & ~((uint64_t)7))
+#define CACHE_BYTE_ORDER (0x01020304)
+
+/**
+ * Cache file header, written in host byte order.
+ */
+typedef struct CacheHeader {
+    uint8_t     magic[4];
+    uint32_t    version;
+    uint32_t    byte_order;
+    uint32_t    track_count;
+    uint64_t    file_size;
+    uint64_t    mtime;
+    uint64_t    moov_hash;
+    uint64_t    total_size;
+    uint32_t    timescale;
+    uint32_t    reserved;
+    uint64_t    duration;
+} CacheHeader;
+
+/**
+ * Cache file track record, the table positions are offsets from the start of the file.
+ */
+typedef struct CacheTrack {
+    uint32_t    track_id;
+    uint8_t     handler_type[4];
+    uint32_t    timescale;
+    uint32_t    sample_count;
+    uint64_t    duration;
+    uint64_t    offsets;
+    uint64_t    sizes;
+    uint64_t    decode_times;
+    uint64_t    composition_offsets;
+    uint64_t    sync;
+} CacheTrack;
+
+uint64_t bmff_hash(const uint8_t *data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for(; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static const Box * _bmff_find_child(const Box *parent, const char *type)
+{
+    if(!parent) {
+        return NULL;
+    }
+    const ContainerBox *container = (const ContainerBox*)parent;
+    uint32_t i = 0;
+    for(; i < container->child_count; ++i) {
+        const Box *child = container->children[i];
+        if(child && BOX_TYPE_IS(child->type, type)) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+static BMFFCode _bmff_index_track(BMFFContext *ctx, const Box *trak, BMFFTrackIndex *track)
+{
+    const TrackHeaderBox *tkhd = (const TrackHeaderBox*)_bmff_find_child(trak, "tkhd");
+    const Box *mdia = _bmff_find_child(trak, "mdia");
+    const MediaHeaderBox *mdhd = (const MediaHeaderBox*)_bmff_find_child(mdia, "mdhd");
+    const HandlerBox *hdlr = (const HandlerBox*)_bmff_find_child(mdia, "hdlr");
+    const Box *stbl = _bmff_find_child(_bmff_find_child(mdia, "minf"), "stbl");
+
+    const TimeToSampleBox *stts = (const TimeToSampleBox*)_bmff_find_child(stbl, "stts");
+    const CompositionOffsetBox *ctts = (const CompositionOffsetBox*)_bmff_find_child(stbl, "ctts");
+    const SampleSizeBox *stsz = (const SampleSizeBox*)_bmff_find_child(stbl, "stsz");
+    const CompactSampleSizeBox *stz2 = (const CompactSampleSizeBox*)_bmff_find_child(stbl, "stz2");
+    const SampleToChunkBox *stsc = (const SampleToChunkBox*)_bmff_find_child(stbl, "stsc");
+    const ChunkOffsetBox *stco = (const ChunkOffsetBox*)_bmff_find_child(stbl, "stco");
+    const ChunkLargeOffsetBox *co64 = (const ChunkLargeOffsetBox*)_bmff_find_child(stbl, "co64");
+    const SyncSampleBox *stss = (const SyncSampleBox*)_bmff_find_child(stbl, "stss");
+
+    memset(track, 0, sizeof(BMFFTrackIndex));
+    if(tkhd) {
+        track->track_id = tkhd->track_id;
+    }
+    if(mdhd) {
+        track->timescale = mdhd->timescale;
+        track->duration = mdhd->duration;
+    }
+    if(hdlr) {
+        memcpy(track->handler_type, hdlr->handler_type, 4);
+    }
+
+    uint32_t n = stsz ? stsz->sample_count : (stz2 ? stz2->sample_count : 0);
+    if(n == 0) {
+        return BMFF_OK;
+    }
+
+    // all tables of a track share one allocation, the 8 byte tables first.
+    size_t bytes = (size_t)n * (8 + 8 + 4 + 4) + (n + 7) / 8;
+    uint8_t *block = _bmff_malloc(ctx, bytes);
+    if(!block) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    memset(block, 0, bytes);
+    track->sample_count = n;
+    track->offsets = (uint64_t*)block;
+    track->decode_times = (uint64_t*)(block + (size_t)n * 8);
+    track->sizes = (uint32_t*)(block + (size_t)n * 16);
+    track->composition_offsets = (int32_t*)(block + (size_t)n * 20);
+    track->sync = block + (size_t)n * 24;
+
+    uint32_t i = 0;
+    for(; i < n; ++i) {
+        if(stsz) {
+            track->sizes[i] = stsz->sample_size > 0 ? stsz->sample_size : stsz->entry_sizes[i];
+        }else{
+            track->sizes[i] = stz2->entry_sizes[i];
+        }
+    }
+
+    // expand the run length encoded timing tables.
+    uint32_t sample = 0;
+    uint64_t time = 0;
+    for(i = 0; stts && i < stts->sample_count && sample < n; ++i) {
+        uint32_t j = 0;
+        for(; j < stts->samples[i].count && sample < n; ++j) {
+            track->decode_times[sample++] = time;
+            time += stts->samples[i].delta;
+        }
+    }
+    sample = 0;
+    for(i = 0; ctts && i < ctts->entry_count && sample < n; ++i) {
+        uint32_t j = 0;
+        for(; j < ctts->entries[i].count && sample < n; ++j) {
+            track->composition_offsets[sample++] = (int32_t)ctts->entries[i].offset;
+        }
+    }
+
+    // walk the chunks, samples in a chunk follow each other.
+    uint32_t chunk_count = stco ? stco->entry_count : (co64 ? co64->entry_count : 0);
+    sample = 0;
+    for(i = 0; stsc && i < stsc->entry_count && sample < n; ++i) {
+        uint32_t first = stsc->entries[i].first_chunk;
+        uint32_t last = i + 1 < stsc->entry_count ? stsc->entries[i + 1].first_chunk - 1 : chunk_count;
+        uint32_t chunk = first > 0 ? first : 1;
+        for(; chunk <= last && chunk <= chunk_count && sample < n; ++chunk) {
+            uint64_t offset = stco ? stco->chunk_offsets[chunk - 1] : co64->chunk_offsets[chunk - 1];
+            uint32_t j = 0;
+            for(; j < stsc->entries[i].samples_per_chunk && sample < n; ++j) {
+                track->offsets[sample] = offset;
+                offset += track->sizes[sample];
+                sample++;
+            }
+        }
+    }
+
+    // every sample is a sync sample when there is no stss.
+    if(stss) {
+        for(i = 0; i < stss->entry_count; ++i) {
+            uint32_t number = stss->sample_numbers[i];
+            if(number > 0 && number <= n) {
+                track->sync[(number - 1) >> 3] |= 1 << ((number - 1) & 0x07);
+            }
+        }
+    }else{
+        memset(track->sync, 0xFF, (n + 7) / 8);
+    }
+
+    return BMFF_OK;
+}
+
+BMFFCode bmff_sample_index_build(BMFFContext *ctx,
+                                 const Box *moov,
+                                 const uint8_t *fourCC,
+                                 BMFFSampleIndex *index)
+{
+    if(!ctx)                            return BMFF_INVALID_CONTEXT;
+    if(!moov || !index)                 return BMFF_INVALID_PARAMETER;
+    if(!BOX_TYPE_IS(moov->type, "moov")) return BMFF_INVALID_DATA;
+
+    memset(index, 0, sizeof(BMFFSampleIndex));
+    index->free = ctx->free;
+    index->allocator = ctx->allocator;
+    if(fourCC) {
+        index->key.moov_hash = bmff_hash(fourCC - 4, (size_t)bmff_get_box_size(moov));
+    }
+
+    const MovieHeaderBox *mvhd = (const MovieHeaderBox*)_bmff_find_child(moov, "mvhd");
+    if(mvhd) {
+        index->timescale = mvhd->timescale;
+        index->duration = mvhd->duration;
+    }
+
+    const ContainerBox *container = (const ContainerBox*)moov;
+    uint32_t count = 0;
+    uint32_t i = 0;
+    for(; i < container->child_count; ++i) {
+        if(container->children[i] && BOX_TYPE_IS(container->children[i]->type, "trak")) {
+            count++;
+        }
+    }
+    if(count == 0) {
+        return BMFF_OK;
+    }
+
+    index->tracks = _bmff_malloc(ctx, sizeof(BMFFTrackIndex) * count);
+    if(!index->tracks) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+    memset(index->tracks, 0, sizeof(BMFFTrackIndex) * count);
+
+    for(i = 0; i < container->child_count; ++i) {
+        const Box *child = container->children[i];
+        if(child && BOX_TYPE_IS(child->type, "trak")) {
+            BMFFCode res = _bmff_index_track(ctx, child, &index->tracks[index->track_count]);
+            if(res != BMFF_OK) {
+                bmff_sample_index_destroy(index);
+                return res;
+            }
+            index->track_count++;
+        }
+    }
+
+    return BMFF_OK;
+}
+
+static int _bmff_write_padded(FILE *file, const void *data, uint64_t size)
+{
+    static const uint8_t padding[8] = {0};
+    if(size > 0 && fwrite(data, (size_t)size, 1, file) != 1) {
+        return 0;
+    }
+    uint64_t pad = CACHE_ALIGN(size) - size;
+    return pad == 0 || fwrite(padding, (size_t)pad, 1, file) == 1;
+}
+
+BMFFCode bmff_sample_index_save(const BMFFSampleIndex *index, const char *path)
+{
+    if(!index || !path) return BMFF_INVALID_PARAMETER;
+
+    // lay out the tables after the header and the track records.
+    uint64_t pos = sizeof(CacheHeader) + sizeof(CacheTrack) * (uint64_t)index->track_count;
+    CacheTrack *records = calloc(index->track_count > 0 ? index->track_count : 1, sizeof(CacheTrack));
+    if(!records) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+
+    uint32_t i = 0;
+    for(; i < index->track_count; ++i) {
+        const BMFFTrackIndex *track = &index->tracks[i];
+        CacheTrack *record = &records[i];
+        uint64_t n = track->sample_count;
+        record->track_id = track->track_id;
+        memcpy(record->handler_type, track->handler_type, 4);
+        record->timescale = track->timescale;
+        record->sample_count = track->sample_count;
+        record->duration = track->duration;
+        record->offsets = pos;                  pos += CACHE_ALIGN(n * 8);
+        record->decode_times = pos;             pos += CACHE_ALIGN(n * 8);
+        record->sizes = pos;                    pos += CACHE_ALIGN(n * 4);
+        record->composition_offsets = pos;      pos += CACHE_ALIGN(n * 4);
+        record->sync = pos;                     pos += CACHE_ALIGN((n + 7) / 8);
+    }
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(CacheHeader));
+    memcpy(header.magic, "BMSI", 4);
+    header.version = BMFF_SAMPLE_INDEX_VERSION;
+    header.byte_order = CACHE_BYTE_ORDER;
+    header.track_count = index->track_count;
+    header.file_size = index->key.file_size;
+    header.mtime = index->key.mtime;
+    header.moov_hash = index->key.moov_hash;
+    header.total_size = pos;
+    header.timescale = index->timescale;
+    header.duration = index->duration;
+
+    size_t path_len = strlen(path);
+    char *tmp_path = malloc(path_len + 5);
+    if(!tmp_path) {
+        free(records);
+        return BMFF_RESOURCE_LIMIT;
+    }
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", 5);
+
+    int ok = 0;
+    FILE *file = fopen(tmp_path, "wb");
+    if(file) {
+        ok = fwrite(&header, sizeof(CacheHeader), 1, file) == 1;
+        if(ok && index->track_count > 0) {
+            ok = fwrite(records, sizeof(CacheTrack), index->track_count, file) == index->track_count;
+        }
+        for(i = 0; ok && i < index->track_count; ++i) {
+            const BMFFTrackIndex *track = &index->tracks[i];
+            uint64_t n = track->sample_count;
+            ok = _bmff_write_padded(file, track->offsets, n * 8) &&
+                 _bmff_write_padded(file, track->decode_times, n * 8) &&
+                 _bmff_write_padded(file, track->sizes, n * 4) &&
+                 _bmff_write_padded(file, track->composition_offsets, n * 4) &&
+                 _bmff_write_padded(file, track->sync, (n + 7) / 8);
+        }
+        ok = (fclose(file) == 0) && ok;
+    }
+    if(ok) {
+        ok = rename(tmp_path, path) == 0;
+    }
+    if(!ok) {
+        remove(tmp_path);
+    }
+
+    free(tmp_path);
+    free(records);
+    return ok ? BMFF_OK : BMFF_IO_ERROR;
+}
+
+static int _bmff_cache_range_valid(uint64_t offset, uint64_t size, uint64_t total)
+{
+    return offset % 8 == 0 && offset <= total && size <= total - offset;
+}
+
+BMFFCode bmff_sample_index_open(const char *path, const BMFFSampleIndexKey *key, BMFFSampleIndex *index)
+{
+    if(!path || !index) return BMFF_INVALID_PARAMETER;
+    memset(index, 0, sizeof(BMFFSampleIndex));
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return BMFF_INVALID_DATA;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        return BMFF_INVALID_DATA;
+    }
+    size_t size = (size_t)st.st_size;
+    uint8_t *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) {
+        return BMFF_INVALID_DATA;
+    }
+
+    const CacheHeader *header = (const CacheHeader*)mapping;
+    int valid = memcmp(header->magic, "BMSI", 4) == 0 &&
+                header->version == BMFF_SAMPLE_INDEX_VERSION &&
+                header->byte_order == CACHE_BYTE_ORDER &&
+                header->total_size == size &&
+                _bmff_cache_range_valid(sizeof(CacheHeader), sizeof(CacheTrack) * (uint64_t)header->track_count, size);
+    if(valid && key) {
+        valid = (key->file_size == 0 || key->file_size == header->file_size) &&
+                (key->mtime == 0 || key->mtime == header->mtime) &&
+                (key->moov_hash == 0 || key->moov_hash == header->moov_hash);
+    }
+
+    BMFFTrackIndex *tracks = NULL;
+    if(valid && header->track_count > 0) {
+        tracks = calloc(header->track_count, sizeof(BMFFTrackIndex));
+        valid = tracks != NULL;
+    }
+
+    const CacheTrack *records = (const CacheTrack*)(mapping + sizeof(CacheHeader));
+    uint32_t i = 0;
+    for(; valid && i < header->track_count; ++i) {
+        const CacheTrack *record = &records[i];
+        BMFFTrackIndex *track = &tracks[i];
+        uint64_t n = record->sample_count;
+        valid = _bmff_cache_range_valid(record->offsets, n * 8, size) &&
+                _bmff_cache_range_valid(record->decode_times, n * 8, size) &&
+                _bmff_cache_range_valid(record->sizes, n * 4, size) &&
+                _bmff_cache_range_valid(record->composition_offsets, n * 4, size) &&
+                _bmff_cache_range_valid(record->sync, (n + 7) / 8, size);
+
+        track->track_id = record->track_id;
+        memcpy(track->handler_type, record->handler_type, 4);
+        track->timescale = record->timescale;
+        track->duration = record->duration;
+        track->sample_count = record->sample_count;
+        track->offsets = (uint64_t*)(mapping + record->offsets);
+        track->decode_times = (uint64_t*)(mapping + record->decode_times);
+        track->sizes = (uint32_t*)(mapping + record->sizes);
+        track->composition_offsets = (int32_t*)(mapping + record->composition_offsets);
+        track->sync = mapping + record->sync;
+    }
+
+    if(!valid) {
+        free(tracks);
+        munmap(mapping, size);
+        return BMFF_INVALID_DATA;
+    }
+
+    index->key.file_size = header->file_size;
+    index->key.mtime = header->mtime;
+    index->key.moov_hash = header->moov_hash;
+    index->timescale = header->timescale;
+    index->duration = header->duration;
+    index->track_count = header->track_count;
+    index->tracks = tracks;
+    index->free = free;
+    index->mapping = mapping;
+    index->mapping_size = size;
+
+    return BMFF_OK;
+}
+
+BMFFCode bmff_sample_index_destroy(BMFFSampleIndex *index)
+{
+    if(!index) return BMFF_INVALID_PARAMETER;
+
+    if(index->mapping) {
+        munmap(index->mapping, index->mapping_size);
+    }else if(index->free) {
+        uint32_t i = 0;
+        for(; i < index->track_count; ++i) {
+            // the tables of a track share the allocation of the offsets.
+            _bmff_allocator_free(&index->allocator, index->free, index->tracks[i].offsets);
+        }
+    }
+    if(index->free && index->tracks) {
+        _bmff_allocator_free(&index->allocator, index->free, index->tracks);
+    }
+    memset(index, 0, sizeof(BMFFSampleIndex));
+
+    return BMFF_OK;
+}
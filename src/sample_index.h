@@ -0,0 +1,129 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SAMPLE_INDEX_H
+#define SAMPLE_INDEX_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// version of the sample index cache file format.
+#define BMFF_SAMPLE_INDEX_VERSION               (1)
+
+#define BMFF_SAMPLE_IS_SYNC(t, i)               (((t)->sync[(i) >> 3] >> ((i) & 0x07)) & 0x01)
+
+/**
+ * Sample tables of a track, expanded to one entry per sample.
+ */
+typedef struct BMFFTrackIndex {
+    uint32_t    track_id;
+    uint8_t     handler_type[4];
+    uint32_t    timescale;
+    uint64_t    duration;
+    uint32_t    sample_count;
+    // file offset of each sample.
+    uint64_t    *offsets;
+    uint32_t    *sizes;
+    uint64_t    *decode_times;
+    int32_t     *composition_offsets;
+    // one bit per sample, set for sync samples.
+    uint8_t     *sync;
+} BMFFTrackIndex;
+
+/**
+ * Identifies the file a sample index was built from. Fields that are 0 are
+ * not checked when a cache file is opened.
+ */
+typedef struct BMFFSampleIndexKey {
+    uint64_t    file_size;
+    uint64_t    mtime;
+    uint64_t    moov_hash;
+} BMFFSampleIndexKey;
+
+/**
+ * Sample index of all tracks of a movie.
+ */
+typedef struct BMFFSampleIndex {
+    BMFFSampleIndexKey  key;
+    // movie header.
+    uint32_t            timescale;
+    uint64_t            duration;
+    uint32_t            track_count;
+    BMFFTrackIndex      *tracks;
+    // allocator that owns the tables of a built index.
+    void (*free)(void*);
+    BMFFAllocator       allocator;
+    // cache file the tables point into, when the index was opened from one.
+    void                *mapping;
+    size_t              mapping_size;
+} BMFFSampleIndex;
+
+/**
+ * Hashes data with 64 bit FNV-1a.
+ */
+uint64_t bmff_hash(const uint8_t *data, size_t size);
+
+/**
+ * Builds the sample index from a parsed moov box. Call it from the
+ * ParseComplete event of the moov, where fourCC points at the type of the raw
+ * moov so its hash can be stored in the key. file_size and mtime of the key are
+ * left for the caller to fill in.
+ * The tables are allocated with the allocator of the context.
+ */
+BMFFCode bmff_sample_index_build(BMFFContext *ctx,
+                                 const Box *moov,
+                                 const uint8_t *fourCC,
+                                 BMFFSampleIndex *index);
+
+/**
+ * Writes the sample index to a cache file. The file is written next to path
+ * and renamed into place.
+ *
+ * @return BMFF_IO_ERROR when the file can not be written.
+ */
+BMFFCode bmff_sample_index_save(const BMFFSampleIndex *index, const char *path);
+
+/**
+ * Maps a cache file and checks its header against the key. The tables of the
+ * index point straight into the read only mapping.
+ *
+ * @return BMFF_INVALID_DATA when the file is missing, stale or not a cache file.
+ */
+BMFFCode bmff_sample_index_open(const char *path, const BMFFSampleIndexKey *key, BMFFSampleIndex *index);
+
+/**
+ * Frees a built index or unmaps an opened one.
+ */
+BMFFCode bmff_sample_index_destroy(BMFFSampleIndex *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SAMPLE_INDEX_H
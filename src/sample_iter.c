@@ -0,0 +1,172 @@
+#include <string.h>
+
+#include "sample_iter.h"
+#include "context.h"
+
+BMFFCode bmff_sample_iter_init_buffer(BMFFSampleIter *iter,
+                                      const BMFFTrackIndex *track,
+                                      const uint8_t *buffer,
+                                      uint64_t buffer_offset,
+                                      size_t buffer_size)
+{
+    if(!iter || !track || !buffer) return BMFF_INVALID_PARAMETER;
+
+    memset(iter, 0, sizeof(BMFFSampleIter));
+    iter->track = track;
+    iter->track_id = track->track_id;
+    iter->buffer = buffer;
+    iter->buffer_offset = buffer_offset;
+    iter->buffer_size = buffer_size;
+    return BMFF_OK;
+}
+
+BMFFCode bmff_sample_iter_init_reader(BMFFSampleIter *iter,
+                                      BMFFContext *ctx,
+                                      const BMFFTrackIndex *track,
+                                      bmff_read_at read_at,
+                                      void *user_data,
+                                      size_t max_batch)
+{
+    if(!ctx)                        return BMFF_INVALID_CONTEXT;
+    if(!iter || !track || !read_at) return BMFF_INVALID_PARAMETER;
+
+    memset(iter, 0, sizeof(BMFFSampleIter));
+    iter->track = track;
+    iter->track_id = track->track_id;
+    iter->read_at = read_at;
+    iter->read_user_data = user_data;
+    iter->max_batch = max_batch > 0 ? max_batch : BMFF_SAMPLE_ITER_BATCH_SIZE;
+    iter->realloc = ctx->realloc;
+    iter->free = ctx->free;
+    iter->allocator = ctx->allocator;
+    return BMFF_OK;
+}
+
+BMFFCode bmff_sample_iter_init_chunk(BMFFSampleIter *iter,
+                                     const BMFFChunk *chunk,
+                                     uint32_t track_id)
+{
+    if(!iter || !chunk) return BMFF_INVALID_PARAMETER;
+
+    memset(iter, 0, sizeof(BMFFSampleIter));
+    iter->chunk = chunk;
+    iter->track_id = track_id;
+    return BMFF_OK;
+}
+
+// reads the run of adjacent samples starting at sample i into the batch buffer.
+static BMFFCode _bmff_sample_iter_read(BMFFSampleIter *iter, uint32_t i)
+{
+    const BMFFTrackIndex *track = iter->track;
+    uint64_t offset = track->offsets[i];
+    uint64_t size = track->sizes[i];
+    uint32_t j = i + 1;
+    for(; j < track->sample_count; ++j) {
+        if(track->offsets[j] != offset + size || size + track->sizes[j] > iter->max_batch) {
+            break;
+        }
+        size += track->sizes[j];
+    }
+    if(size > SIZE_MAX) {
+        return BMFF_RESOURCE_LIMIT;
+    }
+
+    if(size > iter->batch_capacity) {
+        uint8_t *batch = _bmff_allocator_realloc(&iter->allocator, iter->realloc, iter->batch, iter->batch_capacity, (size_t)size);
+        if(!batch) {
+            return BMFF_RESOURCE_LIMIT;
+        }
+        iter->batch = batch;
+        iter->batch_capacity = (size_t)size;
+    }
+
+    iter->stats.requests++;
+    size_t read = iter->read_at(iter->read_user_data, offset, iter->batch, (size_t)size);
+    iter->stats.bytes += read;
+    iter->batch_offset = offset;
+    iter->batch_size = read;
+    if(read != size) {
+        return BMFF_IO_ERROR;
+    }
+    return BMFF_OK;
+}
+
+static BMFFCode _bmff_sample_iter_track(BMFFSampleIter *iter, BMFFSample *sample)
+{
+    const BMFFTrackIndex *track = iter->track;
+    if(iter->next >= track->sample_count) {
+        return BMFF_END_OF_DATA;
+    }
+
+    uint32_t i = iter->next++;
+    sample->track_id = track->track_id;
+    sample->index = i;
+    sample->data = NULL;
+    sample->offset = track->offsets[i];
+    sample->size = track->sizes[i];
+    sample->decode_time = track->decode_times[i];
+    sample->composition_time = track->decode_times[i] + (int64_t)track->composition_offsets[i];
+    sample->flags = BMFF_SAMPLE_IS_SYNC(track, i) ? 0 : BMFF_SAMPLE_FLAG_NON_SYNC;
+
+    if(iter->read_at) {
+        if(sample->offset < iter->batch_offset ||
+                sample->offset + sample->size > iter->batch_offset + iter->batch_size) {
+            BMFFCode res = _bmff_sample_iter_read(iter, i);
+            if(res != BMFF_OK) {
+                return res;
+            }
+        }
+        sample->data = iter->batch + (sample->offset - iter->batch_offset);
+    }else if(sample->offset >= iter->buffer_offset &&
+             sample->offset - iter->buffer_offset <= iter->buffer_size &&
+             sample->size <= iter->buffer_size - (sample->offset - iter->buffer_offset)) {
+        sample->data = iter->buffer + (sample->offset - iter->buffer_offset);
+    }
+    return BMFF_OK;
+}
+
+static BMFFCode _bmff_sample_iter_chunk(BMFFSampleIter *iter, BMFFSample *sample)
+{
+    const BMFFChunk *chunk = iter->chunk;
+    while(iter->next < chunk->sample_count) {
+        uint32_t i = iter->next++;
+        const BMFFChunkSample *chunk_sample = &chunk->samples[i];
+        if(iter->track_id != 0 && chunk_sample->track_id != iter->track_id) {
+            continue;
+        }
+        sample->track_id = chunk_sample->track_id;
+        sample->index = i;
+        sample->data = chunk_sample->data;
+        sample->offset = chunk_sample->offset;
+        sample->size = chunk_sample->size;
+        sample->decode_time = chunk_sample->decode_time;
+        sample->composition_time = chunk_sample->decode_time + chunk_sample->composition_time_offset;
+        sample->flags = chunk_sample->flags;
+        return BMFF_OK;
+    }
+    return BMFF_END_OF_DATA;
+}
+
+BMFFCode bmff_sample_iter_next(BMFFSampleIter *iter, BMFFSample *sample)
+{
+    if(!iter || !sample) return BMFF_INVALID_PARAMETER;
+
+    if(iter->chunk) {
+        return _bmff_sample_iter_chunk(iter, sample);
+    }
+    if(iter->track) {
+        return _bmff_sample_iter_track(iter, sample);
+    }
+    return BMFF_INVALID_PARAMETER;
+}
+
+BMFFCode bmff_sample_iter_destroy(BMFFSampleIter *iter)
+{
+    if(!iter) return BMFF_INVALID_PARAMETER;
+
+    if(iter->batch) {
+        _bmff_allocator_free(&iter->allocator, iter->free, iter->batch);
+    }
+    memset(iter, 0, sizeof(BMFFSampleIter));
+    return BMFF_OK;
+}
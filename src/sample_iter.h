@@ -0,0 +1,143 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef SAMPLE_ITER_H
+#define SAMPLE_ITER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+#include "chunk.h"
+#include "planner.h"
+#include "sample_index.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// default upper bound of a batched read.
+#define BMFF_SAMPLE_ITER_BATCH_SIZE             (1024 * 1024)
+// sample_is_non_sync_sample bit of the sample flags.
+#define BMFF_SAMPLE_FLAG_NON_SYNC               (0x00010000)
+
+/**
+ * Sample yielded by the iterator.
+ */
+typedef struct BMFFSample {
+    uint32_t        track_id;
+    // index of the sample in its track index or chunk.
+    uint32_t        index;
+    // payload of the sample, NULL if it lies outside the input.
+    const uint8_t   *data;
+    // offset of the payload in the file or stream.
+    uint64_t        offset;
+    uint32_t        size;
+    uint64_t        decode_time;
+    uint64_t        composition_time;
+    // sample flags as stored in a track run, BMFF_SAMPLE_FLAG_NON_SYNC is set for non sync samples.
+    uint32_t        flags;
+} BMFFSample;
+
+/**
+ * Sample iterator state.
+ */
+typedef struct BMFFSampleIter {
+    // samples of a progressive track or of a chunk.
+    const BMFFTrackIndex    *track;
+    const BMFFChunk         *chunk;
+    uint32_t                track_id;
+    uint32_t                next;
+    // mapped input, covering the file offsets [buffer_offset, buffer_offset + buffer_size).
+    const uint8_t           *buffer;
+    uint64_t                buffer_offset;
+    size_t                  buffer_size;
+    // reader input, samples that follow each other in the file are read together.
+    bmff_read_at            read_at;
+    void                    *read_user_data;
+    size_t                  max_batch;
+    uint8_t                 *batch;
+    size_t                  batch_capacity;
+    uint64_t                batch_offset;
+    size_t                  batch_size;
+    void *(*realloc)(void*, size_t);
+    void (*free)(void*);
+    BMFFAllocator           allocator;
+    BMFFReadStats           stats;
+} BMFFSampleIter;
+
+/**
+ * Iterates the samples of a progressive track over a mapped file, or a part
+ * of it starting at buffer_offset such as the payload of an mdat.
+ * The yielded payloads point straight into the buffer.
+ */
+BMFFCode bmff_sample_iter_init_buffer(BMFFSampleIter *iter,
+                                      const BMFFTrackIndex *track,
+                                      const uint8_t *buffer,
+                                      uint64_t buffer_offset,
+                                      size_t buffer_size);
+
+/**
+ * Iterates the samples of a progressive track through positioned reads.
+ * Runs of samples that follow each other in the file are fetched with a single
+ * read of up to max_batch bytes, a larger sample is read on its own. The batch
+ * buffer is allocated with the allocator of the context.
+ * A yielded payload is valid until the next call to bmff_sample_iter_next.
+ *
+ * @param max_batch BMFF_SAMPLE_ITER_BATCH_SIZE when 0.
+ */
+BMFFCode bmff_sample_iter_init_reader(BMFFSampleIter *iter,
+                                      BMFFContext *ctx,
+                                      const BMFFTrackIndex *track,
+                                      bmff_read_at read_at,
+                                      void *user_data,
+                                      size_t max_batch);
+
+/**
+ * Iterates the samples of a chunk delivered by the chunk ingest, restricted
+ * to one track unless track_id is 0. The payloads point into the mdat of the
+ * chunk, so iteration has to finish within the chunk callback.
+ */
+BMFFCode bmff_sample_iter_init_chunk(BMFFSampleIter *iter,
+                                     const BMFFChunk *chunk,
+                                     uint32_t track_id);
+
+/**
+ * Yields the next sample.
+ *
+ * @return BMFF_END_OF_DATA after the last sample, BMFF_IO_ERROR when a read
+ * comes up short.
+ */
+BMFFCode bmff_sample_iter_next(BMFFSampleIter *iter, BMFFSample *sample);
+
+/**
+ * Frees the batch buffer of a reader backed iterator.
+ */
+BMFFCode bmff_sample_iter_destroy(BMFFSampleIter *iter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SAMPLE_ITER_H
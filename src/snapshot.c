@@ -0,0 +1,170 @@
+#include <string.h>
+
+#include "snapshot.h"
+#include "context.h"
+
+#define BOX_TYPE_IS(d,t) ((d)[0]==(t)[0] && (d)[1]==(t)[1] && (d)[2]==(t)[2] && (d)[3]==(t)[3])
+
+/**
+ * Capture state, the track being parsed is the last one of the snapshot.
+ */
+typedef struct SnapshotCapture {
+    BMFFInitSnapshot    *snapshot;
+    BMFFTrackState      *track;
+    BMFFCode            result;
+} SnapshotCapture;
+
+// checks the type of the parent of the box whose event is being delivered.
+static eBoolean _bmff_parent_is(BMFFContext *ctx, const char *type)
+{
+    uint32_t depth = ctx->breadcrumb_depth;
+    if(depth == 0 || depth > BMFF_BREADCRUMB_DEPTH) {
+        return eBooleanFalse;
+    }
+    return memcmp(&ctx->breadcrumb_path[depth - 1], type, 4) == 0 ? eBooleanTrue : eBooleanFalse;
+}
+
+static BMFFTrackState * _bmff_snapshot_add_track(SnapshotCapture *capture)
+{
+    BMFFInitSnapshot *snapshot = capture->snapshot;
+    if(snapshot->track_count == BMFF_SNAPSHOT_MAX_TRACKS) {
+        capture->result = BMFF_RESOURCE_LIMIT;
+        return NULL;
+    }
+    BMFFTrackState *track = &snapshot->tracks[snapshot->track_count++];
+    memset(track, 0, sizeof(BMFFTrackState));
+    track->is_constant_iv = eBooleanUnknown;
+    return track;
+}
+
+static void _bmff_snapshot_track_extends(SnapshotCapture *capture, const TrackExtendsBox *trex)
+{
+    BMFFTrackState *track = (BMFFTrackState*)bmff_init_snapshot_get_track(capture->snapshot, trex->track_id);
+    if(!track) {
+        track = _bmff_snapshot_add_track(capture);
+        if(!track) {
+            return;
+        }
+        track->track_id = trex->track_id;
+    }
+    track->default_sample_description_index = trex->default_sample_description_index;
+    track->default_sample_duration = trex->default_sample_duration;
+    track->default_sample_size = trex->default_sample_size;
+    track->default_sample_is_difference_sample = trex->default_sample_is_difference_sample;
+}
+
+static void _bmff_snapshot_track_encryption(BMFFTrackState *track, const TrackEncryptionBox *tenc)
+{
+    // mirrors the context fields set by the tenc parser.
+    track->default_iv_size = tenc->default_per_sample_iv_size;
+    track->is_constant_iv = eBooleanFalse;
+    if(tenc->default_is_protected == 1 && tenc->default_per_sample_iv_size == 0) {
+        track->default_iv_size = tenc->default_constant_iv_size;
+        track->is_constant_iv = eBooleanTrue;
+    }
+    memcpy(track->default_kid, tenc->default_kid, 16);
+    track->default_crypt_byte_block = tenc->default_crypt_byte_block;
+    track->default_skip_byte_block = tenc->default_skip_byte_block;
+}
+
+static void _bmff_snapshot_on_event(BMFFContext *ctx,
+                                    BMFFEventId id,
+                                    const uint8_t *fourCC,
+                                    void *data,
+                                    void *user_data)
+{
+    SnapshotCapture *capture = (SnapshotCapture*)user_data;
+
+    if(id == BMFFEventParseStart) {
+        if(BOX_TYPE_IS(fourCC, "trak")) {
+            capture->track = _bmff_snapshot_add_track(capture);
+        }
+        return;
+    }
+    if(id != BMFFEventParseComplete) {
+        return;
+    }
+
+    BMFFTrackState *track = capture->track;
+    if(BOX_TYPE_IS(fourCC, "trex")) {
+        _bmff_snapshot_track_extends(capture, (const TrackExtendsBox*)data);
+    }else if(!track) {
+        return;
+    }else if(BOX_TYPE_IS(fourCC, "trak")) {
+        capture->track = NULL;
+    }else if(BOX_TYPE_IS(fourCC, "tkhd")) {
+        track->track_id = ((const TrackHeaderBox*)data)->track_id;
+    }else if(BOX_TYPE_IS(fourCC, "mdhd")) {
+        track->timescale = ((const MediaHeaderBox*)data)->timescale;
+    }else if(BOX_TYPE_IS(fourCC, "hdlr") && _bmff_parent_is(ctx, "mdia") == eBooleanTrue) {
+        memcpy(track->handler_type, ((const HandlerBox*)data)->handler_type, 4);
+    }else if(BOX_TYPE_IS(fourCC, "stsd")) {
+        track->sample_description_version = ((const SampleDescriptionBox*)data)->box.version;
+    }else if(_bmff_parent_is(ctx, "stsd") == eBooleanTrue && memcmp(track->handler_type, "soun", 4) == 0) {
+        // only the audio sample entry parser sets the channel count.
+        track->channel_count = ctx->channel_count;
+    }else if(BOX_TYPE_IS(fourCC, "schm")) {
+        memcpy(track->scheme_type, ((const SchemeTypeBox*)data)->scheme_type, 4);
+    }else if(BOX_TYPE_IS(fourCC, "tenc")) {
+        _bmff_snapshot_track_encryption(track, (const TrackEncryptionBox*)data);
+    }
+}
+
+BMFFCode bmff_init_snapshot_capture(BMFFContext *ctx,
+                                    const uint8_t *data,
+                                    size_t size,
+                                    BMFFInitSnapshot *snapshot)
+{
+    if(!ctx)                return BMFF_INVALID_CONTEXT;
+    if(!data)               return BMFF_INVALID_DATA;
+    if(!snapshot)           return BMFF_INVALID_PARAMETER;
+    if(ctx->events)         return BMFF_INVALID_PARAMETER;
+
+    SnapshotCapture capture;
+    capture.snapshot = snapshot;
+    capture.track = NULL;
+    capture.result = BMFF_OK;
+    memset(snapshot, 0, sizeof(BMFFInitSnapshot));
+
+    bmff_on_event callback = ctx->callback;
+    void *callback_user_data = ctx->callback_user_data;
+    uint32_t event_mask = ctx->event_mask;
+    ctx->callback = _bmff_snapshot_on_event;
+    ctx->callback_user_data = &capture;
+    ctx->event_mask = BMFF_EVENT_MASK(BMFFEventParseStart) | BMFF_EVENT_MASK(BMFFEventParseComplete);
+    // the context state is read as each box is parsed, which replayed events do not restore.
+    BMFFMemo *memo = ctx->memo;
+    ctx->memo = NULL;
+
+    BMFFCode res = BMFF_OK;
+    bmff_parse(ctx, data, size, &res);
+
+    ctx->callback = callback;
+    ctx->callback_user_data = callback_user_data;
+    ctx->event_mask = event_mask;
+    ctx->memo = memo;
+
+    return res != BMFF_OK ? res : capture.result;
+}
+
+const BMFFTrackState * bmff_init_snapshot_get_track(const BMFFInitSnapshot *snapshot, uint32_t track_id)
+{
+    if(!snapshot) return NULL;
+
+    uint32_t i = 0;
+    for(; i < snapshot->track_count; ++i) {
+        if(snapshot->tracks[i].track_id == track_id) {
+            return &snapshot->tracks[i];
+        }
+    }
+    return NULL;
+}
+
+BMFFCode bmff_context_attach_snapshot(BMFFContext *ctx, const BMFFInitSnapshot *snapshot)
+{
+    if(!ctx) return BMFF_INVALID_CONTEXT;
+
+    ctx->snapshot = snapshot;
+    ctx->track_state = NULL;
+    return BMFF_OK;
+}
@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// number of tracks kept by an init snapshot.
+#define BMFF_SNAPSHOT_MAX_TRACKS                (16)
+
+/**
+ * State of a track that the parsers of its media segments depend on.
+ */
+typedef struct BMFFTrackState {
+    uint32_t    track_id;
+    uint32_t    timescale;
+    uint8_t     handler_type[4];
+    // from the sample description.
+    uint32_t    sample_description_version;
+    uint32_t    channel_count;
+    // from the protection scheme, a default_iv_size of 0 means the track is not encrypted.
+    uint8_t     scheme_type[4];
+    uint8_t     default_iv_size;
+    eBoolean    is_constant_iv;
+    uint8_t     default_kid[16];
+    uint8_t     default_crypt_byte_block;
+    uint8_t     default_skip_byte_block;
+    // trex defaults for the track fragments.
+    uint32_t    default_sample_description_index;
+    uint32_t    default_sample_duration;
+    uint32_t    default_sample_size;
+    eBoolean    default_sample_is_difference_sample;
+} BMFFTrackState;
+
+/**
+ * Per track state of an init segment.
+ * A snapshot is never modified once captured, so any number of contexts, on
+ * any number of threads, can have it attached at the same time.
+ */
+typedef struct BMFFInitSnapshot {
+    uint32_t        track_count;
+    BMFFTrackState  tracks[BMFF_SNAPSHOT_MAX_TRACKS];
+} BMFFInitSnapshot;
+
+/**
+ * Parses an init segment with the context and captures the state of each of
+ * its tracks. The event callback of the context is replaced for the duration
+ * of the call, batched event delivery must not be enabled. The memo cache of
+ * the context is not used, so every box of the segment is parsed.
+ *
+ * @return BMFF_RESOURCE_LIMIT when there are more than BMFF_SNAPSHOT_MAX_TRACKS tracks.
+ */
+BMFFCode bmff_init_snapshot_capture(BMFFContext *ctx,
+                                    const uint8_t *data,
+                                    size_t size,
+                                    BMFFInitSnapshot *snapshot);
+
+/**
+ * Returns the state of a track, NULL if the snapshot has no such track.
+ */
+const BMFFTrackState * bmff_init_snapshot_get_track(const BMFFInitSnapshot *snapshot, uint32_t track_id);
+
+/**
+ * Attaches a snapshot to a context, NULL detaches it.
+ * Every track fragment header then loads the state of its track into the
+ * context, so media segments parse correctly without their init segment. The
+ * snapshot must outlive the context or be detached first.
+ */
+BMFFCode bmff_context_attach_snapshot(BMFFContext *ctx, const BMFFInitSnapshot *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,319 @@
+#include <string.h>
+
+#include "timed_metadata.h"
+#include "context.h"
+#include "parse.h"
+#include "parse_common.h"
+
+#define BOX_TYPE_IS(d,t) ((d)[0]==(t)[0] && (d)[1]==(t)[1] && (d)[2]==(t)[2] && (d)[3]==(t)[3])
+
+static uint64_t _bmff_hash_append(uint64_t hash, const uint8_t *data, size_t size)
+{
+    size_t i = 0;
+    for(; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// converts t from one timescale to another without overflowing the intermediate product.
+static uint64_t _bmff_rescale(uint64_t t, uint32_t from, uint32_t to)
+{
+    if(from == to || from == 0) {
+        return t;
+    }
+    return (t / from) * to + (t % from) * to / from;
+}
+
+// size of the box at ptr, 0 when it is corrupt or does not fit.
+static uint64_t _bmff_box_size(const uint8_t *ptr, const uint8_t *end)
+{
+    if(end - ptr < 8) {
+        return 0;
+    }
+    uint64_t size = parse_box_size(ptr, end - ptr);
+    if(size > (uint64_t)(end - ptr)) {
+        return 0;
+    }
+    return size;
+}
+
+// finds the tfdt of the track in a moof, parsing only the tfhd and tfdt boxes.
+static eBoolean _bmff_fragment_time(BMFFMetadataExtractor *extractor, const uint8_t *moof, uint64_t moof_size, uint64_t *time)
+{
+    BMFFContext *ctx = extractor->ctx;
+    const uint8_t *moof_end = moof + moof_size;
+    const uint8_t *traf = moof + 8;
+    eBoolean found = eBooleanFalse;
+
+    if(bmff_context_alloc_stack_push(ctx) != BMFF_OK) {
+        _bmff_record_diagnostic(ctx, BMFF_RESOURCE_LIMIT, moof + 4);
+        return eBooleanFalse;
+    }
+    while(found == eBooleanFalse && traf < moof_end) {
+        uint64_t traf_size = _bmff_box_size(traf, moof_end);
+        if(traf_size == 0) {
+            break;
+        }
+        if(BOX_TYPE_IS(traf + 4, "traf")) {
+            const uint8_t *traf_end = traf + traf_size;
+            const uint8_t *child = traf + 8;
+            eBoolean track_matches = extractor->track_id == 0 ? eBooleanTrue : eBooleanFalse;
+            while(child < traf_end) {
+                uint64_t child_size = _bmff_box_size(child, traf_end);
+                if(child_size == 0) {
+                    break;
+                }
+                Box *box = NULL;
+                if(BOX_TYPE_IS(child + 4, "tfhd") &&
+                        _bmff_parse_box_track_fragment_header(ctx, child, child_size, &box) == BMFF_OK) {
+                    const TrackFragmentHeaderBox *tfhd = (const TrackFragmentHeaderBox*)box;
+                    if(tfhd->track_id == extractor->track_id) {
+                        track_matches = eBooleanTrue;
+                    }
+                }else if(BOX_TYPE_IS(child + 4, "tfdt") && track_matches == eBooleanTrue &&
+                         _bmff_parse_box_track_fragment_decode_time(ctx, child, child_size, &box) == BMFF_OK) {
+                    *time = ((const TrackFragmentDecodeTimeBox*)box)->base_media_decode_time;
+                    found = eBooleanTrue;
+                    break;
+                }
+                child += child_size;
+            }
+        }
+        traf += traf_size;
+    }
+    bmff_context_alloc_stack_pop(ctx);
+
+    return found;
+}
+
+/**
+ * Time of the next movie fragment, looked up once for all the boxes in front of it.
+ */
+typedef struct Lookahead {
+    const uint8_t   *moof;
+    eBoolean        found;
+    uint64_t        time;
+} Lookahead;
+
+static uint64_t _bmff_segment_time(BMFFMetadataExtractor *extractor, Lookahead *lookahead, const uint8_t *ptr, const uint8_t *end)
+{
+    if(!lookahead->moof || lookahead->moof < ptr) {
+        lookahead->found = eBooleanFalse;
+        lookahead->moof = end;
+        while(ptr < end) {
+            uint64_t size = _bmff_box_size(ptr, end);
+            if(size == 0) {
+                break;
+            }
+            if(BOX_TYPE_IS(ptr + 4, "moof")) {
+                lookahead->moof = ptr;
+                lookahead->found = _bmff_fragment_time(extractor, ptr, size, &lookahead->time);
+                break;
+            }
+            ptr += size;
+        }
+    }
+    return lookahead->found == eBooleanTrue ? lookahead->time : extractor->fragment_time;
+}
+
+static void _bmff_deliver(BMFFMetadataExtractor *extractor, BMFFTimedMetadata *metadata, const uint8_t *box)
+{
+    BMFFContext *ctx = extractor->ctx;
+    metadata->offset = ctx->parse_offset + (box - ctx->parse_data);
+    extractor->delivered++;
+    if(extractor->callback) {
+        extractor->callback(extractor, metadata, extractor->callback_user_data);
+    }
+}
+
+// returns eBooleanTrue when the event was seen recently, and remembers it otherwise.
+static eBoolean _bmff_is_duplicate(BMFFMetadataExtractor *extractor, const EventMessageBox *emsg)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = _bmff_hash_append(hash, (const uint8_t*)emsg->scheme_id_uri, strlen(emsg->scheme_id_uri) + 1);
+    hash = _bmff_hash_append(hash, (const uint8_t*)emsg->value, strlen(emsg->value) + 1);
+    uint8_t id[4] = { emsg->id >> 24, emsg->id >> 16, emsg->id >> 8, emsg->id };
+    hash = _bmff_hash_append(hash, id, 4);
+
+    uint32_t i = 0;
+    for(; i < extractor->seen_count; ++i) {
+        if(extractor->seen[i] == hash) {
+            return eBooleanTrue;
+        }
+    }
+    extractor->seen[extractor->seen_next] = hash;
+    extractor->seen_next = (extractor->seen_next + 1) % BMFF_METADATA_DEDUP_SIZE;
+    if(extractor->seen_count < BMFF_METADATA_DEDUP_SIZE) {
+        extractor->seen_count++;
+    }
+    return eBooleanFalse;
+}
+
+static void _bmff_extract_event_message(BMFFMetadataExtractor *extractor,
+                                        Lookahead *lookahead,
+                                        const uint8_t *ptr,
+                                        uint64_t size,
+                                        const uint8_t *end)
+{
+    BMFFContext *ctx = extractor->ctx;
+    Box *box = NULL;
+    BMFFCode res = _bmff_parse_box_event_message(ctx, ptr, size, &box);
+    if(res != BMFF_OK) {
+        _bmff_record_diagnostic(ctx, res, ptr + 4);
+        return;
+    }
+
+    const EventMessageBox *emsg = (const EventMessageBox*)box;
+    if(emsg->timescale == 0) {
+        _bmff_record_diagnostic(ctx, BMFF_INVALID_DATA, ptr + 4);
+        return;
+    }
+    if(_bmff_is_duplicate(extractor, emsg) == eBooleanTrue) {
+        extractor->duplicates++;
+        return;
+    }
+
+    BMFFTimedMetadata metadata;
+    memset(&metadata, 0, sizeof(BMFFTimedMetadata));
+    memcpy(metadata.type, "emsg", 4);
+    metadata.scheme_id_uri = emsg->scheme_id_uri;
+    metadata.value = emsg->value;
+    metadata.id = emsg->id;
+    if(emsg->box.version == 1) {
+        metadata.presentation_time = _bmff_rescale(emsg->presentation_time, emsg->timescale, extractor->timescale);
+    }else{
+        metadata.presentation_time = _bmff_segment_time(extractor, lookahead, ptr + size, end) +
+                                     _bmff_rescale(emsg->presentation_time_delta, emsg->timescale, extractor->timescale);
+    }
+    metadata.duration = emsg->event_duration == 0xFFFFFFFF ? BMFF_METADATA_UNKNOWN_DURATION :
+                        _bmff_rescale(emsg->event_duration, emsg->timescale, extractor->timescale);
+    metadata.data = emsg->message_data;
+    metadata.data_size = emsg->message_data_size;
+    metadata.box = box;
+    _bmff_deliver(extractor, &metadata, ptr);
+}
+
+static void _bmff_extract_meta(BMFFMetadataExtractor *extractor,
+                               Lookahead *lookahead,
+                               const uint8_t *ptr,
+                               uint64_t size,
+                               const uint8_t *end)
+{
+    BMFFContext *ctx = extractor->ctx;
+    const uint8_t *meta_end = ptr + size;
+    // meta is a full box.
+    const uint8_t *child = ptr + 12;
+    while(child < meta_end) {
+        uint64_t child_size = _bmff_box_size(child, meta_end);
+        if(child_size == 0) {
+            break;
+        }
+        if(BOX_TYPE_IS(child + 4, "ID32")) {
+            Box *box = NULL;
+            BMFFCode res = _bmff_parse_box_id3v2_metadata(ctx, child, child_size, &box);
+            if(res != BMFF_OK) {
+                _bmff_record_diagnostic(ctx, res, child + 4);
+            }else{
+                const ID3v2MetadataBox *id32 = (const ID3v2MetadataBox*)box;
+                BMFFTimedMetadata metadata;
+                memset(&metadata, 0, sizeof(BMFFTimedMetadata));
+                memcpy(metadata.type, "ID32", 4);
+                metadata.presentation_time = _bmff_segment_time(extractor, lookahead, meta_end, end);
+                metadata.duration = BMFF_METADATA_UNKNOWN_DURATION;
+                metadata.data = id32->data;
+                metadata.data_size = id32->data_size;
+                metadata.box = box;
+                _bmff_deliver(extractor, &metadata, child);
+            }
+        }
+        child += child_size;
+    }
+}
+
+BMFFCode bmff_metadata_extractor_init(BMFFMetadataExtractor *extractor,
+                                      BMFFContext *ctx,
+                                      uint32_t track_id,
+                                      uint32_t timescale,
+                                      bmff_on_timed_metadata callback,
+                                      void *user_data)
+{
+    if(!extractor)      return BMFF_INVALID_PARAMETER;
+    if(!ctx)            return BMFF_INVALID_CONTEXT;
+    if(timescale == 0)  return BMFF_INVALID_PARAMETER;
+
+    memset(extractor, 0, sizeof(BMFFMetadataExtractor));
+    extractor->ctx = ctx;
+    extractor->track_id = track_id;
+    extractor->timescale = timescale;
+    extractor->callback = callback;
+    extractor->callback_user_data = user_data;
+    return BMFF_OK;
+}
+
+size_t bmff_metadata_extract(BMFFMetadataExtractor *extractor,
+                             const uint8_t *data,
+                             size_t size,
+                             BMFFCode *code)
+{
+    if(!code)                           return 0;
+    if(!extractor || !extractor->ctx)   { *code = BMFF_INVALID_CONTEXT; return 0; }
+    if(!data)                           { *code = BMFF_INVALID_DATA; return 0; }
+    if(size < 8)                        { *code = BMFF_INVALID_SIZE; return 0; }
+
+    BMFFContext *ctx = extractor->ctx;
+    const uint8_t *ptr = data;
+    const uint8_t *end = data + size;
+    Lookahead lookahead;
+    memset(&lookahead, 0, sizeof(Lookahead));
+    ctx->parse_data = data;
+    *code = BMFF_OK;
+
+    while(ptr + 8 <= end) {
+        uint64_t box_size;
+        uint32_t raw_size = parse_u32(ptr);
+        if(raw_size == 0) {
+            if(ctx->end_of_stream != eBooleanTrue) {
+                break;
+            }
+            box_size = end - ptr;
+        }else if(raw_size == 1 && ptr + 16 > end) {
+            break;
+        }else{
+            box_size = parse_box_size(ptr, end - ptr);
+            if(box_size == 0) {
+                _bmff_record_diagnostic(ctx, BMFF_INVALID_SIZE, ptr + 4);
+                *code = BMFF_INVALID_SIZE;
+                break;
+            }
+        }
+        if(box_size > (uint64_t)(end - ptr)) {
+            break;
+        }
+
+        const uint8_t *type = ptr + 4;
+        if(BOX_TYPE_IS(type, "moof")) {
+            uint64_t time = 0;
+            if(_bmff_fragment_time(extractor, ptr, box_size, &time) == eBooleanTrue) {
+                extractor->fragment_time = time;
+            }
+        }else if(BOX_TYPE_IS(type, "emsg") || BOX_TYPE_IS(type, "meta")) {
+            if(bmff_context_alloc_stack_push(ctx) != BMFF_OK) {
+                _bmff_record_diagnostic(ctx, BMFF_RESOURCE_LIMIT, type);
+            }else{
+                if(BOX_TYPE_IS(type, "emsg")) {
+                    _bmff_extract_event_message(extractor, &lookahead, ptr, box_size, end);
+                }else{
+                    _bmff_extract_meta(extractor, &lookahead, ptr, box_size, end);
+                }
+                bmff_context_alloc_stack_pop(ctx);
+            }
+        }
+        ptr += box_size;
+    }
+
+    ctx->parse_offset += ptr - data;
+    ctx->parse_data = NULL;
+    return ptr - data;
+}
@@ -0,0 +1,125 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Joel Freeman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef TIMED_METADATA_H
+#define TIMED_METADATA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "bmff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// number of recent emsg events remembered to drop repeats.
+#define BMFF_METADATA_DEDUP_SIZE                (256)
+// duration of events that last until further notice.
+#define BMFF_METADATA_UNKNOWN_DURATION          (UINT64_MAX)
+
+/**
+ * Event taken from an emsg or ID32 box.
+ * Times are in the timescale of the track the extractor maps to.
+ */
+typedef struct BMFFTimedMetadata {
+    // "emsg" or "ID32".
+    uint8_t         type[4];
+    const char      *scheme_id_uri;
+    const char      *value;
+    uint32_t        id;
+    uint64_t        presentation_time;
+    uint64_t        duration;
+    const uint8_t   *data;
+    uint32_t        data_size;
+    // offset of the box in the stream.
+    uint64_t        offset;
+    // the parsed EventMessageBox or ID3v2MetadataBox.
+    const Box       *box;
+} BMFFTimedMetadata;
+
+// forward declaration
+typedef struct BMFFMetadataExtractor BMFFMetadataExtractor;
+
+/**
+ * Timed Metadata Callback.
+ * The event and the data it points to are valid for the duration of the call only.
+ */
+typedef void (*bmff_on_timed_metadata) (BMFFMetadataExtractor *extractor,
+                                        const BMFFTimedMetadata *metadata,
+                                        void *user_data);
+
+/**
+ * Timed metadata extractor state.
+ */
+typedef struct BMFFMetadataExtractor {
+    BMFFContext             *ctx;
+    bmff_on_timed_metadata  callback;
+    void                    *callback_user_data;
+    // track whose tfdt and timescale events are mapped to, 0 uses the first track fragment.
+    uint32_t                track_id;
+    uint32_t                timescale;
+    // tfdt of the last movie fragment.
+    uint64_t                fragment_time;
+    // hashes of recent events, the oldest is replaced first.
+    uint64_t                seen[BMFF_METADATA_DEDUP_SIZE];
+    uint32_t                seen_count;
+    uint32_t                seen_next;
+    uint64_t                delivered;
+    uint64_t                duplicates;
+} BMFFMetadataExtractor;
+
+/**
+ * Sets up an extractor that maps events to the given track.
+ * The timescale is the one of the mdhd of the track in the init segment.
+ */
+BMFFCode bmff_metadata_extractor_init(BMFFMetadataExtractor *extractor,
+                                      BMFFContext *ctx,
+                                      uint32_t track_id,
+                                      uint32_t timescale,
+                                      bmff_on_timed_metadata callback,
+                                      void *user_data);
+
+/**
+ * Extracts the timed metadata of complete top level boxes.
+ *
+ * Only emsg, ID32 in meta boxes, and the tfhd and tfdt of movie fragments are
+ * parsed, every other box is skipped by its size. Version 1 emsg boxes carry
+ * an absolute time. Version 0 emsg and ID32 boxes are placed relative to the
+ * tfdt of the next movie fragment in the data, or of the last one seen when
+ * none follows. emsg events that repeat the scheme, value and id of a recent
+ * event are dropped.
+ *
+ * @return the number of bytes consumed, like bmff_parse.
+ */
+size_t bmff_metadata_extract(BMFFMetadataExtractor *extractor,
+                             const uint8_t *data,
+                             size_t size,
+                             BMFFCode *code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIMED_METADATA_H
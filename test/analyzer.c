@@ -0,0 +1,236 @@
+#include "test.h"
+#include <bmff.h>
+#include <analyzer.h>
+#include <snapshot.h>
+#include <string.h>
+
+void test_analyzer(void);
+void test_size_percentile(void);
+void test_analyzer_snapshot(void);
+
+int main(int argc, char** argv)
+{
+    test_analyzer();
+    test_size_percentile();
+    test_analyzer_snapshot();
+    return 0;
+}
+
+// init segment with a progressive video track of 6 samples that is continued in fragments.
+uint8_t analyzer_moov[] = {
+    0x00, 0x00, 0x01, 0x51, 0x6D, 0x6F, 0x6F, 0x76, // moov
+    0x00, 0x00, 0x01, 0x21, 0x74, 0x72, 0x61, 0x6B, // trak
+    // tkhd
+    0x00, 0x00, 0x00, 0x5C, 0x74, 0x6B, 0x68, 0x64,
+    0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x72,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0xBD, 0x6D, 0x64, 0x69, 0x61, // mdia
+    // mdhd
+    0x00, 0x00, 0x00, 0x20, 0x6D, 0x64, 0x68, 0x64,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xE8,
+    0x00, 0x00, 0x01, 0x72, 0x55, 0xC4, 0x00, 0x00,
+    // hdlr
+    0x00, 0x00, 0x00, 0x21, 0x68, 0x64, 0x6C, 0x72,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x76, 0x69, 0x64, 0x65, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00,
+    0x00, 0x00, 0x00, 0x74, 0x6D, 0x69, 0x6E, 0x66, // minf
+    0x00, 0x00, 0x00, 0x6C, 0x73, 0x74, 0x62, 0x6C, // stbl
+    // stts
+    0x00, 0x00, 0x00, 0x20, 0x73, 0x74, 0x74, 0x73,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x28,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x32,
+    // stss
+    0x00, 0x00, 0x00, 0x18, 0x73, 0x74, 0x73, 0x73,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x04,
+    // stsz
+    0x00, 0x00, 0x00, 0x2C, 0x73, 0x74, 0x73, 0x7A,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x03, 0xE8,
+    0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0x64,
+    0x00, 0x00, 0x07, 0xD0, 0x00, 0x00, 0x00, 0xC8,
+    0x00, 0x00, 0x01, 0x2C,
+    0x00, 0x00, 0x00, 0x28, 0x6D, 0x76, 0x65, 0x78, // mvex
+    // trex
+    0x00, 0x00, 0x00, 0x20, 0x74, 0x72, 0x65, 0x78,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x28,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+};
+
+// moof with 3 more samples of track 1, only the first one is a sync sample.
+uint8_t analyzer_moof[] = {
+    0x00, 0x00, 0x00, 0x64, 0x6D, 0x6F, 0x6F, 0x66, // moof
+    // mfhd
+    0x00, 0x00, 0x00, 0x10, 0x6D, 0x66, 0x68, 0x64,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x4C, 0x74, 0x72, 0x61, 0x66, // traf
+    // tfhd
+    0x00, 0x00, 0x00, 0x10, 0x74, 0x66, 0x68, 0x64,
+    0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    // tfdt
+    0x00, 0x00, 0x00, 0x14, 0x74, 0x66, 0x64, 0x74,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0xF0,
+    // trun
+    0x00, 0x00, 0x00, 0x20, 0x74, 0x72, 0x75, 0x6E,
+    0x00, 0x00, 0x02, 0x04, 0x00, 0x00, 0x00, 0x03,
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xF4,
+    0x00, 0x00, 0x00, 0x32, 0x00, 0x00, 0x00, 0x32,
+};
+
+typedef struct AnalyzerResults {
+    uint32_t events;
+} AnalyzerResults;
+
+void analyzer_callback_func(BMFFContext *ctx, BMFFEventId event_id, const uint8_t *fourCC, void *data, void *user_data)
+{
+    AnalyzerResults *results = (AnalyzerResults*)user_data;
+    results->events++;
+}
+
+void test_analyzer(void)
+{
+    test_start("test_analyzer");
+
+    BMFFContext ctx;
+    BMFFAnalyzer analyzer;
+    AnalyzerResults results;
+    BMFFCode res;
+
+    memset(&results, 0, sizeof(AnalyzerResults));
+    bmff_context_init(&ctx);
+    bmff_set_event_callback(&ctx, analyzer_callback_func, &results);
+
+    res = bmff_analyzer_init(NULL, &ctx, 0);
+    test_assert_equal(res, BMFF_INVALID_PARAMETER, "invalid analyzer");
+    res = bmff_analyzer_init(&analyzer, NULL, 0);
+    test_assert_equal(res, BMFF_INVALID_CONTEXT, "invalid context");
+
+    // 10ms slots, 160ms window.
+    res = bmff_analyzer_init(&analyzer, &ctx, 160);
+    test_assert_equal(res, BMFF_OK, "success");
+
+    bmff_parse(&ctx, analyzer_moov, sizeof(analyzer_moov), &res);
+    test_assert_equal(res, BMFF_OK, "init segment parsed");
+    bmff_parse(&ctx, analyzer_moof, sizeof(analyzer_moof), &res);
+    test_assert_equal(res, BMFF_OK, "fragment parsed");
+    test_assert(results.events > 0, "events forwarded");
+
+    test_assert(bmff_analyzer_get_track(&analyzer, 2) == NULL, "unknown track");
+    const BMFFTrackStats *stats = bmff_analyzer_get_track(&analyzer, 1);
+    test_assert(stats != NULL, "track found");
+    test_assert(memcmp(stats->handler_type, "vide", 4) == 0, "handler type");
+    test_assert_equal(stats->timescale, 1000, "timescale");
+    test_assert_equal(stats->sample_count, 9, "sample count");
+    test_assert_equal(stats->total_size, 4300, "total size");
+    test_assert_equal(stats->total_duration, 370, "total duration");
+
+    test_assert_equal(stats->average_bitrate, 92972, "average bitrate");
+    // the first 4 samples fall in one window.
+    test_assert_equal(stats->peak_bitrate, 160000, "peak bitrate");
+
+    test_assert_equal(stats->duration_min, 40, "min duration");
+    test_assert_equal(stats->duration_max, 50, "max duration");
+    test_assert_equal(stats->duration_changes, 2, "duration changes");
+    test_assert(stats->duration_mean > 41.1 && stats->duration_mean < 41.2, "mean duration");
+    test_assert(stats->duration_variance > 0, "irregular durations");
+
+    // the last GOP is still open.
+    test_assert_equal(stats->sync_count, 3, "sync samples");
+    test_assert_equal(stats->gop_count, 2, "closed GOPs");
+    res = bmff_analyzer_flush(&analyzer);
+    test_assert_equal(res, BMFF_OK, "flushed");
+    test_assert_equal(stats->gop_count, 3, "all GOPs");
+    test_assert_equal(stats->gop_min, 3, "min GOP");
+    test_assert_equal(stats->gop_max, 3, "max GOP");
+    test_assert_equal(stats->gop_buckets[3], 3, "GOP histogram");
+
+    test_assert_equal(stats->sizes.count, 9, "size histogram");
+    test_assert_equal(stats->sizes.min, 50, "min size");
+    test_assert_equal(stats->sizes.max, 2000, "max size");
+    // buckets are 1/8th of a power of two wide.
+    test_assert_equal(bmff_size_percentile(&stats->sizes, 0), 51, "p0 size");
+    test_assert_equal(bmff_size_percentile(&stats->sizes, 50), 207, "p50 size");
+    test_assert_equal(bmff_size_percentile(&stats->sizes, 100), 2000, "p100 size");
+
+    res = bmff_analyzer_destroy(&analyzer);
+    test_assert_equal(res, BMFF_OK, "destroyed");
+    test_assert(ctx.callback == analyzer_callback_func, "callback restored");
+
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+void test_size_percentile(void)
+{
+    test_start("test_size_percentile");
+
+    BMFFSizeHistogram histogram;
+    memset(&histogram, 0, sizeof(BMFFSizeHistogram));
+    test_assert_equal(bmff_size_percentile(&histogram, 50), 0, "empty histogram");
+
+    // sizes below the sub bucket count have a bucket each.
+    histogram.buckets[3] = 1;
+    histogram.buckets[5] = 3;
+    histogram.count = 4;
+    histogram.min = 3;
+    histogram.max = 5;
+
+    test_assert_equal(bmff_size_percentile(&histogram, 25), 3, "p25");
+    test_assert_equal(bmff_size_percentile(&histogram, 50), 5, "p50");
+    test_assert_equal(bmff_size_percentile(&histogram, 200), 5, "clamped percentile");
+
+    test_end();
+}
+
+void test_analyzer_snapshot(void)
+{
+    test_start("test_analyzer_snapshot");
+
+    BMFFContext ctx;
+    BMFFInitSnapshot snapshot;
+    BMFFAnalyzer analyzer;
+    BMFFCode res;
+
+    bmff_context_init(&ctx);
+    res = bmff_init_snapshot_capture(&ctx, analyzer_moov, sizeof(analyzer_moov), &snapshot);
+    test_assert_equal(res, BMFF_OK, "captured");
+    bmff_context_destroy(&ctx);
+
+    // only the fragment is parsed, the track and its trex defaults come from the snapshot.
+    bmff_context_init(&ctx);
+    bmff_context_attach_snapshot(&ctx, &snapshot);
+    res = bmff_analyzer_init(&analyzer, &ctx, 160);
+    test_assert_equal(res, BMFF_OK, "success");
+    bmff_parse(&ctx, analyzer_moof, sizeof(analyzer_moof), &res);
+    test_assert_equal(res, BMFF_OK, "fragment parsed");
+
+    const BMFFTrackStats *stats = bmff_analyzer_get_track(&analyzer, 1);
+    test_assert(stats != NULL, "track found");
+    test_assert(memcmp(stats->handler_type, "vide", 4) == 0, "handler type");
+    test_assert_equal(stats->timescale, 1000, "timescale");
+    test_assert_equal(stats->sample_count, 3, "sample count");
+    test_assert_equal(stats->total_duration, 120, "trex sample duration");
+    test_assert_equal(stats->sync_count, 1, "trex sample flags");
+    test_assert(stats->average_bitrate > 0, "average bitrate");
+
+    bmff_analyzer_destroy(&analyzer);
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
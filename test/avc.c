@@ -0,0 +1,163 @@
+#include "test.h"
+#include <bmff.h>
+#include <avc.h>
+#include <string.h>
+
+void test_avc_config_decode(void);
+void test_avc_index_nal_units(void);
+void test_avc_to_annexb(void);
+
+int main(int argc, char** argv)
+{
+    test_avc_config_decode();
+    test_avc_index_nal_units();
+    test_avc_to_annexb();
+    return 0;
+}
+
+// high profile record with 4 byte lengths, one SPS and one PPS.
+uint8_t avc_config_record[] = {
+    0x01, 0x64, 0x00, 0x1F, // version, profile, compatibility, level
+    0xFF,                   // length size minus one
+    0xE1,                   // SPS count
+    0x00, 0x04, 0x67, 0x64, 0x00, 0x1F,
+    0x01,                   // PPS count
+    0x00, 0x03, 0x68, 0xEE, 0x3C,
+    0xFD, 0xF8, 0xF8, 0x00, // chroma format, bit depths, SPS extension count
+};
+
+// access unit delimiter and an IDR slice.
+uint8_t avc_sync_sample[] = {
+    0x00, 0x00, 0x00, 0x02, 0x09, 0x10,
+    0x00, 0x00, 0x00, 0x05, 0x65, 0x88, 0x84, 0x00, 0x33,
+};
+
+uint8_t avc_sync_annexb[] = {
+    0x00, 0x00, 0x00, 0x01, 0x09, 0x10,
+    0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x1F,
+    0x00, 0x00, 0x00, 0x01, 0x68, 0xEE, 0x3C,
+    0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00, 0x33,
+};
+
+void init_avcc(AVCDecoderConfigBox *avcc)
+{
+    memset(avcc, 0, sizeof(AVCDecoderConfigBox));
+    avcc->config_record = avc_config_record;
+    avcc->config_record_size = sizeof(avc_config_record);
+}
+
+void test_avc_config_decode(void)
+{
+    test_start("test_avc_config_decode");
+
+    AVCDecoderConfigBox avcc;
+    BMFFAvcConfig config;
+    BMFFCode res;
+
+    init_avcc(&avcc);
+    res = bmff_avc_config_decode(NULL, &config);
+    test_assert_equal(res, BMFF_INVALID_PARAMETER, "invalid box");
+
+    res = bmff_avc_config_decode(&avcc, &config);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert_equal(config.configuration_version, 1, "version");
+    test_assert_equal(config.profile_indication, 100, "profile");
+    test_assert_equal(config.level_indication, 31, "level");
+    test_assert_equal(config.nal_length_size, 4, "nal length size");
+    test_assert_equal(config.sps_count, 1, "sps count");
+    test_assert(config.sps[0].data == avc_config_record + 8, "sps data");
+    test_assert_equal(config.sps[0].size, 4, "sps size");
+    test_assert_equal(config.pps_count, 1, "pps count");
+    test_assert(config.pps[0].data == avc_config_record + 15, "pps data");
+    test_assert_equal(config.pps[0].size, 3, "pps size");
+    test_assert_equal(config.has_format_extension, eBooleanTrue, "format extension");
+    test_assert_equal(config.chroma_format, 1, "chroma format");
+    test_assert_equal(config.bit_depth_luma_minus8, 0, "luma bit depth");
+
+    // the PPS runs past the end of the record.
+    avcc.config_record_size = 16;
+    res = bmff_avc_config_decode(&avcc, &config);
+    test_assert_equal(res, BMFF_INVALID_SIZE, "truncated record");
+
+    test_end();
+}
+
+void test_avc_index_nal_units(void)
+{
+    test_start("test_avc_index_nal_units");
+
+    BMFFNalUnit units[2];
+    uint32_t count = 0;
+    BMFFCode res;
+
+    res = bmff_avc_index_nal_units(avc_sync_sample, sizeof(avc_sync_sample), 3, units, 2, &count);
+    test_assert_equal(res, BMFF_INVALID_PARAMETER, "invalid length size");
+
+    res = bmff_avc_index_nal_units(avc_sync_sample, sizeof(avc_sync_sample), 4, units, 2, &count);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert_equal(count, 2, "count");
+    test_assert_equal(units[0].offset, 4, "aud offset");
+    test_assert_equal(units[0].size, 2, "aud size");
+    test_assert_equal(units[0].type, BMFF_AVC_NAL_AUD, "aud type");
+    test_assert_equal(units[1].offset, 10, "idr offset");
+    test_assert_equal(units[1].size, 5, "idr size");
+    test_assert_equal(units[1].type, BMFF_AVC_NAL_IDR, "idr type");
+
+    res = bmff_avc_index_nal_units(avc_sync_sample, sizeof(avc_sync_sample), 4, units, 1, &count);
+    test_assert_equal(res, BMFF_RESOURCE_LIMIT, "too many nal units");
+    test_assert_equal(count, 2, "all nal units counted");
+
+    res = bmff_avc_index_nal_units(avc_sync_sample, sizeof(avc_sync_sample) - 1, 4, units, 2, &count);
+    test_assert_equal(res, BMFF_INVALID_DATA, "truncated nal unit");
+
+    test_end();
+}
+
+void test_avc_to_annexb(void)
+{
+    test_start("test_avc_to_annexb");
+
+    AVCDecoderConfigBox avcc;
+    BMFFAvcConfig config;
+    uint8_t out[64];
+    size_t written = 0;
+    BMFFCode res;
+
+    init_avcc(&avcc);
+    bmff_avc_config_decode(&avcc, &config);
+
+    // parameter sets go after the access unit delimiter.
+    res = bmff_avc_to_annexb(&config, avc_sync_sample, sizeof(avc_sync_sample), eBooleanTrue, NULL, 0, &written);
+    test_assert_equal(res, BMFF_RESOURCE_LIMIT, "size query");
+    test_assert_equal(written, sizeof(avc_sync_annexb), "annex b size");
+    res = bmff_avc_to_annexb(&config, avc_sync_sample, sizeof(avc_sync_sample), eBooleanTrue, out, sizeof(out), &written);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert(memcmp(out, avc_sync_annexb, sizeof(avc_sync_annexb)) == 0, "sync sample");
+
+    // non sync samples are converted as they are.
+    res = bmff_avc_to_annexb(&config, avc_sync_sample, sizeof(avc_sync_sample), eBooleanFalse, out, sizeof(out), &written);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert_equal(written, 15, "no parameter sets");
+    test_assert(memcmp(out + 6, avc_sync_annexb + 21, 9) == 0, "slice copied");
+
+    // 2 byte lengths.
+    uint8_t short_sample[] = { 0x00, 0x03, 0x41, 0x9A, 0x02 };
+    config.nal_length_size = 2;
+    res = bmff_avc_to_annexb(&config, short_sample, sizeof(short_sample), eBooleanFalse, out, sizeof(out), &written);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert_equal(written, 7, "2 byte lengths");
+    test_assert(out[3] == 0x01 && out[4] == 0x41 && out[6] == 0x02, "2 byte lengths converted");
+
+    uint8_t sample[sizeof(avc_sync_sample)];
+    memcpy(sample, avc_sync_sample, sizeof(sample));
+    res = bmff_avc_to_annexb_in_place(2, sample, sizeof(sample));
+    test_assert_equal(res, BMFF_INVALID_PARAMETER, "in place needs 4 byte lengths");
+    res = bmff_avc_to_annexb_in_place(4, sample, sizeof(sample) - 1);
+    test_assert_equal(res, BMFF_INVALID_DATA, "truncated sample");
+    test_assert(memcmp(sample, avc_sync_sample, sizeof(sample)) == 0, "truncated sample untouched");
+    res = bmff_avc_to_annexb_in_place(4, sample, sizeof(sample));
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert(sample[3] == 0x01 && sample[9] == 0x01 && sample[10] == 0x65, "converted in place");
+
+    test_end();
+}
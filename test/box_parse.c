@@ -32,6 +32,8 @@ void test_parse_box_movie_extends_header(void);
 void test_parse_box_track_extends(void);
 void test_parse_box_track_fragment_header(void);
 void test_parse_box_track_run(void);
+void test_parse_box_track_run_memory_limit(void);
+void test_parse_box_track_run_invalid_count(void);
 void test_parse_box_sample_dependency_type(void);
 void test_parse_box_sample_to_group(void);
 void test_parse_box_sub_sample_information(void);
@@ -55,6 +57,7 @@ void test_parse_box_time_to_sample(void);
 void test_parse_box_composition_offset(void);
 void test_parse_box_sample_to_chunk(void);
 void test_parse_box_sample_size(void);
+void test_parse_box_sample_size_invalid_count(void);
 void test_parse_box_compact_sample_size_4(void);
 void test_parse_box_compact_sample_size_8(void);
 void test_parse_box_compact_sample_size_16(void);
@@ -106,6 +109,7 @@ void test_parse_box_protection_system_specific_header(void);
 void test_parse_box_track_encryption(void);
 void test_parse_box_id3_metadata(void);
 void test_parse_box_event_message(void);
+void test_parse_box_event_message_v1(void);
 
 //void test_parse_box_(void);
 
@@ -139,6 +143,8 @@ int main(int argc, char** argv)
     test_parse_box_track_extends();
     test_parse_box_track_fragment_header();
     test_parse_box_track_run();
+    test_parse_box_track_run_memory_limit();
+    test_parse_box_track_run_invalid_count();
     test_parse_box_sample_dependency_type();
     test_parse_box_sample_to_group();
     test_parse_box_sub_sample_information();
@@ -162,6 +168,7 @@ int main(int argc, char** argv)
     test_parse_box_composition_offset();
     test_parse_box_sample_to_chunk();
     test_parse_box_sample_size();
+    test_parse_box_sample_size_invalid_count();
     test_parse_box_compact_sample_size_4();
     test_parse_box_compact_sample_size_8();
     test_parse_box_compact_sample_size_16();
@@ -213,6 +220,7 @@ int main(int argc, char** argv)
     test_parse_box_track_encryption();
     test_parse_box_id3_metadata();
     test_parse_box_event_message();
+    test_parse_box_event_message_v1();
     //test_parse_box_();
     return 0;
 }
@@ -1958,6 +1966,72 @@ void test_parse_box_track_run(void)
     test_end();
 }
 
+void test_parse_box_track_run_memory_limit(void)
+{
+    test_start("test_parse_box_track_run_memory_limit");
+
+    BMFFContext ctx;
+    bmff_context_init(&ctx);
+    bmff_set_memory_limit(&ctx, sizeof(TrackRunBox) + sizeof(TrackRunSample));
+
+    uint8_t data[] = {
+        0, 0, 0, 0x18,
+        't', 'r', 'u', 'n',
+        0x00, // version
+        0x00, 0x01, 0x00, // flags
+        0x00, 0x00, 0x00, 0x02, // sample count
+        // sample 0
+        0x01, 0x02, 0x03, 0x04, // duration
+        // sample 1
+        0x11, 0x12, 0x13, 0x14, // duration
+    };
+
+    BMFFCode res;
+    TrackRunBox *box = NULL;
+    res = _bmff_parse_box_track_run(&ctx, data, sizeof(data), (Box**)&box);
+    test_assert_equal(BMFF_RESOURCE_LIMIT, res, "resource limit");
+    test_assert(box == NULL, "box not returned");
+    test_assert(ctx.memory_used <= ctx.memory_limit, "memory used within limit");
+
+    bmff_set_memory_limit(&ctx, 0);
+    res = _bmff_parse_box_track_run(&ctx, data, sizeof(data), (Box**)&box);
+    test_assert_equal(BMFF_OK, res, "success without limit");
+    test_assert_equal(box->sample_count, 2, "sample count");
+
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+void test_parse_box_track_run_invalid_count(void)
+{
+    test_start("test_parse_box_track_run_invalid_count");
+
+    BMFFContext ctx;
+    bmff_context_init(&ctx);
+
+    // no per sample fields, the samples take no bytes.
+    uint8_t data[] = {
+        0, 0, 0, 0x14,
+        't', 'r', 'u', 'n',
+        0x00, // version
+        0x00, 0x00, 0x01, // flags
+        0xFF, 0xFF, 0xFF, 0xFF, // sample count
+        0x12, 0x34, 0x56, 0x78, // data offset
+    };
+
+    BMFFCode res;
+    TrackRunBox *box = NULL;
+    res = _bmff_parse_box_track_run(&ctx, data, sizeof(data), (Box**)&box);
+    test_assert_equal(BMFF_RESOURCE_LIMIT, res, "resource limit");
+    test_assert(box == NULL, "box not returned");
+    test_assert(ctx.memory_used < 1024, "table not allocated");
+
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
 void test_parse_box_sample_dependency_type(void)
 {
     test_start("test_parse_box_sample_dependency_type");
@@ -3298,6 +3372,35 @@ void test_parse_box_sample_size(void)
     test_end();
 }
 
+void test_parse_box_sample_size_invalid_count(void)
+{
+    test_start("test_parse_box_sample_size_invalid_count");
+
+    BMFFContext ctx;
+    bmff_context_init(&ctx);
+
+    uint8_t data[] = {
+        0, 0, 0, 0x18,
+        's', 't', 's', 'z',
+        0x00, // version
+        0x00, 0x00, 0x00, // flags
+        0x00, 0x00, 0x00, 0x00, // sample size
+        0xFF, 0xFF, 0xFF, 0xFF, // sampe count
+        0x00, 0x00, 0x00, 0x10, // entry 0
+    };
+
+    BMFFCode res;
+    SampleSizeBox *box = NULL;
+    res = _bmff_parse_box_sample_size(&ctx, data, sizeof(data), (Box**)&box);
+    test_assert_equal(BMFF_RESOURCE_LIMIT, res, "resource limit");
+    test_assert(box == NULL, "box not returned");
+    test_assert(ctx.memory_used < 1024, "table not allocated");
+
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
 void test_parse_box_compact_sample_size_4(void)
 {
     test_start("test_parse_box_compact_sample_size_4");
@@ -5528,6 +5631,48 @@ void test_parse_box_event_message(void)
     test_end();
 }
 
+void test_parse_box_event_message_v1(void)
+{
+    test_start("test_parse_box_event_message_v1");
+
+    BMFFContext ctx;
+    bmff_context_init(&ctx);
+
+    uint8_t data[] = {
+        0, 0, 0, 0x2C,
+        'e', 'm', 's', 'g',
+        0x01, // version
+        0x00, 0x00, 0x00, // flags
+        0x00, 0x00, 0x03, 0xE8, // timescale
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // presentation time
+        0x09, 0x0A, 0x0B, 0x0C, // event duration
+        0x0D, 0x0E, 0x0F, 0x10, // id
+        's','c','h','e','m','e',0x00,
+        'v',0x00,
+        0x99, 0x88, 0x77, // message data
+    };
+
+    BMFFCode res;
+    EventMessageBox *box = NULL;
+    res = _bmff_parse_box_event_message(&ctx, data, sizeof(data), (Box**)&box);
+    test_assert_equal(BMFF_OK, res, "success");
+    test_assert(box != NULL, "NULL box reference");
+    test_assert_equal(box->box.version, 0x01, "version");
+    test_assert_equal(box->timescale, 1000, "timescale");
+    test_assert_equal_uint64(box->presentation_time, 0x0102030405060708ULL, "presentation time");
+    test_assert_equal(box->presentation_time_delta, 0, "no presentation time delta");
+    test_assert_equal(box->event_duration, 0x090A0B0C, "event duration");
+    test_assert_equal(box->id, 0x0D0E0F10, "id");
+    test_assert_equal(strcmp(box->scheme_id_uri, "scheme"), 0, "scheme id uri");
+    test_assert_equal(strcmp(box->value, "v"), 0, "value");
+    test_assert(box->message_data == data + 41, "message data");
+    test_assert_equal(box->message_data_size, 3, "message data size");
+
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
 /*
 void test_parse_box_(void)
 {
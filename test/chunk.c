@@ -0,0 +1,305 @@
+#include "test.h"
+#include <bmff.h>
+#include <chunk.h>
+#include <snapshot.h>
+#include <memo.h>
+#include <string.h>
+
+void test_chunk_ingest(void);
+void test_chunk_latency_percentile(void);
+void test_chunk_ingest_budget(void);
+void test_chunk_ingest_snapshot(void);
+void test_chunk_ingest_memo(void);
+
+int main(int argc, char** argv)
+{
+    test_chunk_ingest();
+    test_chunk_latency_percentile();
+    test_chunk_ingest_budget();
+    test_chunk_ingest_snapshot();
+    test_chunk_ingest_memo();
+    return 0;
+}
+
+// init segment with a single trex for track 1.
+uint8_t init_segment[] = {
+    0x00, 0x00, 0x00, 0x48, 'm', 'o', 'o', 'v',
+    0x00, 0x00, 0x00, 0x40, 'm', 'v', 'e', 'x',
+    // trex
+    0x00, 0x00, 0x00, 0x20, 't', 'r', 'e', 'x',
+    0x00, 0x00, 0x00, 0x00, // version, flags
+    0x00, 0x00, 0x00, 0x01, // track id
+    0x00, 0x00, 0x00, 0x01, // default sample description index
+    0x00, 0x00, 0x00, 0x10, // default sample duration
+    0x00, 0x00, 0x00, 0x03, // default sample size
+    0x00, 0x00, 0x00, 0x00, // default sample flags
+    // free
+    0x00, 0x00, 0x00, 0x18, 'f', 'r', 'e', 'e',
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+// moof + mdat with two samples of track 1.
+uint8_t chunk_data[] = {
+    0x00, 0x00, 0x00, 0x6C, 'm', 'o', 'o', 'f',
+    // mfhd
+    0x00, 0x00, 0x00, 0x10, 'm', 'f', 'h', 'd',
+    0x00, 0x00, 0x00, 0x00, // version, flags
+    0x00, 0x00, 0x00, 0x01, // sequence number
+    0x00, 0x00, 0x00, 0x54, 't', 'r', 'a', 'f',
+    // tfhd
+    0x00, 0x00, 0x00, 0x14, 't', 'f', 'h', 'd',
+    0x00, 0x02, 0x00, 0x08, // version, flags (default base is moof, default duration)
+    0x00, 0x00, 0x00, 0x01, // track id
+    0x00, 0x00, 0x03, 0xE8, // default sample duration
+    // tfdt
+    0x00, 0x00, 0x00, 0x14, 't', 'f', 'd', 't',
+    0x01, 0x00, 0x00, 0x00, // version, flags
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, // base media decode time
+    // trun
+    0x00, 0x00, 0x00, 0x24, 't', 'r', 'u', 'n',
+    0x00, 0x00, 0x02, 0x05, // version, flags (data offset, first sample flags, size)
+    0x00, 0x00, 0x00, 0x02, // sample count
+    0x00, 0x00, 0x00, 0x74, // data offset
+    0x02, 0x00, 0x00, 0x00, // first sample flags
+    0x00, 0x00, 0x00, 0x05, // sample 0 size
+    0x00, 0x00, 0x00, 0x07, // sample 1 size
+    0x00, 0x00, 0x00, 0x00, // padding to the end of the trun
+    // mdat
+    0x00, 0x00, 0x00, 0x14, 'm', 'd', 'a', 't',
+    0xA0, 0xA1, 0xA2, 0xA3, 0xA4,
+    0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6,
+};
+
+typedef struct ChunkResults {
+    uint32_t chunks;
+    uint32_t sequence_numbers[4];
+    uint32_t sample_counts[4];
+    BMFFChunkSample samples[4][2];
+    uint8_t first_bytes[4][2];
+    uint64_t latencies[4];
+} ChunkResults;
+
+void chunk_callback_func(BMFFChunkIngest *ingest, const BMFFChunk *chunk, void *user_data)
+{
+    ChunkResults *results = (ChunkResults*)user_data;
+    uint32_t idx = results->chunks++;
+    if(idx >= 4) {
+        return;
+    }
+    results->sequence_numbers[idx] = chunk->sequence_number;
+    results->sample_counts[idx] = chunk->sample_count;
+    results->latencies[idx] = chunk->latency;
+    uint32_t i = 0;
+    for(; i < chunk->sample_count && i < 2; ++i) {
+        results->samples[idx][i] = chunk->samples[i];
+        results->first_bytes[idx][i] = chunk->samples[i].data ? chunk->samples[i].data[0] : 0;
+    }
+}
+
+uint64_t test_clock(void *user_data)
+{
+    // each call advances the clock by 100us.
+    uint64_t *now = (uint64_t*)user_data;
+    *now += 100;
+    return *now;
+}
+
+void test_chunk_ingest(void)
+{
+    test_start("test_chunk_ingest");
+
+    BMFFContext ctx;
+    BMFFChunkIngest ingest;
+    BMFFCode res;
+    ChunkResults results;
+    uint64_t now = 0;
+    memset(&results, 0, sizeof(ChunkResults));
+
+    bmff_context_init(&ctx);
+    res = bmff_chunk_ingest_init(&ingest, &ctx, chunk_callback_func, &results);
+    test_assert_equal(res, BMFF_OK, "ingest attached");
+    bmff_chunk_ingest_set_clock(&ingest, test_clock, &now);
+
+    res = bmff_chunk_ingest_push(&ingest, init_segment, sizeof(init_segment));
+    test_assert_equal(res, BMFF_OK, "init segment");
+    test_assert_equal(ingest.track_count, 1, "trex defaults kept");
+
+    // the first chunk arrives in pieces, the second in a single push.
+    res = bmff_chunk_ingest_push(&ingest, chunk_data, 20);
+    test_assert_equal(res, BMFF_OK, "first piece");
+    res = bmff_chunk_ingest_push(&ingest, chunk_data + 20, 100);
+    test_assert_equal(res, BMFF_OK, "second piece");
+    test_assert_equal(results.chunks, 0, "not ready before the mdat is complete");
+    res = bmff_chunk_ingest_push(&ingest, chunk_data + 120, sizeof(chunk_data) - 120);
+    test_assert_equal(res, BMFF_OK, "last piece");
+    test_assert_equal(results.chunks, 1, "ready when the mdat is complete");
+
+    chunk_data[23] = 0x02; // sequence number
+    res = bmff_chunk_ingest_push(&ingest, chunk_data, sizeof(chunk_data));
+    test_assert_equal(res, BMFF_OK, "second chunk");
+    test_assert_equal(results.chunks, 2, "second chunk ready");
+
+    test_assert_equal(results.sequence_numbers[0], 1, "chunk 0 sequence number");
+    test_assert_equal(results.sequence_numbers[1], 2, "chunk 1 sequence number");
+    test_assert_equal(results.sample_counts[0], 2, "chunk 0 sample count");
+
+    BMFFChunkSample *sample = &results.samples[0][0];
+    test_assert_equal(sample->track_id, 1, "sample 0 track id");
+    test_assert_equal(sample->size, 5, "sample 0 size");
+    test_assert_equal(sample->duration, 1000, "sample 0 duration from tfhd");
+    test_assert_equal(sample->flags, 0x02000000, "sample 0 first sample flags");
+    test_assert_equal_uint64(sample->decode_time, 0x1000, "sample 0 decode time");
+    test_assert_equal(results.first_bytes[0][0], 0xA0, "sample 0 payload");
+
+    sample = &results.samples[0][1];
+    test_assert_equal(sample->size, 7, "sample 1 size");
+    test_assert_equal(sample->flags, 0, "sample 1 flags");
+    test_assert_equal_uint64(sample->decode_time, 0x1000 + 1000, "sample 1 decode time");
+    test_assert_equal(results.first_bytes[0][1], 0xB0, "sample 1 payload");
+    test_assert_equal(results.first_bytes[1][1], 0xB0, "chunk 1 sample 1 payload");
+
+    // chunk 0 spans three pushes, chunk 1 is timed within its own push.
+    test_assert_equal_uint64(results.latencies[0], 300, "chunk 0 latency");
+    test_assert_equal_uint64(results.latencies[1], 100, "chunk 1 latency");
+
+    const BMFFLatencyHistogram *latency = bmff_chunk_ingest_get_latency(&ingest);
+    test_assert_equal_uint64(latency->count, 2, "latency count");
+    test_assert_equal_uint64(latency->max, 300, "latency max");
+
+    res = bmff_chunk_ingest_destroy(&ingest);
+    test_assert_equal(res, BMFF_OK, "ingest detached");
+    test_assert(ctx.callback == NULL, "event callback restored");
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+void test_chunk_latency_percentile(void)
+{
+    test_start("test_chunk_latency_percentile");
+
+    BMFFLatencyHistogram histogram;
+    memset(&histogram, 0, sizeof(BMFFLatencyHistogram));
+    test_assert_equal_uint64(bmff_latency_percentile(&histogram, 50), 0, "empty");
+
+    // 90 latencies in [64, 128) and 10 in [1024, 2048)
+    histogram.buckets[7] = 90;
+    histogram.buckets[11] = 10;
+    histogram.count = 100;
+    histogram.max = 1500;
+    test_assert_equal_uint64(bmff_latency_percentile(&histogram, 50), 128, "p50");
+    test_assert_equal_uint64(bmff_latency_percentile(&histogram, 90), 128, "p90");
+    test_assert_equal_uint64(bmff_latency_percentile(&histogram, 99), 2048, "p99");
+
+    test_end();
+}
+
+void test_chunk_ingest_budget(void)
+{
+    test_start("test_chunk_ingest_budget");
+
+    BMFFContext ctx;
+    BMFFChunkIngest ingest;
+    BMFFCode res;
+    ChunkResults results;
+    memset(&results, 0, sizeof(ChunkResults));
+
+    bmff_context_init(&ctx);
+    bmff_set_memory_limit(&ctx, 16384);
+    res = bmff_chunk_ingest_init(&ingest, &ctx, chunk_callback_func, &results);
+    test_assert_equal(res, BMFF_OK, "ingest attached");
+
+    // an mdat announcing 1GB is buffered until it exceeds the budget.
+    uint8_t header[] = { 0x40, 0x00, 0x00, 0x00, 'm', 'd', 'a', 't' };
+    uint8_t payload[4096];
+    memset(payload, 0, sizeof(payload));
+    res = bmff_chunk_ingest_push(&ingest, header, sizeof(header));
+    test_assert_equal(res, BMFF_OK, "header");
+    uint32_t i = 0;
+    for(; i < 16 && res == BMFF_OK; ++i) {
+        res = bmff_chunk_ingest_push(&ingest, payload, sizeof(payload));
+    }
+    test_assert_equal(res, BMFF_RESOURCE_LIMIT, "buffer exceeds the budget");
+    test_assert(i > 1 && i < 16, "payload buffered within the budget");
+    test_assert(ctx.memory_used <= ctx.memory_limit, "memory within the budget");
+
+    res = bmff_chunk_ingest_destroy(&ingest);
+    test_assert_equal(res, BMFF_OK, "ingest detached");
+    test_assert_equal(ctx.memory_used, 0, "buffer uncharged");
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+void test_chunk_ingest_snapshot(void)
+{
+    test_start("test_chunk_ingest_snapshot");
+
+    BMFFContext ctx;
+    BMFFInitSnapshot snapshot;
+    BMFFChunkIngest ingest;
+    BMFFCode res;
+    ChunkResults results;
+    memset(&results, 0, sizeof(ChunkResults));
+
+    bmff_context_init(&ctx);
+    res = bmff_init_snapshot_capture(&ctx, init_segment, sizeof(init_segment), &snapshot);
+    test_assert_equal(res, BMFF_OK, "captured");
+    bmff_context_destroy(&ctx);
+
+    // the init segment is not pushed, its trex defaults come from the snapshot.
+    uint8_t data[sizeof(chunk_data)];
+    memcpy(data, chunk_data, sizeof(chunk_data));
+    data[43] = 0x00; // tfhd flags without the default sample duration
+
+    bmff_context_init(&ctx);
+    bmff_context_attach_snapshot(&ctx, &snapshot);
+    res = bmff_chunk_ingest_init(&ingest, &ctx, chunk_callback_func, &results);
+    test_assert_equal(res, BMFF_OK, "ingest attached");
+    res = bmff_chunk_ingest_push(&ingest, data, sizeof(data));
+    test_assert_equal(res, BMFF_OK, "chunk");
+    test_assert_equal(results.chunks, 1, "chunk ready");
+    test_assert_equal(ingest.track_count, 0, "no trex pushed");
+    test_assert_equal(results.samples[0][0].duration, 0x10, "sample 0 duration from the snapshot");
+    test_assert_equal_uint64(results.samples[0][1].decode_time, 0x1000 + 0x10, "sample 1 decode time");
+
+    bmff_chunk_ingest_destroy(&ingest);
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+void test_chunk_ingest_memo(void)
+{
+    test_start("test_chunk_ingest_memo");
+
+    BMFFContext ctx;
+    BMFFChunkIngest ingest;
+    BMFFCode res;
+    BMFFMemoStats stats;
+    ChunkResults results;
+    const char *types[] = { "moov" };
+
+    bmff_context_init(&ctx);
+    bmff_memo_enable(&ctx, types, 1, 64 * 1024);
+
+    // a pooled context ingests the same init segment for two streams.
+    uint32_t stream = 0;
+    for(; stream < 2; ++stream) {
+        memset(&results, 0, sizeof(ChunkResults));
+        res = bmff_chunk_ingest_init(&ingest, &ctx, chunk_callback_func, &results);
+        test_assert_equal(res, BMFF_OK, "ingest attached");
+        res = bmff_chunk_ingest_push(&ingest, init_segment, sizeof(init_segment));
+        test_assert_equal(res, BMFF_OK, "init segment");
+        test_assert_equal(ingest.track_count, 1, "trex of the moov delivered");
+        test_assert_equal(ingest.tracks[0].default_sample_size, 3, "trex defaults kept");
+        bmff_chunk_ingest_destroy(&ingest);
+    }
+
+    bmff_memo_get_stats(&ctx, &stats);
+    test_assert_equal_uint64(stats.hits, 1, "moov memoized");
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
@@ -1,13 +1,28 @@
 #include "test.h"
+#include "moov.h"
 #include <bmff.h>
+#include <memo.h>
+#include <string.h>
 
 void test_init(void);
 void test_destroy(void);
+void test_set_memory_limit(void);
+void test_diagnostics(void);
+void test_reset(void);
+void test_pool(void);
+void test_allocator(void);
+void test_out_of_memory(void);
 
 int main(int argc, char** argv)
 {
     test_init();
     test_destroy();
+    test_set_memory_limit();
+    test_diagnostics();
+    test_reset();
+    test_pool();
+    test_allocator();
+    test_out_of_memory();
     return 0;
 }
 
@@ -43,3 +58,329 @@ void test_destroy(void)
 
     test_end();
 }
+
+void test_set_memory_limit(void)
+{
+    test_start("test_set_memory_limit");
+
+    BMFFContext ctx;
+    BMFFCode res;
+
+    res = bmff_set_memory_limit(NULL, 1024);
+    test_assert_equal(res, BMFF_INVALID_CONTEXT, "invalid context");
+
+    bmff_context_init(&ctx);
+    test_assert_equal(ctx.memory_limit, 0, "no limit by default");
+
+    res = bmff_set_memory_limit(&ctx, 1024);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert_equal(ctx.memory_limit, 1024, "limit set");
+
+    // top level leaf boxes are released after their events.
+    uint8_t leaf_data[] = {
+        0x00, 0x00, 0x00, 0x14, 'f', 't', 'y', 'p', 'i', 's', 'o', 'm', 0x00, 0x00, 0x00, 0x01, 'i', 's', 'o', 'm',
+        0x00, 0x00, 0x00, 0x14, 's', 't', 'y', 'p', 'm', 's', 'd', 'h', 0x00, 0x00, 0x00, 0x00, 'm', 's', 'd', 'h',
+    };
+    uint32_t i = 0;
+    for(; i < 200; ++i) {
+        bmff_parse(&ctx, leaf_data, sizeof(leaf_data), &res);
+        if(res != BMFF_OK || ctx.memory_used != 0) {
+            break;
+        }
+    }
+    test_assert_equal(i, 200, "limit not reached by released boxes");
+    test_assert_equal(ctx.diagnostics_count, 0, "no resource errors");
+
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+void test_diagnostics(void)
+{
+    test_start("test_diagnostics");
+
+    BMFFContext ctx;
+    BMFFDiagnostic diagnostics[BMFF_DIAGNOSTICS_SIZE];
+    BMFFCode res;
+
+    // 20 track header boxes, none of which fit in the memory budget.
+    uint8_t data[20 * 12];
+    uint32_t i = 0;
+    for(; i < 20; ++i) {
+        uint8_t box[12] = {0x00, 0x00, 0x00, 0x0C, 't', 'k', 'h', 'd', 0x00, 0x00, 0x00, 0x00};
+        memcpy(&data[i * 12], box, 12);
+    }
+
+    bmff_context_init(&ctx);
+    test_assert_equal(bmff_get_diagnostics(&ctx, diagnostics, BMFF_DIAGNOSTICS_SIZE), 0, "empty");
+
+    bmff_set_memory_limit(&ctx, 1);
+    size_t parsed = bmff_parse(&ctx, data, sizeof(data), &res);
+    test_assert_equal(parsed, sizeof(data), "parsed past errors");
+    test_assert_equal(ctx.diagnostics_count, 20, "all errors counted");
+
+    uint32_t count = bmff_get_diagnostics(&ctx, diagnostics, BMFF_DIAGNOSTICS_SIZE);
+    test_assert_equal(count, BMFF_DIAGNOSTICS_SIZE, "ring is bounded");
+    test_assert_equal(diagnostics[0].offset, 4 * 12, "oldest retained error");
+    test_assert_equal(diagnostics[count-1].offset, 19 * 12, "newest error");
+    test_assert_equal(diagnostics[count-1].code, BMFF_RESOURCE_LIMIT, "error code");
+    test_assert_equal(diagnostics[count-1].depth, 0, "top level box");
+    test_assert_equal(memcmp(diagnostics[count-1].type, "tkhd", 4), 0, "box type");
+
+    count = bmff_get_diagnostics(&ctx, diagnostics, 2);
+    test_assert_equal(count, 2, "limited to max");
+    test_assert_equal(diagnostics[1].offset, 19 * 12, "newest errors returned");
+
+    res = bmff_clear_diagnostics(&ctx);
+    test_assert_equal(res, BMFF_OK, "cleared");
+    test_assert_equal(bmff_get_diagnostics(&ctx, diagnostics, BMFF_DIAGNOSTICS_SIZE), 0, "empty after clear");
+
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+static uint32_t malloc_calls = 0;
+
+void *counting_malloc(size_t size)
+{
+    malloc_calls++;
+    return malloc(size);
+}
+
+// moov container holding a few free boxes.
+uint8_t container_data[] = {
+    0x00, 0x00, 0x00, 0x2C, 'm', 'o', 'o', 'v',
+    0x00, 0x00, 0x00, 0x0C, 'f', 'r', 'e', 'e', 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x0C, 'f', 'r', 'e', 'e', 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x0C, 'f', 'r', 'e', 'e', 0x00, 0x00, 0x00, 0x00,
+};
+
+void test_reset(void)
+{
+    test_start("test_reset");
+
+    BMFFContext ctx;
+    BMFFCode res;
+
+    res = bmff_context_reset(NULL);
+    test_assert_equal(res, BMFF_INVALID_CONTEXT, "invalid context");
+
+    bmff_context_init(&ctx);
+    ctx.malloc = counting_malloc;
+    bmff_set_memory_limit(&ctx, 4096);
+
+    malloc_calls = 0;
+    bmff_parse(&ctx, container_data, sizeof(container_data), &res);
+    test_assert(malloc_calls > 0, "cold context allocates");
+
+    ctx.sample_count = 10;
+    ctx.default_iv_size = 8;
+    ctx.handler_type[0] = 'v';
+    res = bmff_context_reset(&ctx);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert_equal(ctx.sample_count, 0, "sample count cleared");
+    test_assert_equal(ctx.default_iv_size, 0, "iv size cleared");
+    test_assert_equal(ctx.handler_type[0], 0, "handler type cleared");
+    test_assert_equal(ctx.parse_offset, 0, "stream offset cleared");
+    test_assert_equal(ctx.memory_limit, 4096, "memory limit kept");
+    test_assert(ctx.spare_stack != NULL, "arena kept");
+
+    malloc_calls = 0;
+    bmff_parse(&ctx, container_data, sizeof(container_data), &res);
+    test_assert_equal(malloc_calls, 0, "warm context does not allocate");
+    test_assert_equal(ctx.memory_used, 0, "all memory released");
+
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+void test_pool(void)
+{
+    test_start("test_pool");
+
+    BMFFContextPool pool;
+    BMFFCode res;
+
+    res = bmff_context_pool_init(&pool, 0);
+    test_assert_equal(res, BMFF_INVALID_SIZE, "empty pool");
+
+    res = bmff_context_pool_init(&pool, 2);
+    test_assert_equal(res, BMFF_OK, "success");
+
+    BMFFContext *a = bmff_context_pool_acquire(&pool);
+    BMFFContext *b = bmff_context_pool_acquire(&pool);
+    test_assert(a != NULL && b != NULL && a != b, "contexts acquired");
+    test_assert(bmff_context_pool_acquire(&pool) == NULL, "pool exhausted");
+
+    bmff_parse(a, container_data, sizeof(container_data), &res);
+    res = bmff_context_pool_release(&pool, a);
+    test_assert_equal(res, BMFF_OK, "released");
+    test_assert(bmff_context_pool_acquire(&pool) == a, "context reused");
+    test_assert(a->spare_stack != NULL, "reused context is warm");
+
+    // a segment of top level leaf boxes and a container.
+    uint8_t segment_data[sizeof(container_data) + 40] = {
+        0x00, 0x00, 0x00, 0x14, 's', 't', 'y', 'p', 'm', 's', 'd', 'h', 0x00, 0x00, 0x00, 0x00, 'm', 's', 'd', 'h',
+        0x00, 0x00, 0x00, 0x14, 'm', 'd', 'a', 't', 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,
+    };
+    memcpy(segment_data + 40, container_data, sizeof(container_data));
+
+    a->malloc = counting_malloc;
+    uint32_t i = 0;
+    for(; i < 4; ++i) {
+        malloc_calls = 0;
+        bmff_parse(a, segment_data, sizeof(segment_data), &res);
+        test_assert_equal(res, BMFF_OK, "segment parsed");
+        test_assert_equal(a->memory_used, 0, "all memory released");
+        bmff_context_pool_release(&pool, a);
+        test_assert(bmff_context_pool_acquire(&pool) == a, "context reused");
+    }
+    test_assert_equal(malloc_calls, 0, "warm pooled context does not allocate");
+
+    BMFFContext other;
+    res = bmff_context_pool_release(&pool, &other);
+    test_assert_equal(res, BMFF_INVALID_CONTEXT, "foreign context");
+
+    bmff_context_pool_destroy(&pool);
+
+    test_end();
+}
+
+// per request arena, blocks are only released by the reset.
+typedef struct TestArena {
+    uint8_t     buffer[65536] __attribute__((aligned(64)));
+    size_t      used;
+    uint32_t    allocs;
+    uint32_t    resets;
+    uint32_t    misaligned;
+} TestArena;
+
+void * arena_alloc(void *state, size_t size, size_t alignment)
+{
+    TestArena *arena = (TestArena*)state;
+    size_t start = (arena->used + alignment - 1) & ~(alignment - 1);
+    if(start + size > sizeof(arena->buffer)) {
+        return NULL;
+    }
+    arena->used = start + size;
+    arena->allocs++;
+    void *mem = arena->buffer + start;
+    if((size_t)mem % alignment != 0) {
+        arena->misaligned++;
+    }
+    return mem;
+}
+
+void arena_reset(void *state)
+{
+    TestArena *arena = (TestArena*)state;
+    arena->used = 0;
+    arena->resets++;
+}
+
+void test_allocator(void)
+{
+    test_start("test_allocator");
+
+    static TestArena arena;
+    BMFFContext ctx;
+    BMFFCode res;
+    BMFFAllocator allocator;
+    memset(&allocator, 0, sizeof(BMFFAllocator));
+
+    bmff_context_init(&ctx);
+    res = bmff_set_allocator(&ctx, &allocator);
+    test_assert_equal(res, BMFF_INVALID_PARAMETER, "alloc is required");
+
+    allocator.state = &arena;
+    allocator.alloc = arena_alloc;
+    allocator.reset = arena_reset;
+    res = bmff_set_allocator(&ctx, &allocator);
+    test_assert_equal(res, BMFF_OK, "allocator set");
+
+    static const char * const types[] = {"moov"};
+    BMFFMemoStats stats;
+    bmff_memo_enable(&ctx, types, 1, 4096);
+
+    ctx.malloc = counting_malloc;
+    malloc_calls = 0;
+    bmff_parse(&ctx, container_data, sizeof(container_data), &res);
+    test_assert_equal(res, BMFF_OK, "parsed");
+    test_assert(arena.allocs > 0, "allocations from the arena");
+    test_assert_equal(malloc_calls, 0, "malloc of the context not used");
+    test_assert_equal(arena.misaligned, 0, "alignment honored");
+
+    // the end of a request drops every allocation at once.
+    res = bmff_context_reset(&ctx);
+    test_assert_equal(res, BMFF_OK, "reset");
+    test_assert_equal(arena.resets, 1, "arena reset");
+    test_assert(ctx.spare_stack == NULL, "no arena kept");
+    res = bmff_memo_get_stats(&ctx, &stats);
+    test_assert_equal(res, BMFF_OK, "memo cache still enabled");
+    test_assert_equal(stats.entries, 0, "memo cache emptied");
+
+    bmff_parse(&ctx, container_data, sizeof(container_data), &res);
+    test_assert_equal(res, BMFF_OK, "parsed after reset");
+    bmff_memo_get_stats(&ctx, &stats);
+    test_assert_equal(stats.entries, 1, "memo cache used after reset");
+
+    res = bmff_set_allocator(&ctx, NULL);
+    test_assert_equal(res, BMFF_OK, "allocator removed");
+    test_assert_equal(arena.resets, 2, "arena reset when replaced");
+    res = bmff_memo_get_stats(&ctx, &stats);
+    test_assert_equal(res, BMFF_OK, "memo cache enabled with the new allocator");
+    bmff_parse(&ctx, container_data, sizeof(container_data), &res);
+    test_assert(malloc_calls > 0, "malloc of the context used again");
+
+    bmff_context_destroy(&ctx);
+    test_assert_equal(arena.resets, 2, "arena no longer used by the context");
+
+    test_end();
+}
+
+static uint32_t malloc_fail_at = 0;
+
+// fails a single allocation, the one numbered malloc_fail_at.
+void *failing_malloc(size_t size)
+{
+    if(++malloc_calls == malloc_fail_at) {
+        return NULL;
+    }
+    return malloc(size);
+}
+
+void test_out_of_memory(void)
+{
+    test_start("test_out_of_memory");
+
+    BMFFCode res;
+    BMFFDiagnostic diagnostic;
+    uint32_t failures = 0;
+    uint32_t unexpected = 0;
+
+    // run out of memory at each allocation of a parse in turn.
+    uint32_t i = 1;
+    for(; i < 256; ++i) {
+        BMFFContext ctx;
+        bmff_context_init(&ctx);
+        ctx.malloc = failing_malloc;
+        malloc_calls = 0;
+        malloc_fail_at = i;
+
+        bmff_parse(&ctx, moov_data, sizeof(moov_data), &res);
+        if(bmff_get_diagnostics(&ctx, &diagnostic, 1) == 1) {
+            failures++;
+            unexpected += diagnostic.code != BMFF_RESOURCE_LIMIT ? 1 : 0;
+        }
+        test_assert(ctx.allocs_stack == NULL, "no layer left");
+        test_assert_equal(ctx.memory_used, 0, "all memory released");
+        bmff_context_destroy(&ctx);
+    }
+    test_assert(failures > 0, "allocations failed");
+    test_assert_equal(unexpected, 0, "failures reported as resource limits");
+
+    test_end();
+}
@@ -0,0 +1,261 @@
+#include "test.h"
+#include <bmff.h>
+#include <decrypt.h>
+#include <string.h>
+
+void test_decryptor_init(void);
+void test_decrypt_cenc(void);
+void test_decrypt_cbcs(void);
+
+int main(int argc, char** argv)
+{
+    test_decryptor_init();
+    test_decrypt_cenc();
+    test_decrypt_cbcs();
+    return 0;
+}
+
+uint8_t test_key[16] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+};
+
+uint8_t cenc_iv[8] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88 };
+
+uint8_t cenc_whole_iv[16] = {
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10,
+};
+
+uint8_t cbcs_iv[16] = {
+    0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+    0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF,
+};
+
+// samples encrypted with the test key, the cenc sample has the subsamples (5, 20) and (3, 30).
+uint8_t cenc_sample[] = {
+    0x00, 0x07, 0x0E, 0x15, 0x1C, 0x4D, 0x9C, 0x28,
+    0x56, 0x79, 0xC5, 0xB4, 0xBE, 0x12, 0xBD, 0x17,
+    0x6B, 0xE0, 0xE8, 0xE5, 0x11, 0x6E, 0x72, 0x8F,
+    0x54, 0xAF, 0xB6, 0xBD, 0x96, 0x7D, 0xA4, 0x66,
+    0x34, 0x3D, 0xD8, 0xD1, 0xEE, 0x85, 0xD7, 0xA8,
+    0x93, 0x2D, 0xB6, 0x61, 0xFF, 0xC9, 0x50, 0x07,
+    0x4C, 0xD4, 0x86, 0xA4, 0xB5, 0xEF, 0xFD, 0x80,
+    0x24, 0x99,
+};
+
+uint8_t cenc_whole_plain[] = {
+    0x01, 0x04, 0x07, 0x0A, 0x0D, 0x10, 0x13, 0x16,
+    0x19, 0x1C, 0x1F, 0x22, 0x25, 0x28, 0x2B, 0x2E,
+    0x31, 0x34, 0x37, 0x3A, 0x3D, 0x40, 0x43, 0x46,
+    0x49, 0x4C, 0x4F, 0x52, 0x55, 0x58, 0x5B, 0x5E,
+    0x61, 0x64, 0x67, 0x6A, 0x6D, 0x70, 0x73, 0x76,
+    0x79, 0x7C, 0x7F, 0x82, 0x85, 0x88, 0x8B, 0x8E,
+    0x91, 0x94, 0x97, 0x9A, 0x9D, 0xA0, 0xA3, 0xA6,
+    0xA9, 0xAC, 0xAF, 0xB2, 0xB5, 0xB8, 0xBB, 0xBE,
+    0xC1, 0xC4, 0xC7, 0xCA, 0xCD, 0xD0,
+};
+
+uint8_t cenc_whole_sample[] = {
+    0x09, 0x96, 0x0F, 0x5C, 0x08, 0xAE, 0x9C, 0x22,
+    0x86, 0x44, 0x55, 0xDB, 0xB6, 0xF7, 0x3A, 0xD6,
+    0x94, 0x1B, 0x91, 0xD0, 0x12, 0xFC, 0xC4, 0xA1,
+    0x8F, 0xB2, 0x40, 0x4C, 0x9F, 0x36, 0xD0, 0x8D,
+    0x74, 0xC2, 0x40, 0xA9, 0xC1, 0x01, 0x68, 0x28,
+    0x17, 0xBC, 0xFC, 0xE4, 0xD8, 0xE8, 0x3C, 0xF6,
+    0x8D, 0x6D, 0x4D, 0xEB, 0xEB, 0x6E, 0x28, 0x47,
+    0xFE, 0xEC, 0x29, 0xC8, 0xC9, 0x3A, 0x9E, 0xA1,
+    0x71, 0xEA, 0x5E, 0x17, 0x51, 0xAC,
+};
+
+uint8_t cbcs_plain[] = {
+    0x03, 0x08, 0x0D, 0x12, 0x17, 0x1C, 0x21, 0x26,
+    0x2B, 0x30, 0x35, 0x3A, 0x3F, 0x44, 0x49, 0x4E,
+    0x53, 0x58, 0x5D, 0x62, 0x67, 0x6C, 0x71, 0x76,
+    0x7B, 0x80, 0x85, 0x8A, 0x8F, 0x94, 0x99, 0x9E,
+    0xA3, 0xA8, 0xAD, 0xB2, 0xB7, 0xBC, 0xC1, 0xC6,
+    0xCB, 0xD0, 0xD5, 0xDA, 0xDF, 0xE4, 0xE9, 0xEE,
+    0xF3, 0xF8, 0xFD, 0x02, 0x07, 0x0C, 0x11, 0x16,
+    0x1B, 0x20, 0x25, 0x2A, 0x2F, 0x34, 0x39, 0x3E,
+    0x43, 0x48, 0x4D, 0x52, 0x57, 0x5C, 0x61, 0x66,
+    0x6B, 0x70, 0x75, 0x7A, 0x7F, 0x84, 0x89, 0x8E,
+    0x93, 0x98, 0x9D, 0xA2, 0xA7, 0xAC, 0xB1, 0xB6,
+    0xBB, 0xC0, 0xC5, 0xCA, 0xCF, 0xD4, 0xD9, 0xDE,
+    0xE3, 0xE8, 0xED, 0xF2, 0xF7, 0xFC, 0x01, 0x06,
+    0x0B, 0x10, 0x15, 0x1A, 0x1F, 0x24, 0x29, 0x2E,
+    0x33, 0x38, 0x3D, 0x42, 0x47, 0x4C, 0x51, 0x56,
+    0x5B, 0x60, 0x65, 0x6A, 0x6F, 0x74, 0x79, 0x7E,
+    0x83, 0x88, 0x8D, 0x92, 0x97, 0x9C, 0xA1, 0xA6,
+    0xAB, 0xB0, 0xB5, 0xBA, 0xBF, 0xC4, 0xC9, 0xCE,
+    0xD3, 0xD8, 0xDD, 0xE2, 0xE7, 0xEC, 0xF1, 0xF6,
+    0xFB, 0x00, 0x05, 0x0A, 0x0F, 0x14, 0x19, 0x1E,
+    0x23, 0x28, 0x2D, 0x32, 0x37, 0x3C, 0x41, 0x46,
+    0x4B, 0x50, 0x55, 0x5A, 0x5F, 0x64, 0x69, 0x6E,
+    0x73, 0x78, 0x7D, 0x82, 0x87, 0x8C, 0x91, 0x96,
+    0x9B, 0xA0, 0xA5, 0xAA, 0xAF, 0xB4, 0xB9, 0xBE,
+    0xC3, 0xC8, 0xCD, 0xD2, 0xD7, 0xDC, 0xE1, 0xE6,
+    0xEB, 0xF0, 0xF5, 0xFA, 0xFF, 0x04, 0x09, 0x0E,
+    0x13, 0x18, 0x1D, 0x22, 0x27, 0x2C, 0x31, 0x36,
+    0x3B, 0x40, 0x45, 0x4A, 0x4F, 0x54, 0x59, 0x5E,
+    0x63, 0x68, 0x6D, 0x72, 0x77, 0x7C, 0x81, 0x86,
+    0x8B, 0x90, 0x95,
+};
+
+uint8_t cbcs_sample[] = {
+    0x03, 0x08, 0x0D, 0x12, 0xCB, 0xE6, 0xD6, 0x90,
+    0x72, 0x2B, 0xC3, 0x58, 0xAE, 0x94, 0xC7, 0x44,
+    0xF2, 0x21, 0x38, 0x12, 0x67, 0x6C, 0x71, 0x76,
+    0x7B, 0x80, 0x85, 0x8A, 0x8F, 0x94, 0x99, 0x9E,
+    0xA3, 0xA8, 0xAD, 0xB2, 0xB7, 0xBC, 0xC1, 0xC6,
+    0xCB, 0xD0, 0xD5, 0xDA, 0xDF, 0xE4, 0xE9, 0xEE,
+    0xF3, 0xF8, 0xFD, 0x02, 0x07, 0x0C, 0x11, 0x16,
+    0x1B, 0x20, 0x25, 0x2A, 0x2F, 0x34, 0x39, 0x3E,
+    0x43, 0x48, 0x4D, 0x52, 0x57, 0x5C, 0x61, 0x66,
+    0x6B, 0x70, 0x75, 0x7A, 0x7F, 0x84, 0x89, 0x8E,
+    0x93, 0x98, 0x9D, 0xA2, 0xA7, 0xAC, 0xB1, 0xB6,
+    0xBB, 0xC0, 0xC5, 0xCA, 0xCF, 0xD4, 0xD9, 0xDE,
+    0xE3, 0xE8, 0xED, 0xF2, 0xF7, 0xFC, 0x01, 0x06,
+    0x0B, 0x10, 0x15, 0x1A, 0x1F, 0x24, 0x29, 0x2E,
+    0x33, 0x38, 0x3D, 0x42, 0x47, 0x4C, 0x51, 0x56,
+    0x5B, 0x60, 0x65, 0x6A, 0x6F, 0x74, 0x79, 0x7E,
+    0x83, 0x88, 0x8D, 0x92, 0x97, 0x9C, 0xA1, 0xA6,
+    0xAB, 0xB0, 0xB5, 0xBA, 0xBF, 0xC4, 0xC9, 0xCE,
+    0xD3, 0xD8, 0xDD, 0xE2, 0xE7, 0xEC, 0xF1, 0xF6,
+    0xFB, 0x00, 0x05, 0x0A, 0x0F, 0x14, 0x19, 0x1E,
+    0x23, 0x28, 0x2D, 0x32, 0x84, 0x8F, 0x65, 0xC0,
+    0xF2, 0x12, 0x7A, 0x60, 0xDB, 0x2C, 0x37, 0x96,
+    0x34, 0xEE, 0x11, 0xBC, 0x87, 0x8C, 0x91, 0x96,
+    0x9B, 0xA0, 0xA5, 0xAA, 0xAF, 0xB4, 0xB9, 0xBE,
+    0xC3, 0xC8, 0xCD, 0xD2, 0xD7, 0xDC, 0xE1, 0xE6,
+    0xEB, 0xF0, 0xF5, 0x2B, 0xF1, 0xE0, 0xD6, 0x78,
+    0x5E, 0x98, 0xCA, 0x74, 0xBD, 0x02, 0xB9, 0xDA,
+    0x55, 0xB8, 0xB6, 0x4A, 0x4F, 0x54, 0x59, 0x5E,
+    0x63, 0x68, 0x6D, 0x72, 0x77, 0x7C, 0x81, 0x86,
+    0x8B, 0x90, 0x95,
+};
+
+void test_decryptor_init(void)
+{
+    test_start("test_decryptor_init");
+
+    BMFFDecryptor decryptor;
+    BMFFCode res;
+
+    res = bmff_decryptor_init(NULL, (const uint8_t*)"cenc", test_key, NULL);
+    test_assert_equal(res, BMFF_INVALID_PARAMETER, "invalid decryptor");
+    res = bmff_decryptor_init(&decryptor, (const uint8_t*)"cens", test_key, NULL);
+    test_assert_equal(res, BMFF_INVALID_PARAMETER, "unsupported scheme");
+
+    TrackEncryptionBox tenc;
+    memset(&tenc, 0, sizeof(TrackEncryptionBox));
+    tenc.default_crypt_byte_block = 1;
+    tenc.default_skip_byte_block = 9;
+    tenc.default_constant_iv_size = 16;
+    tenc.default_constant_iv = cbcs_iv;
+
+    res = bmff_decryptor_init(&decryptor, (const uint8_t*)"cbcs", test_key, &tenc);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert_equal(decryptor.scheme, BMFFSchemeCbcs, "scheme");
+    test_assert_equal(decryptor.crypt_byte_block, 1, "crypt blocks");
+    test_assert_equal(decryptor.skip_byte_block, 9, "skip blocks");
+    test_assert_equal(decryptor.constant_iv_size, 16, "constant iv");
+
+    // the pattern only applies to cbcs.
+    res = bmff_decryptor_init(&decryptor, (const uint8_t*)"cenc", test_key, &tenc);
+    test_assert_equal(decryptor.crypt_byte_block, 0, "no pattern");
+
+    test_end();
+}
+
+void test_decrypt_cenc(void)
+{
+    test_start("test_decrypt_cenc");
+
+    BMFFDecryptor decryptor;
+    EncryptionSubsample subsamples[2] = { { 5, 20 }, { 3, 30 } };
+    EncryptionSample sample;
+    uint8_t data[sizeof(cenc_whole_sample)];
+    BMFFCode res;
+    uint32_t pass = 0;
+
+    bmff_decryptor_init(&decryptor, (const uint8_t*)"cenc", test_key, NULL);
+
+    // once with the AES instructions when there are any, once with the portable code.
+    for(; pass < 2; ++pass) {
+        if(pass == 1) {
+            decryptor.key.hardware = eBooleanFalse;
+        }
+
+        sample.iv_size = 8;
+        sample.iv = cenc_iv;
+        sample.subsample_count = 2;
+        sample.subsamples = subsamples;
+        memcpy(data, cenc_sample, sizeof(cenc_sample));
+        res = bmff_decrypt_sample(&decryptor, &sample, data, sizeof(cenc_sample));
+        test_assert_equal(res, BMFF_OK, "success");
+        uint32_t i = 0;
+        for(; i < sizeof(cenc_sample); ++i) {
+            if(data[i] != (uint8_t)(i * 7)) {
+                break;
+            }
+        }
+        test_assert_equal(i, sizeof(cenc_sample), "subsamples decrypted");
+
+        // the subsamples do not fit.
+        res = bmff_decrypt_sample(&decryptor, &sample, data, 50);
+        test_assert_equal(res, BMFF_INVALID_SIZE, "subsamples too large");
+
+        sample.iv_size = 16;
+        sample.iv = cenc_whole_iv;
+        sample.subsample_count = 0;
+        sample.subsamples = NULL;
+        memcpy(data, cenc_whole_sample, sizeof(cenc_whole_sample));
+        res = bmff_decrypt_sample(&decryptor, &sample, data, sizeof(cenc_whole_sample));
+        test_assert_equal(res, BMFF_OK, "success");
+        test_assert(memcmp(data, cenc_whole_plain, sizeof(cenc_whole_plain)) == 0, "whole sample decrypted");
+
+        // no per sample IV and no constant IV.
+        sample.iv_size = 0;
+        res = bmff_decrypt_sample(&decryptor, &sample, data, sizeof(cenc_whole_sample));
+        test_assert_equal(res, BMFF_INVALID_DATA, "missing iv");
+    }
+
+    test_end();
+}
+
+void test_decrypt_cbcs(void)
+{
+    test_start("test_decrypt_cbcs");
+
+    BMFFDecryptor decryptor;
+    TrackEncryptionBox tenc;
+    EncryptionSubsample subsamples[2] = { { 4, 197 }, { 2, 32 } };
+    EncryptionSample sample;
+    uint8_t data[sizeof(cbcs_sample)];
+    BMFFCode res;
+    uint32_t pass = 0;
+
+    memset(&tenc, 0, sizeof(TrackEncryptionBox));
+    tenc.default_crypt_byte_block = 1;
+    tenc.default_skip_byte_block = 9;
+    tenc.default_constant_iv_size = 16;
+    tenc.default_constant_iv = cbcs_iv;
+    bmff_decryptor_init(&decryptor, (const uint8_t*)"cbcs", test_key, &tenc);
+
+    for(; pass < 2; ++pass) {
+        if(pass == 1) {
+            decryptor.key.hardware = eBooleanFalse;
+        }
+
+        // the constant IV is used and the pattern restarts in each subsample.
+        memset(&sample, 0, sizeof(EncryptionSample));
+        sample.subsample_count = 2;
+        sample.subsamples = subsamples;
+        memcpy(data, cbcs_sample, sizeof(data));
+        res = bmff_decrypt_sample(&decryptor, &sample, data, sizeof(data));
+        test_assert_equal(res, BMFF_OK, "success");
+        test_assert(memcmp(data, cbcs_plain, sizeof(cbcs_plain)) == 0, "pattern decrypted");
+    }
+
+    test_end();
+}
@@ -0,0 +1,259 @@
+#include "test.h"
+#include <bmff.h>
+#include <detach.h>
+#include <memo.h>
+#include <string.h>
+
+void test_detach_box(void);
+void test_detach_batched(void);
+void test_detach_invalid(void);
+
+int main(int argc, char** argv)
+{
+    test_detach_box();
+    test_detach_batched();
+    test_detach_invalid();
+    return 0;
+}
+
+// a ftyp, an emsg and a moov with a hdlr inside a trak and a pssh.
+uint8_t detach_data[] = {
+    0x00, 0x00, 0x00, 0x18, 'f', 't', 'y', 'p',
+    'i', 's', 'o', 'm',
+    0x00, 0x00, 0x00, 0x00, // minor version
+    'i', 's', 'o', '6',
+    'c', 'm', 'f', 'c',
+
+    0x00, 0x00, 0x00, 0x28, 'e', 'm', 's', 'g',
+    0x00, 0x00, 0x00, 0x00, // version and flags
+    'u', 'r', 'n', ':', 'a', 0x00, // scheme id uri
+    '1', 0x00, // value
+    0x00, 0x00, 0x03, 0xE8, // timescale
+    0x00, 0x00, 0x00, 0x00, // presentation time delta
+    0x00, 0x00, 0x00, 0x64, // event duration
+    0x00, 0x00, 0x00, 0x07, // id
+    'D', 'A', 'T', 'A', // message data
+
+    0x00, 0x00, 0x00, 0x66, 'm', 'o', 'o', 'v',
+    0x00, 0x00, 0x00, 0x36, 't', 'r', 'a', 'k',
+    0x00, 0x00, 0x00, 0x2E, 'm', 'd', 'i', 'a',
+    0x00, 0x00, 0x00, 0x26, 'h', 'd', 'l', 'r',
+    0x00, 0x00, 0x00, 0x00, // version and flags
+    0x00, 0x00, 0x00, 0x00, // pre-defined
+    'v', 'i', 'd', 'e',
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    'V', 'i', 'd', 'e', 'o', 0x00,
+    0x00, 0x00, 0x00, 0x28, 'p', 's', 's', 'h',
+    0x00, 0x00, 0x00, 0x00, // version and flags
+    0x10, 0x77, 0xEF, 0xEC, 0xC0, 0xB2, 0x4D, 0x02, // system id
+    0xAC, 0xE3, 0x3C, 0x1E, 0x52, 0xE2, 0xFB, 0x4B,
+    0x00, 0x00, 0x00, 0x04, // data size
+    0xDE, 0xAD, 0xBE, 0xEF, // data
+    0x00, 0x00, 0x00, 0x00, // padding up to the size of the box
+};
+
+typedef struct DetachResult {
+    BMFFDetachedBox         *detached[4];
+    uint32_t                count;
+    BMFFCode                nested_code;
+    const FileTypeBox       *ftyp;
+    const EventMessageBox   *emsg;
+    const ContainerBox      *moov;
+    const HandlerBox        *hdlr;
+} DetachResult;
+
+static void detach_event(BMFFContext *ctx, BMFFEventId event_id, const uint8_t *fourCC, void *data, DetachResult *result)
+{
+    if(event_id != BMFFEventParseComplete) {
+        return;
+    }
+    if(memcmp(fourCC, "hdlr", 4) == 0) {
+        result->hdlr = (const HandlerBox*)data;
+        // only the top level box can be detached.
+        result->nested_code = bmff_detach_box(ctx, (const Box*)data, &result->detached[3]);
+        return;
+    }
+    if(memcmp(fourCC, "ftyp", 4) == 0) {
+        result->ftyp = (const FileTypeBox*)data;
+    }else if(memcmp(fourCC, "emsg", 4) == 0) {
+        result->emsg = (const EventMessageBox*)data;
+    }else if(memcmp(fourCC, "moov", 4) == 0) {
+        result->moov = (const ContainerBox*)data;
+    }else{
+        return;
+    }
+    if(bmff_detach_box(ctx, (const Box*)data, &result->detached[result->count]) == BMFF_OK) {
+        result->count++;
+    }
+}
+
+void detach_callback_func(BMFFContext *ctx,
+    BMFFEventId event_id,
+    const uint8_t *fourCC,
+    void *data,
+    void *user_data)
+{
+    detach_event(ctx, event_id, fourCC, data, (DetachResult*)user_data);
+}
+
+void detach_batch_callback_func(BMFFContext *ctx,
+    const BMFFEvent *events,
+    uint32_t count,
+    void *user_data)
+{
+    uint32_t i = 0;
+    for(; i < count; ++i) {
+        detach_event(ctx, events[i].id, events[i].type, events[i].data, (DetachResult*)user_data);
+    }
+}
+
+// checks the detached boxes once the buffer they were parsed from is gone.
+static void check_detached(BMFFContext *ctx, DetachResult *result, uint8_t *buffer, size_t size)
+{
+    test_assert_equal(result->count, 3, "top level boxes detached");
+    test_assert_equal(result->nested_code, BMFF_INVALID_PARAMETER, "box inside a top level box not detached");
+    test_assert(ctx->memory_used > 0, "detached boxes charged to the memory limit");
+
+    memset(buffer, 0xAA, size);
+
+    test_assert_equal(result->ftyp->nb_compatible_brands, 2, "compatible brands");
+    test_assert_equal(memcmp(result->ftyp->compatible_brands, "iso6cmfc", 8), 0, "brands copied");
+    test_assert_equal(strcmp(result->emsg->scheme_id_uri, "urn:a"), 0, "scheme id uri copied");
+    test_assert_equal(strcmp(result->emsg->value, "1"), 0, "value copied");
+    test_assert_equal(result->emsg->id, 7, "id");
+    test_assert_equal(result->emsg->message_data_size, 4, "message data size");
+    test_assert_equal(memcmp(result->emsg->message_data, "DATA", 4), 0, "message data copied");
+
+    test_assert_equal(result->moov->child_count, 2, "moov children");
+    const ContainerBox *trak = (const ContainerBox*)result->moov->children[0];
+    const ContainerBox *mdia = (const ContainerBox*)trak->children[0];
+    const HandlerBox *hdlr = (const HandlerBox*)mdia->children[0];
+    test_assert(hdlr == result->hdlr, "boxes keep their address");
+    test_assert_equal(strcmp(hdlr->name, "Video"), 0, "handler name copied");
+    const ProtectionSystemSpecificHeaderBox *pssh = (const ProtectionSystemSpecificHeaderBox*)result->moov->children[1];
+    test_assert_equal(pssh->data_size, 4, "pssh data size");
+    test_assert_equal(memcmp(pssh->data, "\xDE\xAD\xBE\xEF", 4), 0, "pssh data copied");
+
+    uint32_t i = 0;
+    for(; i < result->count; ++i) {
+        test_assert_equal(bmff_detached_box_release(ctx, result->detached[i]), BMFF_OK, "released");
+    }
+    test_assert_equal(ctx->memory_used, 0, "detached boxes uncharged");
+}
+
+void test_detach_box(void)
+{
+    test_start("test_detach_box");
+
+    uint8_t data[sizeof(detach_data)];
+    memcpy(data, detach_data, sizeof(data));
+
+    BMFFContext ctx;
+    bmff_context_init(&ctx);
+    DetachResult result;
+    memset(&result, 0, sizeof(DetachResult));
+    bmff_set_event_callback(&ctx, detach_callback_func, &result);
+
+    BMFFCode res;
+    size_t parsed = bmff_parse(&ctx, data, sizeof(data), &res);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert_equal(parsed, sizeof(data), "parsed");
+    check_detached(&ctx, &result, data, sizeof(data));
+
+    // the layers stay usable once their allocations are detached.
+    memcpy(data, detach_data, sizeof(data));
+    memset(&result, 0, sizeof(DetachResult));
+    bmff_parse(&ctx, data, sizeof(data), &res);
+    test_assert_equal(res, BMFF_OK, "parsed again");
+    check_detached(&ctx, &result, data, sizeof(data));
+
+    bmff_context_destroy(&ctx);
+    test_end();
+}
+
+void test_detach_batched(void)
+{
+    test_start("test_detach_batched");
+
+    uint8_t data[sizeof(detach_data)];
+    memcpy(data, detach_data, sizeof(data));
+
+    BMFFContext ctx;
+    bmff_context_init(&ctx);
+    DetachResult result;
+    memset(&result, 0, sizeof(DetachResult));
+    BMFFEvent events[16];
+    bmff_set_event_batch(&ctx, events, 16, detach_batch_callback_func, &result);
+
+    BMFFCode res;
+    bmff_parse(&ctx, data, sizeof(data), &res);
+    test_assert_equal(res, BMFF_OK, "success");
+    check_detached(&ctx, &result, data, sizeof(data));
+
+    bmff_context_destroy(&ctx);
+    test_end();
+}
+
+typedef struct DetachAttempt {
+    BMFFCode        first;
+    BMFFCode        second;
+    BMFFDetachedBox *detached;
+} DetachAttempt;
+
+void detach_attempt_callback_func(BMFFContext *ctx,
+    BMFFEventId event_id,
+    const uint8_t *fourCC,
+    void *data,
+    void *user_data)
+{
+    DetachAttempt *attempt = (DetachAttempt*)user_data;
+    if(event_id == BMFFEventParseComplete && memcmp(fourCC, "emsg", 4) == 0) {
+        attempt->first = bmff_detach_box(ctx, (const Box*)data, &attempt->detached);
+        BMFFDetachedBox *again = NULL;
+        attempt->second = bmff_detach_box(ctx, (const Box*)data, &again);
+    }
+}
+
+void test_detach_invalid(void)
+{
+    test_start("test_detach_invalid");
+
+    BMFFContext ctx;
+    bmff_context_init(&ctx);
+    DetachAttempt attempt;
+    memset(&attempt, 0, sizeof(DetachAttempt));
+    bmff_set_event_callback(&ctx, detach_attempt_callback_func, &attempt);
+
+    BMFFCode res;
+    bmff_parse(&ctx, detach_data, sizeof(detach_data), &res);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert_equal(attempt.first, BMFF_OK, "detached");
+    test_assert_equal(attempt.second, BMFF_INVALID_PARAMETER, "detached once");
+    bmff_detached_box_release(&ctx, attempt.detached);
+    test_assert_equal(ctx.memory_used, 0, "released");
+
+    // outside of the events of the box.
+    BMFFDetachedBox *detached = NULL;
+    Box box;
+    memset(&box, 0, sizeof(Box));
+    test_assert_equal(bmff_detach_box(&ctx, &box, &detached), BMFF_INVALID_PARAMETER, "not a parsed box");
+
+    // the copies do not fit, the box is released with the others.
+    memset(&attempt, 0, sizeof(DetachAttempt));
+    bmff_set_memory_limit(&ctx, sizeof(EventMessageBox) + 8);
+    bmff_parse(&ctx, detach_data + 24, 40, &res);
+    test_assert_equal(attempt.first, BMFF_RESOURCE_LIMIT, "over the memory limit");
+    test_assert_equal(ctx.memory_used, 0, "nothing left behind");
+    bmff_set_memory_limit(&ctx, 0);
+
+    // memoized boxes belong to the cache.
+    static const char * const types[] = {"emsg"};
+    bmff_memo_enable(&ctx, types, 1, 4096);
+    memset(&attempt, 0, sizeof(DetachAttempt));
+    bmff_parse(&ctx, detach_data, sizeof(detach_data), &res);
+    test_assert_equal(res, BMFF_OK, "parsed with the memo cache");
+    test_assert_equal(attempt.first, BMFF_INVALID_PARAMETER, "memoized box not detached");
+
+    bmff_context_destroy(&ctx);
+    test_end();
+}
@@ -0,0 +1,150 @@
+#include "test.h"
+#include "moov.h"
+#include <bmff.h>
+#include <frozen_tree.h>
+#include <memo.h>
+#include <sample_index.h>
+#include <string.h>
+
+void test_frozen_tree_build(void);
+void test_frozen_tree_share(void);
+
+int main(int argc, char** argv)
+{
+    test_frozen_tree_build();
+    test_frozen_tree_share();
+    return 0;
+}
+
+#define FROZEN_PATH "frozen_tree_test.blob"
+
+void hdlr_callback_func(BMFFContext *ctx,
+    BMFFEventId event_id,
+    const uint8_t *fourCC,
+    void *data,
+    void *user_data)
+{
+    if(event_id == BMFFEventParseComplete && memcmp(fourCC, "hdlr", 4) == 0) {
+        memcpy(user_data, ((HandlerBox*)data)->handler_type, 4);
+    }
+}
+
+void check_tree(const BMFFFrozenTree *tree)
+{
+    test_assert_equal(tree->node_count, 15, "node count");
+
+    const BMFFFrozenNode *moov = &tree->nodes[0];
+    test_assert_equal(memcmp(moov->type, "moov", 4), 0, "root type");
+    test_assert_equal(moov->parent, BMFF_FROZEN_NONE, "root parent");
+    test_assert_equal(moov->next_sibling, BMFF_FROZEN_NONE, "single root");
+    test_assert_equal_uint64(moov->size, sizeof(moov_data), "root size");
+    test_assert_equal(memcmp(bmff_frozen_node_data(tree, moov), moov_data, sizeof(moov_data)), 0, "source bytes copied");
+
+    const BMFFFrozenNode *trak = bmff_frozen_tree_find(tree, NULL, "moov.trak");
+    test_assert(trak != NULL, "trak found");
+    test_assert_equal(trak->depth, 1, "trak depth");
+    test_assert(&tree->nodes[trak->parent] == moov, "trak parent");
+
+    const BMFFFrozenNode *stss = bmff_frozen_tree_find(tree, trak, "mdia.minf.stbl.stss");
+    test_assert(stss != NULL, "stss found");
+    test_assert_equal(stss->depth, 5, "stss depth");
+    test_assert_equal(stss->next_sibling, BMFF_FROZEN_NONE, "stss is the last box");
+    test_assert_equal_uint64(stss->size, 0x14, "stss size");
+    test_assert(bmff_frozen_tree_find(tree, NULL, "moov.trak.edts") == NULL, "missing box");
+    test_assert(bmff_frozen_tree_find(tree, NULL, "moov.tr") == NULL, "malformed path");
+
+    // a single box is parsed on demand from the blob.
+    const BMFFFrozenNode *hdlr = bmff_frozen_tree_find(tree, trak, "mdia.hdlr");
+    test_assert(hdlr != NULL, "hdlr found");
+    BMFFContext ctx;
+    BMFFCode res;
+    uint8_t handler_type[4] = {0};
+    bmff_context_init(&ctx);
+    bmff_set_event_callback(&ctx, hdlr_callback_func, handler_type);
+    bmff_parse(&ctx, bmff_frozen_node_data(tree, hdlr), (size_t)hdlr->size, &res);
+    test_assert_equal(res, BMFF_OK, "hdlr parsed");
+    test_assert_equal(memcmp(handler_type, "vide", 4), 0, "handler type");
+    bmff_context_destroy(&ctx);
+}
+
+void test_frozen_tree_build(void)
+{
+    test_start("test_frozen_tree_build");
+
+    BMFFContext ctx;
+    BMFFFrozenTree tree;
+    BMFFCode res;
+    bmff_context_init(&ctx);
+
+    res = bmff_frozen_tree_build(&ctx, moov_data, sizeof(moov_data), &tree);
+    test_assert_equal(res, BMFF_OK, "built");
+    test_assert(tree.source_hash == bmff_hash(moov_data, sizeof(moov_data)), "source hash");
+    test_assert(ctx.callback == NULL, "callback restored");
+    check_tree(&tree);
+    bmff_frozen_tree_destroy(&tree);
+    bmff_context_destroy(&ctx);
+
+    // every node is found in a moov the memo cache already holds.
+    static const char * const types[] = {"moov"};
+    bmff_context_init(&ctx);
+    bmff_memo_enable(&ctx, types, 1, 64 * 1024);
+    bmff_parse(&ctx, moov_data, sizeof(moov_data), &res);
+    res = bmff_frozen_tree_build(&ctx, moov_data, sizeof(moov_data), &tree);
+    test_assert_equal(res, BMFF_OK, "built with a memo cache");
+    test_assert(ctx.memo != NULL, "memo cache restored");
+    check_tree(&tree);
+
+    bmff_frozen_tree_destroy(&tree);
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+void test_frozen_tree_share(void)
+{
+    test_start("test_frozen_tree_share");
+
+    BMFFContext ctx;
+    BMFFFrozenTree tree;
+    BMFFFrozenTree shared;
+    BMFFCode res;
+    bmff_context_init(&ctx);
+    res = bmff_frozen_tree_build(&ctx, moov_data, sizeof(moov_data), &tree);
+    test_assert_equal(res, BMFF_OK, "built");
+
+    // the blob works at any address.
+    uint64_t *copy = malloc(tree.blob_size);
+    memcpy(copy, tree.blob, tree.blob_size);
+    res = bmff_frozen_tree_load((uint8_t*)copy, tree.blob_size, &shared);
+    test_assert_equal(res, BMFF_OK, "loaded");
+    check_tree(&shared);
+    bmff_frozen_tree_destroy(&shared);
+
+    // links must point forward.
+    BMFFFrozenNode *nodes = (BMFFFrozenNode*)((uint8_t*)copy + ((const uint8_t*)tree.nodes - tree.blob));
+    nodes[1].next_sibling = 0;
+    res = bmff_frozen_tree_load((uint8_t*)copy, tree.blob_size, &shared);
+    test_assert_equal(res, BMFF_INVALID_DATA, "loop rejected");
+    res = bmff_frozen_tree_load((uint8_t*)copy, tree.blob_size - 8, &shared);
+    test_assert_equal(res, BMFF_INVALID_DATA, "truncated blob rejected");
+    free(copy);
+
+    res = bmff_frozen_tree_save(&tree, FROZEN_PATH);
+    test_assert_equal(res, BMFF_OK, "saved");
+    res = bmff_frozen_tree_open(FROZEN_PATH, tree.source_hash, &shared);
+    test_assert_equal(res, BMFF_OK, "opened");
+    test_assert(shared.mapping != NULL, "mapped");
+    check_tree(&shared);
+    bmff_frozen_tree_destroy(&shared);
+
+    res = bmff_frozen_tree_open(FROZEN_PATH, tree.source_hash + 1, &shared);
+    test_assert_equal(res, BMFF_INVALID_DATA, "stale blob rejected");
+    res = bmff_frozen_tree_open("missing.blob", 0, &shared);
+    test_assert_equal(res, BMFF_INVALID_DATA, "missing blob");
+
+    remove(FROZEN_PATH);
+    bmff_frozen_tree_destroy(&tree);
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
@@ -0,0 +1,207 @@
+#include "test.h"
+#include "moov.h"
+#include <bmff.h>
+#include <index_cache.h>
+#include <pthread.h>
+#include <string.h>
+
+void test_index_cache(void);
+void test_index_cache_eviction(void);
+void test_index_cache_threads(void);
+
+int main(int argc, char** argv)
+{
+    test_index_cache();
+    test_index_cache_eviction();
+    test_index_cache_threads();
+    return 0;
+}
+
+// bytes of the tables of the index of moov_data.
+#define INDEX_BYTES (sizeof(BMFFTrackIndex) + 4 * 24 + 1)
+
+void index_callback_func(BMFFContext *ctx,
+    BMFFEventId event_id,
+    const uint8_t *fourCC,
+    void *data,
+    void *user_data)
+{
+    if(event_id == BMFFEventParseComplete && memcmp(fourCC, "moov", 4) == 0) {
+        bmff_sample_index_build(ctx, (Box*)data, fourCC, (BMFFSampleIndex*)user_data);
+    }
+}
+
+void build_index(BMFFSampleIndex *index, uint64_t file_size, uint64_t mtime)
+{
+    BMFFContext ctx;
+    BMFFCode res;
+    memset(index, 0, sizeof(BMFFSampleIndex));
+    bmff_context_init(&ctx);
+    bmff_set_event_callback(&ctx, index_callback_func, index);
+    bmff_parse(&ctx, moov_data, sizeof(moov_data), &res);
+    bmff_context_destroy(&ctx);
+    index->key.file_size = file_size;
+    index->key.mtime = mtime;
+}
+
+void test_index_cache(void)
+{
+    test_start("test_index_cache");
+
+    BMFFIndexCache cache;
+    BMFFIndexCacheStats stats;
+    BMFFSampleIndex index;
+    BMFFCode res;
+
+    res = bmff_index_cache_init(&cache, 1024 * 1024);
+    test_assert_equal(res, BMFF_OK, "initialized");
+    test_assert(bmff_index_cache_get(&cache, "a.mp4", 1000, 1) == NULL, "empty cache");
+
+    build_index(&index, 1000, 1);
+    const BMFFSampleIndex *added = bmff_index_cache_put(&cache, "a.mp4", &index);
+    test_assert(added != NULL, "added");
+    test_assert(index.tracks == NULL, "index taken over");
+    test_assert_equal(added->tracks[0].sample_count, 4, "cached tables");
+    bmff_index_cache_release(&cache, added);
+
+    const BMFFSampleIndex *cached = bmff_index_cache_get(&cache, "a.mp4", 1000, 1);
+    test_assert(cached == added, "hit");
+    test_assert_equal_uint64(cached->tracks[0].offsets[3], 5000, "sample 3 offset");
+    bmff_index_cache_release(&cache, cached);
+    test_assert(bmff_index_cache_get(&cache, "a.mp4", 1000, 2) == NULL, "other mtime");
+    test_assert(bmff_index_cache_get(&cache, "b.mp4", 1000, 1) == NULL, "other path");
+
+    // a concurrent put of the same file returns the cached index.
+    build_index(&index, 1000, 1);
+    cached = bmff_index_cache_put(&cache, "a.mp4", &index);
+    test_assert(cached == added, "first index kept");
+    bmff_index_cache_release(&cache, cached);
+
+    // a new version of the file replaces the old one, which outlives its eviction.
+    cached = bmff_index_cache_get(&cache, "a.mp4", 1000, 1);
+    build_index(&index, 2000, 2);
+    bmff_index_cache_release(&cache, bmff_index_cache_put(&cache, "a.mp4", &index));
+    test_assert(bmff_index_cache_get(&cache, "a.mp4", 1000, 1) == NULL, "old version dropped");
+    test_assert_equal(cached->tracks[0].sizes[3], 40, "handed out index still valid");
+    bmff_index_cache_release(&cache, cached);
+
+    bmff_index_cache_get_stats(&cache, &stats);
+    test_assert_equal_uint64(stats.hits, 2, "hits");
+    test_assert_equal_uint64(stats.misses, 4, "misses");
+    test_assert_equal_uint64(stats.insertions, 2, "insertions");
+    test_assert_equal_uint64(stats.evictions, 1, "evictions");
+    test_assert_equal(stats.entries, 1, "entries");
+    test_assert_equal_uint64(stats.bytes, INDEX_BYTES, "bytes");
+
+    bmff_index_cache_destroy(&cache);
+
+    test_end();
+}
+
+void test_index_cache_eviction(void)
+{
+    test_start("test_index_cache_eviction");
+
+    BMFFIndexCache cache;
+    BMFFIndexCacheStats stats;
+    BMFFSampleIndex index;
+    char path[32];
+
+    // room for two indexes.
+    bmff_index_cache_init(&cache, INDEX_BYTES * 2);
+
+    uint32_t i = 0;
+    for(; i < 3; ++i) {
+        sprintf(path, "%u.mp4", i);
+        build_index(&index, 1000, 1);
+        bmff_index_cache_release(&cache, bmff_index_cache_put(&cache, path, &index));
+        if(i == 1) {
+            // 0 becomes the most recently used.
+            bmff_index_cache_release(&cache, bmff_index_cache_get(&cache, "0.mp4", 1000, 1));
+        }
+    }
+
+    bmff_index_cache_get_stats(&cache, &stats);
+    test_assert_equal(stats.entries, 2, "entries");
+    test_assert_equal_uint64(stats.evictions, 1, "evictions");
+    test_assert(stats.bytes <= INDEX_BYTES * 2, "within budget");
+
+    const BMFFSampleIndex *cached = bmff_index_cache_get(&cache, "1.mp4", 1000, 1);
+    test_assert(cached == NULL, "least recently used evicted");
+    cached = bmff_index_cache_get(&cache, "0.mp4", 1000, 1);
+    test_assert(cached != NULL, "recently used kept");
+    bmff_index_cache_release(&cache, cached);
+
+    bmff_index_cache_destroy(&cache);
+
+    test_end();
+}
+
+#define THREAD_COUNT (4)
+#define THREAD_ITERATIONS (2000)
+
+typedef struct ThreadArgs {
+    BMFFIndexCache  *cache;
+    uint32_t        seed;
+    uint32_t        errors;
+} ThreadArgs;
+
+void * cache_thread_func(void *arg)
+{
+    ThreadArgs *args = (ThreadArgs*)arg;
+    char path[32];
+    uint32_t i = 0;
+    for(; i < THREAD_ITERATIONS; ++i) {
+        args->seed = args->seed * 1103515245 + 12345;
+        sprintf(path, "%u.mp4", (args->seed >> 16) % 8);
+
+        const BMFFSampleIndex *index = bmff_index_cache_get(args->cache, path, 1000, 1);
+        if(!index) {
+            BMFFSampleIndex built;
+            build_index(&built, 1000, 1);
+            index = bmff_index_cache_put(args->cache, path, &built);
+        }
+        if(!index || index->tracks[0].offsets[3] != 5000) {
+            args->errors++;
+        }
+        bmff_index_cache_release(args->cache, index);
+    }
+    return NULL;
+}
+
+void test_index_cache_threads(void)
+{
+    test_start("test_index_cache_threads");
+
+    BMFFIndexCache cache;
+    BMFFIndexCacheStats stats;
+    pthread_t threads[THREAD_COUNT];
+    ThreadArgs args[THREAD_COUNT];
+
+    // room for half of the files, so threads evict each other's indexes.
+    bmff_index_cache_init(&cache, INDEX_BYTES * 4);
+
+    uint32_t i = 0;
+    for(; i < THREAD_COUNT; ++i) {
+        args[i].cache = &cache;
+        args[i].seed = i + 1;
+        args[i].errors = 0;
+        pthread_create(&threads[i], NULL, cache_thread_func, &args[i]);
+    }
+    uint32_t errors = 0;
+    for(i = 0; i < THREAD_COUNT; ++i) {
+        pthread_join(threads[i], NULL);
+        errors += args[i].errors;
+    }
+    test_assert_equal(errors, 0, "every lookup found a valid index");
+
+    bmff_index_cache_get_stats(&cache, &stats);
+    test_assert_equal_uint64(stats.hits + stats.misses, THREAD_COUNT * THREAD_ITERATIONS, "lookups counted");
+    test_assert(stats.evictions > 0, "evictions");
+    test_assert_equal_uint64(stats.insertions - stats.evictions, stats.entries, "entries");
+    test_assert(stats.bytes <= INDEX_BYTES * 4, "within budget");
+
+    bmff_index_cache_destroy(&cache);
+
+    test_end();
+}
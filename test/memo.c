@@ -0,0 +1,276 @@
+#include "test.h"
+#include <bmff.h>
+#include <memo.h>
+#include <string.h>
+
+void test_memo_hit(void);
+void test_memo_eviction(void);
+void test_memo_out_of_memory(void);
+void test_memo_replay(void);
+
+int main(int argc, char** argv)
+{
+    test_memo_hit();
+    test_memo_eviction();
+    test_memo_out_of_memory();
+    test_memo_replay();
+    return 0;
+}
+
+#define PSSH_SIZE (0x28)
+
+// pssh with 4 bytes of data, the last byte is patched to make other boxes.
+uint8_t pssh_data[PSSH_SIZE] = {
+    0x00, 0x00, 0x00, 0x28, 'p', 's', 's', 'h',
+    0x00, 0x00, 0x00, 0x00, // version and flags
+    0x10, 0x77, 0xEF, 0xEC, 0xC0, 0xB2, 0x4D, 0x02, // system id
+    0xAC, 0xE3, 0x3C, 0x1E, 0x52, 0xE2, 0xFB, 0x4B,
+    0x00, 0x00, 0x00, 0x04, // data size
+    0xDE, 0xAD, 0xBE, 0x00, // data
+    0x00, 0x00, 0x00, 0x00, // padding up to the size of the box
+};
+
+// moof with the same pssh as above, followed by a tenc using 8 byte IVs.
+uint8_t moof_data[] = {
+    0x00, 0x00, 0x00, 0x50, 'm', 'o', 'o', 'f',
+    0x00, 0x00, 0x00, 0x28, 'p', 's', 's', 'h',
+    0x00, 0x00, 0x00, 0x00,
+    0x10, 0x77, 0xEF, 0xEC, 0xC0, 0xB2, 0x4D, 0x02,
+    0xAC, 0xE3, 0x3C, 0x1E, 0x52, 0xE2, 0xFB, 0x4B,
+    0x00, 0x00, 0x00, 0x04,
+    0xDE, 0xAD, 0xBE, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x20, 't', 'e', 'n', 'c',
+    0x00, 0x00, 0x00, 0x00, // version and flags
+    0x00, 0x00, // reserved
+    0x01, // is protected
+    0x08, // per sample iv size
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, // kid
+    0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+};
+
+typedef struct PsshResult {
+    uint32_t                                count;
+    const ProtectionSystemSpecificHeaderBox *boxes[4];
+} PsshResult;
+
+void pssh_callback_func(BMFFContext *ctx,
+    BMFFEventId event_id,
+    const uint8_t *fourCC,
+    void *data,
+    void *user_data)
+{
+    PsshResult *result = (PsshResult*)user_data;
+    if(event_id == BMFFEventParseComplete && memcmp(fourCC, "pssh", 4) == 0 && result->count < 4) {
+        result->boxes[result->count++] = (const ProtectionSystemSpecificHeaderBox*)data;
+    }
+}
+
+void test_memo_hit(void)
+{
+    test_start("test_memo_hit");
+
+    static const char * const types[] = {"pssh", "tenc"};
+    BMFFContext ctx;
+    BMFFMemoStats stats;
+    PsshResult result;
+    BMFFCode res;
+    bmff_context_init(&ctx);
+    memset(&result, 0, sizeof(result));
+    bmff_set_event_callback(&ctx, pssh_callback_func, &result);
+
+    res = bmff_memo_enable(&ctx, types, 2, 64 * 1024);
+    test_assert_equal(res, BMFF_OK, "enabled");
+
+    // a top level pssh, parsed from a buffer that is released afterwards.
+    uint8_t *segment = malloc(PSSH_SIZE);
+    memcpy(segment, pssh_data, PSSH_SIZE);
+    bmff_parse(&ctx, segment, PSSH_SIZE, &res);
+    test_assert_equal(res, BMFF_OK, "pssh parsed");
+    memset(segment, 0, PSSH_SIZE);
+    free(segment);
+
+    // the same pssh inside a moof.
+    bmff_parse(&ctx, moof_data, sizeof(moof_data), &res);
+    test_assert_equal(res, BMFF_OK, "moof parsed");
+    test_assert_equal(result.count, 2, "pssh events");
+    test_assert(result.boxes[0] == result.boxes[1], "memoized pssh handed back");
+    test_assert_equal(result.boxes[1]->data_size, 4, "pssh data size");
+    test_assert_equal(result.boxes[1]->data[1], 0xAD, "pssh data outlives its source");
+    test_assert_equal(ctx.default_iv_size, 8, "tenc state");
+
+    // a memoized tenc restores the context state it left behind.
+    ctx.default_iv_size = 0;
+    ctx.is_constant_iv = eBooleanUnknown;
+    bmff_parse(&ctx, moof_data, sizeof(moof_data), &res);
+    test_assert_equal(ctx.default_iv_size, 8, "tenc state restored");
+    test_assert_equal(ctx.is_constant_iv, eBooleanFalse, "constant iv state restored");
+
+    bmff_memo_get_stats(&ctx, &stats);
+    test_assert_equal_uint64(stats.hits, 3, "hits");
+    test_assert_equal_uint64(stats.misses, 2, "misses");
+    test_assert_equal(stats.entries, 2, "entries");
+    test_assert(stats.bytes > PSSH_SIZE + 0x20, "bytes");
+
+    // the memo has a budget of its own.
+    test_assert_equal(ctx.memory_used, 0, "memo memory not charged to the parse");
+
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+void test_memo_eviction(void)
+{
+    test_start("test_memo_eviction");
+
+    static const char * const types[] = {"pssh"};
+    BMFFContext ctx;
+    BMFFMemoStats stats;
+    PsshResult result;
+    BMFFCode res;
+    uint8_t pssh_a[PSSH_SIZE];
+    uint8_t pssh_b[PSSH_SIZE];
+    uint8_t both[PSSH_SIZE * 2];
+    memcpy(pssh_a, pssh_data, PSSH_SIZE);
+    memcpy(pssh_b, pssh_data, PSSH_SIZE);
+    pssh_b[35] = 0x01;
+    memcpy(both, pssh_a, PSSH_SIZE);
+    memcpy(both + PSSH_SIZE, pssh_b, PSSH_SIZE);
+
+    bmff_context_init(&ctx);
+    memset(&result, 0, sizeof(result));
+    bmff_set_event_callback(&ctx, pssh_callback_func, &result);
+
+    // room for a single entry.
+    bmff_memo_enable(&ctx, types, 1, 300);
+
+    // both boxes of one parse stay, their parents may still refer to them.
+    bmff_parse(&ctx, both, sizeof(both), &res);
+    bmff_memo_get_stats(&ctx, &stats);
+    test_assert_equal(stats.entries, 2, "entries of the current parse are kept");
+    test_assert_equal_uint64(stats.evictions, 0, "no evictions");
+
+    bmff_parse(&ctx, pssh_b, PSSH_SIZE, &res);
+    bmff_parse(&ctx, pssh_a, PSSH_SIZE, &res);
+    bmff_memo_get_stats(&ctx, &stats);
+    test_assert_equal_uint64(stats.hits, 2, "hits");
+    test_assert_equal(stats.entries, 2, "nothing added, nothing trimmed");
+
+    // a new box evicts the least recently used ones.
+    uint8_t pssh_c[PSSH_SIZE];
+    memcpy(pssh_c, pssh_data, PSSH_SIZE);
+    pssh_c[35] = 0x02;
+    bmff_parse(&ctx, pssh_c, PSSH_SIZE, &res);
+    bmff_memo_get_stats(&ctx, &stats);
+    test_assert_equal(stats.entries, 1, "trimmed to the budget");
+    test_assert_equal_uint64(stats.evictions, 2, "evictions");
+    test_assert(stats.bytes <= 300, "within budget");
+
+    bmff_parse(&ctx, pssh_a, PSSH_SIZE, &res);
+    bmff_memo_get_stats(&ctx, &stats);
+    test_assert_equal_uint64(stats.misses, 4, "evicted box parsed again");
+
+    bmff_memo_disable(&ctx);
+    test_assert_equal(bmff_memo_get_stats(&ctx, &stats), BMFF_INVALID_PARAMETER, "disabled");
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+static uint32_t malloc_calls = 0;
+static uint32_t malloc_fail_at = 0;
+
+// fails a single allocation, the one numbered malloc_fail_at.
+void *failing_malloc(size_t size)
+{
+    if(++malloc_calls == malloc_fail_at) {
+        return NULL;
+    }
+    return malloc(size);
+}
+
+void test_memo_out_of_memory(void)
+{
+    test_start("test_memo_out_of_memory");
+
+    static const char * const types[] = {"pssh"};
+    BMFFMemoStats stats;
+    BMFFCode res;
+
+    // run out of memory at each allocation of a memoized parse in turn.
+    uint32_t failed = 0;
+    uint32_t entries = 0;
+    uint32_t i = 1;
+    for(; i < 32; ++i) {
+        BMFFContext ctx;
+        bmff_context_init(&ctx);
+        bmff_memo_enable(&ctx, types, 1, 64 * 1024);
+        ctx.malloc = failing_malloc;
+        malloc_calls = 0;
+        malloc_fail_at = i;
+
+        bmff_parse(&ctx, pssh_data, PSSH_SIZE, &res);
+        bmff_memo_get_stats(&ctx, &stats);
+        failed += stats.entries == 0 ? 1 : 0;
+        entries = stats.entries;
+        bmff_context_destroy(&ctx);
+    }
+    test_assert(failed > 0, "allocations failed");
+    test_assert_equal(entries, 1, "box kept once there is memory");
+
+    test_end();
+}
+
+typedef struct EventLog {
+    uint32_t    count;
+    BMFFEvent   events[16];
+} EventLog;
+
+void batch_callback_func(BMFFContext *ctx, const BMFFEvent *events, uint32_t count, void *user_data)
+{
+    EventLog *log = (EventLog*)user_data;
+    uint32_t i = 0;
+    for(; i < count && log->count < 16; ++i) {
+        log->events[log->count++] = events[i];
+    }
+}
+
+void test_memo_replay(void)
+{
+    test_start("test_memo_replay");
+
+    static const char * const types[] = {"moof"};
+    BMFFContext ctx;
+    BMFFEvent buffer[4];
+    EventLog parsed;
+    EventLog memoized;
+    BMFFCode res;
+    bmff_context_init(&ctx);
+    bmff_memo_enable(&ctx, types, 1, 64 * 1024);
+
+    memset(&parsed, 0, sizeof(parsed));
+    bmff_set_event_batch(&ctx, buffer, 4, batch_callback_func, &parsed);
+    bmff_parse(&ctx, moof_data, sizeof(moof_data), &res);
+    test_assert_equal(res, BMFF_OK, "moof parsed");
+
+    // the second moof starts further into the stream.
+    memset(&memoized, 0, sizeof(memoized));
+    bmff_set_event_batch(&ctx, buffer, 4, batch_callback_func, &memoized);
+    bmff_parse(&ctx, moof_data, sizeof(moof_data), &res);
+    test_assert_equal(res, BMFF_OK, "moof memoized");
+
+    test_assert_equal(parsed.count, 6, "moof, pssh and tenc events");
+    test_assert_equal(memoized.count, parsed.count, "events of the boxes inside replayed");
+    uint32_t i = 0;
+    for(; i < parsed.count; ++i) {
+        test_assert_equal(memoized.events[i].id, parsed.events[i].id, "event id");
+        test_assert(memcmp(memoized.events[i].type, parsed.events[i].type, 4) == 0, "event type");
+        test_assert_equal(memoized.events[i].depth, parsed.events[i].depth, "event depth");
+        test_assert_equal_uint64(memoized.events[i].offset, parsed.events[i].offset + sizeof(moof_data), "event offset");
+    }
+
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
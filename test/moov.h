@@ -0,0 +1,83 @@
+#ifndef MOOV_H
+#define MOOV_H
+
+#include <stdint.h>
+
+// progressive moov with one video track of 4 samples in 2 chunks.
+uint8_t moov_data[] = {
+    0x00, 0x00, 0x01, 0xE1, 0x6D, 0x6F, 0x6F, 0x76, // moov
+    // mvhd
+    0x00, 0x00, 0x00, 0x6C, 0x6D, 0x76, 0x68, 0x64,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xE8,
+    0x00, 0x00, 0x0F, 0xA0, 0x00, 0x01, 0x00, 0x00,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x01, 0x6D, 0x74, 0x72, 0x61, 0x6B, // trak
+    // tkhd
+    0x00, 0x00, 0x00, 0x5C, 0x74, 0x6B, 0x68, 0x64,
+    0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0F, 0xA0,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x01, 0x09, 0x6D, 0x64, 0x69, 0x61, // mdia
+    // mdhd
+    0x00, 0x00, 0x00, 0x20, 0x6D, 0x64, 0x68, 0x64,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x5F, 0x90,
+    0x00, 0x00, 0x01, 0x90, 0x55, 0xC4, 0x00, 0x00,
+    // hdlr
+    0x00, 0x00, 0x00, 0x21, 0x68, 0x64, 0x6C, 0x72,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x76, 0x69, 0x64, 0x65, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00,
+    0x00, 0x00, 0x00, 0xC0, 0x6D, 0x69, 0x6E, 0x66, // minf
+    0x00, 0x00, 0x00, 0xB8, 0x73, 0x74, 0x62, 0x6C, // stbl
+    // stts
+    0x00, 0x00, 0x00, 0x18, 0x73, 0x74, 0x74, 0x73,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x64,
+    // ctts
+    0x00, 0x00, 0x00, 0x20, 0x63, 0x74, 0x74, 0x73,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0xC8,
+    0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x64,
+    // stsz
+    0x00, 0x00, 0x00, 0x24, 0x73, 0x74, 0x73, 0x7A,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x0A,
+    0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x1E,
+    0x00, 0x00, 0x00, 0x28,
+    // stsc
+    0x00, 0x00, 0x00, 0x28, 0x73, 0x74, 0x73, 0x63,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x03,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
+    // stco
+    0x00, 0x00, 0x00, 0x18, 0x73, 0x74, 0x63, 0x6F,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x03, 0xE8, 0x00, 0x00, 0x13, 0x88,
+    // stss
+    0x00, 0x00, 0x00, 0x14, 0x73, 0x74, 0x73, 0x73,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x01,
+};
+
+#endif // MOOV_H
@@ -2,14 +2,28 @@
 #include <bmff.h>
 #include "mp4.h"
 #include <memory.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 
 char *test_data_pos = test_data_fmp4_mp4;
 
 void test_parse(void);
+void test_parse_batched(void);
+void test_parse_large_size(void);
+void test_parse_size_zero(void);
+void test_parse_iov(void);
+void test_parse_iov_media_data(void);
+void test_parse_max_depth(void);
 
 int main(int argc, char** argv)
 {
     test_parse();
+    test_parse_batched();
+    test_parse_large_size();
+    test_parse_size_zero();
+    test_parse_iov();
+    test_parse_iov_media_data();
+    test_parse_max_depth();
     return 0;
 }
 
@@ -43,6 +57,12 @@ void callback_func(BMFFContext *ctx,
         }
         else if(strncmp(four_cc, "tkhd", 4) == 0) {
             test_assert_equal(strcmp("moov.trak", breadcrumb), 0, "breadcrumb should be moov.trak");
+
+            uint32_t depth = 0;
+            const uint32_t *path = bmff_get_breadcrumb_path(ctx, &depth);
+            test_assert_equal(depth, 2, "breadcrumb path depth should be 2");
+            test_assert_equal(memcmp(&path[0], "moov", 4), 0, "breadcrumb path should start with moov");
+            test_assert_equal(memcmp(&path[1], "trak", 4), 0, "breadcrumb path should end with trak");
         }
         else if(strncmp(four_cc, "minf", 4) == 0) {
             test_assert_equal(strcmp("moov.trak.mdia", breadcrumb), 0, "breadcrumb should be moov.trak.mdia");
@@ -65,9 +85,9 @@ void callback_func(BMFFContext *ctx,
     }
 }
 
-void test_parse(void)
+void parse_test_data(BMFFContext *ctx)
 {
-    test_start("test_parse");
+    test_data_pos = test_data_fmp4_mp4;
 
     // buffer for storing data into
     size_t buffer_size = 1024*1024;
@@ -75,13 +95,6 @@ void test_parse(void)
     uint8_t *write_pos = buffer;
     uint8_t *read_pos = buffer;
 
-    // create a context for parsing
-    BMFFContext ctx;
-    bmff_context_init(&ctx);
-
-    // set the parsing callback
-    bmff_set_event_callback(&ctx, callback_func, NULL);
-
     // read 1024 bytes from the file until we reach the end of the file
     int read_size = 1024;
     size_t read = read_mp4(write_pos, 1, read_size);
@@ -91,7 +104,7 @@ void test_parse(void)
         write_pos += read;
         // parse the data
         BMFFCode res;
-        size_t parsed = bmff_parse(&ctx, read_pos, write_pos-read_pos, &res);
+        size_t parsed = bmff_parse(ctx, read_pos, write_pos-read_pos, &res);
         read_pos += parsed;
 
         // reset the buffer if everything is parsed
@@ -110,9 +123,489 @@ void test_parse(void)
     }
 
     // end parsing
-    bmff_parse_end(&ctx);
+    bmff_parse_end(ctx);
+    free(buffer);
+}
+
+void test_parse(void)
+{
+    test_start("test_parse");
+
+    // create a context for parsing
+    BMFFContext ctx;
+    bmff_context_init(&ctx);
+
+    // set the parsing callback
+    bmff_set_event_callback(&ctx, callback_func, NULL);
+
+    parse_test_data(&ctx);
+
     // destory the context
     bmff_context_destroy(&ctx);
     // end the test
     test_end();
 }
+
+typedef struct BatchStats {
+    uint32_t batches;
+    uint32_t largest_batch;
+    uint32_t starts;
+    uint32_t completes;
+    uint32_t first_offset;
+    uint32_t moov_depth;
+    uint32_t trak_depth;
+} BatchStats;
+
+void batch_callback_func(BMFFContext *ctx,
+    const BMFFEvent *events,
+    uint32_t count,
+    void *user_data)
+{
+    BatchStats *stats = (BatchStats*)user_data;
+    if(count > stats->largest_batch) {
+        stats->largest_batch = count;
+    }
+
+    uint32_t i = 0;
+    for(; i < count; ++i) {
+        const BMFFEvent *event = &events[i];
+        if(event->id == BMFFEventParseStart) {
+            stats->starts++;
+        }else if(event->id == BMFFEventParseComplete) {
+            if(stats->completes == 0) {
+                stats->first_offset = (uint32_t)event->offset;
+            }
+            stats->completes++;
+            test_assert(event->data != NULL, "complete event has a box");
+            test_assert_equal(memcmp(((Box*)event->data)->type, event->type, 4), 0, "box type matches event type");
+            if(memcmp(event->type, "moov", 4) == 0) {
+                stats->moov_depth = event->depth;
+            }else if(memcmp(event->type, "trak", 4) == 0) {
+                stats->trak_depth = event->depth;
+            }
+        }
+    }
+    stats->batches++;
+}
+
+void test_parse_batched(void)
+{
+    test_start("test_parse_batched");
+
+    BMFFContext ctx;
+    bmff_context_init(&ctx);
+
+    BatchStats stats;
+    memset(&stats, 0, sizeof(BatchStats));
+    stats.moov_depth = stats.trak_depth = 0xFFFFFFFF;
+
+    BMFFEvent events[16];
+    BMFFCode res = bmff_set_event_batch(&ctx, events, 16, batch_callback_func, &stats);
+    test_assert_equal(res, BMFF_OK, "batching enabled");
+    res = bmff_set_event_mask(&ctx, BMFF_EVENT_MASK_ALL & ~BMFF_EVENT_MASK(BMFFEventParseStart));
+    test_assert_equal(res, BMFF_OK, "mask set");
+
+    parse_test_data(&ctx);
+
+    test_assert(stats.batches > 1, "events delivered in batches");
+    test_assert(stats.largest_batch <= 16, "batches fit the buffer");
+    test_assert_equal(stats.starts, 0, "masked events dropped");
+    test_assert(stats.completes > 0, "complete events delivered");
+    test_assert_equal(stats.first_offset, 0, "first box at offset 0");
+    test_assert_equal(stats.moov_depth, 0, "moov is a top level box");
+    test_assert_equal(stats.trak_depth, 1, "trak is inside moov");
+
+    bmff_context_destroy(&ctx);
+    test_end();
+}
+
+void write_box_header(uint8_t *ptr, uint32_t size, const char *type)
+{
+    ptr[0] = (size >> 24) & 0xFF;
+    ptr[1] = (size >> 16) & 0xFF;
+    ptr[2] = (size >> 8) & 0xFF;
+    ptr[3] = size & 0xFF;
+    memcpy(ptr + 4, type, 4);
+}
+
+void write_large_size(uint8_t *ptr, uint64_t size)
+{
+    int i = 0;
+    for(; i < 8; ++i) {
+        ptr[i] = (size >> (56 - i * 8)) & 0xFF;
+    }
+}
+
+typedef struct LargeSizeStats {
+    uint32_t completes;
+    uint64_t mdat_size;
+    uint64_t mdat_data_len;
+    uint64_t free_offset;
+} LargeSizeStats;
+
+void large_size_callback_func(BMFFContext *ctx,
+    const BMFFEvent *events,
+    uint32_t count,
+    void *user_data)
+{
+    LargeSizeStats *stats = (LargeSizeStats*)user_data;
+    uint32_t i = 0;
+    for(; i < count; ++i) {
+        if(events[i].id != BMFFEventParseComplete) {
+            continue;
+        }
+        stats->completes++;
+        if(memcmp(events[i].type, "mdat", 4) == 0) {
+            MediaDataBox *mdat = (MediaDataBox*)events[i].data;
+            stats->mdat_size = bmff_get_box_size(&mdat->box);
+            stats->mdat_data_len = mdat->data_len;
+        }else if(memcmp(events[i].type, "free", 4) == 0) {
+            stats->free_offset = events[i].offset;
+        }
+    }
+}
+
+void test_parse_large_size(void)
+{
+    test_start("test_parse_large_size");
+
+    // a 5GB mdat using the largesize form between a ftyp and a free box. The
+    // mapping is never written past the box headers so it stays sparse.
+    uint64_t mdat_size = 5ULL * 1024 * 1024 * 1024;
+    uint64_t total = 24 + mdat_size + 8;
+    if(sizeof(size_t) < 8) {
+        test_assert(1, "skipped, no 64 bit address space");
+        test_end();
+        return;
+    }
+    uint8_t *data = (uint8_t*)mmap(NULL, (size_t)total, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(data == MAP_FAILED) {
+        test_assert(1, "skipped, unable to map the test data");
+        test_end();
+        return;
+    }
+
+    write_box_header(data, 1, "ftyp");
+    write_large_size(data + 8, 24);
+    memcpy(data + 16, "isom", 4);
+    write_box_header(data + 24, 1, "mdat");
+    write_large_size(data + 32, mdat_size);
+    write_box_header(data + 24 + mdat_size, 8, "free");
+
+    BMFFContext ctx;
+    bmff_context_init(&ctx);
+
+    LargeSizeStats stats;
+    memset(&stats, 0, sizeof(LargeSizeStats));
+    BMFFEvent events[8];
+    bmff_set_event_batch(&ctx, events, 8, large_size_callback_func, &stats);
+
+    BMFFCode res;
+    size_t parsed = bmff_parse(&ctx, data, (size_t)total, &res);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert(parsed == total, "parsed in one pass");
+    test_assert_equal(stats.completes, 3, "all boxes parsed");
+    test_assert(stats.mdat_size == mdat_size, "mdat size");
+    test_assert(stats.mdat_data_len == mdat_size - 16, "mdat data length");
+    test_assert(stats.free_offset == 24 + mdat_size, "free box offset");
+
+    bmff_context_destroy(&ctx);
+    munmap(data, (size_t)total);
+    test_end();
+}
+
+void test_parse_size_zero(void)
+{
+    test_start("test_parse_size_zero");
+
+    // a ftyp followed by a mdat that runs to the end of the file.
+    uint8_t data[16 + 8 + 100];
+    memset(data, 0, sizeof(data));
+    write_box_header(data, 16, "ftyp");
+    memcpy(data + 8, "isom", 4);
+    write_box_header(data + 16, 0, "mdat");
+
+    BMFFContext ctx;
+    bmff_context_init(&ctx);
+
+    LargeSizeStats stats;
+    memset(&stats, 0, sizeof(LargeSizeStats));
+    BMFFEvent events[8];
+    bmff_set_event_batch(&ctx, events, 8, large_size_callback_func, &stats);
+
+    BMFFCode res;
+    size_t parsed = bmff_parse(&ctx, data, sizeof(data), &res);
+    test_assert_equal(parsed, 16, "size 0 box waits for the end of the stream");
+    test_assert_equal(stats.completes, 1, "ftyp parsed");
+
+    res = bmff_set_end_of_stream(&ctx, eBooleanTrue);
+    test_assert_equal(res, BMFF_OK, "end of stream set");
+    parsed = bmff_parse(&ctx, data + 16, sizeof(data) - 16, &res);
+    test_assert_equal(parsed, sizeof(data) - 16, "size 0 box parsed");
+    test_assert_equal(stats.completes, 2, "mdat parsed");
+    test_assert(stats.mdat_size == sizeof(data) - 16, "mdat extends to the end");
+    test_assert(stats.mdat_data_len == 100, "mdat data length");
+
+    bmff_context_destroy(&ctx);
+    test_end();
+}
+
+
+typedef struct IovStats {
+    uint32_t completes;
+    uint32_t errors;
+    uint64_t offsets;
+    uint32_t types;
+} IovStats;
+
+void iov_callback_func(BMFFContext *ctx,
+    const BMFFEvent *events,
+    uint32_t count,
+    void *user_data)
+{
+    IovStats *stats = (IovStats*)user_data;
+    uint32_t i = 0;
+    for(; i < count; ++i) {
+        if(events[i].id == BMFFEventParseComplete) {
+            stats->completes++;
+            stats->offsets += events[i].offset;
+            stats->types = stats->types * 31 + ((uint32_t)events[i].type[0] << 24 | events[i].type[3]);
+        }else if(events[i].id == BMFFEventParseError) {
+            stats->errors++;
+        }
+    }
+}
+
+// splits data into segments of uneven sizes, cutting through box headers.
+int split_iov(uint8_t *data, size_t size, struct iovec *iov, int max_count)
+{
+    static const size_t sizes[] = {7, 1000, 3, 16384, 5, 65536, 12, 40000};
+    int count = 0;
+    size_t pos = 0;
+    while(pos < size && count < max_count) {
+        size_t n = sizes[count % 8];
+        if(n > size - pos || count == max_count - 1) {
+            n = size - pos;
+        }
+        iov[count].iov_base = data + pos;
+        iov[count].iov_len = n;
+        pos += n;
+        count++;
+    }
+    return count;
+}
+
+void test_parse_iov(void)
+{
+    test_start("test_parse_iov");
+
+    uint8_t *data = (uint8_t*)test_data_fmp4_mp4;
+    size_t size = sizeof(test_data_fmp4_mp4) - 1;
+    BMFFEvent events[64];
+    BMFFCode res;
+
+    // reference parse of the contiguous data.
+    BMFFContext ctx;
+    IovStats expected;
+    memset(&expected, 0, sizeof(IovStats));
+    bmff_context_init(&ctx);
+    bmff_set_event_batch(&ctx, events, 64, iov_callback_func, &expected);
+    size_t parsed = bmff_parse(&ctx, data, size, &res);
+    test_assert_equal(parsed, size, "contiguous parse");
+    bmff_context_destroy(&ctx);
+
+    IovStats stats;
+    memset(&stats, 0, sizeof(IovStats));
+    bmff_context_init(&ctx);
+    bmff_set_event_batch(&ctx, events, 64, iov_callback_func, &stats);
+
+    // the first call only gets part of the stream, the cut box is left over.
+    struct iovec iov[256];
+    size_t first = size / 2 + 3;
+    int count = split_iov(data, first, iov, 256);
+    parsed = bmff_parse_iov(&ctx, iov, count, &res);
+    test_assert_equal(res, BMFF_OK, "first part parsed");
+    test_assert(parsed < first, "partial box left over");
+
+    count = split_iov(data + parsed, size - parsed, iov, 256);
+    size_t rest = bmff_parse_iov(&ctx, iov, count, &res);
+    test_assert_equal(res, BMFF_OK, "rest parsed");
+    test_assert_equal(parsed + rest, size, "all bytes consumed");
+
+    test_assert_equal(stats.completes, expected.completes, "same boxes");
+    test_assert_equal(stats.errors, expected.errors, "same errors");
+    test_assert_equal_uint64(stats.offsets, expected.offsets, "same offsets");
+    test_assert_equal(stats.types, expected.types, "same order");
+    test_assert(ctx.bounce != NULL, "straddling boxes bounced");
+    test_assert(ctx.bounce_size < size / 2, "bounce buffer holds single boxes");
+
+    bmff_context_destroy(&ctx);
+    test_end();
+}
+
+typedef struct IovMediaData {
+    uint32_t    count;
+    uint64_t    offset;
+    size_t      data_len;
+    eBoolean    has_data;
+    int         range_count;
+    size_t      range_bytes;
+    uint32_t    mismatches;
+} IovMediaData;
+
+void iov_mdat_callback_func(BMFFContext *ctx,
+    BMFFEventId event_id,
+    const uint8_t *fourCC,
+    void *data,
+    void *user_data)
+{
+    IovMediaData *result = (IovMediaData*)user_data;
+    if(event_id != BMFFEventParseComplete || memcmp(fourCC, "mdat", 4) != 0) {
+        return;
+    }
+    const MediaDataBox *mdat = (const MediaDataBox*)data;
+    result->count++;
+    result->data_len = mdat->data_len;
+    result->has_data = mdat->data ? eBooleanTrue : eBooleanFalse;
+    result->range_count = mdat->data_iov_count;
+
+    // the payload bytes count up from 0.
+    size_t pos = 0;
+    int i = 0;
+    for(; i < mdat->data_iov_count; ++i) {
+        const uint8_t *bytes = (const uint8_t*)mdat->data_iov[i].iov_base;
+        size_t j = 0;
+        for(; j < mdat->data_iov[i].iov_len; ++j, ++pos) {
+            result->mismatches += bytes[j] == (uint8_t)pos ? 0 : 1;
+        }
+    }
+    result->range_bytes = pos;
+}
+
+void test_parse_iov_media_data(void)
+{
+    test_start("test_parse_iov_media_data");
+
+    // a free box cut across the first segments followed by a mdat spanning the rest.
+    size_t free_size = 2000;
+    size_t payload_size = 100000;
+    size_t size = free_size + 8 + payload_size;
+    uint8_t *data = calloc(1, size);
+    data[2] = free_size >> 8;
+    data[3] = free_size & 0xFF;
+    memcpy(data + 4, "free", 4);
+    uint8_t *mdat = data + free_size;
+    mdat[0] = (8 + payload_size) >> 24;
+    mdat[1] = (8 + payload_size) >> 16;
+    mdat[2] = (8 + payload_size) >> 8;
+    mdat[3] = (8 + payload_size) & 0xFF;
+    memcpy(mdat + 4, "mdat", 4);
+    size_t i = 0;
+    for(; i < payload_size; ++i) {
+        mdat[8 + i] = (uint8_t)i;
+    }
+
+    struct iovec iov[16];
+    int count = split_iov(data, size, iov, 16);
+    BMFFContext ctx;
+    IovMediaData result;
+    BMFFCode res;
+    memset(&result, 0, sizeof(IovMediaData));
+    bmff_context_init(&ctx);
+    bmff_set_event_callback(&ctx, iov_mdat_callback_func, &result);
+
+    size_t parsed = bmff_parse_iov(&ctx, iov, count, &res);
+    test_assert_equal(res, BMFF_OK, "parsed");
+    test_assert_equal(parsed, size, "all bytes consumed");
+    test_assert_equal(result.count, 1, "mdat parsed");
+    test_assert_equal(result.data_len, payload_size, "payload size");
+    test_assert_equal(result.has_data, eBooleanFalse, "payload not contiguous");
+    test_assert_equal(result.range_count, 5, "payload ranges");
+    test_assert_equal(result.range_bytes, payload_size, "payload covered");
+    test_assert_equal(result.mismatches, 0, "payload in place");
+    test_assert_equal(ctx.bounce_size, free_size, "only the free box bounced");
+    test_assert_equal(ctx.memory_used, free_size, "bounce buffer charged");
+    bmff_context_destroy(&ctx);
+
+    // the straddling free box does not fit the memory limit.
+    bmff_context_init(&ctx);
+    bmff_set_memory_limit(&ctx, 1024);
+    parsed = bmff_parse_iov(&ctx, iov, count, &res);
+    test_assert_equal(res, BMFF_RESOURCE_LIMIT, "bounce buffer over the limit");
+    test_assert_equal(parsed, 0, "nothing consumed");
+    test_assert(ctx.bounce == NULL, "no bounce buffer");
+    bmff_context_destroy(&ctx);
+
+    free(data);
+    test_end();
+}
+
+#define NESTED_LEVELS (10000)
+
+// moov boxes nested in each other around a free box, NESTED_LEVELS deep.
+uint8_t * nested_boxes(size_t *size)
+{
+    *size = NESTED_LEVELS * 8;
+    uint8_t *data = malloc(*size);
+    uint32_t i = 0;
+    for(; i < NESTED_LEVELS; ++i) {
+        uint32_t box_size = *size - i * 8;
+        data[i*8] = box_size >> 24;
+        data[i*8+1] = box_size >> 16;
+        data[i*8+2] = box_size >> 8;
+        data[i*8+3] = box_size;
+        memcpy(&data[i*8+4], i == NESTED_LEVELS - 1 ? "free" : "moov", 4);
+    }
+    return data;
+}
+
+void test_parse_max_depth(void)
+{
+    test_start("test_parse_max_depth");
+
+    size_t size = 0;
+    uint8_t *data = nested_boxes(&size);
+    BMFFEvent events[64];
+    BMFFDiagnostic diagnostic;
+    BMFFCode res;
+
+    BMFFContext ctx;
+    IovStats stats;
+    memset(&stats, 0, sizeof(IovStats));
+    bmff_context_init(&ctx);
+    bmff_set_event_batch(&ctx, events, 64, iov_callback_func, &stats);
+    size_t parsed = bmff_parse(&ctx, data, size, &res);
+    test_assert_equal(parsed, size, "parsed");
+    test_assert_equal(stats.completes, BMFF_DEFAULT_MAX_DEPTH, "boxes up to the default depth");
+    test_assert_equal(stats.errors, 1, "the box past the limit fails");
+    test_assert_equal(bmff_get_diagnostics(&ctx, &diagnostic, 1), 1, "diagnostic recorded");
+    test_assert_equal(diagnostic.code, BMFF_RESOURCE_LIMIT, "depth limit");
+    test_assert_equal(diagnostic.depth, BMFF_DEFAULT_MAX_DEPTH, "depth of the box");
+    test_assert_equal_uint64(diagnostic.offset, BMFF_DEFAULT_MAX_DEPTH * 8, "offset of the box");
+    bmff_context_destroy(&ctx);
+
+    // every level is parsed without recursing once the limit allows it.
+    memset(&stats, 0, sizeof(IovStats));
+    bmff_context_init(&ctx);
+    bmff_set_event_batch(&ctx, events, 64, iov_callback_func, &stats);
+    res = bmff_set_max_depth(&ctx, NESTED_LEVELS);
+    test_assert_equal(res, BMFF_OK, "max depth set");
+    parsed = bmff_parse(&ctx, data, size, &res);
+    test_assert_equal(parsed, size, "parsed");
+    test_assert_equal(stats.completes, NESTED_LEVELS, "all the levels");
+    test_assert_equal(stats.errors, 0, "no errors");
+
+    // a lower limit takes effect on the next parse.
+    memset(&stats, 0, sizeof(IovStats));
+    bmff_set_max_depth(&ctx, 4);
+    bmff_context_reset(&ctx);
+    parsed = bmff_parse(&ctx, data, size, &res);
+    test_assert_equal(parsed, size, "parsed");
+    test_assert_equal(stats.completes, 4, "boxes up to the depth");
+    test_assert_equal(stats.errors, 1, "the box past the limit fails");
+    bmff_context_destroy(&ctx);
+
+    free(data);
+    test_end();
+}
@@ -0,0 +1,164 @@
+#include "test.h"
+#include <bmff.h>
+#include <planner.h>
+#include <string.h>
+
+void test_load_moov_at_end(void);
+void test_load_large_moov(void);
+void test_load_over_budget(void);
+
+int main(int argc, char** argv)
+{
+    test_load_moov_at_end();
+    test_load_large_moov();
+    test_load_over_budget();
+    return 0;
+}
+
+typedef struct MemoryFile {
+    uint8_t *data;
+    uint64_t size;
+} MemoryFile;
+
+size_t memory_read_at(void *user_data, uint64_t offset, uint8_t *buffer, size_t size)
+{
+    MemoryFile *file = (MemoryFile*)user_data;
+    if(offset >= file->size) {
+        return 0;
+    }
+    if(offset + size > file->size) {
+        size = file->size - offset;
+    }
+    memcpy(buffer, file->data + offset, size);
+    return size;
+}
+
+typedef struct LoadedBoxes {
+    uint32_t ftyp;
+    uint32_t moov;
+    uint32_t mdat;
+} LoadedBoxes;
+
+void planner_callback_func(BMFFContext *ctx,
+    BMFFEventId event_id,
+    const uint8_t *fourCC,
+    void *data,
+    void *user_data)
+{
+    LoadedBoxes *loaded = (LoadedBoxes*)user_data;
+    if(event_id != BMFFEventParseComplete) {
+        return;
+    }
+    if(memcmp(fourCC, "ftyp", 4) == 0) loaded->ftyp++;
+    if(memcmp(fourCC, "moov", 4) == 0) loaded->moov++;
+    if(memcmp(fourCC, "mdat", 4) == 0) loaded->mdat++;
+}
+
+void write_box(uint8_t *ptr, uint32_t size, const char *type)
+{
+    ptr[0] = (size >> 24) & 0xFF;
+    ptr[1] = (size >> 16) & 0xFF;
+    ptr[2] = (size >> 8) & 0xFF;
+    ptr[3] = size & 0xFF;
+    memcpy(ptr + 4, type, 4);
+}
+
+// ftyp, a moov of moov_size bytes and a mdat of mdat_size bytes, in either order.
+void build_file(MemoryFile *file, uint32_t moov_size, uint32_t mdat_size, int moov_at_end)
+{
+    file->size = 20 + moov_size + mdat_size;
+    file->data = (uint8_t*)calloc(1, file->size);
+
+    uint8_t *ptr = file->data;
+    write_box(ptr, 20, "ftyp");
+    memcpy(ptr + 8, "isom", 4);
+    memcpy(ptr + 16, "isom", 4);
+    ptr += 20;
+
+    uint8_t *moov = moov_at_end ? ptr + mdat_size : ptr;
+    uint8_t *mdat = moov_at_end ? ptr : ptr + moov_size;
+    write_box(moov, moov_size, "moov");
+    write_box(moov + 8, moov_size - 8, "free");
+    write_box(mdat, mdat_size, "mdat");
+}
+
+void test_load_moov_at_end(void)
+{
+    test_start("test_load_moov_at_end");
+
+    MemoryFile file;
+    build_file(&file, 512, 4 * 1024 * 1024, 1);
+
+    BMFFContext ctx;
+    LoadedBoxes loaded;
+    BMFFReadStats stats;
+    memset(&loaded, 0, sizeof(LoadedBoxes));
+    bmff_context_init(&ctx);
+    bmff_set_event_callback(&ctx, planner_callback_func, &loaded);
+
+    BMFFCode res = bmff_load_header_boxes(&ctx, file.size, memory_read_at, &file, 4096, &stats);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert_equal(loaded.ftyp, 1, "ftyp loaded");
+    test_assert_equal(loaded.moov, 1, "moov loaded");
+    test_assert_equal(loaded.mdat, 0, "mdat skipped");
+    test_assert_equal(stats.requests, 2, "one read for the head, one for the moov");
+    test_assert(stats.bytes < 8192, "mdat not downloaded");
+
+    bmff_context_destroy(&ctx);
+    free(file.data);
+
+    test_end();
+}
+
+void test_load_large_moov(void)
+{
+    test_start("test_load_large_moov");
+
+    MemoryFile file;
+    build_file(&file, 10000, 1024 * 1024, 0);
+
+    BMFFContext ctx;
+    LoadedBoxes loaded;
+    BMFFReadStats stats;
+    memset(&loaded, 0, sizeof(LoadedBoxes));
+    bmff_context_init(&ctx);
+    bmff_set_event_callback(&ctx, planner_callback_func, &loaded);
+
+    BMFFCode res = bmff_load_header_boxes(&ctx, file.size, memory_read_at, &file, 4096, &stats);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert_equal(loaded.ftyp, 1, "ftyp loaded");
+    test_assert_equal(loaded.moov, 1, "moov loaded");
+    test_assert_equal(stats.requests, 2, "moov tail read with the next headers");
+    test_assert(stats.bytes == 20 + 10000 + 4096, "no bytes read twice");
+
+    bmff_context_destroy(&ctx);
+    free(file.data);
+
+    test_end();
+}
+
+void test_load_over_budget(void)
+{
+    test_start("test_load_over_budget");
+
+    MemoryFile file;
+    build_file(&file, 10000, 1024 * 1024, 0);
+
+    BMFFContext ctx;
+    LoadedBoxes loaded;
+    memset(&loaded, 0, sizeof(LoadedBoxes));
+    bmff_context_init(&ctx);
+    bmff_set_event_callback(&ctx, planner_callback_func, &loaded);
+    bmff_set_memory_limit(&ctx, 8192);
+
+    BMFFCode res = bmff_load_header_boxes(&ctx, file.size, memory_read_at, &file, 4096, NULL);
+    test_assert_equal(res, BMFF_RESOURCE_LIMIT, "moov exceeds the budget");
+    test_assert_equal(loaded.ftyp, 1, "ftyp loaded");
+    test_assert_equal(loaded.moov, 0, "moov not loaded");
+    test_assert_equal(ctx.memory_used, 0, "read buffer uncharged");
+
+    bmff_context_destroy(&ctx);
+    free(file.data);
+
+    test_end();
+}
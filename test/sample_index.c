@@ -0,0 +1,129 @@
+#include "test.h"
+#include "moov.h"
+#include <bmff.h>
+#include <sample_index.h>
+#include <string.h>
+
+void test_sample_index_build(void);
+void test_sample_index_cache(void);
+
+int main(int argc, char** argv)
+{
+    test_sample_index_build();
+    test_sample_index_cache();
+    return 0;
+}
+
+#define CACHE_PATH "sample_index_test.cache"
+
+void index_callback_func(BMFFContext *ctx,
+    BMFFEventId event_id,
+    const uint8_t *fourCC,
+    void *data,
+    void *user_data)
+{
+    if(event_id == BMFFEventParseComplete && memcmp(fourCC, "moov", 4) == 0) {
+        BMFFCode res = bmff_sample_index_build(ctx, (Box*)data, fourCC, (BMFFSampleIndex*)user_data);
+        test_assert_equal(res, BMFF_OK, "index built");
+    }
+}
+
+void build_index(BMFFContext *ctx, BMFFSampleIndex *index)
+{
+    BMFFCode res;
+    memset(index, 0, sizeof(BMFFSampleIndex));
+    bmff_context_init(ctx);
+    bmff_set_event_callback(ctx, index_callback_func, index);
+    bmff_parse(ctx, moov_data, sizeof(moov_data), &res);
+}
+
+void check_index(BMFFSampleIndex *index)
+{
+    test_assert_equal(index->timescale, 1000, "movie timescale");
+    test_assert_equal(index->track_count, 1, "track count");
+
+    BMFFTrackIndex *track = &index->tracks[0];
+    test_assert_equal(track->track_id, 1, "track id");
+    test_assert_equal(memcmp(track->handler_type, "vide", 4), 0, "handler type");
+    test_assert_equal(track->timescale, 90000, "track timescale");
+    test_assert_equal(track->sample_count, 4, "sample count");
+
+    test_assert_equal_uint64(track->offsets[0], 1000, "sample 0 offset");
+    test_assert_equal_uint64(track->offsets[1], 1010, "sample 1 offset");
+    test_assert_equal_uint64(track->offsets[2], 1030, "sample 2 offset");
+    test_assert_equal_uint64(track->offsets[3], 5000, "sample 3 offset, second chunk");
+    test_assert_equal(track->sizes[3], 40, "sample 3 size");
+    test_assert_equal_uint64(track->decode_times[3], 300, "sample 3 decode time");
+    test_assert_equal(track->composition_offsets[0], 200, "sample 0 composition offset");
+    test_assert_equal(track->composition_offsets[3], 100, "sample 3 composition offset");
+    test_assert_equal(BMFF_SAMPLE_IS_SYNC(track, 0), 1, "sample 0 is sync");
+    test_assert_equal(BMFF_SAMPLE_IS_SYNC(track, 1), 0, "sample 1 is not sync");
+}
+
+void test_sample_index_build(void)
+{
+    test_start("test_sample_index_build");
+
+    BMFFContext ctx;
+    BMFFSampleIndex index;
+    build_index(&ctx, &index);
+
+    test_assert(index.key.moov_hash == bmff_hash(moov_data, sizeof(moov_data)), "moov hash");
+    check_index(&index);
+
+    bmff_sample_index_destroy(&index);
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+void test_sample_index_cache(void)
+{
+    test_start("test_sample_index_cache");
+
+    BMFFContext ctx;
+    BMFFSampleIndex index;
+    BMFFSampleIndex cached;
+    BMFFCode res;
+    build_index(&ctx, &index);
+    index.key.file_size = 123456;
+    index.key.mtime = 1700000000;
+
+    res = bmff_sample_index_save(&index, CACHE_PATH);
+    test_assert_equal(res, BMFF_OK, "saved");
+
+    BMFFSampleIndexKey key = index.key;
+    res = bmff_sample_index_open(CACHE_PATH, &key, &cached);
+    test_assert_equal(res, BMFF_OK, "opened");
+    test_assert(cached.mapping != NULL, "tables are mapped");
+    check_index(&cached);
+    bmff_sample_index_destroy(&cached);
+
+    key.mtime = 0;
+    key.moov_hash = 0;
+    res = bmff_sample_index_open(CACHE_PATH, &key, &cached);
+    test_assert_equal(res, BMFF_OK, "unset key fields are not checked");
+    bmff_sample_index_destroy(&cached);
+
+    key.mtime = 1700000001;
+    res = bmff_sample_index_open(CACHE_PATH, &key, &cached);
+    test_assert_equal(res, BMFF_INVALID_DATA, "stale cache rejected");
+
+    res = bmff_sample_index_open("missing.cache", NULL, &cached);
+    test_assert_equal(res, BMFF_INVALID_DATA, "missing cache");
+
+    // a cache file of another version is rejected.
+    FILE *file = fopen(CACHE_PATH, "r+b");
+    uint32_t version = BMFF_SAMPLE_INDEX_VERSION + 1;
+    fseek(file, 4, SEEK_SET);
+    fwrite(&version, sizeof(uint32_t), 1, file);
+    fclose(file);
+    res = bmff_sample_index_open(CACHE_PATH, NULL, &cached);
+    test_assert_equal(res, BMFF_INVALID_DATA, "version mismatch");
+
+    remove(CACHE_PATH);
+    bmff_sample_index_destroy(&index);
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
@@ -0,0 +1,228 @@
+#include "test.h"
+#include <bmff.h>
+#include <sample_iter.h>
+#include <string.h>
+
+void test_sample_iter_buffer(void);
+void test_sample_iter_reader(void);
+void test_sample_iter_chunk(void);
+
+int main(int argc, char** argv)
+{
+    test_sample_iter_buffer();
+    test_sample_iter_reader();
+    test_sample_iter_chunk();
+    return 0;
+}
+
+// 5 samples in two chunks of the file, the first and the fourth are sync samples.
+uint64_t iter_offsets[] = { 100, 110, 130, 300, 308 };
+uint32_t iter_sizes[] = { 10, 20, 5, 8, 4 };
+uint64_t iter_decode_times[] = { 0, 10, 20, 30, 40 };
+int32_t iter_composition_offsets[] = { 20, 0, -10, 10, 0 };
+uint8_t iter_sync[] = { 0x09 };
+
+uint8_t iter_file[400];
+
+void init_track(BMFFTrackIndex *track)
+{
+    uint32_t i = 0;
+    for(; i < sizeof(iter_file); ++i) {
+        iter_file[i] = (uint8_t)i;
+    }
+
+    memset(track, 0, sizeof(BMFFTrackIndex));
+    track->track_id = 1;
+    track->sample_count = 5;
+    track->offsets = iter_offsets;
+    track->sizes = iter_sizes;
+    track->decode_times = iter_decode_times;
+    track->composition_offsets = iter_composition_offsets;
+    track->sync = iter_sync;
+}
+
+typedef struct ReaderState {
+    uint32_t requests;
+    uint64_t offsets[8];
+    size_t sizes[8];
+    // reads are cut short past this offset.
+    uint64_t end;
+} ReaderState;
+
+size_t reader_func(void *user_data, uint64_t offset, uint8_t *buffer, size_t size)
+{
+    ReaderState *state = (ReaderState*)user_data;
+    if(state->requests < 8) {
+        state->offsets[state->requests] = offset;
+        state->sizes[state->requests] = size;
+    }
+    state->requests++;
+    if(offset >= state->end) {
+        return 0;
+    }
+    if(offset + size > state->end) {
+        size = state->end - offset;
+    }
+    memcpy(buffer, iter_file + offset, size);
+    return size;
+}
+
+void test_sample_iter_buffer(void)
+{
+    test_start("test_sample_iter_buffer");
+
+    BMFFTrackIndex track;
+    BMFFSampleIter iter;
+    BMFFSample sample;
+    BMFFCode res;
+
+    init_track(&track);
+
+    res = bmff_sample_iter_init_buffer(&iter, NULL, iter_file, 0, sizeof(iter_file));
+    test_assert_equal(res, BMFF_INVALID_PARAMETER, "invalid track");
+
+    res = bmff_sample_iter_init_buffer(&iter, &track, iter_file, 0, sizeof(iter_file));
+    test_assert_equal(res, BMFF_OK, "success");
+
+    uint32_t i = 0;
+    while(bmff_sample_iter_next(&iter, &sample) == BMFF_OK) {
+        test_assert_equal(sample.index, i, "index");
+        test_assert_equal(sample.track_id, 1, "track id");
+        test_assert(sample.data == iter_file + iter_offsets[i], "points into the buffer");
+        test_assert_equal(sample.size, iter_sizes[i], "size");
+        test_assert_equal(sample.decode_time, iter_decode_times[i], "decode time");
+        test_assert_equal(sample.composition_time, iter_decode_times[i] + iter_composition_offsets[i], "composition time");
+        i++;
+    }
+    test_assert_equal(i, 5, "all samples");
+    res = bmff_sample_iter_next(&iter, &sample);
+    test_assert_equal(res, BMFF_END_OF_DATA, "end of data");
+
+    // only the first chunk is in the buffer.
+    bmff_sample_iter_init_buffer(&iter, &track, iter_file + 100, 100, 35);
+    bmff_sample_iter_next(&iter, &sample);
+    test_assert_equal(sample.flags, 0, "sync sample");
+    bmff_sample_iter_next(&iter, &sample);
+    test_assert_equal(sample.flags, BMFF_SAMPLE_FLAG_NON_SYNC, "non sync sample");
+    bmff_sample_iter_next(&iter, &sample);
+    test_assert(sample.data == iter_file + 130, "last sample of the buffer");
+    bmff_sample_iter_next(&iter, &sample);
+    test_assert(sample.data == NULL, "sample outside the buffer");
+    test_assert_equal(sample.flags, 0, "sync sample");
+
+    bmff_sample_iter_destroy(&iter);
+
+    test_end();
+}
+
+void test_sample_iter_reader(void)
+{
+    test_start("test_sample_iter_reader");
+
+    BMFFContext ctx;
+    BMFFTrackIndex track;
+    BMFFSampleIter iter;
+    BMFFSample sample;
+    ReaderState state;
+    BMFFCode res;
+
+    init_track(&track);
+    bmff_context_init(&ctx);
+
+    res = bmff_sample_iter_init_reader(&iter, NULL, &track, reader_func, &state, 0);
+    test_assert_equal(res, BMFF_INVALID_CONTEXT, "invalid context");
+
+    // adjacent samples are read together.
+    memset(&state, 0, sizeof(ReaderState));
+    state.end = sizeof(iter_file);
+    res = bmff_sample_iter_init_reader(&iter, &ctx, &track, reader_func, &state, 0);
+    test_assert_equal(res, BMFF_OK, "success");
+    uint32_t i = 0;
+    while(bmff_sample_iter_next(&iter, &sample) == BMFF_OK) {
+        test_assert(memcmp(sample.data, iter_file + iter_offsets[i], iter_sizes[i]) == 0, "payload");
+        i++;
+    }
+    test_assert_equal(i, 5, "all samples");
+    test_assert_equal(state.requests, 2, "one read per run");
+    test_assert_equal(state.offsets[0], 100, "first run offset");
+    test_assert_equal(state.sizes[0], 35, "first run size");
+    test_assert_equal(state.offsets[1], 300, "second run offset");
+    test_assert_equal(state.sizes[1], 12, "second run size");
+    test_assert_equal(iter.stats.requests, 2, "read stats");
+    test_assert_equal(iter.stats.bytes, 47, "bytes read");
+    bmff_sample_iter_destroy(&iter);
+
+    // batches are capped.
+    memset(&state, 0, sizeof(ReaderState));
+    state.end = sizeof(iter_file);
+    bmff_sample_iter_init_reader(&iter, &ctx, &track, reader_func, &state, 25);
+    while(bmff_sample_iter_next(&iter, &sample) == BMFF_OK);
+    test_assert_equal(state.requests, 3, "capped runs");
+    test_assert_equal(state.sizes[0], 10, "sample read alone");
+    test_assert_equal(state.sizes[1], 25, "capped run size");
+    bmff_sample_iter_destroy(&iter);
+
+    // the second run is cut short.
+    memset(&state, 0, sizeof(ReaderState));
+    state.end = 305;
+    bmff_sample_iter_init_reader(&iter, &ctx, &track, reader_func, &state, 0);
+    for(i = 0; i < 3; ++i) {
+        res = bmff_sample_iter_next(&iter, &sample);
+        test_assert_equal(res, BMFF_OK, "sample read");
+    }
+    res = bmff_sample_iter_next(&iter, &sample);
+    test_assert_equal(res, BMFF_IO_ERROR, "short read");
+    bmff_sample_iter_destroy(&iter);
+
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+void test_sample_iter_chunk(void)
+{
+    test_start("test_sample_iter_chunk");
+
+    BMFFChunkSample samples[3];
+    BMFFChunk chunk;
+    BMFFSampleIter iter;
+    BMFFSample sample;
+    BMFFCode res;
+
+    memset(samples, 0, sizeof(samples));
+    samples[0].track_id = 1;
+    samples[0].data = iter_file + 10;
+    samples[0].size = 4;
+    samples[0].decode_time = 1000;
+    samples[0].composition_time_offset = 500;
+    samples[1].track_id = 2;
+    samples[1].data = iter_file + 14;
+    samples[2].track_id = 1;
+    samples[2].data = iter_file + 20;
+    samples[2].flags = BMFF_SAMPLE_FLAG_NON_SYNC;
+
+    memset(&chunk, 0, sizeof(BMFFChunk));
+    chunk.sample_count = 3;
+    chunk.samples = samples;
+
+    res = bmff_sample_iter_init_chunk(&iter, &chunk, 1);
+    test_assert_equal(res, BMFF_OK, "success");
+    res = bmff_sample_iter_next(&iter, &sample);
+    test_assert_equal(res, BMFF_OK, "first sample");
+    test_assert(sample.data == iter_file + 10, "points into the mdat");
+    test_assert_equal(sample.composition_time, 1500, "composition time");
+    res = bmff_sample_iter_next(&iter, &sample);
+    test_assert_equal(sample.index, 2, "other track skipped");
+    test_assert_equal(sample.flags, BMFF_SAMPLE_FLAG_NON_SYNC, "flags");
+    res = bmff_sample_iter_next(&iter, &sample);
+    test_assert_equal(res, BMFF_END_OF_DATA, "end of data");
+
+    bmff_sample_iter_init_chunk(&iter, &chunk, 0);
+    uint32_t count = 0;
+    while(bmff_sample_iter_next(&iter, &sample) == BMFF_OK) {
+        count++;
+    }
+    test_assert_equal(count, 3, "all tracks");
+
+    test_end();
+}
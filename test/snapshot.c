@@ -0,0 +1,320 @@
+#include "test.h"
+#include <bmff.h>
+#include <snapshot.h>
+#include <memo.h>
+#include <string.h>
+
+void test_snapshot_capture(void);
+void test_snapshot_attach(void);
+
+int main(int argc, char** argv)
+{
+    test_snapshot_capture();
+    test_snapshot_attach();
+    return 0;
+}
+
+// init segment with a cenc video track 1 using 8 byte IVs and a cbcs audio
+// track 2 using a 16 byte constant IV.
+uint8_t init_data[] = {
+    0x00, 0x00, 0x03, 0x81, 0x6D, 0x6F, 0x6F, 0x76,
+    0x00, 0x00, 0x00, 0x6C, 0x6D, 0x76, 0x68, 0x64,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xE8,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x01, 0x73,
+    0x74, 0x72, 0x61, 0x6B, 0x00, 0x00, 0x00, 0x5C,
+    0x74, 0x6B, 0x68, 0x64, 0x00, 0x00, 0x00, 0x03,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x01, 0x0F, 0x6D, 0x64, 0x69, 0x61,
+    0x00, 0x00, 0x00, 0x20, 0x6D, 0x64, 0x68, 0x64,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x5F, 0x90,
+    0x00, 0x00, 0x00, 0x00, 0x55, 0xC4, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x21, 0x68, 0x64, 0x6C, 0x72,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x76, 0x69, 0x64, 0x65, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xC6, 0x6D, 0x69, 0x6E,
+    0x66, 0x00, 0x00, 0x00, 0xBE, 0x73, 0x74, 0x62,
+    0x6C, 0x00, 0x00, 0x00, 0xB6, 0x73, 0x74, 0x73,
+    0x64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x01, 0x00, 0x00, 0x00, 0xA6, 0x65, 0x6E, 0x63,
+    0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x40, 0x00, 0xF0, 0x00, 0x48, 0x00,
+    0x00, 0x00, 0x48, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x18, 0xFF, 0xFF, 0x00,
+    0x00, 0x00, 0x50, 0x73, 0x69, 0x6E, 0x66, 0x00,
+    0x00, 0x00, 0x0C, 0x66, 0x72, 0x6D, 0x61, 0x61,
+    0x76, 0x63, 0x31, 0x00, 0x00, 0x00, 0x14, 0x73,
+    0x63, 0x68, 0x6D, 0x00, 0x00, 0x00, 0x00, 0x63,
+    0x65, 0x6E, 0x63, 0x00, 0x01, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x28, 0x73, 0x63, 0x68, 0x69, 0x00,
+    0x00, 0x00, 0x20, 0x74, 0x65, 0x6E, 0x63, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x00,
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x00,
+    0x00, 0x01, 0x52, 0x74, 0x72, 0x61, 0x6B, 0x00,
+    0x00, 0x00, 0x5C, 0x74, 0x6B, 0x68, 0x64, 0x00,
+    0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xEE, 0x6D,
+    0x64, 0x69, 0x61, 0x00, 0x00, 0x00, 0x20, 0x6D,
+    0x64, 0x68, 0x64, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0xBB, 0x80, 0x00, 0x00, 0x00, 0x00, 0x55,
+    0xC4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x21, 0x68,
+    0x64, 0x6C, 0x72, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x73, 0x6F, 0x75, 0x6E, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xA5,
+    0x6D, 0x69, 0x6E, 0x66, 0x00, 0x00, 0x00, 0x9D,
+    0x73, 0x74, 0x62, 0x6C, 0x00, 0x00, 0x00, 0x95,
+    0x73, 0x74, 0x73, 0x64, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x85,
+    0x65, 0x6E, 0x63, 0x61, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x10,
+    0x00, 0x00, 0x00, 0x00, 0xBB, 0x80, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x61, 0x73, 0x69, 0x6E, 0x66,
+    0x00, 0x00, 0x00, 0x0C, 0x66, 0x72, 0x6D, 0x61,
+    0x6D, 0x70, 0x34, 0x61, 0x00, 0x00, 0x00, 0x14,
+    0x73, 0x63, 0x68, 0x6D, 0x00, 0x00, 0x00, 0x00,
+    0x63, 0x62, 0x63, 0x73, 0x00, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x39, 0x73, 0x63, 0x68, 0x69,
+    0x00, 0x00, 0x00, 0x31, 0x74, 0x65, 0x6E, 0x63,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x19, 0x01, 0x00,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x10, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+    0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E,
+    0x1F, 0x00, 0x00, 0x00, 0x48, 0x6D, 0x76, 0x65,
+    0x78, 0x00, 0x00, 0x00, 0x20, 0x74, 0x72, 0x65,
+    0x78, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x0B,
+    0xB8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x20, 0x74, 0x72, 0x65,
+    0x78, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x02, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x04,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00,
+};
+
+// media segment of track 1 with two 8 byte IVs.
+uint8_t video_segment[] = {
+    0x00, 0x00, 0x00, 0x50, 0x6D, 0x6F, 0x6F, 0x66,
+    0x00, 0x00, 0x00, 0x10, 0x6D, 0x66, 0x68, 0x64,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x38, 0x74, 0x72, 0x61, 0x66,
+    0x00, 0x00, 0x00, 0x10, 0x74, 0x66, 0x68, 0x64,
+    0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x20, 0x73, 0x65, 0x6E, 0x63,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+    0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF,
+};
+
+// media segment of track 2 with one subsample and no IV.
+uint8_t audio_segment[] = {
+    0x00, 0x00, 0x00, 0x48, 0x6D, 0x6F, 0x6F, 0x66,
+    0x00, 0x00, 0x00, 0x10, 0x6D, 0x66, 0x68, 0x64,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x30, 0x74, 0x72, 0x61, 0x66,
+    0x00, 0x00, 0x00, 0x10, 0x74, 0x66, 0x68, 0x64,
+    0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x18, 0x73, 0x65, 0x6E, 0x63,
+    0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x01, 0x00, 0x10, 0x00, 0x00, 0x00, 0x40,
+};
+
+// the parsed boxes are released with their top level box, so the callback
+// keeps what the test checks.
+typedef struct SencResult {
+    uint32_t    sample_count;
+    uint32_t    iv_size;
+    uint8_t     iv[16];
+    eBoolean    has_iv;
+    uint32_t    subsample_count;
+    uint32_t    encrypted_bytes;
+} SencResult;
+
+void senc_callback_func(BMFFContext *ctx,
+    BMFFEventId event_id,
+    const uint8_t *fourCC,
+    void *data,
+    void *user_data)
+{
+    if(event_id == BMFFEventParseComplete && memcmp(fourCC, "senc", 4) == 0) {
+        const SampleEncryptionBox *senc = (const SampleEncryptionBox*)data;
+        const EncryptionSample *sample = &senc->samples[senc->sample_count - 1];
+        SencResult *result = (SencResult*)user_data;
+        result->sample_count = senc->sample_count;
+        result->iv_size = sample->iv_size;
+        result->has_iv = sample->iv ? eBooleanTrue : eBooleanFalse;
+        if(sample->iv) {
+            memcpy(result->iv, sample->iv, sample->iv_size);
+        }
+        result->subsample_count = sample->subsample_count;
+        if(sample->subsample_count > 0) {
+            result->encrypted_bytes = sample->subsamples[0].bytes_of_encrypted_data;
+        }
+    }
+}
+
+void test_snapshot_capture(void)
+{
+    test_start("test_snapshot_capture");
+
+    BMFFContext ctx;
+    BMFFInitSnapshot snapshot;
+    BMFFCode res;
+    bmff_context_init(&ctx);
+
+    res = bmff_init_snapshot_capture(&ctx, init_data, sizeof(init_data), &snapshot);
+    test_assert_equal(res, BMFF_OK, "captured");
+    test_assert_equal(snapshot.track_count, 2, "track count");
+    test_assert(bmff_init_snapshot_get_track(&snapshot, 3) == NULL, "unknown track");
+
+    const BMFFTrackState *video = bmff_init_snapshot_get_track(&snapshot, 1);
+    test_assert(video != NULL, "video track");
+    test_assert_equal(memcmp(video->handler_type, "vide", 4), 0, "video handler type");
+    test_assert_equal(video->timescale, 90000, "video timescale");
+    test_assert_equal(memcmp(video->scheme_type, "cenc", 4), 0, "video scheme");
+    test_assert_equal(video->default_iv_size, 8, "video iv size");
+    test_assert_equal(video->is_constant_iv, eBooleanFalse, "video per sample iv");
+    test_assert_equal(video->default_kid[15], 15, "video kid");
+    test_assert_equal(video->default_sample_duration, 3000, "video trex duration");
+
+    const BMFFTrackState *audio = bmff_init_snapshot_get_track(&snapshot, 2);
+    test_assert(audio != NULL, "audio track");
+    test_assert_equal(memcmp(audio->handler_type, "soun", 4), 0, "audio handler type");
+    test_assert_equal(audio->timescale, 48000, "audio timescale");
+    test_assert_equal(audio->channel_count, 2, "audio channel count");
+    test_assert_equal(memcmp(audio->scheme_type, "cbcs", 4), 0, "audio scheme");
+    test_assert_equal(audio->default_iv_size, 16, "audio iv size");
+    test_assert_equal(audio->is_constant_iv, eBooleanTrue, "audio constant iv");
+    test_assert_equal(audio->default_crypt_byte_block, 1, "audio crypt blocks");
+    test_assert_equal(audio->default_skip_byte_block, 9, "audio skip blocks");
+    test_assert_equal(audio->default_sample_duration, 1024, "audio trex duration");
+
+    test_assert(ctx.callback == NULL, "callback restored");
+    bmff_context_destroy(&ctx);
+
+    // the capture sees every track of a moov the memo cache already holds.
+    static const char * const types[] = {"moov"};
+    BMFFMemoStats stats;
+    bmff_context_init(&ctx);
+    bmff_memo_enable(&ctx, types, 1, 64 * 1024);
+    bmff_parse(&ctx, init_data, sizeof(init_data), &res);
+    res = bmff_init_snapshot_capture(&ctx, init_data, sizeof(init_data), &snapshot);
+    test_assert_equal(res, BMFF_OK, "captured with a memo cache");
+    test_assert_equal(snapshot.track_count, 2, "track count with a memo cache");
+    bmff_memo_get_stats(&ctx, &stats);
+    test_assert_equal_uint64(stats.hits, 0, "memo cache bypassed");
+    test_assert(ctx.memo != NULL, "memo cache restored");
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}
+
+void test_snapshot_attach(void)
+{
+    test_start("test_snapshot_attach");
+
+    BMFFContext init_ctx;
+    BMFFInitSnapshot snapshot;
+    BMFFCode res;
+    bmff_context_init(&init_ctx);
+    res = bmff_init_snapshot_capture(&init_ctx, init_data, sizeof(init_data), &snapshot);
+    test_assert_equal(res, BMFF_OK, "captured");
+    bmff_context_destroy(&init_ctx);
+
+    // both segment contexts share the snapshot.
+    BMFFContext video_ctx;
+    BMFFContext audio_ctx;
+    SencResult senc;
+    bmff_context_init(&video_ctx);
+    bmff_context_init(&audio_ctx);
+    bmff_context_attach_snapshot(&video_ctx, &snapshot);
+    bmff_context_attach_snapshot(&audio_ctx, &snapshot);
+
+    memset(&senc, 0, sizeof(senc));
+    bmff_set_event_callback(&audio_ctx, senc_callback_func, &senc);
+    bmff_parse(&audio_ctx, audio_segment, sizeof(audio_segment), &res);
+    test_assert_equal(res, BMFF_OK, "audio segment parsed");
+    test_assert(audio_ctx.track_state == bmff_init_snapshot_get_track(&snapshot, 2), "audio track selected");
+    test_assert_equal(senc.sample_count, 1, "audio senc samples");
+    test_assert_equal(senc.iv_size, 16, "audio constant iv size");
+    test_assert_equal(senc.has_iv, eBooleanFalse, "audio iv not in senc");
+    test_assert_equal(senc.subsample_count, 1, "audio subsamples");
+    test_assert_equal(senc.encrypted_bytes, 64, "audio encrypted bytes");
+
+    memset(&senc, 0, sizeof(senc));
+    bmff_set_event_callback(&video_ctx, senc_callback_func, &senc);
+    bmff_parse(&video_ctx, video_segment, sizeof(video_segment), &res);
+    test_assert_equal(res, BMFF_OK, "video segment parsed");
+    test_assert_equal(senc.sample_count, 2, "video senc samples");
+    test_assert_equal(senc.iv_size, 8, "video iv size");
+    test_assert_equal(senc.iv[0], 0xA8, "video second iv");
+
+    // without the snapshot the IVs of the video segment are not known.
+    BMFFContext bare_ctx;
+    bmff_context_init(&bare_ctx);
+    memset(&senc, 0, sizeof(senc));
+    bmff_set_event_callback(&bare_ctx, senc_callback_func, &senc);
+    bmff_parse(&bare_ctx, video_segment, sizeof(video_segment), &res);
+    test_assert_equal(senc.iv_size, 0, "no iv without snapshot");
+
+    // a track the snapshot does not have clears the state of the previous one.
+    uint8_t unknown_segment[sizeof(video_segment)];
+    memcpy(unknown_segment, video_segment, sizeof(video_segment));
+    unknown_segment[47] = 0x03; // track id
+    memset(&senc, 0, sizeof(senc));
+    bmff_parse(&video_ctx, unknown_segment, sizeof(unknown_segment), &res);
+    test_assert(video_ctx.track_state == NULL, "unknown track");
+    test_assert_equal(video_ctx.default_iv_size, 0, "iv size cleared");
+    test_assert_equal(video_ctx.is_constant_iv, eBooleanUnknown, "constant iv cleared");
+    test_assert(memcmp(video_ctx.handler_type, "\0\0\0\0", 4) == 0, "handler type cleared");
+    test_assert_equal(senc.iv_size, 0, "no iv for an unknown track");
+
+    bmff_context_attach_snapshot(&video_ctx, NULL);
+    test_assert(video_ctx.track_state == NULL, "detached");
+
+    bmff_context_destroy(&bare_ctx);
+    bmff_context_destroy(&video_ctx);
+    bmff_context_destroy(&audio_ctx);
+
+    test_end();
+}
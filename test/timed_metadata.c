@@ -0,0 +1,158 @@
+#include "test.h"
+#include <bmff.h>
+#include <timed_metadata.h>
+#include <string.h>
+
+void test_metadata_extract(void);
+
+int main(int argc, char** argv)
+{
+    test_metadata_extract();
+    return 0;
+}
+
+// segment with metadata in front of and behind the movie fragment of track 1.
+uint8_t metadata_segment[] = {
+    // emsg v0
+    0x00, 0x00, 0x00, 0x3A, 0x65, 0x6D, 0x73, 0x67,
+    0x00, 0x00, 0x00, 0x00, 0x75, 0x72, 0x6E, 0x3A,
+    0x73, 0x63, 0x74, 0x65, 0x3A, 0x73, 0x63, 0x74,
+    0x65, 0x33, 0x35, 0x3A, 0x32, 0x30, 0x31, 0x33,
+    0x3A, 0x62, 0x69, 0x6E, 0x00, 0x31, 0x00, 0x00,
+    0x01, 0x5F, 0x90, 0x00, 0x01, 0x5F, 0x90, 0xFF,
+    0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x07, 0xFC,
+    0x30, 0x11,
+    // meta
+    0x00, 0x00, 0x00, 0x1F, 0x6D, 0x65, 0x74, 0x61,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x13,
+    0x49, 0x44, 0x33, 0x32, 0x00, 0x00, 0x00, 0x00,
+    0x15, 0xC7, 0x49, 0x44, 0x33, 0x04, 0x00,
+    // free
+    0x00, 0x00, 0x00, 0x0C, 0x66, 0x72, 0x65, 0x65,
+    0x00, 0x00, 0x00, 0x00,
+    // moof
+    0x00, 0x00, 0x00, 0x6C, 0x6D, 0x6F, 0x6F, 0x66,
+    0x00, 0x00, 0x00, 0x10, 0x6D, 0x66, 0x68, 0x64,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x28, 0x74, 0x72, 0x61, 0x66,
+    0x00, 0x00, 0x00, 0x10, 0x74, 0x66, 0x68, 0x64,
+    0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x10, 0x74, 0x66, 0x64, 0x74,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x64,
+    0x00, 0x00, 0x00, 0x2C, 0x74, 0x72, 0x61, 0x66,
+    0x00, 0x00, 0x00, 0x10, 0x74, 0x66, 0x68, 0x64,
+    0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x14, 0x74, 0x66, 0x64, 0x74,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x07, 0x53, 0x00,
+    // mdat
+    0x00, 0x00, 0x00, 0x0C, 0x6D, 0x64, 0x61, 0x74,
+    0xAA, 0xAA, 0xAA, 0xAA,
+    // emsg v1
+    0x00, 0x00, 0x00, 0x2C, 0x65, 0x6D, 0x73, 0x67,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xE8,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x2E, 0xE0,
+    0x00, 0x00, 0x01, 0xF4, 0x00, 0x00, 0x00, 0x08,
+    0x75, 0x72, 0x6E, 0x3A, 0x74, 0x65, 0x73, 0x74,
+    0x00, 0x00, 0x01, 0x02,
+    // repeated emsg v0
+    0x00, 0x00, 0x00, 0x3A, 0x65, 0x6D, 0x73, 0x67,
+    0x00, 0x00, 0x00, 0x00, 0x75, 0x72, 0x6E, 0x3A,
+    0x73, 0x63, 0x74, 0x65, 0x3A, 0x73, 0x63, 0x74,
+    0x65, 0x33, 0x35, 0x3A, 0x32, 0x30, 0x31, 0x33,
+    0x3A, 0x62, 0x69, 0x6E, 0x00, 0x31, 0x00, 0x00,
+    0x01, 0x5F, 0x90, 0x00, 0x01, 0x5F, 0x90, 0xFF,
+    0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x07, 0xFC,
+    0x30, 0x11,
+};
+
+// version 0 emsg without a movie fragment behind it.
+uint8_t metadata_segment_2[] = {
+    0x00, 0x00, 0x00, 0x37, 0x65, 0x6D, 0x73, 0x67,
+    0x00, 0x00, 0x00, 0x00, 0x75, 0x72, 0x6E, 0x3A,
+    0x73, 0x63, 0x74, 0x65, 0x3A, 0x73, 0x63, 0x74,
+    0x65, 0x33, 0x35, 0x3A, 0x32, 0x30, 0x31, 0x33,
+    0x3A, 0x62, 0x69, 0x6E, 0x00, 0x31, 0x00, 0x00,
+    0x01, 0x5F, 0x90, 0x00, 0x00, 0xAF, 0xC8, 0x00,
+    0x01, 0x5F, 0x90, 0x00, 0x00, 0x00, 0x09,
+};
+
+typedef struct MetadataResults {
+    uint32_t count;
+    BMFFTimedMetadata events[4];
+    char schemes[4][32];
+} MetadataResults;
+
+void metadata_callback_func(BMFFMetadataExtractor *extractor, const BMFFTimedMetadata *metadata, void *user_data)
+{
+    MetadataResults *results = (MetadataResults*)user_data;
+    if(results->count < 4) {
+        results->events[results->count] = *metadata;
+        if(metadata->scheme_id_uri) {
+            strncpy(results->schemes[results->count], metadata->scheme_id_uri, 31);
+        }
+    }
+    results->count++;
+}
+
+void test_metadata_extract(void)
+{
+    test_start("test_metadata_extract");
+
+    BMFFContext ctx;
+    BMFFMetadataExtractor extractor;
+    MetadataResults results;
+    BMFFCode res;
+
+    memset(&results, 0, sizeof(MetadataResults));
+    bmff_context_init(&ctx);
+
+    res = bmff_metadata_extractor_init(&extractor, &ctx, 1, 0, metadata_callback_func, &results);
+    test_assert_equal(res, BMFF_INVALID_PARAMETER, "invalid timescale");
+    res = bmff_metadata_extractor_init(&extractor, &ctx, 1, 48000, metadata_callback_func, &results);
+    test_assert_equal(res, BMFF_OK, "success");
+
+    size_t consumed = bmff_metadata_extract(&extractor, metadata_segment, sizeof(metadata_segment), &res);
+    test_assert_equal(res, BMFF_OK, "success");
+    test_assert_equal(consumed, sizeof(metadata_segment), "all boxes consumed");
+    test_assert_equal(results.count, 3, "events delivered");
+    test_assert_equal_uint64(extractor.duplicates, 1, "repeated event dropped");
+    test_assert_equal_uint64(extractor.fragment_time, 480000, "fragment time of track 1");
+
+    // version 0, placed against the tfdt of the fragment behind it.
+    BMFFTimedMetadata *event = &results.events[0];
+    test_assert(memcmp(event->type, "emsg", 4) == 0, "emsg type");
+    test_assert_equal(strcmp(results.schemes[0], "urn:scte:scte35:2013:bin"), 0, "scheme id uri");
+    test_assert_equal(event->id, 7, "id");
+    test_assert_equal_uint64(event->presentation_time, 528000, "presentation time from delta");
+    test_assert(event->duration == BMFF_METADATA_UNKNOWN_DURATION, "unknown duration");
+    test_assert_equal(event->data_size, 3, "message data");
+    test_assert_equal_uint64(event->offset, 0, "offset");
+
+    event = &results.events[1];
+    test_assert(memcmp(event->type, "ID32", 4) == 0, "ID32 type");
+    test_assert_equal_uint64(event->presentation_time, 480000, "ID32 at the fragment time");
+    test_assert_equal(event->data_size, 5, "ID3 data");
+    test_assert(memcmp(event->data, "ID3", 3) == 0, "ID3 tag");
+    test_assert_equal_uint64(event->offset, 70, "ID32 offset");
+
+    // version 1, absolute time.
+    event = &results.events[2];
+    test_assert_equal(event->id, 8, "id");
+    test_assert_equal_uint64(event->presentation_time, 576000, "absolute presentation time");
+    test_assert_equal_uint64(event->duration, 24000, "duration");
+    test_assert_equal_uint64(event->offset, 221, "offset");
+
+    // no fragment follows, so the last fragment time is used.
+    consumed = bmff_metadata_extract(&extractor, metadata_segment_2, sizeof(metadata_segment_2), &res);
+    test_assert_equal(consumed, sizeof(metadata_segment_2), "all boxes consumed");
+    test_assert_equal(results.count, 4, "event delivered");
+    event = &results.events[3];
+    test_assert_equal_uint64(event->presentation_time, 504000, "presentation time from the last fragment");
+    test_assert_equal_uint64(event->duration, 48000, "duration");
+    test_assert_equal_uint64(event->offset, sizeof(metadata_segment), "offset in the stream");
+
+    bmff_context_destroy(&ctx);
+
+    test_end();
+}